@@ -1,6 +1,7 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <limits>
@@ -24,6 +25,7 @@
 #endif
 
 #include <udt.h>
+#include <ccc.h>
 
 #include "test_util.h"
 
@@ -131,6 +133,100 @@ bool send_all_nonblocking(UDTSOCKET sock, const guint8* data, size_t len, std::a
    return offset == len;
 }
 
+// Send every segment, advancing through them on a partial send; the segments are updated.
+bool sendv_all_nonblocking(UDTSOCKET sock, UDTIOVEC* iov, int iovcnt, std::atomic<bool>& running)
+{
+   int first = 0;
+   while (first < iovcnt && running.load())
+   {
+      int sent = UDT::sendv(sock, iov + first, iovcnt - first, 0);
+      if (UDT::ERROR == sent)
+      {
+         CUDTException ex = UDT::getlasterror();
+         if (CUDTException::EASYNCSND == ex.getErrorCode())
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+         }
+         std::cerr << "sendv: " << ex.getErrorMessage() << std::endl;
+         return false;
+      }
+      if (0 == sent)
+      {
+         std::cerr << "sendv: connection closed" << std::endl;
+         return false;
+      }
+
+      size_t left = static_cast<size_t>(sent);
+      while (first < iovcnt && left >= iov[first].iov_len)
+      {
+         left -= iov[first].iov_len;
+         ++first;
+      }
+      if (left > 0)
+      {
+         iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + left;
+         iov[first].iov_len -= left;
+      }
+   }
+   return first == iovcnt;
+}
+
+// Frames up to this size are copied together with their header by one UDT::sendv, larger
+// ones are sent from their own memory by UDT::sendzc after the header.
+const size_t kGatherFrameLimit = 64 * 1024;
+
+// A mapped frame referenced by UDT::sendzc; each accepted chunk holds a reference that is
+// dropped once UDT has the chunk acknowledged.
+struct ZeroCopyFrame
+{
+   GstBuffer* buffer = nullptr;
+   GstMapInfo info;
+   std::atomic<int> refs{1};
+};
+
+void release_frame(const char*, int, void* arg)
+{
+   ZeroCopyFrame* frame = static_cast<ZeroCopyFrame*>(arg);
+   if (1 == frame->refs.fetch_sub(1))
+   {
+      gst_buffer_unmap(frame->buffer, &frame->info);
+      gst_buffer_unref(frame->buffer);
+      delete frame;
+   }
+}
+
+bool send_frame_zerocopy(UDTSOCKET sock, ZeroCopyFrame* frame, std::atomic<bool>& running)
+{
+   size_t offset = 0;
+   size_t len = frame->info.size;
+   while (offset < len && running.load())
+   {
+      frame->refs.fetch_add(1);
+      int sent = UDT::sendzc(sock, reinterpret_cast<const char*>(frame->info.data + offset), static_cast<int>(len - offset), release_frame, frame);
+      if ((UDT::ERROR == sent) || (0 == sent))
+         frame->refs.fetch_sub(1);
+      if (UDT::ERROR == sent)
+      {
+         CUDTException ex = UDT::getlasterror();
+         if (CUDTException::EASYNCSND == ex.getErrorCode())
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+         }
+         std::cerr << "sendzc: " << ex.getErrorMessage() << std::endl;
+         return false;
+      }
+      if (0 == sent)
+      {
+         std::cerr << "sendzc: connection closed" << std::endl;
+         return false;
+      }
+      offset += static_cast<size_t>(sent);
+   }
+   return offset == len;
+}
+
 bool recv_all_blocking(UDTSOCKET sock, guint8* data, size_t len)
 {
    size_t offset = 0;
@@ -201,6 +297,13 @@ void set_property_if_exists(GstElement* element, const char* property, gint valu
       g_object_set(element, property, value, nullptr);
 }
 
+void set_property_if_exists(GstElement* element, const char* property, guint value)
+{
+   GParamSpec* pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), property);
+   if (pspec && (G_PARAM_SPEC_VALUE_TYPE(pspec) == G_TYPE_UINT))
+      g_object_set(element, property, value, nullptr);
+}
+
 void set_property_if_exists(GstElement* element, const char* property, bool value)
 {
    GParamSpec* pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), property);
@@ -222,9 +325,38 @@ struct PipelineContext
    std::atomic<bool> running{true};
    std::atomic<bool> negotiated{false};
    std::string encoder_name;
+   GstElement* encoder = nullptr;
+   guint bitrate = 0;
+   std::chrono::steady_clock::time_point last_rate_check;
    UDTSOCKET socket = UDT::INVALID_SOCK;
 };
 
+// Follow the rate allowed by the congestion control with the encoder bitrate (kbit/s),
+// leaving some room for the stream headers and retransmissions.
+void update_encoder_bitrate(PipelineContext& ctx)
+{
+   auto now = std::chrono::steady_clock::now();
+   if (now - ctx.last_rate_check < std::chrono::milliseconds(500))
+      return;
+   ctx.last_rate_check = now;
+
+   int64_t target = 0;
+   int len = sizeof(target);
+   if ((UDT::ERROR == UDT::getsockopt(ctx.socket, 0, UDT_TARGETBW, &target, &len)) || (target <= 0))
+      return;
+
+   guint bitrate = static_cast<guint>(target * 8 * 9 / 10 / 1000);
+   if (bitrate < 100)
+      bitrate = 100;
+
+   // avoid retuning the encoder on small fluctuations
+   if ((ctx.bitrate > 0) && (bitrate * 20 > ctx.bitrate * 19) && (bitrate * 20 < ctx.bitrate * 21))
+      return;
+
+   ctx.bitrate = bitrate;
+   set_property_if_exists(ctx.encoder, "bitrate", bitrate);
+}
+
 bool send_negotiation(PipelineContext& ctx, GstCaps* caps)
 {
    if (ctx.negotiated.load())
@@ -291,9 +423,15 @@ bool transmit_sample(PipelineContext& ctx, GstSample* sample)
    if (!buffer)
       return true;
 
-   GstMapInfo info;
-   if (!gst_buffer_map(buffer, &info, GST_MAP_READ))
+   // a large frame is sent from its own memory, it stays mapped until UDT has it acknowledged
+   ZeroCopyFrame* frame = new ZeroCopyFrame;
+   if (!gst_buffer_map(buffer, &frame->info, GST_MAP_READ))
+   {
+      delete frame;
       return true;
+   }
+   frame->buffer = gst_buffer_ref(buffer);
+   const GstMapInfo& info = frame->info;
 
    guint32 payload_len = static_cast<guint32>(info.size);
    guint32 payload_len_be = htonl(payload_len);
@@ -311,22 +449,30 @@ bool transmit_sample(PipelineContext& ctx, GstSample* sample)
    guint64 duration_be = host_to_be64(duration);
    guint32 flags_be = htonl(flags);
 
-   std::vector<guint8> header;
-   const guint8* payload_len_ptr = reinterpret_cast<const guint8*>(&payload_len_be);
-   const guint8* pts_ptr = reinterpret_cast<const guint8*>(&pts_be);
-   const guint8* duration_ptr = reinterpret_cast<const guint8*>(&duration_be);
-   const guint8* flags_ptr = reinterpret_cast<const guint8*>(&flags_be);
-
-   header.insert(header.end(), payload_len_ptr, payload_len_ptr + sizeof(payload_len_be));
-   header.insert(header.end(), pts_ptr, pts_ptr + sizeof(pts_be));
-   header.insert(header.end(), duration_ptr, duration_ptr + sizeof(duration_be));
-   header.insert(header.end(), flags_ptr, flags_ptr + sizeof(flags_be));
+   UDTIOVEC iov[5];
+   iov[0].iov_base = &payload_len_be;
+   iov[0].iov_len = sizeof(payload_len_be);
+   iov[1].iov_base = &pts_be;
+   iov[1].iov_len = sizeof(pts_be);
+   iov[2].iov_base = &duration_be;
+   iov[2].iov_len = sizeof(duration_be);
+   iov[3].iov_base = &flags_be;
+   iov[3].iov_len = sizeof(flags_be);
+   int iovcnt = 4;
+
+   bool gather = (info.size > 0) && (info.size <= kGatherFrameLimit);
+   if (gather)
+   {
+      iov[4].iov_base = info.data;
+      iov[4].iov_len = info.size;
+      iovcnt = 5;
+   }
 
-   bool ok = send_all_nonblocking(ctx.socket, header.data(), header.size(), ctx.running);
-   if (ok && info.size > 0)
-      ok = send_all_nonblocking(ctx.socket, info.data, info.size, ctx.running);
+   bool ok = sendv_all_nonblocking(ctx.socket, iov, iovcnt, ctx.running);
+   if (ok && !gather && info.size > 0)
+      ok = send_frame_zerocopy(ctx.socket, frame, ctx.running);
 
-   gst_buffer_unmap(buffer, &info);
+   release_frame(nullptr, 0, frame);
 
    if (!ok)
       ctx.running.store(false);
@@ -451,6 +597,7 @@ bool run_pipeline(PipelineContext& ctx)
 
    ctx.pipeline = pipeline;
    ctx.sink = sink;
+   ctx.encoder = encoder;
 
    GstStateChangeReturn ret = gst_element_set_state(pipeline, GST_STATE_PLAYING);
    if (GST_STATE_CHANGE_FAILURE == ret)
@@ -465,6 +612,8 @@ bool run_pipeline(PipelineContext& ctx)
 
    while (ctx.running.load())
    {
+      update_encoder_bitrate(ctx);
+
       GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(ctx.sink), GST_SECOND / 4);
       if (!sample)
          continue;
@@ -488,7 +637,7 @@ bool run_pipeline(PipelineContext& ctx)
 int main(int argc, char* argv[])
 {
    const char* usage =
-      "usage: appgstclient [--verbose|--quiet]"
+      "usage: appgstclient [--verbose|--quiet] [--fec=GROUP[:PARITY]]"
 #ifdef USE_LIBNICE
       " [--stun=HOST[:PORT]] [--turn=HOST[:PORT],USERNAME,PASSWORD]"
 #endif
@@ -497,9 +646,24 @@ int main(int argc, char* argv[])
    std::string stun_option;
    std::string turn_option;
 #endif
+   int fec_group = 0;
+   int fec_parity = 1;
    for (int i = 1; i < argc; ++i)
    {
       std::string arg(argv[i]);
+      if (arg.rfind("--fec=", 0) == 0)
+      {
+         char* end = NULL;
+         fec_group = static_cast<int>(strtol(arg.c_str() + 6, &end, 10));
+         if (*end == ':')
+            fec_parity = static_cast<int>(strtol(end + 1, &end, 10));
+         if (*end != '\0')
+         {
+            std::cout << usage << std::endl;
+            return 0;
+         }
+         continue;
+      }
 #ifdef USE_LIBNICE
       if (arg.rfind("--stun=", 0) == 0)
       {
@@ -605,6 +769,22 @@ int main(int argc, char* argv[])
    }
 #endif
 
+   // delay based congestion control keeps the queues short and exposes the target bitrate (UDT_TARGETBW)
+   UDT::setsockopt(client, 0, UDT_CC, new CCCFactory<CGCCCC>, sizeof(CCCFactory<CGCCCC>));
+
+   // parity packets repair isolated losses without waiting one RTT for the retransmission
+   if (fec_group > 0)
+   {
+      bool fec_msg = true;
+      if ((UDT::ERROR == UDT::setsockopt(client, 0, UDT_FECGROUP, &fec_group, sizeof(int))) ||
+          (UDT::ERROR == UDT::setsockopt(client, 0, UDT_FECPARITY, &fec_parity, sizeof(int))) ||
+          (UDT::ERROR == UDT::setsockopt(client, 0, UDT_FECMSG, &fec_msg, sizeof(bool))))
+      {
+         std::cout << "setsockopt: " << UDT::getlasterror().getErrorMessage() << std::endl;
+         return 0;
+      }
+   }
+
    if (UDT::ERROR == UDT::connect(client, nullptr, 0))
    {
       std::cout << "connect: " << UDT::getlasterror().getErrorMessage() << std::endl;
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -21,6 +23,7 @@
 #endif
 
 #include <udt.h>
+#include <ccc.h>
 
 #include "test_util.h"
 
@@ -316,9 +319,130 @@ bool setup_pipeline(ServerPipelineContext& ctx, GstCaps* caps, const std::string
    return true;
 }
 
+// Packets lent by UDT::recvzc; every chunk still queued in the reader and every GstMemory
+// wrapping part of it holds a reference, the last one gives the packets back to UDT.
+struct LentPackets
+{
+   UDTSOCKET sock = UDT::INVALID_SOCK;
+   int token = 0;
+   std::atomic<int> refs{0};
+};
+
+void unref_lent_packets(gpointer arg)
+{
+   LentPackets* lent = static_cast<LentPackets*>(arg);
+   if (1 == lent->refs.fetch_sub(1))
+   {
+      UDT::release(lent->sock, lent->token);
+      delete lent;
+   }
+}
+
+class LentStreamReader
+{
+public:
+   explicit LentStreamReader(UDTSOCKET sock): m_Sock(sock) {}
+
+   ~LentStreamReader()
+   {
+      for (std::deque<Chunk>::iterator it = m_Chunks.begin(); it != m_Chunks.end(); ++it)
+         unref_lent_packets(it->lent);
+   }
+
+   // Copy len bytes out of the lent packets, for the small frame headers.
+   bool read(guint8* data, size_t len)
+   {
+      while (len > 0)
+      {
+         if (m_Chunks.empty() && !fill())
+            return false;
+
+         Chunk& chunk = m_Chunks.front();
+         size_t n = std::min(len, chunk.len);
+         memcpy(data, chunk.data, n);
+         data += n;
+         len -= n;
+         consume(n);
+      }
+      return true;
+   }
+
+   // Append len bytes to buffer as memory wrapping the lent packets, without copying.
+   bool append(GstBuffer* buffer, size_t len)
+   {
+      while (len > 0)
+      {
+         if (m_Chunks.empty() && !fill())
+            return false;
+
+         Chunk& chunk = m_Chunks.front();
+         size_t n = std::min(len, chunk.len);
+         chunk.lent->refs.fetch_add(1);
+         GstMemory* mem = gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY, chunk.data, n, 0, n, chunk.lent, unref_lent_packets);
+         gst_buffer_append_memory(buffer, mem);
+         len -= n;
+         consume(n);
+      }
+      return true;
+   }
+
+private:
+   struct Chunk
+   {
+      LentPackets* lent;
+      guint8* data;
+      size_t len;
+   };
+
+   bool fill()
+   {
+      UDTIOVEC iov[64];
+      int iovcnt = 64;
+      int token = 0;
+      int received = UDT::recvzc(m_Sock, iov, &iovcnt, &token);
+      if (UDT::ERROR == received)
+      {
+         std::cerr << "recvzc: " << UDT::getlasterror().getErrorMessage() << std::endl;
+         return false;
+      }
+      if (0 == received)
+      {
+         std::cerr << "recvzc: connection closed" << std::endl;
+         return false;
+      }
+
+      LentPackets* lent = new LentPackets;
+      lent->sock = m_Sock;
+      lent->token = token;
+      lent->refs.store(iovcnt);
+      for (int i = 0; i < iovcnt; ++i)
+      {
+         Chunk chunk = {lent, static_cast<guint8*>(iov[i].iov_base), static_cast<size_t>(iov[i].iov_len)};
+         m_Chunks.push_back(chunk);
+      }
+      return true;
+   }
+
+   void consume(size_t n)
+   {
+      Chunk& chunk = m_Chunks.front();
+      chunk.data += n;
+      chunk.len -= n;
+      if (0 == chunk.len)
+      {
+         LentPackets* lent = chunk.lent;
+         m_Chunks.pop_front();
+         unref_lent_packets(lent);
+      }
+   }
+
+   UDTSOCKET m_Sock;
+   std::deque<Chunk> m_Chunks;
+};
+
 bool receive_stream(UDTSOCKET sock, ServerPipelineContext& ctx)
 {
-   std::vector<guint8> payload;
+   LentStreamReader reader(sock);
    while (ctx.running.load())
    {
       guint32 payload_len_be = 0;
@@ -326,13 +450,13 @@ bool receive_stream(UDTSOCKET sock, ServerPipelineContext& ctx)
       guint64 duration_be = 0;
       guint32 flags_be = 0;
 
-      if (!recv_all_blocking(sock, reinterpret_cast<guint8*>(&payload_len_be), sizeof(payload_len_be)))
+      if (!reader.read(reinterpret_cast<guint8*>(&payload_len_be), sizeof(payload_len_be)))
          return false;
-      if (!recv_all_blocking(sock, reinterpret_cast<guint8*>(&pts_be), sizeof(pts_be)))
+      if (!reader.read(reinterpret_cast<guint8*>(&pts_be), sizeof(pts_be)))
          return false;
-      if (!recv_all_blocking(sock, reinterpret_cast<guint8*>(&duration_be), sizeof(duration_be)))
+      if (!reader.read(reinterpret_cast<guint8*>(&duration_be), sizeof(duration_be)))
          return false;
-      if (!recv_all_blocking(sock, reinterpret_cast<guint8*>(&flags_be), sizeof(flags_be)))
+      if (!reader.read(reinterpret_cast<guint8*>(&flags_be), sizeof(flags_be)))
          return false;
 
       guint32 payload_len = ntohl(payload_len_be);
@@ -340,22 +464,18 @@ bool receive_stream(UDTSOCKET sock, ServerPipelineContext& ctx)
       guint64 duration = be64_to_host(duration_be);
       guint32 flags = ntohl(flags_be);
 
-      payload.resize(payload_len);
-      if (payload_len > 0)
-      {
-         if (!recv_all_blocking(sock, payload.data(), payload_len))
-            return false;
-      }
-
-      GstBuffer* buffer = gst_buffer_new_allocate(nullptr, payload_len, nullptr);
+      GstBuffer* buffer = gst_buffer_new();
       if (!buffer)
       {
          std::cerr << "Failed to allocate GstBuffer" << std::endl;
          return false;
       }
 
-      if (payload_len > 0)
-         gst_buffer_fill(buffer, 0, payload.data(), payload_len);
+      if (!reader.append(buffer, payload_len))
+      {
+         gst_buffer_unref(buffer);
+         return false;
+      }
 
       if (pts == G_MAXUINT64)
          GST_BUFFER_PTS(buffer) = GST_CLOCK_TIME_NONE;
@@ -630,6 +750,9 @@ int main(int argc, char* argv[])
    }
 #endif
 
+   // the receiver side of the delay based congestion control reports the rate estimate to the client
+   UDT::setsockopt(serv, 0, UDT_CC, new CCCFactory<CGCCCC>, sizeof(CCCFactory<CGCCCC>));
+
    if (UDT::ERROR == UDT::listen(serv, 1))
    {
       std::cout << "listen: " << UDT::getlasterror().getErrorMessage() << std::endl;
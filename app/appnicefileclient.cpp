@@ -1,5 +1,7 @@
 #ifndef WIN32
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <pthread.h>
 
@@ -10,6 +12,7 @@
 #include <wspiapi.h>
 #endif
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -177,6 +180,9 @@ int main(int argc, char *argv[])
       "usage: appnicefileclient"
 #ifdef USE_LIBNICE
       " [--stun=HOST[:PORT]] [--turn=HOST[:PORT],USERNAME,PASSWORD]"
+#endif
+#ifndef WIN32
+      " [--streams=N]"
 #endif
       " <file_to_send>";
 
@@ -185,10 +191,23 @@ int main(int argc, char *argv[])
    std::string turn_option;
 #endif
    std::string filepath;
+   int streams = 1;
 
    for (int i = 1; i < argc; ++i)
    {
       std::string arg(argv[i]);
+#ifndef WIN32
+      if (arg.rfind("--streams=", 0) == 0)
+      {
+         streams = atoi(arg.c_str() + 10);
+         if (streams < 1)
+         {
+            cout << usage << endl;
+            return 0;
+         }
+         continue;
+      }
+#endif
 #ifdef USE_LIBNICE
       if (arg.rfind("--stun=", 0) == 0)
       {
@@ -228,6 +247,18 @@ int main(int argc, char *argv[])
    if (slash != string::npos && slash + 1 < filepath.size())
       filename = filepath.substr(slash + 1);
 
+#ifndef WIN32
+   // the file is handed to UDT as a descriptor, so it is mapped straight into the sending buffer
+   int fd = open(filepath.c_str(), O_RDONLY);
+   struct stat st;
+   if ((fd < 0) || (fstat(fd, &st) < 0))
+   {
+      cout << "Unable to open file: " << filepath << endl;
+      return 1;
+   }
+
+   int64_t filesize = st.st_size;
+#else
    fstream ifs(filepath.c_str(), ios::in | ios::binary);
    if (!ifs)
    {
@@ -238,6 +269,7 @@ int main(int argc, char *argv[])
    ifs.seekg(0, ios::end);
    int64_t filesize = ifs.tellg();
    ifs.seekg(0, ios::beg);
+#endif
 
    if (filesize < 0)
    {
@@ -247,99 +279,105 @@ int main(int argc, char *argv[])
 
    UDTUpDown _udt_;
 
-   UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
-
-
-   volatile bool running = true;
-   MonitorContext monitor_ctx;
-   monitor_ctx.socket = client;
-   monitor_ctx.running = &running;
+   // every stream is a connection of its own, with its own ICE session when libnice is used
+   vector<UDTSOCKET> socks;
+   for (int i = 0; i < streams; ++i)
+   {
+      UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
 
-#ifndef WIN32
-   pthread_t monitor_thread = 0;
-#else
-   HANDLE monitor_thread = NULL;
-#endif
-   bool monitor_started = false;
+      sockaddr_in any;
+      any.sin_family = AF_INET;
+      any.sin_port = 0;
+      any.sin_addr.s_addr = INADDR_ANY;
+      if (UDT::ERROR == UDT::bind(client, (sockaddr *)&any, sizeof(any)))
+      {
+         cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
+         return 1;
+      }
 
+#ifdef USE_LIBNICE
+      if (!stun_option.empty())
+      {
+         std::string host;
+         int port = 3478;
+         if (!ParseHostPortSpec(stun_option, host, port))
+         {
+            cout << "Invalid STUN server specification: " << stun_option << endl;
+            return 1;
+         }
+         if (UDT::ERROR == UDT::setICESTUNServer(client, host, port))
+         {
+            cout << "setICESTUNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+            return 1;
+         }
+      }
 
-   sockaddr_in any;
-   any.sin_family = AF_INET;
-   any.sin_port = 0;
-   any.sin_addr.s_addr = INADDR_ANY;
-   if (UDT::ERROR == UDT::bind(client, (sockaddr *)&any, sizeof(any)))
-   {
-      cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 1;
-   }
+      if (!turn_option.empty())
+      {
+         std::string server;
+         int port = 3478;
+         std::string username;
+         std::string password;
+         if (!ParseTurnSpec(turn_option, server, port, username, password))
+         {
+            cout << "Invalid TURN relay specification: " << turn_option << endl;
+            return 1;
+         }
+         if (UDT::ERROR == UDT::setICETURNServer(client, server, port, username, password))
+         {
+            cout << "setICETURNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+            return 1;
+         }
+      }
 
-#ifdef USE_LIBNICE
-   if (!stun_option.empty())
-   {
-      std::string host;
-      int port = 3478;
-      if (!ParseHostPortSpec(stun_option, host, port))
+      string ufrag, pwd;
+      vector<string> candidates;
+      if (UDT::ERROR == UDT::getICEInfo(client, ufrag, pwd, candidates))
       {
-         cout << "Invalid STUN server specification: " << stun_option << endl;
+         cout << "getICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
          return 1;
       }
-      if (UDT::ERROR == UDT::setICESTUNServer(client, host, port))
+      cout << formatICEInfo(ufrag, pwd, candidates) << endl;
+
+      cout << "Paste remote ICE info (length-prefixed fields as printed above):" << endl;
+      string line;
+      getline(cin, line);
+      string rem_ufrag, rem_pwd;
+      vector<string> rem_cand;
+      if (!parseICEInfo(line, rem_ufrag, rem_pwd, rem_cand))
       {
-         cout << "setICESTUNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+         cout << "Invalid remote ICE info format" << endl;
          return 1;
       }
-   }
-
-   if (!turn_option.empty())
-   {
-      std::string server;
-      int port = 3478;
-      std::string username;
-      std::string password;
-      if (!ParseTurnSpec(turn_option, server, port, username, password))
+      if (UDT::ERROR == UDT::setICEInfo(client, rem_ufrag, rem_pwd, rem_cand))
       {
-         cout << "Invalid TURN relay specification: " << turn_option << endl;
+         cout << "setICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
          return 1;
       }
-      if (UDT::ERROR == UDT::setICETURNServer(client, server, port, username, password))
+#endif
+
+      if (UDT::ERROR == UDT::connect(client, NULL, 0))
       {
-         cout << "setICETURNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+         cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
          return 1;
       }
-   }
 
-   string ufrag, pwd;
-   vector<string> candidates;
-   if (UDT::ERROR == UDT::getICEInfo(client, ufrag, pwd, candidates))
-   {
-      cout << "getICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 1;
+      socks.push_back(client);
    }
-   cout << formatICEInfo(ufrag, pwd, candidates) << endl;
-
-   cout << "Paste remote ICE info (length-prefixed fields as printed above):" << endl;
-   string line;
-   getline(cin, line);
-   string rem_ufrag, rem_pwd;
-   vector<string> rem_cand;
-   if (!parseICEInfo(line, rem_ufrag, rem_pwd, rem_cand))
-   {
-      cout << "Invalid remote ICE info format" << endl;
-      return 1;
-   }
-   if (UDT::ERROR == UDT::setICEInfo(client, rem_ufrag, rem_pwd, rem_cand))
-   {
-      cout << "setICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 1;
-   }
-#endif
 
-   if (UDT::ERROR == UDT::connect(client, NULL, 0))
-   {
-      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 1;
-   }
+   UDTSOCKET client = socks[0];
 
+   volatile bool running = true;
+   MonitorContext monitor_ctx;
+   monitor_ctx.socket = client;
+   monitor_ctx.running = &running;
+
+#ifndef WIN32
+   pthread_t monitor_thread = 0;
+#else
+   HANDLE monitor_thread = NULL;
+#endif
+   bool monitor_started = false;
 
    monitor_started = startUDTMonitor(monitor_ctx, monitor_thread);
 
@@ -375,14 +413,28 @@ int main(int argc, char *argv[])
       return 1;
    }
 
+#ifndef WIN32
+   // the file is split into ranges over all the streams, the server asks only for those it is missing
+   const int32_t stream_count = streams;
+   if (!sendAll(client, reinterpret_cast<const char *>(&stream_count), sizeof(stream_count)))
+   {
+      stop_monitor();
+      UDT::close(client);
+      return 1;
+   }
+
+   if (UDT::ERROR == UDT::sendfile_striped(&socks[0], streams, fd, filesize))
+#else
    int64_t offset = 0;
    if (UDT::ERROR == UDT::sendfile(client, ifs, offset, filesize))
+#endif
    {
       cout << "sendfile: " << UDT::getlasterror().getErrorMessage() << endl;
 
       stop_monitor();
 
-      UDT::close(client);
+      for (size_t i = 0; i < socks.size(); ++i)
+         UDT::close(socks[i]);
       return 1;
    }
 
@@ -392,8 +444,13 @@ int main(int argc, char *argv[])
    stop_monitor();
 
 
+#ifndef WIN32
+   close(fd);
+#else
    ifs.close();
-   UDT::close(client);
+#endif
+   for (size_t i = 0; i < socks.size(); ++i)
+      UDT::close(socks[i]);
    return 0;
 }
 
@@ -1,5 +1,6 @@
 #ifndef WIN32
 #include <unistd.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <pthread.h>
@@ -9,6 +10,7 @@
 #include <wspiapi.h>
 #endif
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -96,6 +98,12 @@ bool parseICEInfo(const string &line, string &ufrag, string &pwd, vector<string>
 }
 #endif
 
+void closeAll(const vector<UDTSOCKET> &socks)
+{
+   for (size_t i = 0; i < socks.size(); ++i)
+      UDT::close(socks[i]);
+}
+
 bool recvAll(UDTSOCKET socket, char *data, int len)
 {
    int received = 0;
@@ -127,15 +135,31 @@ int main(int argc, char *argv[])
       "usage: appnicefileserver [--verbose|--quiet]"
 #ifdef USE_LIBNICE
       " [--stun=HOST[:PORT]] [--turn=HOST[:PORT],USERNAME,PASSWORD]"
+#endif
+#ifndef WIN32
+      " [--streams=N]"
 #endif
       "";
 #ifdef USE_LIBNICE
    std::string stun_option;
    std::string turn_option;
 #endif
+   int streams = 1;
    for (int i = 1; i < argc; ++i)
    {
       string arg(argv[i]);
+#ifndef WIN32
+      if (arg.rfind("--streams=", 0) == 0)
+      {
+         streams = atoi(arg.c_str() + 10);
+         if (streams < 1)
+         {
+            cout << usage << endl;
+            return 0;
+         }
+         continue;
+      }
+#endif
 #ifdef USE_LIBNICE
       if (arg.rfind("--stun=", 0) == 0)
       {
@@ -165,129 +189,148 @@ int main(int argc, char *argv[])
 
    UDTUpDown _udt_;
 
-   UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
-
-   sockaddr_in any;
-   any.sin_family = AF_INET;
-   any.sin_port = 0;
-   any.sin_addr.s_addr = INADDR_ANY;
-   if (UDT::ERROR == UDT::bind(serv, (sockaddr *)&any, sizeof(any)))
+   // one listener per stream, each with its own ICE session when libnice is used
+   vector<UDTSOCKET> servs;
+   for (int i = 0; i < streams; ++i)
    {
-      cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 0;
-   }
+      UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
 
-#ifdef USE_LIBNICE
-   if (!stun_option.empty())
-   {
-      std::string host;
-      int port = 3478;
-      if (!ParseHostPortSpec(stun_option, host, port))
+      sockaddr_in any;
+      any.sin_family = AF_INET;
+      any.sin_port = 0;
+      any.sin_addr.s_addr = INADDR_ANY;
+      if (UDT::ERROR == UDT::bind(serv, (sockaddr *)&any, sizeof(any)))
       {
-         cout << "Invalid STUN server specification: " << stun_option << endl;
+         cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
          return 0;
       }
-      if (UDT::ERROR == UDT::setICESTUNServer(serv, host, port))
+
+#ifdef USE_LIBNICE
+      if (!stun_option.empty())
       {
-         cout << "setICESTUNServer: " << UDT::getlasterror().getErrorMessage() << endl;
-         return 0;
+         std::string host;
+         int port = 3478;
+         if (!ParseHostPortSpec(stun_option, host, port))
+         {
+            cout << "Invalid STUN server specification: " << stun_option << endl;
+            return 0;
+         }
+         if (UDT::ERROR == UDT::setICESTUNServer(serv, host, port))
+         {
+            cout << "setICESTUNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+            return 0;
+         }
       }
-   }
 
-   if (!turn_option.empty())
-   {
-      std::string server;
-      int port = 3478;
-      std::string username;
-      std::string password;
-      if (!ParseTurnSpec(turn_option, server, port, username, password))
+      if (!turn_option.empty())
+      {
+         std::string server;
+         int port = 3478;
+         std::string username;
+         std::string password;
+         if (!ParseTurnSpec(turn_option, server, port, username, password))
+         {
+            cout << "Invalid TURN relay specification: " << turn_option << endl;
+            return 0;
+         }
+         if (UDT::ERROR == UDT::setICETURNServer(serv, server, port, username, password))
+         {
+            cout << "setICETURNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+            return 0;
+         }
+      }
+
+      string ufrag, pwd;
+      vector<string> candidates;
+      if (UDT::ERROR == UDT::getICEInfo(serv, ufrag, pwd, candidates))
       {
-         cout << "Invalid TURN relay specification: " << turn_option << endl;
+         cout << "getICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
          return 0;
       }
-      if (UDT::ERROR == UDT::setICETURNServer(serv, server, port, username, password))
+      cout << formatICEInfo(ufrag, pwd, candidates) << endl;
+
+      cout << "Paste remote ICE info (length-prefixed fields as printed above):" << endl;
+      string line;
+      getline(cin, line);
+      string rem_ufrag, rem_pwd;
+      vector<string> rem_cand;
+      if (!parseICEInfo(line, rem_ufrag, rem_pwd, rem_cand))
       {
-         cout << "setICETURNServer: " << UDT::getlasterror().getErrorMessage() << endl;
+         cout << "Invalid remote ICE info format" << endl;
+         return 0;
+      }
+      if (UDT::ERROR == UDT::setICEInfo(serv, rem_ufrag, rem_pwd, rem_cand))
+      {
+         cout << "setICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
          return 0;
       }
-   }
-
-   string ufrag, pwd;
-   vector<string> candidates;
-   if (UDT::ERROR == UDT::getICEInfo(serv, ufrag, pwd, candidates))
-   {
-      cout << "getICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 0;
-   }
-   cout << formatICEInfo(ufrag, pwd, candidates) << endl;
-
-   cout << "Paste remote ICE info (length-prefixed fields as printed above):" << endl;
-   string line;
-   getline(cin, line);
-   string rem_ufrag, rem_pwd;
-   vector<string> rem_cand;
-   if (!parseICEInfo(line, rem_ufrag, rem_pwd, rem_cand))
-   {
-      cout << "Invalid remote ICE info format" << endl;
-      return 0;
-   }
-   if (UDT::ERROR == UDT::setICEInfo(serv, rem_ufrag, rem_pwd, rem_cand))
-   {
-      cout << "setICEInfo: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 0;
-   }
 #endif
 
-   if (UDT::ERROR == UDT::listen(serv, 1))
-   {
-      cout << "listen: " << UDT::getlasterror().getErrorMessage() << endl;
-      return 0;
+      if (UDT::ERROR == UDT::listen(serv, 1))
+      {
+         cout << "listen: " << UDT::getlasterror().getErrorMessage() << endl;
+         return 0;
+      }
+
+      servs.push_back(serv);
    }
 
    while (true)
    {
-      sockaddr_storage clientaddr;
-      int addrlen = sizeof(clientaddr);
-      UDTSOCKET recver = UDT::accept(serv, (sockaddr *)&clientaddr, &addrlen);
-      if (UDT::INVALID_SOCK == recver)
+      vector<UDTSOCKET> *recvers = new vector<UDTSOCKET>;
+      for (int i = 0; i < streams; ++i)
       {
-         cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
-         continue;
+         sockaddr_storage clientaddr;
+         int addrlen = sizeof(clientaddr);
+         UDTSOCKET recver = UDT::accept(servs[i], (sockaddr *)&clientaddr, &addrlen);
+         if (UDT::INVALID_SOCK == recver)
+         {
+            cout << "accept: " << UDT::getlasterror().getErrorMessage() << endl;
+            break;
+         }
+
+         char clienthost[NI_MAXHOST] = {0};
+         char clientservice[NI_MAXSERV] = {0};
+         if (0 == getnameinfo((sockaddr *)&clientaddr, addrlen, clienthost, sizeof(clienthost), clientservice, sizeof(clientservice), NI_NUMERICHOST | NI_NUMERICSERV))
+            cout << "new connection: " << clienthost << ":" << clientservice << endl;
+         else
+            cout << "new connection" << endl;
+
+         recvers->push_back(recver);
       }
 
-      char clienthost[NI_MAXHOST] = {0};
-      char clientservice[NI_MAXSERV] = {0};
-      if (0 == getnameinfo((sockaddr *)&clientaddr, addrlen, clienthost, sizeof(clienthost), clientservice, sizeof(clientservice), NI_NUMERICHOST | NI_NUMERICSERV))
-         cout << "new connection: " << clienthost << ":" << clientservice << endl;
-      else
-         cout << "new connection" << endl;
+      if (recvers->size() < static_cast<size_t>(streams))
+      {
+         closeAll(*recvers);
+         delete recvers;
+         continue;
+      }
 
 #ifndef WIN32
-      UDTSOCKET *worker = new UDTSOCKET(recver);
       pthread_t rcvthread;
-      if (0 != pthread_create(&rcvthread, NULL, handle_client, worker))
+      if (0 != pthread_create(&rcvthread, NULL, handle_client, recvers))
       {
          cout << "pthread_create failed" << endl;
-         delete worker;
-         UDT::close(recver);
+         closeAll(*recvers);
+         delete recvers;
          continue;
       }
       pthread_detach(rcvthread);
 #else
-      UDTSOCKET *worker = new UDTSOCKET(recver);
-      HANDLE rcvthread = CreateThread(NULL, 0, handle_client, worker, 0, NULL);
+      HANDLE rcvthread = CreateThread(NULL, 0, handle_client, recvers, 0, NULL);
       if (NULL == rcvthread)
       {
          cout << "CreateThread failed" << endl;
-         delete worker;
-         UDT::close(recver);
+         closeAll(*recvers);
+         delete recvers;
          continue;
       }
       CloseHandle(rcvthread);
 #endif
    }
 
-   UDT::close(serv);
+   for (size_t i = 0; i < servs.size(); ++i)
+      UDT::close(servs[i]);
    return 0;
 }
 
@@ -297,13 +340,14 @@ void *handle_client(void *usocket)
 DWORD WINAPI handle_client(LPVOID usocket)
 #endif
 {
-   UDTSOCKET recver = *(UDTSOCKET *)usocket;
-   delete (UDTSOCKET *)usocket;
+   vector<UDTSOCKET> recvers(*(vector<UDTSOCKET> *)usocket);
+   delete (vector<UDTSOCKET> *)usocket;
+   UDTSOCKET recver = recvers[0];
 
    int32_t name_len = 0;
    if (!recvAll(recver, reinterpret_cast<char *>(&name_len), sizeof(name_len)))
    {
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -314,7 +358,7 @@ DWORD WINAPI handle_client(LPVOID usocket)
    if (name_len < 0 || name_len > 1024 * 1024)
    {
       cout << "Invalid file name length received" << endl;
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -325,7 +369,7 @@ DWORD WINAPI handle_client(LPVOID usocket)
    string remote_name(static_cast<size_t>(name_len), '\0');
    if (!recvAll(recver, &remote_name[0], name_len))
    {
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -336,7 +380,7 @@ DWORD WINAPI handle_client(LPVOID usocket)
    int64_t filesize = 0;
    if (!recvAll(recver, reinterpret_cast<char *>(&filesize), sizeof(filesize)))
    {
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -347,7 +391,7 @@ DWORD WINAPI handle_client(LPVOID usocket)
    if (filesize < 0)
    {
       cout << "Invalid file size received" << endl;
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -355,12 +399,41 @@ DWORD WINAPI handle_client(LPVOID usocket)
 #endif
    }
 
+#ifndef WIN32
+   int32_t streams = 0;
+   if (!recvAll(recver, reinterpret_cast<char *>(&streams), sizeof(streams)))
+   {
+      closeAll(recvers);
+      return NULL;
+   }
+
+   if (streams != static_cast<int32_t>(recvers.size()))
+   {
+      cout << "Client uses " << streams << " streams, expected " << recvers.size() << endl;
+      closeAll(recvers);
+      return NULL;
+   }
+#endif
+
    const string output_name = "filetest";
+#ifndef WIN32
+   // the ranges already written are kept in the journal, so an interrupted transfer of the same size
+   // continues where it stopped; the data goes from the UDT buffer to the descriptor directly
+   const string journal_name = output_name + ".ranges";
+   int fd = open(output_name.c_str(), O_WRONLY | O_CREAT, 0644);
+   if ((fd >= 0) && (ftruncate(fd, filesize) < 0))
+   {
+      close(fd);
+      fd = -1;
+   }
+   if (fd < 0)
+#else
    fstream ofs(output_name.c_str(), ios::out | ios::binary | ios::trunc);
    if (!ofs)
+#endif
    {
       cout << "Unable to open destination file: " << output_name << endl;
-      UDT::close(recver);
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -368,12 +441,20 @@ DWORD WINAPI handle_client(LPVOID usocket)
 #endif
    }
 
+#ifndef WIN32
+   if (UDT::ERROR == UDT::recvfile_striped(&recvers[0], streams, fd, filesize, journal_name.c_str()))
+#else
    int64_t offset = 0;
    if (UDT::ERROR == UDT::recvfile(recver, ofs, offset, filesize))
+#endif
    {
       cout << "recvfile: " << UDT::getlasterror().getErrorMessage() << endl;
+#ifndef WIN32
+      close(fd);
+#else
       ofs.close();
-      UDT::close(recver);
+#endif
+      closeAll(recvers);
 #ifndef WIN32
       return NULL;
 #else
@@ -383,8 +464,12 @@ DWORD WINAPI handle_client(LPVOID usocket)
 
    cout << "Received file from client: " << remote_name << " saved as '" << output_name << "'" << endl;
 
+#ifndef WIN32
+   close(fd);
+#else
    ofs.close();
-   UDT::close(recver);
+#endif
+   closeAll(recvers);
 
 #ifndef WIN32
    return NULL;
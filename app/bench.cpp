@@ -0,0 +1,864 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+#include "udt.h"
+#include "ccc.h"
+#include "common.h"
+#include "buffer.h"
+#include "queue.h"
+
+using namespace std;
+
+// Benchmark harnesses for the data structures and paths of the library, one case per argument.
+// Each case prints one line per configuration; compare the numbers across builds, not across machines.
+
+
+// the send buffer: a full flight window, each new packet sent once, retransmitted near the tail and acknowledged
+int Bench_SndBuffer(int, char**)
+{
+   const int window[] = {1000, 10000, 100000};
+   const int rounds = 200000;
+   char data[1456];
+   memset(data, 'x', sizeof(data));
+
+   for (int w = 0; w < 3; ++ w)
+   {
+      CSndBuffer buffer(32, 1500);
+      char* p;
+      int32_t msgno;
+      int msglen;
+
+      for (int i = 0; i < window[w]; ++ i)
+      {
+         buffer.addBuffer(data, sizeof(data));
+         buffer.readData(&p, msgno);
+      }
+
+      uint64_t start = CTimer::getTime();
+      for (int i = 0; i < rounds; ++ i)
+      {
+         buffer.addBuffer(data, sizeof(data));
+         buffer.readData(&p, msgno);
+         buffer.readData(&p, window[w] - 1 - i % 16, msgno, msglen);
+         buffer.ackData(1);
+      }
+      uint64_t elapsed = CTimer::getTime() - start;
+
+      cout << "sndbuf window " << window[w] << ": " << elapsed * 1000.0 / rounds << " ns per packet" << endl;
+   }
+
+   return 0;
+}
+
+
+// the receive buffer in message mode: small messages readable out of order behind a lost first packet
+int Bench_RcvBuffer(int, char**)
+{
+   const int size[] = {1024, 8192, 65536};
+   char data[1500];
+
+   for (int b = 0; b < 3; ++ b)
+   {
+      CUnitQueue queue;
+      queue.init(size[b] * 2, 1500, AF_INET);
+      CRcvBuffer buffer(&queue, size[b], true);
+
+      int msgs = size[b] - 2;
+      for (int i = 1; i <= msgs; ++ i)
+      {
+         CUnit* unit = queue.getNextAvailUnit();
+         unit->m_Packet.m_iSeqNo = i;
+         unit->m_Packet.m_iMsgNo = i | 0xC0000000;
+         unit->m_Packet.setLength(64);
+         buffer.addData(unit, i);
+      }
+
+      uint64_t start = CTimer::getTime();
+      int read = 0;
+      while ((buffer.getRcvMsgNum() > 0) && (buffer.readMsg(data, sizeof(data)) > 0))
+         ++ read;
+      uint64_t elapsed = CTimer::getTime() - start;
+
+      cout << "rcvbuf size " << size[b] << ": " << read << " messages, " << elapsed * 1000.0 / (read > 0 ? read : 1) << " ns per message" << endl;
+   }
+
+   return 0;
+}
+
+
+// the connections of the network cases run over loopback, in this process
+const int g_Bench_Port = 9100;
+
+sockaddr_in benchAddr(int port)
+{
+   sockaddr_in addr;
+   memset(&addr, 0, sizeof(sockaddr_in));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   return addr;
+}
+
+UDTSOCKET benchListen(int port)
+{
+   UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   sockaddr_in addr = benchAddr(port);
+   if ((UDT::ERROR == UDT::bind(serv, (sockaddr*)&addr, sizeof(sockaddr_in))) || (UDT::ERROR == UDT::listen(serv, 1024)))
+   {
+      cout << "listen: " << UDT::getlasterror().getErrorMessage() << endl;
+      return UDT::INVALID_SOCK;
+   }
+   return serv;
+}
+
+// connects a new socket to the local port, from a given local port if not 0, so that many sockets share one UDP port
+UDTSOCKET benchConnect(int port, int localport = 0)
+{
+   UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   if (0 != localport)
+   {
+      sockaddr_in local = benchAddr(localport);
+      UDT::bind(client, (sockaddr*)&local, sizeof(sockaddr_in));
+   }
+
+   sockaddr_in addr = benchAddr(port);
+   if (UDT::ERROR == UDT::connect(client, (sockaddr*)&addr, sizeof(sockaddr_in)))
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      UDT::close(client);
+      return UDT::INVALID_SOCK;
+   }
+   return client;
+}
+
+// closes a socket at once, dropping the data not sent yet
+void benchClose(UDTSOCKET u)
+{
+   linger lin;
+   lin.l_onoff = 0;
+   lin.l_linger = 0;
+   UDT::setsockopt(u, 0, UDT_LINGER, &lin, sizeof(linger));
+   UDT::close(u);
+}
+
+struct BenchStream
+{
+   UDTSOCKET m_Sock;
+   uint64_t m_ullDeadline;      // the stream stops at this time
+   int64_t m_llBytes;           // bytes sent or received
+};
+
+// sends or receives on a socket in 100 ms slices until the deadline
+void* benchStream(void* s, bool send)
+{
+   BenchStream* stream = (BenchStream*)s;
+   int timeout = 100;
+   UDT::setsockopt(stream->m_Sock, 0, send ? UDT_SNDTIMEO : UDT_RCVTIMEO, &timeout, sizeof(int));
+
+   vector<char> buf(1000000);
+   while (CTimer::getTime() < stream->m_ullDeadline)
+   {
+      int len = send ? UDT::send(stream->m_Sock, &buf[0], buf.size(), 0) : UDT::recv(stream->m_Sock, &buf[0], buf.size(), 0);
+      if (len > 0)
+         stream->m_llBytes += len;
+      else if (CUDTException::ETIMEOUT != UDT::getlasterror_code())
+         break;
+   }
+
+   return NULL;
+}
+
+void* benchSend(void* s)
+{
+   return benchStream(s, true);
+}
+
+void* benchRecv(void* s)
+{
+   return benchStream(s, false);
+}
+
+
+// one connection sending in both directions at once, so that each receive worker also sends the control packets
+int Bench_Bidir(int argc, char** argv)
+{
+   int seconds = (argc > 0) ? atoi(argv[0]) : 5;
+
+   UDT::startup();
+   UDTSOCKET serv = benchListen(g_Bench_Port);
+   if (UDT::INVALID_SOCK == serv)
+      return -1;
+
+   // CUBIC at both ends, since one direction may starve the other with the default control;
+   // the accepted socket takes it from the listener
+   UDT::setsockopt(serv, 0, UDT_CC, new CCCFactory<CCUBICCC>, sizeof(CCCFactory<CCUBICCC>));
+   UDTSOCKET client = UDT::socket(AF_INET, SOCK_STREAM, 0);
+   UDT::setsockopt(client, 0, UDT_CC, new CCCFactory<CCUBICCC>, sizeof(CCCFactory<CCUBICCC>));
+   sockaddr_in addr = benchAddr(g_Bench_Port);
+   if (UDT::ERROR == UDT::connect(client, (sockaddr*)&addr, sizeof(sockaddr_in)))
+   {
+      cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+      return -1;
+   }
+   UDTSOCKET peer = UDT::accept(serv, NULL, NULL);
+
+   uint64_t deadline = CTimer::getTime() + seconds * 1000000ULL;
+   BenchStream stream[4] = {{client, deadline, 0}, {peer, deadline, 0}, {peer, deadline, 0}, {client, deadline, 0}};
+   pthread_t worker[4];
+   for (int i = 0; i < 4; ++ i)
+      pthread_create(&worker[i], NULL, (0 == i % 2) ? benchSend : benchRecv, &stream[i]);
+   for (int i = 0; i < 4; ++ i)
+      pthread_join(worker[i], NULL);
+
+   for (int i = 0; i < 2; ++ i)
+   {
+      UDT::TRACEINFO perf;
+      UDT::perfmon((0 == i) ? peer : client, &perf);
+      cout << "bidir " << ((0 == i) ? "client to server" : "server to client") << ": " << stream[i * 2 + 1].m_llBytes * 8.0 / seconds / 1000000 << " Mb/s, "
+           << perf.pktRcvLossTotal << " lost, " << perf.pktSentNAKTotal << " NAKs sent" << endl;
+   }
+
+   benchClose(client);
+   benchClose(peer);
+   UDT::close(serv);
+   UDT::cleanup();
+   return 0;
+}
+
+
+struct BenchCalls
+{
+   UDTSOCKET m_Sock;
+   uint64_t m_ullDeadline;
+   bool m_bSend;                // small sends, or getsockopt and perfmon, which only look the socket up
+   int64_t m_llCalls;
+};
+
+void* benchCalls(void* c)
+{
+   BenchCalls* calls = (BenchCalls*)c;
+   int timeout = 100;
+   UDT::setsockopt(calls->m_Sock, 0, UDT_SNDTIMEO, &timeout, sizeof(int));
+
+   char data[64];
+   memset(data, 0, sizeof(data));
+   UDT::TRACEINFO perf;
+   int val;
+   int size = sizeof(int);
+
+   while (CTimer::getTime() < calls->m_ullDeadline)
+   {
+      for (int i = 0; i < 100; ++ i)
+      {
+         if (calls->m_bSend)
+         {
+            // a send that times out leaves the batch, to check the deadline
+            if (UDT::send(calls->m_Sock, data, sizeof(data), 0) <= 0)
+               break;
+            ++ calls->m_llCalls;
+         }
+         else
+         {
+            UDT::getsockopt(calls->m_Sock, 0, UDT_SNDBUF, &val, &size);
+            UDT::perfmon(calls->m_Sock, &perf);
+            calls->m_llCalls += 2;
+         }
+      }
+   }
+
+   return NULL;
+}
+
+// many threads calling the API on their own connected sockets, among a number of idle sockets
+int Bench_Calls(int argc, char** argv)
+{
+   int threads = (argc > 0) ? atoi(argv[0]) : 32;
+   int idle = (argc > 1) ? atoi(argv[1]) : 0;
+   int seconds = (argc > 2) ? atoi(argv[2]) : 5;
+
+   UDT::startup();
+   UDTSOCKET serv = benchListen(g_Bench_Port);
+   if (UDT::INVALID_SOCK == serv)
+      return -1;
+
+   vector<UDTSOCKET> idlesocks;
+   for (int i = 0; i < idle; ++ i)
+      idlesocks.push_back(UDT::socket(AF_INET, SOCK_STREAM, 0));
+
+   vector<UDTSOCKET> client(threads);
+   vector<UDTSOCKET> peer(threads);
+   for (int i = 0; i < threads; ++ i)
+   {
+      if (UDT::INVALID_SOCK == (client[i] = benchConnect(g_Bench_Port)))
+         return -1;
+      peer[i] = UDT::accept(serv, NULL, NULL);
+   }
+
+   for (int send = 0; send < 2; ++ send)
+   {
+      uint64_t start = CTimer::getTime();
+      uint64_t deadline = start + seconds * 1000000ULL;
+      vector<BenchCalls> calls(threads);
+      vector<BenchStream> sink(threads);
+      vector<pthread_t> worker(threads * 2);
+      for (int i = 0; i < threads; ++ i)
+      {
+         BenchCalls c = {client[i], deadline, 1 == send, 0};
+         calls[i] = c;
+         pthread_create(&worker[i], NULL, benchCalls, &calls[i]);
+
+         BenchStream s = {peer[i], deadline, 0};
+         sink[i] = s;
+         if (1 == send)
+            pthread_create(&worker[threads + i], NULL, benchRecv, &sink[i]);
+      }
+
+      int64_t total = 0;
+      for (int i = 0; i < threads; ++ i)
+      {
+         pthread_join(worker[i], NULL);
+         if (1 == send)
+            pthread_join(worker[threads + i], NULL);
+         total += calls[i].m_llCalls;
+      }
+      uint64_t elapsed = CTimer::getTime() - start;
+
+      cout << "calls " << threads << " threads, " << idle << " idle sockets, " << ((1 == send) ? "64-byte send: " : "getsockopt and perfmon: ")
+           << total / (elapsed / 1000000.0) << " calls/s" << endl;
+   }
+
+   for (int i = 0; i < threads; ++ i)
+   {
+      benchClose(client[i]);
+      benchClose(peer[i]);
+   }
+   for (vector<UDTSOCKET>::iterator i = idlesocks.begin(); i != idlesocks.end(); ++ i)
+      UDT::close(*i);
+   UDT::close(serv);
+   UDT::cleanup();
+   return 0;
+}
+
+
+// the resident set of the process, in bytes
+int64_t benchRSS()
+{
+   long size = 0;
+   long pages = 0;
+   FILE* f = fopen("/proc/self/statm", "r");
+   if (NULL != f)
+   {
+      if (2 != fscanf(f, "%ld %ld", &size, &pages))
+         pages = 0;
+      fclose(f);
+   }
+   return int64_t(pages) * sysconf(_SC_PAGESIZE);
+}
+
+// samples the resident set and the memory counted by the UDT budget every 10 ms until stopped
+struct BenchPeak
+{
+   volatile bool m_bStop;
+   int64_t m_llPeak;
+   int64_t m_llPeakBudget;
+};
+
+void* benchSample(void* p)
+{
+   BenchPeak* peak = (BenchPeak*)p;
+   while (!peak->m_bStop)
+   {
+      peak->m_llPeak = max(peak->m_llPeak, benchRSS());
+      peak->m_llPeakBudget = max(peak->m_llPeakBudget, UDT::getmemusage());
+      usleep(10000);
+   }
+   return NULL;
+}
+
+struct BenchChurn
+{
+   UDTSOCKET m_Serv;
+   int m_iSessions;
+   int m_iPayload;
+};
+
+// accepts each session, reads its payload, replies 16 bytes and closes it
+void* benchChurnServer(void* c)
+{
+   BenchChurn* churn = (BenchChurn*)c;
+   vector<char> buf(churn->m_iPayload);
+
+   for (int i = 0; i < churn->m_iSessions; ++ i)
+   {
+      UDTSOCKET peer = UDT::accept(churn->m_Serv, NULL, NULL);
+      if (UDT::INVALID_SOCK == peer)
+         break;
+
+      int got = 0;
+      while (got < churn->m_iPayload)
+      {
+         int len = UDT::recv(peer, &buf[got], churn->m_iPayload - got, 0);
+         if (len <= 0)
+            break;
+         got += len;
+      }
+      UDT::send(peer, &buf[0], 16, 0);
+      UDT::close(peer);
+   }
+
+   return NULL;
+}
+
+// short sessions back to back: connect, a payload, a 16-byte reply and close, until each closed socket is reclaimed
+int Bench_Churn(int argc, char** argv)
+{
+   int sessions = (argc > 0) ? atoi(argv[0]) : 1000;
+   int payload = ((argc > 1) ? atoi(argv[1]) : 256) * 1024;
+
+   UDT::startup();
+   UDTSOCKET serv = benchListen(g_Bench_Port);
+   if (UDT::INVALID_SOCK == serv)
+      return -1;
+
+   BenchPeak peak = {false, benchRSS(), 0};
+   int64_t base = peak.m_llPeak;
+   pthread_t sampler;
+   pthread_create(&sampler, NULL, benchSample, &peak);
+
+   BenchChurn churn = {serv, sessions, payload};
+   pthread_t server;
+   pthread_create(&server, NULL, benchChurnServer, &churn);
+
+   vector<char> buf(payload);
+   vector<pair<UDTSOCKET, uint64_t> > closed;
+   vector<uint64_t> latency;
+   uint64_t start = CTimer::getTime();
+   uint64_t done = start;
+
+   for (int i = 0; (i < sessions) || (!closed.empty() && (CTimer::getTime() - done < 30000000)); ++ i)
+   {
+      if (i < sessions)
+      {
+         UDTSOCKET client = benchConnect(g_Bench_Port);
+         if (UDT::INVALID_SOCK == client)
+            break;
+
+         int sent = 0;
+         while (sent < payload)
+         {
+            int len = UDT::send(client, &buf[sent], payload - sent, 0);
+            if (len <= 0)
+               break;
+            sent += len;
+         }
+         UDT::recv(client, &buf[0], 16, 0);
+         UDT::close(client);
+
+         closed.push_back(make_pair(client, CTimer::getTime()));
+         done = CTimer::getTime();
+      }
+      else
+      {
+         usleep(10000);
+      }
+
+      for (vector<pair<UDTSOCKET, uint64_t> >::iterator j = closed.begin(); j != closed.end();)
+      {
+         if (NONEXIST == UDT::getsockstate(j->first))
+         {
+            latency.push_back(CTimer::getTime() - j->second);
+            j = closed.erase(j);
+         }
+         else
+            ++ j;
+      }
+   }
+   uint64_t reclaimed = CTimer::getTime() - start;
+
+   pthread_join(server, NULL);
+   peak.m_bStop = true;
+   pthread_join(sampler, NULL);
+
+   sort(latency.begin(), latency.end());
+   cout << "churn " << sessions << " x " << payload / 1024 << " KB: " << sessions * 60000000.0 / (done - start) << " sessions/min, peak RSS +"
+        << (peak.m_llPeak - base) / 1048576 << " MB" << endl;
+   if (!latency.empty())
+   {
+      cout << "churn close to reclaimed: p50 " << latency[latency.size() / 2] / 1000 << " ms, p99 " << latency[latency.size() * 99 / 100] / 1000
+           << " ms, all reclaimed at " << reclaimed / 1000 << " ms, " << closed.size() << " never" << endl;
+   }
+
+   UDT::close(serv);
+   UDT::cleanup();
+   return 0;
+}
+
+
+// a fleet of idle connections, both ends in this process and all clients on one UDP port, then a burst on some of them
+int Bench_Idle(int argc, char** argv)
+{
+   int conns = (argc > 0) ? atoi(argv[0]) : 10000;
+   int bursts = (argc > 1) ? min(atoi(argv[1]), conns) : 200;
+   const int burst = 256 * 1024;
+
+   UDT::startup();
+   UDTSOCKET serv = benchListen(g_Bench_Port);
+   if (UDT::INVALID_SOCK == serv)
+      return -1;
+
+   int64_t base = benchRSS();
+   vector<UDTSOCKET> client;
+   vector<UDTSOCKET> peer;
+   for (int i = 0; i < conns; ++ i)
+   {
+      UDTSOCKET u = benchConnect(g_Bench_Port, g_Bench_Port + 1);
+      if (UDT::INVALID_SOCK == u)
+         break;
+      client.push_back(u);
+      peer.push_back(UDT::accept(serv, NULL, NULL));
+   }
+   int n = client.size();
+   if (0 == n)
+      return -1;
+
+   int64_t rss = benchRSS() - base;
+   cout << "idle " << n << " connections: RSS +" << rss / 1048576 << " MB, " << rss / 1024.0 / n << " KB per connection" << endl;
+
+   // the bursts are all queued before any is read, so that they overlap
+   vector<char> buf(burst);
+   vector<int> sent(bursts, 0);
+   for (int i = 0; i < bursts; ++ i)
+   {
+      while (sent[i] < burst)
+      {
+         int len = UDT::send(client[i], &buf[sent[i]], burst - sent[i], 0);
+         if (len <= 0)
+            break;
+         sent[i] += len;
+      }
+   }
+   for (int i = 0; i < bursts; ++ i)
+   {
+      for (int got = 0; got < sent[i];)
+      {
+         int len = UDT::recv(peer[i], &buf[0], burst, 0);
+         if (len <= 0)
+            break;
+         got += len;
+      }
+   }
+
+   if (bursts > 0)
+   {
+      sleep(3);
+      rss = benchRSS() - base;
+      cout << "idle " << n << " connections, 3 s after a " << burst / 1024 << " KB burst on " << bursts << ": RSS +" << rss / 1048576 << " MB, "
+           << rss / 1024.0 / n << " KB per connection" << endl;
+   }
+
+   for (int i = 0; i < n; ++ i)
+   {
+      benchClose(client[i]);
+      benchClose(peer[i]);
+   }
+   UDT::close(serv);
+   UDT::cleanup();
+   return 0;
+}
+
+
+struct BenchBulk
+{
+   UDTSOCKET m_Sock;
+   int64_t m_llSize;            // bytes to send or receive
+   int m_iDelay;                // seconds to wait before the first read
+};
+
+void* benchBulkSend(void* b)
+{
+   BenchBulk* bulk = (BenchBulk*)b;
+   vector<char> buf(1000000);
+   for (int64_t sent = 0; sent < bulk->m_llSize;)
+   {
+      int len = UDT::send(bulk->m_Sock, &buf[0], int(min(int64_t(buf.size()), bulk->m_llSize - sent)), 0);
+      if (len <= 0)
+         break;
+      sent += len;
+   }
+   return NULL;
+}
+
+void* benchBulkRecv(void* b)
+{
+   BenchBulk* bulk = (BenchBulk*)b;
+   sleep(bulk->m_iDelay);
+
+   vector<char> buf(1000000);
+   for (int64_t got = 0; got < bulk->m_llSize;)
+   {
+      int len = UDT::recv(bulk->m_Sock, &buf[0], buf.size(), 0);
+      if (len <= 0)
+         break;
+      got += len;
+   }
+   return NULL;
+}
+
+// many bulk transfers whose receivers stall before reading, under an optional process-wide memory limit
+int Bench_Budget(int argc, char** argv)
+{
+   int64_t limit = ((argc > 0) ? atoi(argv[0]) : 0) * 1048576LL;
+   int conns = (argc > 1) ? atoi(argv[1]) : 32;
+   int64_t size = ((argc > 2) ? atoi(argv[2]) : 32) * 1048576LL;
+   const int stall = 5;
+
+   UDT::startup();
+   UDT::setmemlimit(limit);
+   UDTSOCKET serv = benchListen(g_Bench_Port);
+   if (UDT::INVALID_SOCK == serv)
+      return -1;
+
+   vector<UDTSOCKET> client;
+   vector<UDTSOCKET> peer;
+   for (int i = 0; i < conns; ++ i)
+   {
+      UDTSOCKET u = benchConnect(g_Bench_Port);
+      if (UDT::INVALID_SOCK == u)
+         return -1;
+      client.push_back(u);
+      peer.push_back(UDT::accept(serv, NULL, NULL));
+   }
+
+   BenchPeak peak = {false, benchRSS(), 0};
+   int64_t base = peak.m_llPeak;
+   pthread_t sampler;
+   pthread_create(&sampler, NULL, benchSample, &peak);
+
+   uint64_t start = CTimer::getTime();
+   vector<BenchBulk> bulk(conns * 2);
+   vector<pthread_t> worker(conns * 2);
+   for (int i = 0; i < conns; ++ i)
+   {
+      BenchBulk s = {client[i], size, 0};
+      BenchBulk r = {peer[i], size, stall};
+      bulk[i * 2] = s;
+      bulk[i * 2 + 1] = r;
+      pthread_create(&worker[i * 2], NULL, benchBulkSend, &bulk[i * 2]);
+      pthread_create(&worker[i * 2 + 1], NULL, benchBulkRecv, &bulk[i * 2 + 1]);
+   }
+   for (int i = 0; i < conns * 2; ++ i)
+      pthread_join(worker[i], NULL);
+   uint64_t elapsed = CTimer::getTime() - start;
+
+   peak.m_bStop = true;
+   pthread_join(sampler, NULL);
+
+   cout << "budget " << limit / 1048576 << " MB (0: none), " << conns << " x " << size / 1048576 << " MB, receivers stalled " << stall << " s: peak RSS +"
+        << (peak.m_llPeak - base) / 1048576 << " MB, peak budget " << peak.m_llPeakBudget / 1048576 << " MB, done in " << elapsed / 1000000.0 << " s" << endl;
+
+   for (int i = 0; i < conns; ++ i)
+   {
+      benchClose(client[i]);
+      benchClose(peer[i]);
+   }
+   UDT::close(serv);
+   UDT::cleanup();
+   return 0;
+}
+
+
+// a UDP relay between a client and a server that delays each packet, to emulate a round trip time
+struct BenchRelay
+{
+   int m_iSock;
+   sockaddr_in m_Server;
+   uint64_t m_ullDelay;         // one way delay, in microseconds
+   volatile bool m_bStop;
+};
+
+struct BenchDelayed
+{
+   uint64_t m_ullTime;          // when the packet is forwarded
+   sockaddr_in m_Dest;
+   int m_iLength;
+   char m_pcData[1500];
+};
+
+void* benchRelay(void* r)
+{
+   BenchRelay* relay = (BenchRelay*)r;
+   deque<BenchDelayed> queue;
+   sockaddr_in client;
+   memset(&client, 0, sizeof(sockaddr_in));
+
+   while (!relay->m_bStop)
+   {
+      uint64_t now = CTimer::getTime();
+      while (!queue.empty() && (queue.front().m_ullTime <= now))
+      {
+         sendto(relay->m_iSock, queue.front().m_pcData, queue.front().m_iLength, 0, (sockaddr*)&queue.front().m_Dest, sizeof(sockaddr_in));
+         queue.pop_front();
+      }
+
+      int timeout = queue.empty() ? 10 : int(min(uint64_t(10000), queue.front().m_ullTime - now) / 1000);
+      pollfd pfd;
+      pfd.fd = relay->m_iSock;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, timeout) <= 0)
+         continue;
+
+      // packets from the server go to the last client heard from, all the others to the server
+      BenchDelayed pkt;
+      sockaddr_in from;
+      socklen_t fromlen = sizeof(sockaddr_in);
+      while ((pkt.m_iLength = recvfrom(relay->m_iSock, pkt.m_pcData, sizeof(pkt.m_pcData), MSG_DONTWAIT, (sockaddr*)&from, &fromlen)) > 0)
+      {
+         bool server = (from.sin_port == relay->m_Server.sin_port) && (from.sin_addr.s_addr == relay->m_Server.sin_addr.s_addr);
+         if (!server)
+            client = from;
+         pkt.m_Dest = server ? client : relay->m_Server;
+         pkt.m_ullTime = CTimer::getTime() + relay->m_ullDelay;
+         queue.push_back(pkt);
+         fromlen = sizeof(sockaddr_in);
+      }
+   }
+
+   return NULL;
+}
+
+// one bulk stream with the default options, directly and through the relay at a number of round trip times
+int Bench_RTT(int argc, char** argv)
+{
+   int seconds = (argc > 0) ? atoi(argv[0]) : 16;
+   vector<int> rtt;
+   for (int i = 1; i < argc; ++ i)
+      rtt.push_back(atoi(argv[i]));
+   if (rtt.empty())
+   {
+      const int def[] = {0, 2, 50, 200, 300};
+      rtt.assign(def, def + 5);
+   }
+
+   UDT::startup();
+
+   for (int r = 0; r < int(rtt.size()); ++ r)
+   {
+      int port = g_Bench_Port + 10 + r * 2;
+      UDTSOCKET serv = benchListen(port);
+      if (UDT::INVALID_SOCK == serv)
+         return -1;
+
+      BenchRelay relay;
+      pthread_t forwarder;
+      if (rtt[r] > 0)
+      {
+         relay.m_iSock = socket(AF_INET, SOCK_DGRAM, 0);
+         int bufsize = 8 * 1048576;
+         setsockopt(relay.m_iSock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(int));
+         setsockopt(relay.m_iSock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(int));
+         sockaddr_in addr = benchAddr(port + 1);
+         if (0 != bind(relay.m_iSock, (sockaddr*)&addr, sizeof(sockaddr_in)))
+         {
+            cout << "relay: cannot bind port " << port + 1 << endl;
+            return -1;
+         }
+         relay.m_Server = benchAddr(port);
+         relay.m_ullDelay = rtt[r] * 500;
+         relay.m_bStop = false;
+         pthread_create(&forwarder, NULL, benchRelay, &relay);
+      }
+
+      UDTSOCKET client = benchConnect((rtt[r] > 0) ? port + 1 : port);
+      if (UDT::INVALID_SOCK == client)
+         return -1;
+      UDTSOCKET peer = UDT::accept(serv, NULL, NULL);
+
+      BenchPeak peak = {false, benchRSS(), 0};
+      int64_t base = peak.m_llPeak;
+      pthread_t sampler;
+      pthread_create(&sampler, NULL, benchSample, &peak);
+
+      uint64_t deadline = CTimer::getTime() + seconds * 1000000ULL;
+      BenchStream stream[2] = {{client, deadline, 0}, {peer, deadline, 0}};
+      pthread_t worker[2];
+      pthread_create(&worker[0], NULL, benchSend, &stream[0]);
+      pthread_create(&worker[1], NULL, benchRecv, &stream[1]);
+
+      // the first half is left to the start up
+      usleep(seconds * 500000);
+      int64_t half = stream[1].m_llBytes;
+      pthread_join(worker[0], NULL);
+      pthread_join(worker[1], NULL);
+      UDT::TRACEINFO perf;
+      UDT::perfmon(client, &perf);
+
+      peak.m_bStop = true;
+      pthread_join(sampler, NULL);
+
+      cout << "rtt " << rtt[r] << " ms" << ((0 == rtt[r]) ? " (direct)" : "") << ": " << (stream[1].m_llBytes - half) * 16.0 / seconds / 1000000
+           << " Mb/s in the second half, measured RTT " << perf.msRTT << " ms, flow window " << perf.pktFlowWindow << " packets, peak RSS +"
+           << (peak.m_llPeak - base) / 1048576 << " MB" << endl;
+
+      benchClose(client);
+      benchClose(peer);
+      UDT::close(serv);
+      if (rtt[r] > 0)
+      {
+         relay.m_bStop = true;
+         pthread_join(forwarder, NULL);
+         close(relay.m_iSock);
+      }
+   }
+
+   UDT::cleanup();
+   return 0;
+}
+
+
+struct BenchCase
+{
+   const char* m_pcName;
+   int (*m_pBench)(int, char**);
+   const char* m_pcUsage;
+};
+
+const BenchCase g_Bench[] =
+{
+   {"sndbuf", Bench_SndBuffer, "send, retransmit and ACK one packet at flight windows of 1k, 10k and 100k packets"},
+   {"rcvbuf", Bench_RcvBuffer, "check for and read small out of order messages behind a hole in receive buffers of 1k, 8k and 64k packets"},
+   {"bidir", Bench_Bidir, "[seconds] send both ways over one loopback connection, 5 seconds by default"},
+   {"calls", Bench_Calls, "[threads [idle [seconds]]] call the API from 32 threads on their own sockets among idle ones, lookups then 64-byte sends"},
+   {"churn", Bench_Churn, "[sessions [KB]] run 1000 sessions of 256 KB back to back, report the peak RSS and how soon closed sockets are reclaimed"},
+   {"idle", Bench_Idle, "[connections [bursts]] hold 10000 idle connections, then send 256 KB on 200 of them, report the RSS"},
+   {"budget", Bench_Budget, "[limit MB [connections [MB]]] send 32 x 32 MB to receivers that stall 5 s, under a memory limit, none by default"},
+   {"rtt", Bench_RTT, "[seconds [RTT ms ...]] run one bulk stream for 16 s with the default options, directly and through a relay delaying 2, 50, 200 and 300 ms"}
+};
+
+const int g_iBenchCase = sizeof(g_Bench) / sizeof(BenchCase);
+
+int main(int argc, char* argv[])
+{
+   if (argc >= 2)
+   {
+      for (int i = 0; i < g_iBenchCase; ++ i)
+      {
+         if (0 == strcmp(argv[1], g_Bench[i].m_pcName))
+            return g_Bench[i].m_pBench(argc - 2, argv + 2);
+      }
+   }
+
+   cout << "usage: bench case [options]" << endl;
+   for (int i = 0; i < g_iBenchCase; ++ i)
+      cout << "   " << g_Bench[i].m_pcName << ": " << g_Bench[i].m_pcUsage << endl;
+
+   return -1;
+}
@@ -11,8 +11,14 @@
 #endif
 #include <algorithm>
 #include <iostream>
+#include <set>
+#include <vector>
 
 #include "udt.h"
+#include "common.h"
+#include "fec.h"
+#include "list.h"
+#include "test_util.h"
 
 using namespace std;
 
@@ -709,9 +715,545 @@ DWORD WINAPI Test_4_Cli(LPVOID)
    #endif
 }
 
+// Unit tests of internal structures, they need no connection and link the static library.
+
+// the loss lists are checked against an ordered set of seq. no., which is how the array based lists behaved
+struct SeqLess
+{
+   bool operator()(int32_t a, int32_t b) const {return CSeqNo::seqcmp(a, b) < 0;}
+};
+
+typedef set<int32_t, SeqLess> SeqSet;
+
+// the NAK loss array of the seq. no. in "s" up to "last", or all of them if "last" is -1
+void encodeLoss(const SeqSet& s, int32_t last, int32_t* array, int& len, int limit)
+{
+   len = 0;
+   SeqSet::const_iterator i = s.begin();
+   while ((i != s.end()) && (len < limit - 1) && ((-1 == last) || (CSeqNo::seqcmp(*i, last) <= 0)))
+   {
+      int32_t start = *i;
+      int32_t end = *i;
+      for (++ i; (i != s.end()) && (*i == CSeqNo::incseq(end)) && ((-1 == last) || (CSeqNo::seqcmp(*i, last) <= 0)); ++ i)
+         end = *i;
+
+      array[len] = start;
+      if (start != end)
+      {
+         array[len] |= 0x80000000;
+         ++ len;
+         array[len] = end;
+      }
+      ++ len;
+   }
+}
+
+// the seq. no. "n" before "seq"
+int32_t backseq(int32_t seq, int n)
+{
+   return CSeqNo::incseq(seq, CSeqNo::m_iMaxSeqNo + 1 - n);
+}
+
+bool sameArray(const int32_t* a, int alen, const int32_t* b, int blen)
+{
+   return (alen == blen) && equal(a, a + alen, b);
+}
+
+int Test_LossList()
+{
+   cout << "Testing loss lists.\n";
+
+   UnitCheck check("LossList");
+   const int32_t max = CSeqNo::m_iMaxSeqNo;
+
+   // sender: ranges across the wraparound are returned in order
+   {
+      CSndLossList snd(1024);
+      check(6 == snd.insert(max - 2, 2), "sender insert across wraparound");
+      check(0 == snd.insert(max, 0), "sender insert of known losses");
+      check(max - 2 == snd.getLostSeq(), "sender first loss before wraparound");
+      snd.remove(max);
+      check(3 == snd.getLossLength(), "sender remove up to the max seq. no.");
+      check(0 == snd.getLostSeq(), "sender first loss after wraparound");
+      check(2 == snd.insert(max - 1, max), "sender insert before the head");
+      check(max - 1 == snd.getLostSeq(), "sender head moved back");
+      snd.remove(1);
+      check(1 == snd.getLossLength(), "sender remove across wraparound");
+      check(2 == snd.getLostSeq(), "sender last loss");
+      check(-1 == snd.getLostSeq(), "sender empty list");
+   }
+
+   // receiver: range removal across the wraparound, and up to the max seq. no.
+   {
+      CRcvLossList rcv(1024);
+      int32_t array[16];
+      int len;
+
+      rcv.insert(max - 5, max - 1);
+      rcv.insert(1, 3);
+      check(rcv.remove(max - 3, 1), "receiver remove across wraparound");
+      check(4 == rcv.getLossLength(), "receiver length after remove across wraparound");
+      rcv.getLossArray(array, len, 16);
+      int32_t expected[] = {int32_t((max - 5) | 0x80000000), max - 4, int32_t(2 | 0x80000000), 3};
+      check(sameArray(array, len, expected, 4), "receiver loss array across wraparound");
+
+      rcv.remove(2, 3);
+      rcv.insert(max - 1, max);
+      check(rcv.remove(max - 5, max), "receiver remove up to the max seq. no.");
+      check(0 == rcv.getLossLength(), "receiver empty after remove up to the max seq. no.");
+      check(-1 == rcv.getFirstLostSeq(), "receiver no first loss");
+   }
+
+   // bitmap: the runs are read in batches, across the end of the map
+   {
+      CLossBitmap bm(256);
+      for (int i = 0; i < 40; i += 4)
+         bm.set((240 + i) % 256, 2);
+
+      int runs[8];
+      check(3 == bm.getRuns(240, 40, runs, 3), "bitmap run limit");
+      int expected[] = {0, 2, 4, 2, 8, 2};
+      check(equal(runs, runs + 6, expected), "bitmap runs");
+      check((3 == bm.getRuns(252, 12, runs, 4)) && equal(runs, runs + 6, expected), "bitmap runs across the end");
+      check((1 == bm.getRuns(241, 3, runs, 4)) && (0 == runs[0]) && (1 == runs[1]), "bitmap run cut by the range");
+
+      CLossBitmap wrap(128);
+      wrap.set(126, 4);
+      check((1 == wrap.getRuns(120, 16, runs, 4)) && (6 == runs[0]) && (4 == runs[1]), "bitmap run over the end");
+   }
+
+   // random operations near the wraparound, against the ordered set
+   srand(1);
+   const int window = 1000;
+
+   {
+      CSndLossList snd(1024);
+      SeqSet model;
+      int32_t base = max - 30000;   // everything up to base is acknowledged
+      int32_t next = base;          // largest seq. no. sent
+
+      for (int step = 0; (step < 200000) && (0 == check.m_iFailed); ++ step)
+      {
+         int op = rand() % 8;
+         if ((op < 3) && (CSeqNo::seqlen(base, next) < window - 50))
+            next = CSeqNo::incseq(next, rand() % 50);
+         else if ((op < 6) && (base != next))
+         {
+            // a NAK reports a range of sent packets, in any order
+            int32_t s1 = CSeqNo::incseq(base, 1 + rand() % CSeqNo::seqoff(base, next));
+            int32_t s2 = CSeqNo::incseq(s1, rand() % 16);
+            if (CSeqNo::seqcmp(s2, next) > 0)
+               s2 = next;
+
+            int added = 0;
+            for (int32_t s = s1; ; s = CSeqNo::incseq(s))
+            {
+               added += model.insert(s).second ? 1 : 0;
+               if (s == s2)
+                  break;
+            }
+            check(added == snd.insert(s1, s2), "sender insert", step);
+         }
+         else if ((op == 6) && (base != next))
+         {
+            // an ACK
+            base = CSeqNo::incseq(base, rand() % (CSeqNo::seqoff(base, next) + 1));
+            snd.remove(base);
+            while (!model.empty() && (CSeqNo::seqcmp(*model.begin(), base) <= 0))
+               model.erase(model.begin());
+         }
+         else
+         {
+            int32_t seq = snd.getLostSeq();
+            check(seq == (model.empty() ? -1 : *model.begin()), "sender first loss", step);
+            if (!model.empty())
+               model.erase(model.begin());
+         }
+
+         check(int(model.size()) == snd.getLossLength(), "sender loss length", step);
+      }
+   }
+
+   {
+      CRcvLossList rcv(1024);
+      SeqSet model;
+      int32_t next = max - 30000;   // next seq. no. expected
+      int32_t array[512];
+      int32_t expected[512];
+      int len, explen;
+
+      for (int step = 0; (step < 200000) && (0 == check.m_iFailed); ++ step)
+      {
+         // keep the losses within the size of the map, as the receive window does
+         if (!model.empty() && (CSeqNo::seqlen(*model.begin(), next) > window - 30))
+         {
+            int32_t last = backseq(next, window - 100);
+            rcv.remove(*model.begin(), last);
+            while (!model.empty() && (CSeqNo::seqcmp(*model.begin(), last) <= 0))
+               model.erase(model.begin());
+         }
+
+         int32_t oldest = backseq(next, window - 30);
+         int32_t s1 = CSeqNo::incseq(oldest, rand() % (window - 30));
+         int32_t s2 = CSeqNo::incseq(s1, rand() % 40);
+         bool found = false;
+         for (SeqSet::iterator i = model.lower_bound(s1); (i != model.end()) && (CSeqNo::seqcmp(*i, s2) <= 0); ++ i)
+            found = true;
+
+         switch (rand() % 8)
+         {
+         case 0:
+         case 1:
+         {
+            // a packet arrives after a gap, or in order
+            int gap = (0 == rand() % 3) ? rand() % 20 : 0;
+            if (gap > 0)
+            {
+               rcv.insert(next, CSeqNo::incseq(next, gap - 1));
+               for (int i = 0; i < gap; ++ i)
+                  model.insert(CSeqNo::incseq(next, i));
+            }
+            next = CSeqNo::incseq(next, gap + 1);
+            break;
+         }
+
+         case 2:
+         case 3:
+            // a retransmission arrives
+            check(rcv.remove(s1) == (model.erase(s1) > 0), "receiver remove", step);
+            break;
+
+         case 4:
+            // a message drop request
+            check(rcv.remove(s1, s2) == found, "receiver remove range", step);
+            model.erase(model.lower_bound(s1), model.upper_bound(s2));
+            break;
+
+         case 5:
+            check(rcv.find(s1, s2) == found, "receiver find", step);
+            break;
+
+         default:
+         {
+            // the NAK array, with a limit that cuts it short at times
+            int limit = 2 + rand() % 300;
+            int32_t last = (0 == rand() % 2) ? -1 : s1;
+            rcv.getLossArray(array, len, limit, last);
+            encodeLoss(model, last, expected, explen, limit);
+            check(sameArray(array, len, expected, explen), "receiver loss array", step);
+            break;
+         }
+         }
+
+         check(int(model.size()) == rcv.getLossLength(), "receiver loss length", step);
+         check(rcv.getFirstLostSeq() == (model.empty() ? -1 : *model.begin()), "receiver first loss", step);
+      }
+
+      // many short runs read in several batches
+      if (!model.empty())
+      {
+         rcv.remove(*model.begin(), CSeqNo::decseq(next));
+         model.clear();
+      }
+      for (int32_t s = next; s != CSeqNo::incseq(next, 900); s = CSeqNo::incseq(s, 3))
+      {
+         rcv.insert(s, s);
+         model.insert(s);
+      }
+      rcv.getLossArray(array, len, 512);
+      encodeLoss(model, -1, expected, explen, 512);
+      check(sameArray(array, len, expected, explen) && (len > 256), "receiver loss array of many runs");
+   }
+
+   return check.m_iFailed;
+}
+
+// pack bytes into the words of a loss report payload, most significant byte first
+void packBytes(int32_t* words, const unsigned char* bytes, int size)
+{
+   for (int i = 0; i < size; ++ i)
+   {
+      if (0 == (i & 3))
+         words[i >> 2] = 0;
+      words[i >> 2] |= int32_t(uint32_t(bytes[i]) << (24 - ((i & 3) << 3)));
+   }
+}
+
+int Test_LossReport()
+{
+   cout << "Testing compressed loss reports.\n";
+
+   UnitCheck check("LossReport");
+   const int32_t max = CSeqNo::m_iMaxSeqNo;
+
+   int32_t report[256];
+   int32_t array[1024];
+   int32_t expected[1024];
+   int len, explen;
+
+   // round trip of random lists across the wraparound, complete or cut by the limit
+   srand(2);
+   for (int step = 0; (step < 20000) && (0 == check.m_iFailed); ++ step)
+   {
+      CRcvLossList rcv(2048);
+      int32_t seq = CSeqNo::incseq(max - 1000, rand() % 2000);
+      int32_t first = seq;
+      int runs = 1 + rand() % 200;
+      for (int i = 0; i < runs; ++ i)
+      {
+         // gaps and runs of every varint size the map can hold
+         int gap = (0 == rand() % 4) ? rand() % 3 : rand() % 8;
+         int run = (0 == rand() % 8) ? 1 + rand() % 200 : 1 + rand() % 3;
+         seq = CSeqNo::incseq(seq, gap);
+         if (CSeqNo::seqlen(first, seq) + run > 2000)
+            break;
+         rcv.insert(seq, CSeqNo::incseq(seq, run - 1));
+         seq = CSeqNo::incseq(seq, run);
+      }
+
+      int32_t last = (0 == rand() % 2) ? -1 : CSeqNo::incseq(first, rand() % 2000);
+      rcv.getLossArray(expected, explen, 1024, last);
+
+      int limit = (0 == rand() % 2) ? 256 : 3 + rand() % 20;
+      rcv.getLossReport(report, len, limit, last);
+      check(len <= limit, "report size", step);
+      if (0 == explen)
+      {
+         check(0 == len, "empty report", step);
+         continue;
+      }
+
+      int n = CRcvLossList::decodeLossReport(report, len, array, 1024);
+      check(n > 0, "decode", step);
+      if (256 == limit)
+         check(sameArray(array, n, expected, explen), "round trip", step);
+      else
+         check((n <= explen) && equal(array, array + n, expected), "round trip cut by the limit", step);
+
+      // the decoder refuses to go over its own limit
+      if (n > 1)
+         check(-1 == CRcvLossList::decodeLossReport(report, len, array, n - 1), "decode limit", step);
+   }
+
+   // fixed reports
+   int32_t words[4];
+
+   // first loss max - 1, a run of 3 (max - 1, max, 0) then one loss 10 later (11)
+   report[0] = max - 1;
+   report[1] = 2;
+   unsigned char valid[] = {0, 2, 10, 0};
+   packBytes(report + 2, valid, 4);
+   check(3 == CRcvLossList::decodeLossReport(report, 3, array, 3), "decode across wraparound");
+   check((array[0] == int32_t((max - 1) | 0x80000000)) && (0 == array[1]) && (11 == array[2]), "decoded array across wraparound");
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 1), "limit cuts a run");
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 2), "limit cuts the last loss");
+
+   // more runs than the payload holds, there is no padding to read as an extra run
+   report[1] = 3;
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 16), "count over the payload");
+   report[1] = 0x7FFFFFFF;
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 16), "huge count");
+
+   // a varint cut by the end of the payload
+   report[1] = 1;
+   unsigned char truncated[] = {0x81, 0x80, 0x80, 0x80};
+   packBytes(report + 2, truncated, 4);
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 16), "truncated varint");
+
+   // a varint longer than 5 bytes or over the max seq. no.
+   unsigned char toolong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 0, 0};
+   packBytes(report + 2, toolong, 8);
+   check(-1 == CRcvLossList::decodeLossReport(report, 4, array, 16), "varint longer than 5 bytes");
+   unsigned char toobig[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0, 0, 0};
+   packBytes(report + 2, toobig, 8);
+   check(-1 == CRcvLossList::decodeLossReport(report, 4, array, 16), "varint over the max seq. no.");
+
+   // bad headers
+   check(-1 == CRcvLossList::decodeLossReport(report, 1, array, 16), "report without count");
+   report[0] = -1;
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 16), "negative first loss");
+   report[0] = 0;
+   report[1] = -1;
+   check(-1 == CRcvLossList::decodeLossReport(report, 3, array, 16), "negative count");
+   report[1] = 0;
+   check(0 == CRcvLossList::decodeLossReport(report, 2, array, 16), "empty report");
+
+   // no room for a single run
+   CRcvLossList rcv(64);
+   rcv.insert(5, 8);
+   rcv.getLossReport(words, len, 2);
+   check(0 == len, "report limit under 3 words");
+   rcv.getLossReport(words, len, 3);
+   check((3 == len) && (1 == words[1]) && (2 == CRcvLossList::decodeLossReport(words, len, array, 16)), "report of 3 words");
+
+   return check.m_iFailed;
+}
+
+int Test_FEC()
+{
+   cout << "Testing forward error correction.\n";
+
+   UnitCheck check("FEC");
+   srand(3);
+
+   // the region kernel, SSSE3 where the CPU has it, against a byte at a time, at any length and alignment
+   {
+      char src[1600];
+      char dst[1600];
+      char ref[1600];
+      for (int step = 0; (step < 20000) && (0 == check.m_iFailed); ++ step)
+      {
+         int len = (step < 200) ? step : rand() % 1500;
+         int soff = rand() % 16;
+         int doff = rand() % 16;
+         unsigned char c = (0 == step % 100) ? step % 2 : rand() % 256;
+         for (int i = 0; i < len + 16; ++ i)
+         {
+            src[i] = char(rand());
+            dst[i] = ref[i] = char(rand());
+         }
+
+         CGF256::muladd(dst + doff, src + soff, c, len);
+         for (int i = 0; i < len; ++ i)
+            ref[doff + i] ^= CGF256::mul(c, (unsigned char)src[soff + i]);
+
+         check(equal(dst, dst + len + 16, ref), "muladd", step);
+      }
+   }
+
+   // groups near the wraparound lose up to as many packets as parity packets arrive, in any order
+   const int payload = 1000;
+   const int32_t max = CSeqNo::m_iMaxSeqNo;
+
+   vector<char> data(CFEC::m_iMaxGroup * payload);
+   vector<char> parity(CFEC::m_iMaxParity * (CFEC::m_iHdrSize + payload + 4));
+   char buf[payload];
+   int32_t msgno[64];
+   int length[64];
+
+   for (int step = 0; (step < 5000) && (0 == check.m_iFailed); ++ step)
+   {
+      int group = 1 + rand() % 32;
+      int rows = 1 + rand() % 8;
+      int32_t base = CSeqNo::incseq(max - 20000, rand() % 40000);
+
+      CFECEncoder encoder(group, rows, payload);
+      for (int i = 0; i < group; ++ i)
+      {
+         msgno[i] = rand();
+         length[i] = (0 == rand() % 4) ? payload : 1 + rand() % payload;
+         for (int k = 0; k < length[i]; ++ k)
+            data[i * payload + k] = char(rand());
+
+         CPacket packet;
+         packet.m_iSeqNo = CSeqNo::incseq(base, i);
+         packet.m_iMsgNo = msgno[i];
+         packet.m_pcData = &data[i * payload];
+         packet.setLength(length[i]);
+         encoder.add(packet);
+      }
+
+      int32_t info[16][2];
+      int plen = 0;
+      for (int j = 0; j < rows; ++ j)
+      {
+         char* p;
+         plen = encoder.getParity(j, info[j], p);
+         memcpy(&parity[j * (plen + 4)], p, plen);
+      }
+      encoder.reset();
+
+      // the losses: one more data packet than the parity packets kept at times, which cannot be rebuilt
+      int kept = 1 + rand() % rows;
+      int lost = rand() % (kept + 1);
+      if ((0 == rand() % 8) && (kept < group))
+         lost = kept + 1;
+      if (lost > group)
+         lost = group;
+
+      vector<int> order;
+      for (int i = 0; i < group; ++ i)
+         order.push_back(i);
+      random_shuffle(order.begin(), order.end());
+      set<int> gone(order.begin(), order.begin() + lost);
+
+      vector<int> par;
+      for (int j = 0; j < rows; ++ j)
+         par.push_back(j);
+      random_shuffle(par.begin(), par.end());
+      par.resize(kept);
+
+      CFECDecoder decoder(payload);
+      bool parityfirst = (0 == rand() % 2);
+      for (int pass = 0; pass < 2; ++ pass)
+      {
+         if ((0 == pass) == parityfirst)
+         {
+            for (vector<int>::iterator j = par.begin(); j != par.end(); ++ j)
+            {
+               CPacket packet;
+               packet.pack(10, info[*j], &parity[*j * (plen + 4)], plen);
+               decoder.addParity(packet);
+            }
+         }
+         else
+         {
+            for (int i = 0; i < group; ++ i)
+            {
+               if (gone.count(i) > 0)
+                  continue;
+
+               CPacket packet;
+               packet.m_iSeqNo = CSeqNo::incseq(base, i);
+               packet.m_iMsgNo = msgno[i];
+               packet.m_pcData = &data[i * payload];
+               packet.setLength(length[i]);
+               decoder.addData(packet);
+            }
+         }
+      }
+
+      // with the parity packets first, the last data packets are rebuilt before they arrive
+      set<int> rebuilt;
+      CPacket packet;
+      packet.m_pcData = buf;
+      while (decoder.getRecovered(packet))
+      {
+         int i = CSeqNo::seqoff(base, packet.m_iSeqNo);
+         check((i >= 0) && (i < group), "rebuilt seq. no.", step);
+         if (0 != check.m_iFailed)
+            break;
+
+         check(packet.m_iMsgNo == msgno[i], "rebuilt msg. no.", step);
+         check(packet.getLength() == length[i], "rebuilt length", step);
+         check(equal(buf, buf + length[i], &data[i * payload]), "rebuilt payload", step);
+         rebuilt.insert(i);
+      }
+
+      if (lost > kept)
+         check(rebuilt.empty(), "rebuilt more losses than parity packets", step);
+      else if (parityfirst)
+         check(includes(rebuilt.begin(), rebuilt.end(), gone.begin(), gone.end()), "rebuilt losses", step);
+      else
+         check(rebuilt == gone, "rebuilt losses", step);
+   }
+
+   return check.m_iFailed;
+}
+
 
 int main()
 {
+   // the unit tests come first, a failure stops the run
+   const int unit_case = 3;
+   int (*Unit_Test[unit_case])() = {Test_LossList, Test_LossReport, Test_FEC};
+
+   for (int i = 0; i < unit_case; ++ i)
+   {
+      if (0 != Unit_Test[i]())
+         return -1;
+   }
+
    const int test_case = 4;
 
 #ifndef WIN32
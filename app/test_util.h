@@ -1,6 +1,8 @@
 #ifndef _UDT_TEST_UTIL_H_
 #define _UDT_TEST_UTIL_H_
 
+#include <iostream>
+
 struct UDTUpDown{
    UDTUpDown()
    {
@@ -14,6 +16,27 @@ struct UDTUpDown{
    }
 };
 
+// counts and reports the failed checks of a unit test
+struct UnitCheck{
+   UnitCheck(const char* name): m_pcName(name), m_iFailed(0) {}
+
+   bool operator()(bool cond, const char* what, long step = -1)
+   {
+      if (!cond)
+      {
+         std::cout << m_pcName << " ERROR " << what;
+         if (step >= 0)
+            std::cout << " at step " << step;
+         std::cout << std::endl;
+         ++ m_iFailed;
+      }
+      return cond;
+   }
+
+   const char* m_pcName;
+   int m_iFailed;
+};
+
 #ifdef USE_LIBNICE
 #include <string>
 #include <cstdlib>
@@ -57,6 +57,7 @@ written by
 #include <cstdlib>
 #include "api.h"
 #include "core.h"
+#include "stripe.h"
 
 using namespace std;
 
@@ -104,7 +105,8 @@ m_pAcceptSockets(NULL),
 m_AcceptCond(),
 m_AcceptLock(),
 m_uiBackLog(0),
-m_iMuxID(-1)
+m_iMuxID(-1),
+m_iPinCount(0)
 {
    #ifndef WIN32
       pthread_mutex_init(&m_AcceptLock, NULL);
@@ -149,8 +151,112 @@ CUDTSocket::~CUDTSocket()
 
 ////////////////////////////////////////////////////////////////////////////////
 
+CSocketIndex::CSocketIndex()
+{
+   for (int i = 0; i < m_iShardNum; ++ i)
+   {
+      #ifndef WIN32
+         pthread_mutex_init(&m_pShards[i].m_Lock, NULL);
+      #else
+         m_pShards[i].m_Lock = CreateMutex(NULL, false, NULL);
+      #endif
+   }
+}
+
+CSocketIndex::~CSocketIndex()
+{
+   for (int i = 0; i < m_iShardNum; ++ i)
+   {
+      #ifndef WIN32
+         pthread_mutex_destroy(&m_pShards[i].m_Lock);
+      #else
+         CloseHandle(m_pShards[i].m_Lock);
+      #endif
+   }
+}
+
+void CSocketIndex::insert(const UDTSOCKET u, CUDTSocket* s)
+{
+   CShard& sh = shard(u);
+   CGuard cg(sh.m_Lock);
+   sh.m_Sockets[u] = s;
+}
+
+void CSocketIndex::erase(const UDTSOCKET u)
+{
+   CShard& sh = shard(u);
+   CGuard cg(sh.m_Lock);
+   sh.m_Sockets.erase(u);
+}
+
+void CSocketIndex::clear()
+{
+   for (int i = 0; i < m_iShardNum; ++ i)
+   {
+      CGuard cg(m_pShards[i].m_Lock);
+      m_pShards[i].m_Sockets.clear();
+   }
+}
+
+CUDTSocket* CSocketIndex::find(const UDTSOCKET u)
+{
+   CShard& sh = shard(u);
+   CGuard cg(sh.m_Lock);
+
+   map<UDTSOCKET, CUDTSocket*>::iterator i = sh.m_Sockets.find(u);
+
+   if ((i == sh.m_Sockets.end()) || (i->second->m_Status == CLOSED))
+      return NULL;
+
+   return i->second;
+}
+
+CUDTSocket* CSocketIndex::pin(const UDTSOCKET u)
+{
+   CShard& sh = shard(u);
+   CGuard cg(sh.m_Lock);
+
+   map<UDTSOCKET, CUDTSocket*>::iterator i = sh.m_Sockets.find(u);
+
+   if ((i == sh.m_Sockets.end()) || (i->second->m_Status == CLOSED))
+      return NULL;
+
+   ++ i->second->m_iPinCount;
+   return i->second;
+}
+
+void CSocketIndex::unpin(CUDTSocket* s)
+{
+   CGuard cg(shard(s->m_SocketID).m_Lock);
+   -- s->m_iPinCount;
+}
+
+bool CSocketIndex::pinned(CUDTSocket* s)
+{
+   CGuard cg(shard(s->m_SocketID).m_Lock);
+   return s->m_iPinCount > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CUDTUnited::CPinned::CPinned(CUDTUnited& owner, const UDTSOCKET u):
+m_Owner(owner),
+m_pSocket(owner.m_SocketIndex.pin(u))
+{
+   if (NULL == m_pSocket)
+      throw CUDTException(5, 4, 0);
+}
+
+CUDTUnited::CPinned::~CPinned()
+{
+   m_Owner.m_SocketIndex.unpin(m_pSocket);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 CUDTUnited::CUDTUnited():
 m_Sockets(),
+m_SocketIndex(),
 m_ControlLock(),
 m_IDLock(),
 m_SocketID(0),
@@ -164,6 +270,7 @@ m_GCStopCond(),
 m_InitLock(),
 m_iInstanceCount(0),
 m_bGCStatus(false),
+m_bGCPending(false),
 m_GCThread(),
 m_ClosedSockets(),
 m_bDebugLoggingEnabled(false),
@@ -330,26 +437,16 @@ int CUDTUnited::cleanup()
    if (!m_bGCStatus)
       return 0;
 
-   // Close all remaining multiplexers and their channels before the worker
-   // threads that depend on them are destroyed.
-   for (map<int, CMultiplexer>::iterator i = m_mMultiplexer.begin(); i != m_mMultiplexer.end(); ++ i)
-   {
-      delete i->second.m_pSndQueue;
-      delete i->second.m_pRcvQueue;
-      if (i->second.m_pChannel)
-         i->second.m_pChannel->close();
-      delete i->second.m_pTimer;
-      delete i->second.m_pChannel;
-   }
-   m_mMultiplexer.clear();
-
-   m_bClosing = true;
    #ifndef WIN32
+      CGuard::enterCS(m_GCStopLock);
+      m_bClosing = true;
       pthread_cond_signal(&m_GCStopCond);
+      CGuard::leaveCS(m_GCStopLock);
       pthread_join(m_GCThread, NULL);
       pthread_mutex_destroy(&m_GCStopLock);
       pthread_cond_destroy(&m_GCStopCond);
    #else
+      m_bClosing = true;
       SetEvent(m_GCStopCond);
       WaitForSingleObject(m_GCThread, INFINITE);
       CloseHandle(m_GCThread);
@@ -357,6 +454,19 @@ int CUDTUnited::cleanup()
       CloseHandle(m_GCStopCond);
    #endif
 
+   // The GC closes and removes every socket on its way out, and with them their multiplexers; close
+   // any that are left only now, as the sockets being closed still use their queues.
+   for (map<int, CMultiplexer>::iterator i = m_mMultiplexer.begin(); i != m_mMultiplexer.end(); ++ i)
+   {
+      delete i->second.m_pSndQueue;
+      delete i->second.m_pRcvQueue;
+      if (i->second.m_pChannel)
+         i->second.m_pChannel->close();
+      delete i->second.m_pTimer;
+      delete i->second.m_pChannel;
+   }
+   m_mMultiplexer.clear();
+
    m_bGCStatus = false;
 
    // Global destruction code
@@ -414,10 +524,12 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type)
    try
    {
       m_Sockets[ns->m_SocketID] = ns;
+      m_SocketIndex.insert(ns->m_SocketID, ns);
    }
    catch (...)
    {
       //failure and rollback
+      m_Sockets.erase(ns->m_SocketID);
       CGuard::leaveCS(m_ControlLock);
       delete ns;
       ns = NULL;
@@ -535,6 +647,7 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
    try
    {
       m_Sockets[ns->m_SocketID] = ns;
+      m_SocketIndex.insert(ns->m_SocketID, ns);
       m_PeerRec[(ns->m_PeerID << 30) + ns->m_iISN].insert(ns->m_SocketID);
    }
    catch (...)
@@ -583,19 +696,26 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr* peer, CHan
 
 CUDT* CUDTUnited::lookup(const UDTSOCKET u)
 {
-   // protects the m_Sockets structure
-   CGuard cg(m_ControlLock);
+   CUDTSocket* s = m_SocketIndex.find(u);
 
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
-
-   if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+   if (NULL == s)
       throw CUDTException(5, 4, 0);
 
-   return i->second->m_pUDT;
+   return s->m_pUDT;
 }
 
 UDTSTATUS CUDTUnited::getStatus(const UDTSOCKET u)
 {
+   // live sockets are answered from the index; only closed or unknown IDs need m_ControlLock
+   CUDTSocket* s = m_SocketIndex.find(u);
+   if (NULL != s)
+   {
+      if (s->m_pUDT->m_bBroken)
+         return BROKEN;
+
+      return s->m_Status;
+   }
+
    // protects the m_Sockets structure
    CGuard cg(m_ControlLock);
 
@@ -618,9 +738,8 @@ UDTSTATUS CUDTUnited::getStatus(const UDTSOCKET u)
 int CUDTUnited::bind(const UDTSOCKET u, const sockaddr* name, int namelen)
 {
    logDebug("bind starting on socket %d", u);
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    CGuard cg(s->m_ControlLock);
 
@@ -654,9 +773,8 @@ int CUDTUnited::bind(const UDTSOCKET u, const sockaddr* name, int namelen)
 int CUDTUnited::bind(UDTSOCKET u, UDPSOCKET udpsock)
 {
    logDebug("bind2 starting on socket %d with UDP socket %d", u, static_cast<int>(udpsock));
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    CGuard cg(s->m_ControlLock);
 
@@ -698,9 +816,8 @@ int CUDTUnited::bind(UDTSOCKET u, UDPSOCKET udpsock)
 int CUDTUnited::listen(const UDTSOCKET u, int backlog)
 {
    logDebug("listen requested on socket %d (backlog=%d)", u, backlog);
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    CGuard cg(s->m_ControlLock);
 
@@ -747,10 +864,8 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
    if ((NULL != addr) && (NULL == addrlen))
       throw CUDTException(5, 3, 0);
 
-   CUDTSocket* ls = locate(listen);
-
-   if (ls == NULL)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, listen);
+   CUDTSocket* ls = pinned.socket();
 
    // the "listen" socket must be in LISTENING status
    if (LISTENING != ls->m_Status)
@@ -837,15 +952,19 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
       throw CUDTException(5, 6, 0);
    }
 
-   if ((addr != NULL) && (addrlen != NULL))
+   // the new socket may have been closed meanwhile, its address is then not available
+   CUDTSocket* ns;
+   if ((addr != NULL) && (addrlen != NULL) && (NULL != (ns = m_SocketIndex.pin(u))))
    {
-      if (AF_INET == locate(u)->m_iIPversion)
+      if (AF_INET == ns->m_iIPversion)
          *addrlen = sizeof(sockaddr_in);
       else
          *addrlen = sizeof(sockaddr_in6);
 
       // copy address information of peer node
-      memcpy(addr, locate(u)->m_pPeerAddr, *addrlen);
+      memcpy(addr, ns->m_pPeerAddr, *addrlen);
+
+      m_SocketIndex.unpin(ns);
    }
 
    logDebug("accept returning new socket %d", u);
@@ -855,9 +974,8 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr* addr, int* addrle
 int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
 {
    logDebug("connect requested on socket %d", u);
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    CGuard cg(s->m_ControlLock);
 
@@ -953,9 +1071,8 @@ int CUDTUnited::connect(const UDTSOCKET u, const sockaddr* name, int namelen)
 
 void CUDTUnited::connect_complete(const UDTSOCKET u)
 {
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    // copy address information of local node
    // the local port must be correctly assigned BEFORE CUDT::connect(),
@@ -969,9 +1086,8 @@ void CUDTUnited::connect_complete(const UDTSOCKET u)
 int CUDTUnited::close(const UDTSOCKET u)
 {
    logDebug("close requested on socket %d", u);
-   CUDTSocket* s = locate(u);
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    CGuard socket_cg(s->m_ControlLock);
 
@@ -1002,26 +1118,35 @@ int CUDTUnited::close(const UDTSOCKET u)
    s->m_pUDT->close();
 
    // synchronize with garbage collection.
-   CGuard manager_cg(m_ControlLock);
+   CGuard::enterCS(m_ControlLock);
 
    // since "s" is located before m_ControlLock, locate it again in case it became invalid
    map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
    if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+   {
+      CGuard::leaveCS(m_ControlLock);
       return 0;
+   }
    s = i->second;
 
    s->m_Status = CLOSED;
 
    // a socket will not be immediated removed when it is closed
    // in order to prevent other methods from accessing invalid address
-   // a timer is started and the socket will be removed after approximately 1 second
+   // the GC removes it once no API call and no queue worker holds it
    s->m_TimeStamp = CTimer::getTime();
 
    m_Sockets.erase(s->m_SocketID);
+   m_SocketIndex.erase(s->m_SocketID);
    m_ClosedSockets.insert(pair<UDTSOCKET, CUDTSocket*>(s->m_SocketID, s));
 
    CTimer::triggerEvent();
 
+   CGuard::leaveCS(m_ControlLock);
+
+   // let the GC reclaim the socket as soon as it is safe instead of on its next periodic pass
+   wakeGC();
+
    logDebug("close completed on socket %d", u);
    return 0;
 }
@@ -1031,10 +1156,8 @@ int CUDTUnited::getpeername(const UDTSOCKET u, sockaddr* name, int* namelen)
    if (CONNECTED != getStatus(u))
       throw CUDTException(2, 2, 0);
 
-   CUDTSocket* s = locate(u);
-
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    if (!s->m_pUDT->m_bConnected || s->m_pUDT->m_bBroken)
       throw CUDTException(2, 2, 0);
@@ -1052,10 +1175,8 @@ int CUDTUnited::getpeername(const UDTSOCKET u, sockaddr* name, int* namelen)
 
 int CUDTUnited::getsockname(const UDTSOCKET u, sockaddr* name, int* namelen)
 {
-   CUDTSocket* s = locate(u);
-
-   if (NULL == s)
-      throw CUDTException(5, 4, 0);
+   CPinned pinned(*this, u);
+   CUDTSocket* s = pinned.socket();
 
    if (s->m_pUDT->m_bBroken)
       throw CUDTException(5, 4, 0);
@@ -1088,7 +1209,7 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
    int count = 0;
    set<UDTSOCKET> rs, ws, es;
 
-   // retrieve related UDT sockets
+   // retrieve related UDT sockets, they are pinned while they are queried
    vector<CUDTSocket*> ru, wu, eu;
    CUDTSocket* s;
    if (NULL != readfds)
@@ -1099,8 +1220,13 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
             rs.insert(*i1);
             ++ count;
          }
-         else if (NULL == (s = locate(*i1)))
+         else if (NULL == (s = m_SocketIndex.pin(*i1)))
+         {
+            unpin(ru);
+            unpin(wu);
+            unpin(eu);
             throw CUDTException(5, 4, 0);
+         }
          else
             ru.push_back(s);
       }
@@ -1112,8 +1238,13 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
             ws.insert(*i2);
             ++ count;
          }
-         else if (NULL == (s = locate(*i2)))
+         else if (NULL == (s = m_SocketIndex.pin(*i2)))
+         {
+            unpin(ru);
+            unpin(wu);
+            unpin(eu);
             throw CUDTException(5, 4, 0);
+         }
          else
             wu.push_back(s);
       }
@@ -1125,8 +1256,13 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
             es.insert(*i3);
             ++ count;
          }
-         else if (NULL == (s = locate(*i3)))
+         else if (NULL == (s = m_SocketIndex.pin(*i3)))
+         {
+            unpin(ru);
+            unpin(wu);
+            unpin(eu);
             throw CUDTException(5, 4, 0);
+         }
          else
             eu.push_back(s);
       }
@@ -1153,7 +1289,7 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
       {
          s = *j2;
 
-         if ((s->m_pUDT->m_bConnected && (s->m_pUDT->m_pSndBuffer->getCurrBufSize() < s->m_pUDT->m_iSndBufSize))
+         if ((s->m_pUDT->m_bConnected && (s->m_pUDT->getSndBufSpace() > 0))
             || s->m_pUDT->m_bBroken || !s->m_pUDT->m_bConnected || (s->m_Status == CLOSED))
          {
             ws.insert(s->m_SocketID);
@@ -1173,6 +1309,10 @@ int CUDTUnited::select(ud_set* readfds, ud_set* writefds, ud_set* exceptfds, con
       CTimer::waitForEvent();
    } while (to > CTimer::getTime() - entertime);
 
+   unpin(ru);
+   unpin(wu);
+   unpin(eu);
+
    if (NULL != readfds)
       *readfds = rs;
 
@@ -1208,10 +1348,13 @@ int CUDTUnited::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfd
    {
       for (vector<UDTSOCKET>::const_iterator i = fds.begin(); i != fds.end(); ++ i)
       {
-         CUDTSocket* s = locate(*i);
+         CUDTSocket* s = m_SocketIndex.pin(*i);
 
          if ((NULL == s) || s->m_pUDT->m_bBroken || (s->m_Status == CLOSED))
          {
+            if (NULL != s)
+               m_SocketIndex.unpin(s);
+
             if (NULL != exceptfds)
             {
                exceptfds->push_back(*i);
@@ -1232,12 +1375,14 @@ int CUDTUnited::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfd
 
          if (NULL != writefds)
          {
-            if (s->m_pUDT->m_bConnected && (s->m_pUDT->m_pSndBuffer->getCurrBufSize() < s->m_pUDT->m_iSndBufSize))
+            if (s->m_pUDT->m_bConnected && (s->m_pUDT->getSndBufSpace() > 0))
             {
                writefds->push_back(s->m_SocketID);
                ++ count;
             }
          }
+
+         m_SocketIndex.unpin(s);
       }
 
       if (count > 0)
@@ -1256,17 +1401,10 @@ int CUDTUnited::epoll_create()
 
 int CUDTUnited::epoll_add_usock(const int eid, const UDTSOCKET u, const int* events)
 {
-   CUDTSocket* s = locate(u);
-   int ret = -1;
-   if (NULL != s)
-   {
-      ret = m_EPoll.add_usock(eid, u, events);
-      s->m_pUDT->addEPoll(eid);
-   }
-   else
-   {
-      throw CUDTException(5, 4);
-   }
+   CPinned pinned(*this, u);
+
+   int ret = m_EPoll.add_usock(eid, u, events);
+   pinned->addEPoll(eid);
 
    return ret;
 }
@@ -1280,10 +1418,11 @@ int CUDTUnited::epoll_remove_usock(const int eid, const UDTSOCKET u)
 {
    int ret = m_EPoll.remove_usock(eid, u);
 
-   CUDTSocket* s = locate(u);
+   CUDTSocket* s = m_SocketIndex.pin(u);
    if (NULL != s)
    {
       s->m_pUDT->removeEPoll(eid);
+      m_SocketIndex.unpin(s);
    }
    //else
    //{
@@ -1303,21 +1442,30 @@ int CUDTUnited::epoll_wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET
    return m_EPoll.wait(eid, readfds, writefds, msTimeOut, lrfds, lwfds);
 }
 
-int CUDTUnited::epoll_release(const int eid)
+int CUDTUnited::epoll_uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut)
 {
-   return m_EPoll.release(eid);
+   return m_EPoll.uwait(eid, events, maxevents, msTimeOut);
 }
 
-CUDTSocket* CUDTUnited::locate(const UDTSOCKET u)
+int CUDTUnited::epoll_getfd(const int eid)
 {
-   CGuard cg(m_ControlLock);
+   return m_EPoll.getfd(eid);
+}
 
-   map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.find(u);
+int CUDTUnited::epoll_release(const int eid)
+{
+   return m_EPoll.release(eid);
+}
 
-   if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
-      return NULL;
+void CUDTUnited::unpin(const vector<CUDTSocket*>& sockets)
+{
+   for (vector<CUDTSocket*>::const_iterator i = sockets.begin(); i != sockets.end(); ++ i)
+      m_SocketIndex.unpin(*i);
+}
 
-   return i->second;
+CUDTSocket* CUDTUnited::locate(const UDTSOCKET u)
+{
+   return m_SocketIndex.find(u);
 }
 
 CUDTSocket* CUDTUnited::locate(const sockaddr* peer, const UDTSOCKET id, int32_t isn)
@@ -1342,15 +1490,16 @@ CUDTSocket* CUDTUnited::locate(const sockaddr* peer, const UDTSOCKET id, int32_t
    return NULL;
 }
 
-void CUDTUnited::checkBrokenSockets()
+bool CUDTUnited::checkBrokenSockets(const bool scan)
 {
-   CGuard cg(m_ControlLock);
+   CGuard::enterCS(m_ControlLock);
 
    // set of sockets To Be Closed and To Be Removed
    vector<UDTSOCKET> tbc;
    vector<UDTSOCKET> tbr;
 
-   for (map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.begin(); i != m_Sockets.end(); ++ i)
+   // live sockets are only scanned for broken connections on the periodic pass
+   for (map<UDTSOCKET, CUDTSocket*>::iterator i = m_Sockets.begin(); scan && (i != m_Sockets.end()); ++ i)
    {
       // check broken connection
       if (i->second->m_pUDT->m_bBroken)
@@ -1402,20 +1551,93 @@ void CUDTUnited::checkBrokenSockets()
          }
       }
 
-      // timeout 1 second to destroy a socket AND it has been removed from RcvUList
-      if ((CTimer::getTime() - j->second->m_TimeStamp > 1000000) && ((NULL == j->second->m_pUDT->m_pRNode) || !j->second->m_pUDT->m_pRNode->m_bOnList))
-      {
+      if (reclaimable(j->second))
          tbr.push_back(j->first);
-      }
    }
 
    // move closed sockets to the ClosedSockets structure
    for (vector<UDTSOCKET>::iterator k = tbc.begin(); k != tbc.end(); ++ k)
+   {
       m_Sockets.erase(*k);
+      m_SocketIndex.erase(*k);
+   }
 
    // remove those timeout sockets
    for (vector<UDTSOCKET>::iterator l = tbr.begin(); l != tbr.end(); ++ l)
       removeSocket(*l);
+
+   const bool waiting = !m_ClosedSockets.empty();
+
+   vector<CMultiplexer> retired;
+   retired.swap(m_vRetiredMux);
+
+   CGuard::leaveCS(m_ControlLock);
+
+   // joining a multiplexer's worker threads takes milliseconds, so it is done without m_ControlLock;
+   // the multiplexer has already left m_mMultiplexer and no socket refers to it.
+   // All receiving workers are told to stop first so that their exits overlap instead of adding up.
+   for (vector<CMultiplexer>::iterator m = retired.begin(); m != retired.end(); ++ m)
+      m->m_pRcvQueue->m_bClosing = true;
+
+   for (vector<CMultiplexer>::iterator m = retired.begin(); m != retired.end(); ++ m)
+   {
+      delete m->m_pSndQueue;
+      delete m->m_pRcvQueue;
+      m->m_pChannel->close();
+      delete m->m_pTimer;
+      delete m->m_pChannel;
+   }
+
+   return waiting;
+}
+
+bool CUDTUnited::reclaimable(CUDTSocket* s)
+{
+   // still lingering, or the sender or receiver worker may still reference it
+   if (s->m_pUDT->m_ullLingerExpiration > 0)
+      return false;
+
+   if ((NULL != s->m_pUDT->m_pRNode) && s->m_pUDT->m_pRNode->m_bOnList)
+      return false;
+
+   // an API call may still be inside the socket
+   if (m_SocketIndex.pinned(s))
+      return false;
+
+   // a closed socket sends nothing more, but the sender worker may still be transmitting its last packet
+   if ((NULL != s->m_pUDT->m_pSndQueue) && (NULL != s->m_pUDT->m_pSNode))
+   {
+      s->m_pUDT->m_pSndQueue->m_pSndUList->remove(s->m_pUDT);
+      if (s->m_pUDT->m_pSndQueue->m_pSndUList->busy(s->m_pUDT))
+         return false;
+   }
+
+   #ifndef WIN32
+      if (0 != pthread_mutex_trylock(&s->m_ControlLock))
+         return false;
+      pthread_mutex_unlock(&s->m_ControlLock);
+   #else
+      if (WAIT_OBJECT_0 != WaitForSingleObject(s->m_ControlLock, 0))
+         return false;
+      ReleaseMutex(s->m_ControlLock);
+   #endif
+
+   return true;
+}
+
+void CUDTUnited::wakeGC()
+{
+   if (!m_bGCStatus)
+      return;
+
+   CGuard::enterCS(m_GCStopLock);
+   m_bGCPending = true;
+   #ifndef WIN32
+      pthread_cond_signal(&m_GCStopCond);
+   #else
+      SetEvent(m_GCStopCond);
+   #endif
+   CGuard::leaveCS(m_GCStopLock);
 }
 
 void CUDTUnited::removeSocket(const UDTSOCKET u)
@@ -1442,6 +1664,7 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
          m_Sockets[*q]->m_Status = CLOSED;
          m_ClosedSockets[*q] = m_Sockets[*q];
          m_Sockets.erase(*q);
+         m_SocketIndex.erase(*q);
       }
 
       CGuard::leaveCS(i->second->m_AcceptLock);
@@ -1456,30 +1679,29 @@ void CUDTUnited::removeSocket(const UDTSOCKET u)
          m_PeerRec.erase(j);
    }
 
-   map<int, CMultiplexer>::iterator m;
-   m = m_mMultiplexer.find(mid);
-   if (m == m_mMultiplexer.end())
-   {
-      //something is wrong!!!
-      return;
-   }
+   // a closed socket left the index at least one GC period ago; erasing it again waits out
+   // any find() that still holds its shard lock, so no lookup can be reading it when it is deleted
+   m_SocketIndex.erase(u);
 
    // delete this one
    i->second->m_pUDT->close();
 
-   const bool last = (m->second.m_iRefCount == 1);
-
    delete i->second;
    m_ClosedSockets.erase(i);
 
+   // a socket closed before it was bound or connected has no multiplexer
+   map<int, CMultiplexer>::iterator m;
+   m = m_mMultiplexer.find(mid);
+   if (m == m_mMultiplexer.end())
+      return;
+
+   const bool last = (m->second.m_iRefCount == 1);
+
    m->second.m_iRefCount --;
    if (last)
    {
-      delete m->second.m_pSndQueue;
-      delete m->second.m_pRcvQueue;
-      m->second.m_pChannel->close();
-      delete m->second.m_pTimer;
-      delete m->second.m_pChannel;
+      // shut down by checkBrokenSockets() once m_ControlLock is released
+      m_vRetiredMux.push_back(m->second);
       m_mMultiplexer.erase(m);
    }
 }
@@ -1660,26 +1882,49 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
 {
    CUDTUnited* self = (CUDTUnited*)p;
 
-   CGuard gcguard(self->m_GCStopLock);
+   uint64_t lastscan = 0;
 
    while (!self->m_bClosing)
    {
-      self->checkBrokenSockets();
+      // broken connections are looked for once per second; closed sockets are handled whenever
+      // close() wakes the GC, and polled every m_ullReclaimPoll while any is waiting to be removed
+      uint64_t currtime = CTimer::getTime();
+      const bool scan = (currtime - lastscan >= 1000000);
+      if (scan)
+      {
+         lastscan = currtime;
 
-      #ifdef WIN32
-         self->checkTLSValue();
-      #endif
+         #ifdef WIN32
+            self->checkTLSValue();
+         #endif
+      }
 
+      const bool waiting = self->checkBrokenSockets(scan);
+
+      currtime = CTimer::getTime();
+      if (self->m_bClosing || (currtime >= lastscan + 1000000))
+         continue;
+
+      uint64_t wait = lastscan + 1000000 - currtime;
+      if (waiting && (wait > m_ullReclaimPoll))
+         wait = m_ullReclaimPoll;
+
+      // m_GCStopLock is only held around the wait, so close() never waits for a GC pass
       #ifndef WIN32
          timeval now;
          timespec timeout;
          gettimeofday(&now, 0);
-         timeout.tv_sec = now.tv_sec + 1;
-         timeout.tv_nsec = now.tv_usec * 1000;
-
-         pthread_cond_timedwait(&self->m_GCStopCond, &self->m_GCStopLock, &timeout);
+         uint64_t usec = now.tv_usec + wait;
+         timeout.tv_sec = now.tv_sec + usec / 1000000;
+         timeout.tv_nsec = (usec % 1000000) * 1000;
+
+         CGuard::enterCS(self->m_GCStopLock);
+         if (!self->m_bGCPending && !self->m_bClosing)
+            pthread_cond_timedwait(&self->m_GCStopCond, &self->m_GCStopLock, &timeout);
+         self->m_bGCPending = false;
+         CGuard::leaveCS(self->m_GCStopLock);
       #else
-         WaitForSingleObject(self->m_GCStopCond, 1000);
+         WaitForSingleObject(self->m_GCStopCond, DWORD(wait / 1000));
       #endif
    }
 
@@ -1708,6 +1953,7 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
       CGuard::leaveCS(ls->second->m_AcceptLock);
    }
    self->m_Sockets.clear();
+   self->m_SocketIndex.clear();
 
    for (map<UDTSOCKET, CUDTSocket*>::iterator j = self->m_ClosedSockets.begin(); j != self->m_ClosedSockets.end(); ++ j)
    {
@@ -1717,7 +1963,7 @@ void CUDTUnited::updateMux(CUDTSocket* s, const CUDTSocket* ls)
 
    while (true)
    {
-      self->checkBrokenSockets();
+      self->checkBrokenSockets(true);
 
       CGuard::enterCS(self->m_ControlLock);
       bool empty = self->m_ClosedSockets.empty();
@@ -1942,7 +2188,7 @@ int CUDT::getsockopt(UDTSOCKET u, int, UDTOpt optname, void* optval, int* optlen
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       udt->getOpt(optname, optval, *optlen);
       return 0;
    }
@@ -1962,7 +2208,7 @@ int CUDT::setsockopt(UDTSOCKET u, int, UDTOpt optname, const void* optval, int o
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       udt->setOpt(optname, optval, optlen);
       return 0;
    }
@@ -1982,7 +2228,7 @@ int CUDT::send(UDTSOCKET u, const char* buf, int len, int)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       return udt->send(buf, len);
    }
    catch (CUDTException e)
@@ -2006,7 +2252,7 @@ int CUDT::recv(UDTSOCKET u, char* buf, int len, int)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       return udt->recv(buf, len);
    }
    catch (CUDTException e)
@@ -2025,7 +2271,7 @@ int CUDT::sendmsg(UDTSOCKET u, const char* buf, int len, int ttl, bool inorder)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       return udt->sendmsg(buf, len, ttl, inorder);
    }
    catch (CUDTException e)
@@ -2049,7 +2295,7 @@ int CUDT::recvmsg(UDTSOCKET u, char* buf, int len)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       return udt->recvmsg(buf, len);
    }
    catch (CUDTException e)
@@ -2064,12 +2310,17 @@ int CUDT::recvmsg(UDTSOCKET u, char* buf, int len)
    }
 }
 
-int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size, int block)
+int CUDT::sendzc(UDTSOCKET u, const char* buf, int len, UDT_RELEASE_CB release, void* arg, int ttl, bool inorder)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
-      return udt->sendfile(ifs, offset, size, block);
+      if (NULL == release)
+         throw CUDTException(5, 3, 0);
+
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      if (UDT_STREAM == udt->m_iSockType)
+         return udt->send(buf, len, release, arg);
+      return udt->sendmsg(buf, len, ttl, inorder, release, arg);
    }
    catch (CUDTException e)
    {
@@ -2088,18 +2339,28 @@ int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size,
    }
 }
 
-int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size, int block)
+int CUDT::recvzc(UDTSOCKET u, UDTIOVEC* iov, int* iovcnt, int* token)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
-      return udt->recvfile(ofs, offset, size, block);
+      if ((NULL == iov) || (NULL == iovcnt) || (NULL == token))
+         throw CUDTException(5, 3, 0);
+
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      if (UDT_STREAM == udt->m_iSockType)
+         return udt->recv(NULL, *iovcnt, iov, iovcnt, token);
+      return udt->recvmsg(NULL, *iovcnt, iov, iovcnt, token);
    }
    catch (CUDTException e)
    {
       s_UDTUnited.setError(new CUDTException(e));
       return ERROR;
    }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
    catch (...)
    {
       s_UDTUnited.setError(new CUDTException(-1, 0, 0));
@@ -2107,28 +2368,19 @@ int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size,
    }
 }
 
-int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, const timeval* timeout)
+int CUDT::release(UDTSOCKET u, int token)
 {
-   if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
-   {
-      s_UDTUnited.setError(new CUDTException(5, 3, 0));
-      return ERROR;
-   }
-
    try
    {
-      return s_UDTUnited.select(readfds, writefds, exceptfds, timeout);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      udt->release(token);
+      return 0;
    }
    catch (CUDTException e)
    {
       s_UDTUnited.setError(new CUDTException(e));
       return ERROR;
    }
-   catch (bad_alloc&)
-   {
-      s_UDTUnited.setError(new CUDTException(3, 2, 0));
-      return ERROR;
-   }
    catch (...)
    {
       s_UDTUnited.setError(new CUDTException(-1, 0, 0));
@@ -2136,17 +2388,299 @@ int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, cons
    }
 }
 
-int CUDT::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfds, vector<UDTSOCKET>* writefds, vector<UDTSOCKET>* exceptfds, int64_t msTimeOut)
+int CUDT::sendv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int)
 {
-   if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
-   {
-      s_UDTUnited.setError(new CUDTException(5, 3, 0));
-      return ERROR;
-   }
-
    try
    {
-      return s_UDTUnited.selectEx(fds, readfds, writefds, exceptfds, msTimeOut);
+      int len = getIOVecSize(iov, iovcnt);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->send(NULL, len, NULL, NULL, iov, iovcnt);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::recvv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int)
+{
+   try
+   {
+      int len = getIOVecSize(iov, iovcnt);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->recv(NULL, len, const_cast<UDTIOVEC*>(iov), &iovcnt);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::sendmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int ttl, bool inorder)
+{
+   try
+   {
+      int len = getIOVecSize(iov, iovcnt);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->sendmsg(NULL, len, ttl, inorder, NULL, NULL, iov, iovcnt);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::recvmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt)
+{
+   try
+   {
+      int len = getIOVecSize(iov, iovcnt);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->recvmsg(NULL, len, const_cast<UDTIOVEC*>(iov), &iovcnt);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::getIOVecSize(const UDTIOVEC* iov, int iovcnt)
+{
+   if ((NULL == iov) || (iovcnt < 0))
+      throw CUDTException(5, 3, 0);
+
+   int64_t len = 0;
+   for (int i = 0; i < iovcnt; ++ i)
+   {
+      if ((NULL == iov[i].iov_base) && (iov[i].iov_len > 0))
+         throw CUDTException(5, 3, 0);
+
+      len += iov[i].iov_len;
+      if (len > 0x7FFFFFFF)
+         throw CUDTException(5, 3, 0);
+   }
+
+   return int(len);
+}
+
+int64_t CUDT::sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size, int block)
+{
+   try
+   {
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->sendfile(ifs, offset, size, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size, int block)
+{
+   try
+   {
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->recvfile(ofs, offset, size, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+#ifndef WIN32
+int64_t CUDT::sendfile_fd(UDTSOCKET u, int fd, int64_t& offset, int64_t size, int block)
+{
+   try
+   {
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->sendfile(fd, offset, size, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::recvfile_fd(UDTSOCKET u, int fd, int64_t& offset, int64_t size, int block)
+{
+   try
+   {
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
+      return udt->recvfile(fd, offset, size, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::sendfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, int block)
+{
+   try
+   {
+      return CStripe::sendfile(socks, n, fd, size, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int64_t CUDT::recvfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal, int block)
+{
+   try
+   {
+      return CStripe::recvfile(socks, n, fd, size, journal, block);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+#endif
+
+int CUDT::select(int, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, const timeval* timeout)
+{
+   if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
+   {
+      s_UDTUnited.setError(new CUDTException(5, 3, 0));
+      return ERROR;
+   }
+
+   try
+   {
+      return s_UDTUnited.select(readfds, writefds, exceptfds, timeout);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (bad_alloc&)
+   {
+      s_UDTUnited.setError(new CUDTException(3, 2, 0));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::selectEx(const vector<UDTSOCKET>& fds, vector<UDTSOCKET>* readfds, vector<UDTSOCKET>* writefds, vector<UDTSOCKET>* exceptfds, int64_t msTimeOut)
+{
+   if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds))
+   {
+      s_UDTUnited.setError(new CUDTException(5, 3, 0));
+      return ERROR;
+   }
+
+   try
+   {
+      return s_UDTUnited.selectEx(fds, readfds, writefds, exceptfds, msTimeOut);
    }
    catch (CUDTException e)
    {
@@ -2273,6 +2807,42 @@ int CUDT::epoll_wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* wri
    }
 }
 
+int CUDT::epoll_uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut)
+{
+   try
+   {
+      return s_UDTUnited.epoll_uwait(eid, events, maxevents, msTimeOut);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
+int CUDT::epoll_getfd(const int eid)
+{
+   try
+   {
+      return s_UDTUnited.epoll_getfd(eid);
+   }
+   catch (CUDTException e)
+   {
+      s_UDTUnited.setError(new CUDTException(e));
+      return ERROR;
+   }
+   catch (...)
+   {
+      s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+      return ERROR;
+   }
+}
+
 int CUDT::epoll_release(const int eid)
 {
    try
@@ -2300,7 +2870,7 @@ int CUDT::perfmon(UDTSOCKET u, CPerfMon* perf, bool clear)
 {
    try
    {
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       udt->sample(perf, clear);
       return 0;
    }
@@ -2341,18 +2911,34 @@ UDTSTATUS CUDT::getsockstate(UDTSOCKET u)
    }
 }
 
+int CUDT::setmemlimit(int64_t limit)
+{
+   if (limit < 0)
+   {
+      s_UDTUnited.setError(new CUDTException(5, 3, 0));
+      return ERROR;
+   }
+
+   CMemBudget::setLimit(limit);
+   return 0;
+}
+
+int64_t CUDT::getmemusage()
+{
+   return CMemBudget::getUsage();
+}
+
 #ifdef USE_LIBNICE
 int CUDT::getICEInfo(UDTSOCKET u, std::string& ufrag, std::string& pwd,
                      std::vector<std::string>& candidates)
 {
    try
    {
-       CUDT* udt = s_UDTUnited.lookup(u);
+       CUDTUnited::CPinned udt(s_UDTUnited, u);
        if (NULL == udt->m_pSndQueue)
        {
-           CUDTSocket* socket = s_UDTUnited.locate(u);
            udt->open();
-           s_UDTUnited.updateMux(socket);
+           s_UDTUnited.updateMux(udt.socket());
        }
        udt->m_pSndQueue->m_pChannel->waitForCandidates();
        int r1 = udt->m_pSndQueue->m_pChannel->getLocalCredentials(ufrag, pwd);
@@ -2376,12 +2962,11 @@ int CUDT::setICEInfo(UDTSOCKET u, const std::string& ufrag, const std::string& p
 {
    try
    {
-       CUDT* udt = s_UDTUnited.lookup(u);
+       CUDTUnited::CPinned udt(s_UDTUnited, u);
        if (NULL == udt->m_pSndQueue)
        {
-           CUDTSocket* socket = s_UDTUnited.locate(u);
            udt->open();
-           s_UDTUnited.updateMux(socket);
+           s_UDTUnited.updateMux(udt.socket());
        }
        int r1 = udt->m_pSndQueue->m_pChannel->setRemoteCredentials(ufrag, pwd);
        int r2 = udt->m_pSndQueue->m_pChannel->setRemoteCandidates(candidates);
@@ -2406,7 +2991,7 @@ int CUDT::setICESTUNServer(UDTSOCKET u, const std::string& server, int port)
       if (!server.empty() && ((port < 0) || (port > 65535)))
          throw CUDTException(5, 3, 0);
 
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       if (server.empty())
       {
          udt->m_bHasStunServer = false;
@@ -2445,7 +3030,7 @@ int CUDT::setICETURNServer(UDTSOCKET u, const std::string& server, int port,
       if (!server.empty() && ((port < 0) || (port > 65535)))
          throw CUDTException(5, 3, 0);
 
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
       if (server.empty())
       {
          udt->m_bHasTurnRelay = false;
@@ -2499,7 +3084,7 @@ int CUDT::setICEPortRange(UDTSOCKET u, int min_port, int max_port)
       if ((min_port > 0) && (min_port > max_port))
          throw CUDTException(5, 3, 0);
 
-      CUDT* udt = s_UDTUnited.lookup(u);
+      CUDTUnited::CPinned udt(s_UDTUnited, u);
 
       if (udt->m_pSndQueue && udt->m_pSndQueue->m_pChannel)
          throw CUDTException(5, 3, 0);
@@ -2623,6 +3208,41 @@ int recvmsg(UDTSOCKET u, char* buf, int len)
    return CUDT::recvmsg(u, buf, len);
 }
 
+int sendzc(UDTSOCKET u, const char* buf, int len, UDT_RELEASE_CB release, void* arg, int ttl, bool inorder)
+{
+   return CUDT::sendzc(u, buf, len, release, arg, ttl, inorder);
+}
+
+int recvzc(UDTSOCKET u, UDTIOVEC* iov, int* iovcnt, int* token)
+{
+   return CUDT::recvzc(u, iov, iovcnt, token);
+}
+
+int release(UDTSOCKET u, int token)
+{
+   return CUDT::release(u, token);
+}
+
+int sendv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags)
+{
+   return CUDT::sendv(u, iov, iovcnt, flags);
+}
+
+int recvv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags)
+{
+   return CUDT::recvv(u, iov, iovcnt, flags);
+}
+
+int sendmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int ttl, bool inorder)
+{
+   return CUDT::sendmsgv(u, iov, iovcnt, ttl, inorder);
+}
+
+int recvmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt)
+{
+   return CUDT::recvmsgv(u, iov, iovcnt);
+}
+
 int64_t sendfile(UDTSOCKET u, fstream& ifs, int64_t& offset, int64_t size, int block)
 {
    return CUDT::sendfile(u, ifs, offset, size, block);
@@ -2633,6 +3253,28 @@ int64_t recvfile(UDTSOCKET u, fstream& ofs, int64_t& offset, int64_t size, int b
    return CUDT::recvfile(u, ofs, offset, size, block);
 }
 
+#ifndef WIN32
+int64_t sendfile_fd(UDTSOCKET u, int fd, int64_t* offset, int64_t size, int block)
+{
+   return CUDT::sendfile_fd(u, fd, *offset, size, block);
+}
+
+int64_t recvfile_fd(UDTSOCKET u, int fd, int64_t* offset, int64_t size, int block)
+{
+   return CUDT::recvfile_fd(u, fd, *offset, size, block);
+}
+
+int64_t sendfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, int block)
+{
+   return CUDT::sendfile_striped(socks, n, fd, size, block);
+}
+
+int64_t recvfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal, int block)
+{
+   return CUDT::recvfile_striped(socks, n, fd, size, journal, block);
+}
+#endif
+
 int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block)
 {
    fstream ifs(path, ios::binary | ios::in);
@@ -2739,6 +3381,16 @@ int epoll_wait2(int eid, UDTSOCKET* readfds, int* rnum, UDTSOCKET* writefds, int
    return ret;
 }
 
+int epoll_uwait(int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut)
+{
+   return CUDT::epoll_uwait(eid, events, maxevents, msTimeOut);
+}
+
+int epoll_getfd(int eid)
+{
+   return CUDT::epoll_getfd(eid);
+}
+
 int epoll_release(int eid)
 {
    return CUDT::epoll_release(eid);
@@ -2799,4 +3451,14 @@ UDTSTATUS getsockstate(UDTSOCKET u)
    return CUDT::getsockstate(u);
 }
 
+int setmemlimit(int64_t limit)
+{
+   return CUDT::setmemlimit(limit);
+}
+
+int64_t getmemusage()
+{
+   return CUDT::getmemusage();
+}
+
 }  // namespace UDT
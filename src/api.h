@@ -90,6 +90,8 @@ public:
 
    int m_iMuxID;                             // multiplexer ID
 
+   int m_iPinCount;                          // API calls currently using this socket, guarded by its CSocketIndex shard lock
+
 #ifdef WIN32
    HANDLE m_ControlLock;            // lock this socket exclusively for control APIs: bind/listen/connect
 #else
@@ -103,6 +105,103 @@ private:
 
 ////////////////////////////////////////////////////////////////////////////////
 
+class CSocketIndex
+{
+public:
+   CSocketIndex();
+   ~CSocketIndex();
+
+public:
+
+      // Functionality:
+      //    publish a socket so that find() can return it.
+      // Parameters:
+      //    0) [in] u: socket ID.
+      //    1) [in] s: socket structure.
+      // Returned value:
+      //    None.
+
+   void insert(const UDTSOCKET u, CUDTSocket* s);
+
+      // Functionality:
+      //    withdraw a socket; find() stops returning it once this call returns.
+      // Parameters:
+      //    0) [in] u: socket ID.
+      // Returned value:
+      //    None.
+
+   void erase(const UDTSOCKET u);
+
+      // Functionality:
+      //    withdraw all sockets.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void clear();
+
+      // Functionality:
+      //    look up a socket by ID, locking only the shard the ID hashes to.
+      // Parameters:
+      //    0) [in] u: socket ID.
+      // Returned value:
+      //    the socket if it is published and not CLOSED, otherwise NULL.
+
+   CUDTSocket* find(const UDTSOCKET u);
+
+      // Functionality:
+      //    look up a socket like find() and hold it against reclamation until unpin() is called.
+      // Parameters:
+      //    0) [in] u: socket ID.
+      // Returned value:
+      //    the pinned socket, or NULL if it is not published or is CLOSED.
+
+   CUDTSocket* pin(const UDTSOCKET u);
+
+      // Functionality:
+      //    release a socket returned by pin().
+      // Parameters:
+      //    0) [in] s: socket structure.
+      // Returned value:
+      //    None.
+
+   void unpin(CUDTSocket* s);
+
+      // Functionality:
+      //    check if any API call still holds a socket through pin().
+      // Parameters:
+      //    0) [in] s: socket structure.
+      // Returned value:
+      //    true if the socket is pinned.
+
+   bool pinned(CUDTSocket* s);
+
+private:
+   static const int m_iShardNum = 64;      // must be a power of 2; socket IDs are sequential, so the low bits spread them
+
+   struct CShard
+   {
+      std::map<UDTSOCKET, CUDTSocket*> m_Sockets;
+   #ifdef WIN32
+      HANDLE m_Lock;
+   #else
+      pthread_mutex_t m_Lock;
+   #endif
+      char m_pcPad[64];                    // keep neighbouring shard locks off the same cache line
+   };
+
+   CShard m_pShards[m_iShardNum];
+
+   CShard& shard(const UDTSOCKET u) {return m_pShards[u & (m_iShardNum - 1)];}
+
+private:
+   CSocketIndex(const CSocketIndex&);
+   CSocketIndex& operator=(const CSocketIndex&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 class CUDTUnited
 {
 friend class CUDT;
@@ -112,6 +211,25 @@ public:
    CUDTUnited();
    ~CUDTUnited();
 
+public:
+   class CPinned                             // keeps a socket from being reclaimed while an API call uses it
+   {
+   public:
+      CPinned(CUDTUnited& owner, const UDTSOCKET u);
+      ~CPinned();
+
+      CUDT* operator->() const {return m_pSocket->m_pUDT;}
+      CUDTSocket* socket() const {return m_pSocket;}
+
+   private:
+      CUDTUnited& m_Owner;
+      CUDTSocket* m_pSocket;
+
+   private:
+      CPinned(const CPinned&);
+      CPinned& operator=(const CPinned&);
+   };
+
 public:
 
       // Functionality:
@@ -189,6 +307,8 @@ public:
    int epoll_remove_usock(const int eid, const UDTSOCKET u);
    int epoll_remove_ssock(const int eid, const SYSSOCKET s);
    int epoll_wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds = NULL, std::set<SYSSOCKET>* lwfds = NULL);
+   int epoll_uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut);
+   int epoll_getfd(const int eid);
    int epoll_release(const int eid);
 
       // Functionality:
@@ -214,13 +334,14 @@ private:
 
 private:
    std::map<UDTSOCKET, CUDTSocket*> m_Sockets;       // stores all the socket structures
+   CSocketIndex m_SocketIndex;                       // sharded copy of m_Sockets for lock-light lookup on the data path
 
 #ifdef WIN32
-   HANDLE m_ControlLock;                    // used to synchronize UDT API
+   HANDLE m_ControlLock;                    // used to synchronize UDT API; writers of m_SocketIndex also hold it
 
    HANDLE m_IDLock;                         // used to synchronize ID generation
 #else
-   pthread_mutex_t m_ControlLock;                    // used to synchronize UDT API
+   pthread_mutex_t m_ControlLock;                    // used to synchronize UDT API; writers of m_SocketIndex also hold it
 
    pthread_mutex_t m_IDLock;                         // used to synchronize ID generation
 #endif
@@ -243,11 +364,13 @@ private:
    void connect_complete(const UDTSOCKET u);
    CUDTSocket* locate(const UDTSOCKET u);
    CUDTSocket* locate(const sockaddr* peer, const UDTSOCKET id, int32_t isn);
+   void unpin(const std::vector<CUDTSocket*>& sockets);
    void updateMux(CUDTSocket* s, const sockaddr* addr = NULL, const UDPSOCKET* = NULL);
    void updateMux(CUDTSocket* s, const CUDTSocket* ls);
 
 private:
    std::map<int, CMultiplexer> m_mMultiplexer;		// UDP multiplexer
+   std::vector<CMultiplexer> m_vRetiredMux;		// multiplexers whose last socket was removed, waiting to be shut down
 #ifdef WIN32
    HANDLE m_MultiplexerLock;
 #else
@@ -272,6 +395,7 @@ private:
    #endif
    int m_iInstanceCount;				// number of startup() called by application
    bool m_bGCStatus;					// if the GC thread is working (true)
+   bool m_bGCPending;					// close() has queued work for the GC since its last wait, guarded by m_GCStopLock
 
    #ifdef WIN32
    HANDLE m_GCThread;
@@ -286,8 +410,12 @@ private:
 
    std::map<UDTSOCKET, CUDTSocket*> m_ClosedSockets;   // temporarily store closed sockets
 
-   void checkBrokenSockets();
+   bool checkBrokenSockets(const bool scan);
+   bool reclaimable(CUDTSocket* s);
    void removeSocket(const UDTSOCKET u);
+   void wakeGC();
+
+   static const uint64_t m_ullReclaimPoll = 10000;     // GC interval (us) while closed sockets are waiting to be removed
 
 private:
    CEPoll m_EPoll;                                     // handling epoll data structures and events
@@ -38,6 +38,11 @@ written by
    Yunhong Gu, last updated 03/12/2011
 *****************************************************************************/
 
+#ifndef WIN32
+   #include <unistd.h>
+   #include <limits.h>
+   #include <sys/mman.h>
+#endif
 #include <cstring>
 #include <cmath>
 #include "buffer.h"
@@ -47,43 +52,41 @@ using namespace std;
 CSndBuffer::CSndBuffer(int size, int mss):
 m_BufLock(),
 m_pBlock(NULL),
-m_pFirstBlock(NULL),
-m_pCurrBlock(NULL),
-m_pLastBlock(NULL),
+m_iFirstBlock(0),
+m_iCurrBlock(0),
+m_iLastBlock(0),
+m_iMask(0),
 m_pBuffer(NULL),
 m_iNextMsgNo(1),
-m_iSize(size),
+m_iSize(1),
 m_iMSS(mss),
-m_iCount(0)
+m_iCount(0),
+m_iReleaseCount(0)
 {
+   // the ring is addressed by masking, round its size up to a power of 2
+   while (m_iSize < size)
+      m_iSize <<= 1;
+   m_iMask = m_iSize - 1;
+
    // initial physical buffer of "size"
    m_pBuffer = new Buffer;
    m_pBuffer->m_pcData = new char [m_iSize * m_iMSS];
    m_pBuffer->m_iSize = m_iSize;
    m_pBuffer->m_pNext = NULL;
+   CMemBudget::reserve(int64_t(m_iSize) * m_iMSS, true);
 
-   // circular linked list for out bound packets
-   m_pBlock = new Block;
-   Block* pb = m_pBlock;
-   for (int i = 1; i < m_iSize; ++ i)
-   {
-      pb->m_pNext = new Block;
-      pb->m_iMsgNo = 0;
-      pb = pb->m_pNext;
-   }
-   pb->m_pNext = m_pBlock;
-
-   pb = m_pBlock;
+   // ring of out bound packets
+   m_pBlock = new Block [m_iSize];
    char* pc = m_pBuffer->m_pcData;
    for (int i = 0; i < m_iSize; ++ i)
    {
-      pb->m_pcData = pc;
-      pb = pb->m_pNext;
+      m_pBlock[i].m_pcData = pc;
+      m_pBlock[i].m_pcUserData = NULL;
+      m_pBlock[i].m_pRelease = NULL;
+      m_pBlock[i].m_iMsgNo = 0;
       pc += m_iMSS;
    }
 
-   m_pFirstBlock = m_pCurrBlock = m_pLastBlock = m_pBlock;
-
    #ifndef WIN32
       pthread_mutex_init(&m_BufLock, NULL);
    #else
@@ -93,19 +96,26 @@ m_iCount(0)
 
 CSndBuffer::~CSndBuffer()
 {
-   Block* pb = m_pBlock->m_pNext;
-   while (pb != m_pBlock)
+   // user buffers that have not been acknowledged are given back as well
+   Release* list = NULL;
+   for (int i = 0; (i < m_iSize) && (m_iReleaseCount > 0); ++ i)
    {
-      Block* temp = pb;
-      pb = pb->m_pNext;
-      delete temp;
+      if (NULL != m_pBlock[i].m_pRelease)
+      {
+         m_pBlock[i].m_pRelease->m_pNext = list;
+         list = m_pBlock[i].m_pRelease;
+         -- m_iReleaseCount;
+      }
    }
-   delete m_pBlock;
+   release(list);
+
+   delete [] m_pBlock;
 
    while (m_pBuffer != NULL)
    {
       Buffer* temp = m_pBuffer;
       m_pBuffer = m_pBuffer->m_pNext;
+      CMemBudget::release(int64_t(temp->m_iSize) * m_iMSS);
       delete [] temp->m_pcData;
       delete temp;
    }
@@ -117,7 +127,7 @@ CSndBuffer::~CSndBuffer()
    #endif
 }
 
-void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
+void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order, UDT_RELEASE_CB release, void* arg)
 {
    int size = len / m_iMSS;
    if ((len % m_iMSS) != 0)
@@ -131,14 +141,22 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
    int32_t inorder = order;
    inorder <<= 29;
 
-   Block* s = m_pLastBlock;
+   int pos = m_iLastBlock;
    for (int i = 0; i < size; ++ i)
    {
+      Block* s = m_pBlock + pos;
+
       int pktlen = len - i * m_iMSS;
       if (pktlen > m_iMSS)
          pktlen = m_iMSS;
 
-      memcpy(s->m_pcData, data + i * m_iMSS, pktlen);
+      if (NULL == release)
+      {
+         memcpy(s->m_pcData, data + i * m_iMSS, pktlen);
+         s->m_pcUserData = NULL;
+      }
+      else
+         s->m_pcUserData = data + i * m_iMSS;
       s->m_iLength = pktlen;
 
       s->m_iMsgNo = m_iNextMsgNo | inorder;
@@ -150,11 +168,92 @@ void CSndBuffer::addBuffer(const char* data, int len, int ttl, bool order)
       s->m_OriginTime = time;
       s->m_iTTL = ttl;
 
-      s = s->m_pNext;
+      pos = (pos + 1) & m_iMask;
+   }
+
+   if (NULL != release)
+   {
+      Release* r = new Release;
+      r->m_pCallback = release;
+      r->m_pArg = arg;
+      r->m_pcData = data;
+      r->m_iLength = len;
+      r->m_pNext = NULL;
+      m_pBlock[(pos - 1) & m_iMask].m_pRelease = r;
    }
-   m_pLastBlock = s;
 
    CGuard::enterCS(m_BufLock);
+   m_iLastBlock = pos;
+   m_iCount += size;
+   if (NULL != release)
+      ++ m_iReleaseCount;
+   CGuard::leaveCS(m_BufLock);
+
+   m_iNextMsgNo ++;
+   if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
+      m_iNextMsgNo = 1;
+}
+
+void CSndBuffer::addBuffer(const UDTIOVEC* iov, int iovcnt, int len, int ttl, bool order)
+{
+   int size = len / m_iMSS;
+   if ((len % m_iMSS) != 0)
+      size ++;
+
+   // dynamically increase sender buffer
+   while (size + m_iCount >= m_iSize)
+      increase();
+
+   uint64_t time = CTimer::getTime();
+   int32_t inorder = order;
+   inorder <<= 29;
+
+   // packets are filled across the segment boundaries, so they are as large as with a single user buffer
+   int seg = 0;
+   int segoff = 0;
+
+   int pos = m_iLastBlock;
+   for (int i = 0; i < size; ++ i)
+   {
+      Block* s = m_pBlock + pos;
+
+      int pktlen = len - i * m_iMSS;
+      if (pktlen > m_iMSS)
+         pktlen = m_iMSS;
+
+      for (int copied = 0; (copied < pktlen) && (seg < iovcnt); )
+      {
+         int seglen = int(iov[seg].iov_len) - segoff;
+         if (seglen > pktlen - copied)
+            seglen = pktlen - copied;
+
+         memcpy(s->m_pcData + copied, (const char*)iov[seg].iov_base + segoff, seglen);
+         copied += seglen;
+         segoff += seglen;
+
+         if (segoff == int(iov[seg].iov_len))
+         {
+            ++ seg;
+            segoff = 0;
+         }
+      }
+      s->m_pcUserData = NULL;
+      s->m_iLength = pktlen;
+
+      s->m_iMsgNo = m_iNextMsgNo | inorder;
+      if (i == 0)
+         s->m_iMsgNo |= 0x80000000;
+      if (i == size - 1)
+         s->m_iMsgNo |= 0x40000000;
+
+      s->m_OriginTime = time;
+      s->m_iTTL = ttl;
+
+      pos = (pos + 1) & m_iMask;
+   }
+
+   CGuard::enterCS(m_BufLock);
+   m_iLastBlock = pos;
    m_iCount += size;
    CGuard::leaveCS(m_BufLock);
 
@@ -173,13 +272,15 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
    while (size + m_iCount >= m_iSize)
       increase();
 
-   Block* s = m_pLastBlock;
+   int pos = m_iLastBlock;
    int total = 0;
    for (int i = 0; i < size; ++ i)
    {
       if (ifs.bad() || ifs.fail() || ifs.eof())
          break;
 
+      Block* s = m_pBlock + pos;
+
       int pktlen = len - i * m_iMSS;
       if (pktlen > m_iMSS)
          pktlen = m_iMSS;
@@ -187,6 +288,7 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
       ifs.read(s->m_pcData, pktlen);
       if ((pktlen = ifs.gcount()) <= 0)
          break;
+      s->m_pcUserData = NULL;
 
       // currently file transfer is only available in streaming mode, message is always in order, ttl = infinite
       s->m_iMsgNo = m_iNextMsgNo | 0x20000000;
@@ -197,13 +299,13 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
 
       s->m_iLength = pktlen;
       s->m_iTTL = -1;
-      s = s->m_pNext;
+      pos = (pos + 1) & m_iMask;
 
       total += pktlen;
    }
-   m_pLastBlock = s;
 
    CGuard::enterCS(m_BufLock);
+   m_iLastBlock = pos;
    m_iCount += size;
    CGuard::leaveCS(m_BufLock);
 
@@ -214,50 +316,151 @@ int CSndBuffer::addBufferFromFile(fstream& ifs, int len)
    return total;
 }
 
+#ifndef WIN32
+int CSndBuffer::addBufferFromFile(int fd, int64_t offset, int len, bool map)
+{
+   if (map)
+   {
+      // map from the page boundary, the blocks reference the pages until they are acknowledged
+      int64_t pagesize = sysconf(_SC_PAGESIZE);
+      int64_t start = offset - offset % pagesize;
+      int flags = MAP_SHARED;
+      #ifdef MAP_POPULATE
+         flags |= MAP_POPULATE;
+      #endif
+
+      void* base = mmap(NULL, size_t(offset - start + len), PROT_READ, flags, fd, start);
+      if (MAP_FAILED != base)
+      {
+         addBuffer((char*)base + (offset - start), len, -1, true, unmapFile, base);
+         return len;
+      }
+   }
+
+   int size = len / m_iMSS;
+   if ((len % m_iMSS) != 0)
+      size ++;
+
+   // dynamically increase sender buffer
+   while (size + m_iCount >= m_iSize)
+      increase();
+
+   // read straight into the blocks, as many as a system call can take at a time
+   iovec iov[IOV_MAX];
+   int total = 0;
+   while (total < len)
+   {
+      int n = 0;
+      int bytes = 0;
+      for (int pos = (m_iLastBlock + total / m_iMSS) & m_iMask; (n < IOV_MAX) && (total + bytes < len); pos = (pos + 1) & m_iMask)
+      {
+         iov[n].iov_base = m_pBlock[pos].m_pcData;
+         iov[n].iov_len = (len - total - bytes > m_iMSS) ? m_iMSS : len - total - bytes;
+         bytes += iov[n].iov_len;
+         ++ n;
+      }
+
+      ssize_t res = preadv(fd, iov, n, offset + total);
+      if (res < 0)
+      {
+         if (0 == total)
+            return -1;
+         break;
+      }
+
+      total += res;
+      if (res < bytes)
+         break;
+   }
+
+   if (0 == total)
+      return 0;
+
+   size = total / m_iMSS;
+   if ((total % m_iMSS) != 0)
+      size ++;
+
+   int pos = m_iLastBlock;
+   for (int i = 0; i < size; ++ i)
+   {
+      Block* s = m_pBlock + pos;
+
+      int pktlen = total - i * m_iMSS;
+      if (pktlen > m_iMSS)
+         pktlen = m_iMSS;
+
+      s->m_pcUserData = NULL;
+
+      // currently file transfer is only available in streaming mode, message is always in order, ttl = infinite
+      s->m_iMsgNo = m_iNextMsgNo | 0x20000000;
+      if (i == 0)
+         s->m_iMsgNo |= 0x80000000;
+      if (i == size - 1)
+         s->m_iMsgNo |= 0x40000000;
+
+      s->m_iLength = pktlen;
+      s->m_iTTL = -1;
+      pos = (pos + 1) & m_iMask;
+   }
+
+   CGuard::enterCS(m_BufLock);
+   m_iLastBlock = pos;
+   m_iCount += size;
+   CGuard::leaveCS(m_BufLock);
+
+   m_iNextMsgNo ++;
+   if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
+      m_iNextMsgNo = 1;
+
+   return total;
+}
+
+void CSndBuffer::unmapFile(const char* data, int len, void* arg)
+{
+   munmap(arg, data + len - (char*)arg);
+}
+#endif
+
 int CSndBuffer::readData(char** data, int32_t& msgno)
 {
+   CGuard bufferguard(m_BufLock);
+
    // No data to read
-   if (m_pCurrBlock == m_pLastBlock)
+   if (m_iCurrBlock == m_iLastBlock)
       return 0;
 
-   *data = m_pCurrBlock->m_pcData;
-   int readlen = m_pCurrBlock->m_iLength;
-   msgno = m_pCurrBlock->m_iMsgNo;
+   Block* p = m_pBlock + m_iCurrBlock;
+   *data = (NULL != p->m_pcUserData) ? (char*)p->m_pcUserData : p->m_pcData;
+   int readlen = p->m_iLength;
+   msgno = p->m_iMsgNo;
 
-   m_pCurrBlock = m_pCurrBlock->m_pNext;
+   m_iCurrBlock = (m_iCurrBlock + 1) & m_iMask;
 
    return readlen;
 }
 
-int CSndBuffer::readData(char** data, const int offset, int32_t& msgno, int& msglen)
+int CSndBuffer::readData(char** data, const int offset, int32_t& msgno, int& msglen, uint64_t margin)
 {
    CGuard bufferguard(m_BufLock);
 
-   Block* p = m_pFirstBlock;
-
-   for (int i = 0; i < offset; ++ i)
-      p = p->m_pNext;
+   int pos = (m_iFirstBlock + offset) & m_iMask;
+   Block* p = m_pBlock + pos;
 
-   if ((p->m_iTTL >= 0) && ((CTimer::getTime() - p->m_OriginTime) / 1000 > (uint64_t)p->m_iTTL))
+   if ((p->m_iTTL >= 0) && ((CTimer::getTime() + margin - p->m_OriginTime) / 1000 > (uint64_t)p->m_iTTL))
    {
       msgno = p->m_iMsgNo & 0x1FFFFFFF;
-
-      msglen = 1;
-      p = p->m_pNext;
-      bool move = false;
-      while (msgno == (p->m_iMsgNo & 0x1FFFFFFF))
-      {
-         if (p == m_pCurrBlock)
-            move = true;
-         p = p->m_pNext;
-         if (move)
-            m_pCurrBlock = p;
-         msglen ++;
-      }
-
+      msglen = skipMsg(pos, m_iCount - offset);
       return -1;
    }
 
+   // the packet is sent after the lock is released and an ACK may give the user buffer back in between,
+   // so a retransmission reads a copy; the first transmission cannot be acknowledged before it is sent
+   if (NULL != p->m_pcUserData)
+   {
+      memcpy(p->m_pcData, p->m_pcUserData, p->m_iLength);
+      p->m_pcUserData = NULL;
+   }
+
    *data = p->m_pcData;
    int readlen = p->m_iLength;
    msgno = p->m_iMsgNo;
@@ -265,15 +468,141 @@ int CSndBuffer::readData(char** data, const int offset, int32_t& msgno, int& msg
    return readlen;
 }
 
-void CSndBuffer::ackData(int offset)
+int CSndBuffer::dropExpired(int offset, int limit, int32_t& msgno)
 {
    CGuard bufferguard(m_BufLock);
 
-   for (int i = 0; i < offset; ++ i)
-      m_pFirstBlock = m_pFirstBlock->m_pNext;
+   // a message none of whose packets has been sent is removed by dropUnsent()
+   if (offset >= ((m_iCurrBlock - m_iFirstBlock) & m_iMask))
+      return 0;
+
+   int pos = (m_iFirstBlock + offset) & m_iMask;
+   Block* p = m_pBlock + pos;
+
+   if ((p->m_iTTL < 0) || ((CTimer::getTime() - p->m_OriginTime) / 1000 <= (uint64_t)p->m_iTTL))
+      return 0;
+
+   msgno = p->m_iMsgNo & 0x1FFFFFFF;
+   return skipMsg(pos, limit - offset);
+}
+
+int CSndBuffer::dropUnsent(uint64_t margin, uint64_t interval)
+{
+   Release* list = NULL;
+   Release** tail = &list;
+   int dropped = 0;
+
+   CGuard::enterCS(m_BufLock);
+
+   uint64_t currtime = CTimer::getTime();
+
+   while (m_iCurrBlock != m_iLastBlock)
+   {
+      // a message partly sent is dropped by its sequence numbers
+      Block* p = m_pBlock + m_iCurrBlock;
+      if ((p->m_iTTL < 0) || (0 == (p->m_iMsgNo & 0x80000000)))
+         break;
+
+      int32_t msgno = p->m_iMsgNo & 0x1FFFFFFF;
+      int msglen = 0;
+      for (int i = m_iCurrBlock; (i != m_iLastBlock) && (msgno == (m_pBlock[i].m_iMsgNo & 0x1FFFFFFF)); i = (i + 1) & m_iMask)
+         ++ msglen;
+
+      // the message is not started if its last packet cannot reach the receiver in time
+      if ((currtime + margin + msglen * interval - p->m_OriginTime) / 1000 <= (uint64_t)p->m_iTTL)
+         break;
+
+      for (int i = 0; i < msglen; ++ i)
+      {
+         Block* b = m_pBlock + ((m_iCurrBlock + i) & m_iMask);
+         if (NULL != b->m_pRelease)
+         {
+            *tail = b->m_pRelease;
+            tail = &(b->m_pRelease->m_pNext);
+            b->m_pRelease = NULL;
+            -- m_iReleaseCount;
+         }
+      }
+
+      // the sent blocks move up over the gap, so they keep their offsets from the first block; the blocks after
+      // the message stay in place, as data may be added after them meanwhile
+      int sent = (m_iCurrBlock - m_iFirstBlock) & m_iMask;
+      for (int i = sent - 1; i >= 0; -- i)
+      {
+         Block tmp = m_pBlock[(m_iFirstBlock + i) & m_iMask];
+         m_pBlock[(m_iFirstBlock + i) & m_iMask] = m_pBlock[(m_iFirstBlock + i + msglen) & m_iMask];
+         m_pBlock[(m_iFirstBlock + i + msglen) & m_iMask] = tmp;
+      }
+      m_iFirstBlock = (m_iFirstBlock + msglen) & m_iMask;
+      m_iCurrBlock = (m_iCurrBlock + msglen) & m_iMask;
+
+      m_iCount -= msglen;
+      dropped += msglen;
+   }
+
+   CGuard::leaveCS(m_BufLock);
+
+   release(list);
+
+   return dropped;
+}
+
+int CSndBuffer::skipMsg(int pos, int limit)
+{
+   int32_t msgno = m_pBlock[pos].m_iMsgNo & 0x1FFFFFFF;
+
+   int msglen = 0;
+   for (int i = pos; (i != m_iLastBlock) && (msgno == (m_pBlock[i].m_iMsgNo & 0x1FFFFFFF)); i = (i + 1) & m_iMask)
+      ++ msglen;
+
+   if (msglen > limit)
+      return 0;
+
+   // the blocks not sent yet are never sent
+   for (int i = 0; i < msglen; ++ i)
+   {
+      if (((pos + i) & m_iMask) == m_iCurrBlock)
+      {
+         m_iCurrBlock = (pos + msglen) & m_iMask;
+         break;
+      }
+   }
+
+   return msglen;
+}
+
+void CSndBuffer::ackData(int offset)
+{
+   Release* list = NULL;
+
+   CGuard::enterCS(m_BufLock);
+
+   // collect the user buffers that are completely acknowledged, in the order they were added
+   if (m_iReleaseCount > 0)
+   {
+      Release** tail = &list;
+      for (int i = 0; i < offset; ++ i)
+      {
+         Block* p = m_pBlock + ((m_iFirstBlock + i) & m_iMask);
+         if (NULL != p->m_pRelease)
+         {
+            *tail = p->m_pRelease;
+            tail = &(p->m_pRelease->m_pNext);
+            p->m_pRelease = NULL;
+            -- m_iReleaseCount;
+         }
+      }
+   }
+
+   m_iFirstBlock = (m_iFirstBlock + offset) & m_iMask;
 
    m_iCount -= offset;
 
+   CGuard::leaveCS(m_BufLock);
+
+   // the callbacks may take time, do not hold the buffer meanwhile
+   release(list);
+
    CTimer::triggerEvent();
 }
 
@@ -282,93 +611,190 @@ int CSndBuffer::getCurrBufSize() const
    return m_iCount;
 }
 
+void CSndBuffer::release(Release* list)
+{
+   while (NULL != list)
+   {
+      Release* r = list;
+      list = list->m_pNext;
+      r->m_pCallback(r->m_pcData, r->m_iLength, r->m_pArg);
+      delete r;
+   }
+}
+
 void CSndBuffer::increase()
 {
-   int unitsize = m_pBuffer->m_iSize;
+   // double the ring, so that the number of remappings is logarithmic to the window size
+   int unitsize = m_iSize;
 
    // new physical buffer
    Buffer* nbuf = NULL;
+   Block* nblk = NULL;
    try
    {
       nbuf  = new Buffer;
       nbuf->m_pcData = new char [unitsize * m_iMSS];
+      nblk = new Block [m_iSize + unitsize];
    }
    catch (...)
    {
+      if (NULL != nbuf)
+         delete [] nbuf->m_pcData;
       delete nbuf;
       throw CUDTException(3, 2, 0);
    }
    nbuf->m_iSize = unitsize;
    nbuf->m_pNext = NULL;
 
+   // the sender has checked the budget with getRoom() before adding the data
+   CMemBudget::reserve(int64_t(unitsize) * m_iMSS, true);
+
    // insert the buffer at the end of the buffer list
    Buffer* p = m_pBuffer;
    while (NULL != p->m_pNext)
       p = p->m_pNext;
    p->m_pNext = nbuf;
 
-   // new packet blocks
+   // the packet data stay in place, only the ring is remapped so that the first block is at 0
+   // and the new blocks follow the old ones
+   char* pc = nbuf->m_pcData;
+   for (int i = m_iSize; i < m_iSize + unitsize; ++ i)
+   {
+      nblk[i].m_pcData = pc;
+      nblk[i].m_pcUserData = NULL;
+      nblk[i].m_pRelease = NULL;
+      nblk[i].m_iMsgNo = 0;
+      pc += m_iMSS;
+   }
+
+   CGuard bufferguard(m_BufLock);
+
+   for (int i = 0; i < m_iSize; ++ i)
+      nblk[i] = m_pBlock[(m_iFirstBlock + i) & m_iMask];
+
+   m_iCurrBlock = (m_iCurrBlock - m_iFirstBlock) & m_iMask;
+   m_iLastBlock = (m_iLastBlock - m_iFirstBlock) & m_iMask;
+   m_iFirstBlock = 0;
+
+   delete [] m_pBlock;
+   m_pBlock = nblk;
+
+   m_iSize += unitsize;
+   m_iMask = m_iSize - 1;
+}
+
+int CSndBuffer::getRoom(int limit) const
+{
+   // one block of the ring is kept free, and the ring doubles each time it grows
+   int room = m_iSize - 1 - m_iCount;
+   int64_t headroom = CMemBudget::getHeadroom(true);
+
+   for (int64_t grow = int64_t(m_iSize) * m_iMSS; (room < limit) && (grow <= headroom); grow <<= 1)
+   {
+      room += int(grow / m_iMSS);
+      headroom -= grow;
+   }
+
+   return (room < limit) ? room : limit;
+}
+
+void CSndBuffer::trim()
+{
+   CGuard bufferguard(m_BufLock);
+
+   // the first physical buffer is the initial one, the blocks of the others are not in use while the buffer is empty
+   if ((m_iCount > 0) || (m_iReleaseCount > 0) || (NULL == m_pBuffer->m_pNext))
+      return;
+
    Block* nblk = NULL;
    try
    {
-      nblk = new Block;
+      nblk = new Block [m_pBuffer->m_iSize];
    }
    catch (...)
    {
-      delete nblk;
-      throw CUDTException(3, 2, 0);
+      return;
    }
-   Block* pb = nblk;
-   for (int i = 1; i < unitsize; ++ i)
+
+   char* pc = m_pBuffer->m_pcData;
+   for (int i = 0; i < m_pBuffer->m_iSize; ++ i)
    {
-      pb->m_pNext = new Block;
-      pb = pb->m_pNext;
+      nblk[i].m_pcData = pc;
+      nblk[i].m_pcUserData = NULL;
+      nblk[i].m_pRelease = NULL;
+      nblk[i].m_iMsgNo = 0;
+      pc += m_iMSS;
    }
 
-   // insert the new blocks onto the existing one
-   pb->m_pNext = m_pLastBlock->m_pNext;
-   m_pLastBlock->m_pNext = nblk;
-
-   pb = nblk;
-   char* pc = nbuf->m_pcData;
-   for (int i = 0; i < unitsize; ++ i)
+   for (Buffer* p = m_pBuffer->m_pNext; NULL != p; )
    {
-      pb->m_pcData = pc;
-      pb = pb->m_pNext;
-      pc += m_iMSS;
+      Buffer* temp = p;
+      p = p->m_pNext;
+      CMemBudget::release(int64_t(temp->m_iSize) * m_iMSS);
+      delete [] temp->m_pcData;
+      delete temp;
    }
+   m_pBuffer->m_pNext = NULL;
 
-   m_iSize += unitsize;
+   delete [] m_pBlock;
+   m_pBlock = nblk;
+
+   m_iFirstBlock = m_iCurrBlock = m_iLastBlock = 0;
+   m_iSize = m_pBuffer->m_iSize;
+   m_iMask = m_iSize - 1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CRcvBuffer::CRcvBuffer(CUnitQueue* queue, int bufsize):
-m_pUnit(NULL),
+CRcvBuffer::CRcvBuffer(CUnitQueue* queue, int bufsize, bool msgmode):
+m_Units(bufsize),
 m_iSize(bufsize),
 m_pUnitQueue(queue),
 m_iStartPos(0),
 m_iLastAckPos(0),
 m_iMaxPos(0),
-m_iNotch(0)
+m_iNotch(0),
+m_mLoans(),
+m_iNextToken(0),
+m_iLentCount(0),
+m_bMsgMode(msgmode),
+m_mPartialMsgs(),
+m_qReadyMsgs(),
+m_ScanLock()
 {
-   m_pUnit = new CUnit* [m_iSize];
-   for (int i = 0; i < m_iSize; ++ i)
-      m_pUnit[i] = NULL;
+   #ifndef WIN32
+      pthread_mutex_init(&m_ScanLock, NULL);
+   #else
+      m_ScanLock = CreateMutex(NULL, false, NULL);
+   #endif
 }
 
 CRcvBuffer::~CRcvBuffer()
 {
    for (int i = 0; i < m_iSize; ++ i)
    {
-      if (NULL != m_pUnit[i])
+      if ((NULL != m_Units[i]) && (4 != m_Units[i]->m_iFlag))
       {
-         m_pUnit[i]->m_iFlag = 0;
+         m_Units[i]->m_iFlag = 0;
          -- m_pUnitQueue->m_iCount;
       }
    }
 
-   delete [] m_pUnit;
+   // units still lent are reclaimed, the application must not use them after the socket is closed
+   for (map<int, vector<pair<CUnit*, int> > >::iterator i = m_mLoans.begin(); i != m_mLoans.end(); ++ i)
+   {
+      for (vector<pair<CUnit*, int> >::iterator j = i->second.begin(); j != i->second.end(); ++ j)
+      {
+         j->first->m_iFlag = 0;
+         -- m_pUnitQueue->m_iCount;
+      }
+   }
+
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_ScanLock);
+   #else
+      CloseHandle(m_ScanLock);
+   #endif
 }
 
 int CRcvBuffer::addData(CUnit* unit, int offset)
@@ -377,36 +803,53 @@ int CRcvBuffer::addData(CUnit* unit, int offset)
    if (offset > m_iMaxPos)
       m_iMaxPos = offset;
 
-   if (NULL != m_pUnit[pos])
+   if (NULL != m_Units[pos])
       return -1;
    
-   m_pUnit[pos] = unit;
+   m_Units.set(pos, unit);
 
    unit->m_iFlag = 1;
    ++ m_pUnitQueue->m_iCount;
 
+   if (m_bMsgMode && !unit->m_Packet.getMsgOrderFlag())
+      indexMsg(unit, pos);
+
    return 0;
 }
 
 int CRcvBuffer::readBuffer(char* data, int len)
 {
+   UDTIOVEC iov;
+   iov.iov_base = data;
+   iov.iov_len = len;
+
+   return readBuffer(&iov, 1);
+}
+
+int CRcvBuffer::readBuffer(const UDTIOVEC* iov, int iovcnt)
+{
+   int len = 0;
+   for (int i = 0; i < iovcnt; ++ i)
+      len += int(iov[i].iov_len);
+
    int p = m_iStartPos;
    int lastack = m_iLastAckPos;
    int rs = len;
+   int seg = 0;
+   int segoff = 0;
 
    while ((p != lastack) && (rs > 0))
    {
-      int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
+      int unitsize = m_Units[p]->m_Packet.getLength() - m_iNotch;
       if (unitsize > rs)
          unitsize = rs;
 
-      memcpy(data, m_pUnit[p]->m_Packet.m_pcData + m_iNotch, unitsize);
-      data += unitsize;
+      scatter(iov, seg, segoff, m_Units[p]->m_Packet.m_pcData + m_iNotch, unitsize);
 
-      if ((rs > unitsize) || (rs == m_pUnit[p]->m_Packet.getLength() - m_iNotch))
+      if ((rs > unitsize) || (rs == m_Units[p]->m_Packet.getLength() - m_iNotch))
       {
-         CUnit* tmp = m_pUnit[p];
-         m_pUnit[p] = NULL;
+         CUnit* tmp = m_Units[p];
+         m_Units.set(p, NULL);
          tmp->m_iFlag = 0;
          -- m_pUnitQueue->m_iCount;
 
@@ -433,18 +876,18 @@ int CRcvBuffer::readBufferToFile(fstream& ofs, int len)
 
    while ((p != lastack) && (rs > 0))
    {
-      int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
+      int unitsize = m_Units[p]->m_Packet.getLength() - m_iNotch;
       if (unitsize > rs)
          unitsize = rs;
 
-      ofs.write(m_pUnit[p]->m_Packet.m_pcData + m_iNotch, unitsize);
+      ofs.write(m_Units[p]->m_Packet.m_pcData + m_iNotch, unitsize);
       if (ofs.fail())
          break;
 
-      if ((rs > unitsize) || (rs == m_pUnit[p]->m_Packet.getLength() - m_iNotch))
+      if ((rs > unitsize) || (rs == m_Units[p]->m_Packet.getLength() - m_iNotch))
       {
-         CUnit* tmp = m_pUnit[p];
-         m_pUnit[p] = NULL;
+         CUnit* tmp = m_Units[p];
+         m_Units.set(p, NULL);
          tmp->m_iFlag = 0;
          -- m_pUnitQueue->m_iCount;
 
@@ -464,6 +907,69 @@ int CRcvBuffer::readBufferToFile(fstream& ofs, int len)
    return len - rs;
 }
 
+#ifndef WIN32
+int CRcvBuffer::readBufferToFile(int fd, int64_t offset, int len)
+{
+   iovec iov[IOV_MAX];
+   int total = 0;
+
+   while (total < len)
+   {
+      // gather the run of units that can be written at once
+      int n = 0;
+      int bytes = 0;
+      int notch = m_iNotch;
+      for (int p = m_iStartPos; (p != m_iLastAckPos) && (n < IOV_MAX) && (total + bytes < len); p = (p + 1) % m_iSize)
+      {
+         int unitsize = m_Units[p]->m_Packet.getLength() - notch;
+         if (unitsize > len - total - bytes)
+            unitsize = len - total - bytes;
+
+         iov[n].iov_base = m_Units[p]->m_Packet.m_pcData + notch;
+         iov[n].iov_len = unitsize;
+         bytes += unitsize;
+         ++ n;
+         notch = 0;
+      }
+
+      if (0 == n)
+         break;
+
+      ssize_t res = pwritev(fd, iov, n, offset + total);
+      if (res < 0)
+         return (0 == total) ? -1 : total;
+
+      // release what has been written, the rest of a unit is kept for the next write
+      for (int rs = int(res); rs > 0;)
+      {
+         int unitsize = m_Units[m_iStartPos]->m_Packet.getLength() - m_iNotch;
+         if (unitsize > rs)
+         {
+            m_iNotch += rs;
+            break;
+         }
+
+         CUnit* tmp = m_Units[m_iStartPos];
+         m_Units.set(m_iStartPos, NULL);
+         tmp->m_iFlag = 0;
+         -- m_pUnitQueue->m_iCount;
+
+         if (++ m_iStartPos == m_iSize)
+            m_iStartPos = 0;
+
+         m_iNotch = 0;
+         rs -= unitsize;
+      }
+
+      total += res;
+      if (res < bytes)
+         break;
+   }
+
+   return total;
+}
+#endif
+
 void CRcvBuffer::ackData(int len)
 {
    m_iLastAckPos = (m_iLastAckPos + len) % m_iSize;
@@ -477,7 +983,9 @@ void CRcvBuffer::ackData(int len)
 int CRcvBuffer::getAvailBufSize() const
 {
    // One slot must be empty in order to tell the difference between "empty buffer" and "full buffer"
-   return m_iSize - getRcvDataSize() - 1;
+   // the units lent to the application still count, so that the memory held per connection stays bounded
+   int size = m_iSize - getRcvDataSize() - m_iLentCount - 1;
+   return (size > 0) ? size : 0;
 }
 
 int CRcvBuffer::getRcvDataSize() const
@@ -491,40 +999,60 @@ int CRcvBuffer::getRcvDataSize() const
 void CRcvBuffer::dropMsg(int32_t msgno)
 {
    for (int i = m_iStartPos, n = (m_iLastAckPos + m_iMaxPos) % m_iSize; i != n; i = (i + 1) % m_iSize)
-      if ((NULL != m_pUnit[i]) && (msgno == m_pUnit[i]->m_Packet.m_iMsgNo))
-         m_pUnit[i]->m_iFlag = 3;
+      if ((NULL != m_Units[i]) && (4 != m_Units[i]->m_iFlag) && (msgno == m_Units[i]->m_Packet.getMsgSeq()))
+         m_Units[i]->m_iFlag = 3;
+
+   if (m_bMsgMode)
+   {
+      CGuard scanguard(m_ScanLock);
+      m_mPartialMsgs.erase(msgno);
+   }
 }
 
 int CRcvBuffer::readMsg(char* data, int len)
+{
+   UDTIOVEC iov;
+   iov.iov_base = data;
+   iov.iov_len = len;
+
+   return readMsg(&iov, 1);
+}
+
+int CRcvBuffer::readMsg(const UDTIOVEC* iov, int iovcnt)
 {
    int p, q;
    bool passack;
    if (!scanMsg(p, q, passack))
       return 0;
 
+   int len = 0;
+   for (int i = 0; i < iovcnt; ++ i)
+      len += int(iov[i].iov_len);
+
    int rs = len;
+   int seg = 0;
+   int segoff = 0;
    while (p != (q + 1) % m_iSize)
    {
-      int unitsize = m_pUnit[p]->m_Packet.getLength();
+      int unitsize = m_Units[p]->m_Packet.getLength();
       if ((rs >= 0) && (unitsize > rs))
          unitsize = rs;
 
       if (unitsize > 0)
       {
-         memcpy(data, m_pUnit[p]->m_Packet.m_pcData, unitsize);
-         data += unitsize;
+         scatter(iov, seg, segoff, m_Units[p]->m_Packet.m_pcData, unitsize);
          rs -= unitsize;
       }
 
       if (!passack)
       {
-         CUnit* tmp = m_pUnit[p];
-         m_pUnit[p] = NULL;
+         CUnit* tmp = m_Units[p];
+         m_Units.set(p, NULL);
          tmp->m_iFlag = 0;
          -- m_pUnitQueue->m_iCount;
       }
       else
-         m_pUnit[p]->m_iFlag = 2;
+         m_Units[p]->m_iFlag = 2;
 
       if (++ p == m_iSize)
          p = 0;
@@ -536,6 +1064,168 @@ int CRcvBuffer::readMsg(char* data, int len)
    return len - rs;
 }
 
+int CRcvBuffer::lendBuffer(UDTIOVEC* iov, int& iovcnt, int& token)
+{
+   CGuard scanguard(m_ScanLock);
+
+   int p = m_iStartPos;
+   int lastack = m_iLastAckPos;
+   int n = 0;
+   int size = 0;
+   vector<pair<CUnit*, int> > loan;
+
+   while ((p != lastack) && (n < iovcnt))
+   {
+      CUnit* unit = m_Units[p];
+      iov[n].iov_base = unit->m_Packet.m_pcData + m_iNotch;
+      iov[n].iov_len = unit->m_Packet.getLength() - m_iNotch;
+      size += iov[n].iov_len;
+      ++ n;
+
+      m_Units.set(p, NULL);
+      lend(unit, -1, loan);
+
+      if (++ p == m_iSize)
+         p = 0;
+
+      m_iNotch = 0;
+   }
+
+   m_iStartPos = p;
+
+   if (n > 0)
+   {
+      iovcnt = n;
+      token = m_iNextToken ++;
+      m_mLoans[token].swap(loan);
+   }
+
+   return size;
+}
+
+int CRcvBuffer::lendMsg(UDTIOVEC* iov, int& iovcnt, int& token)
+{
+   int p, q;
+   bool passack;
+   if (!scanMsg(p, q, passack))
+      return 0;
+
+   CGuard scanguard(m_ScanLock);
+
+   int n = 0;
+   int size = 0;
+   vector<pair<CUnit*, int> > loan;
+
+   while (p != (q + 1) % m_iSize)
+   {
+      CUnit* unit = m_Units[p];
+
+      if (n < iovcnt)
+      {
+         iov[n].iov_base = unit->m_Packet.m_pcData;
+         iov[n].iov_len = unit->m_Packet.getLength();
+         size += iov[n].iov_len;
+         ++ n;
+
+         // a message read before it is acknowledged stays in the buffer, as in readMsg()
+         if (!passack)
+         {
+            m_Units.set(p, NULL);
+            lend(unit, -1, loan);
+         }
+         else
+            lend(unit, p, loan);
+      }
+      else if (!passack)
+      {
+         m_Units.set(p, NULL);
+         unit->m_iFlag = 0;
+         -- m_pUnitQueue->m_iCount;
+      }
+      else
+         unit->m_iFlag = 2;
+
+      if (++ p == m_iSize)
+         p = 0;
+   }
+
+   if (!passack)
+      m_iStartPos = (q + 1) % m_iSize;
+
+   if (n > 0)
+   {
+      iovcnt = n;
+      token = m_iNextToken ++;
+      m_mLoans[token].swap(loan);
+   }
+
+   return size;
+}
+
+int CRcvBuffer::release(int token)
+{
+   CGuard scanguard(m_ScanLock);
+
+   map<int, vector<pair<CUnit*, int> > >::iterator i = m_mLoans.find(token);
+   if (i == m_mLoans.end())
+      return -1;
+
+   for (vector<pair<CUnit*, int> >::iterator j = i->second.begin(); j != i->second.end(); ++ j)
+   {
+      if ((j->second >= 0) && (m_Units[j->second] == j->first))
+      {
+         // still in the buffer as an out-of-order message, it will be freed from there
+         j->first->m_iFlag = 2;
+      }
+      else
+      {
+         j->first->m_iFlag = 0;
+         -- m_pUnitQueue->m_iCount;
+         -- m_iLentCount;
+      }
+   }
+
+   m_mLoans.erase(i);
+
+   return 0;
+}
+
+void CRcvBuffer::scatter(const UDTIOVEC* iov, int& seg, int& offset, const char* data, int len)
+{
+   while (len > 0)
+   {
+      int seglen = int(iov[seg].iov_len) - offset;
+      if (seglen > len)
+         seglen = len;
+
+      memcpy((char*)iov[seg].iov_base + offset, data, seglen);
+      data += seglen;
+      len -= seglen;
+      offset += seglen;
+
+      if (offset == int(iov[seg].iov_len))
+      {
+         ++ seg;
+         offset = 0;
+      }
+   }
+}
+
+void CRcvBuffer::lend(CUnit* unit, int pos, vector<pair<CUnit*, int> >& loan)
+{
+   unit->m_iFlag = 4;
+   loan.push_back(make_pair(unit, pos));
+   if (pos < 0)
+      ++ m_iLentCount;
+}
+
+void CRcvBuffer::trim()
+{
+   CGuard scanguard(m_ScanLock);
+
+   m_Units.trim();
+}
+
 int CRcvBuffer::getRcvMsgNum()
 {
    int p, q;
@@ -549,30 +1239,33 @@ bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
    if ((m_iStartPos == m_iLastAckPos) && (m_iMaxPos <= 0))
       return false;
 
+   // a loan may be released while the bad msgs are skipped
+   CGuard scanguard(m_ScanLock);
+
    //skip all bad msgs at the beginning
    while (m_iStartPos != m_iLastAckPos)
    {
-      if (NULL == m_pUnit[m_iStartPos])
+      if (NULL == m_Units[m_iStartPos])
       {
          if (++ m_iStartPos == m_iSize)
             m_iStartPos = 0;
          continue;
       }
 
-      if ((1 == m_pUnit[m_iStartPos]->m_iFlag) && (m_pUnit[m_iStartPos]->m_Packet.getMsgBoundary() > 1))
+      if ((1 == m_Units[m_iStartPos]->m_iFlag) && (m_Units[m_iStartPos]->m_Packet.getMsgBoundary() > 1))
       {
          bool good = true;
 
          // look ahead for the whole message
          for (int i = m_iStartPos; i != m_iLastAckPos;)
          {
-            if ((NULL == m_pUnit[i]) || (1 != m_pUnit[i]->m_iFlag))
+            if ((NULL == m_Units[i]) || (1 != m_Units[i]->m_iFlag))
             {
                good = false;
                break;
             }
 
-            if ((m_pUnit[i]->m_Packet.getMsgBoundary() == 1) || (m_pUnit[i]->m_Packet.getMsgBoundary() == 3))
+            if ((m_Units[i]->m_Packet.getMsgBoundary() == 1) || (m_Units[i]->m_Packet.getMsgBoundary() == 3))
                break;
 
             if (++ i == m_iSize)
@@ -583,70 +1276,175 @@ bool CRcvBuffer::scanMsg(int& p, int& q, bool& passack)
             break;
       }
 
-      CUnit* tmp = m_pUnit[m_iStartPos];
-      m_pUnit[m_iStartPos] = NULL;
-      tmp->m_iFlag = 0;
-      -- m_pUnitQueue->m_iCount;
+      CUnit* tmp = m_Units[m_iStartPos];
+      m_Units.set(m_iStartPos, NULL);
+
+      // a message missing a packet that was skipped will never be complete
+      if (m_bMsgMode)
+         m_mPartialMsgs.erase(tmp->m_Packet.getMsgSeq());
+
+      if (4 == tmp->m_iFlag)
+      {
+         // lent out of order, the loan gives it back
+         ++ m_iLentCount;
+      }
+      else
+      {
+         tmp->m_iFlag = 0;
+         -- m_pUnitQueue->m_iCount;
+      }
 
       if (++ m_iStartPos == m_iSize)
          m_iStartPos = 0;
    }
 
-   p = -1;                  // message head
-   q = m_iStartPos;         // message tail
-   passack = m_iStartPos == m_iLastAckPos;
-   bool found = false;
+   // drop the index entries of messages that have been read or dropped
+   while (!m_qReadyMsgs.empty())
+   {
+      CUnit* head = m_Units[m_qReadyMsgs.front().first];
+      if ((NULL != head) && (1 == head->m_iFlag) && (head->m_Packet.getMsgSeq() == m_qReadyMsgs.front().second))
+         break;
+      m_qReadyMsgs.pop_front();
+   }
 
-   // looking for the first message
-   for (int i = 0, n = m_iMaxPos + getRcvDataSize(); i <= n; ++ i)
+   // the first message can be read if it is complete before the ACK point
+   if (m_iStartPos != m_iLastAckPos)
    {
-      if ((NULL != m_pUnit[q]) && (1 == m_pUnit[q]->m_iFlag))
-      {
-         switch (m_pUnit[q]->m_Packet.getMsgBoundary())
-         {
-         case 3: // 11
-            p = q;
-            found = true;
-            break;
+      p = m_iStartPos;
+      passack = false;
 
-         case 2: // 10
-            p = q;
-            break;
+      for (q = p; q != m_iLastAckPos;)
+      {
+         if ((m_Units[q]->m_Packet.getMsgBoundary() == 1) || (m_Units[q]->m_Packet.getMsgBoundary() == 3))
+            return true;
 
-         case 1: // 01
-            if (p != -1)
-               found = true;
-         }
+         if (++ q == m_iSize)
+            q = 0;
       }
-      else
+
+      // if the message is larger than the receiver buffer, return part of the message
+      if (getRcvDataSize() == m_iSize - 1)
       {
-         // a hole in this message, not valid, restart search
-         p = -1;
+         q = (m_iLastAckPos + m_iSize - 1) % m_iSize;
+         return true;
       }
+   }
 
-      if (found)
+   // otherwise only a message allowed to be read out of order, in the order they were completed
+   while (!m_qReadyMsgs.empty())
+   {
+      p = m_qReadyMsgs.front().first;
+      if (findMsgTail(p, m_qReadyMsgs.front().second, q))
       {
-         // the msg has to be ack'ed or it is allowed to read out of order, and was not read before
-         if (!passack || !m_pUnit[q]->m_Packet.getMsgOrderFlag())
-            break;
+         // the msg has not been fully acknowledged, it stays in the buffer after being read
+         passack = (q - m_iStartPos + m_iSize) % m_iSize >= getRcvDataSize();
+         return true;
+      }
+
+      m_qReadyMsgs.pop_front();
+   }
+
+   return false;
+}
+
+bool CRcvBuffer::findMsgTail(int start, int32_t msgno, int& end) const
+{
+   for (int i = start, n = 0; n < m_iSize; ++ n)
+   {
+      const CUnit* unit = m_Units[i];
+      if ((NULL == unit) || (1 != unit->m_iFlag) || (unit->m_Packet.getMsgSeq() != msgno))
+         return false;
 
-         found = false;
+      if ((unit->m_Packet.getMsgBoundary() == 1) || (unit->m_Packet.getMsgBoundary() == 3))
+      {
+         end = i;
+         return true;
       }
 
-      if (++ q == m_iSize)
-         q = 0;
+      if (++ i == m_iSize)
+         i = 0;
+   }
 
-      if (q == m_iLastAckPos)
-         passack = true;
+   return false;
+}
+
+void CRcvBuffer::indexMsg(CUnit* unit, int pos)
+{
+   int32_t msgno = unit->m_Packet.getMsgSeq();
+   int boundary = unit->m_Packet.getMsgBoundary();
+
+   CGuard scanguard(m_ScanLock);
+
+   if (3 == boundary)
+   {
+      m_qReadyMsgs.push_back(make_pair(pos, msgno));
+      return;
    }
 
-   // no msg found
-   if (!found)
+   // count the packets of the message, it is complete when all the packets between its head and its tail are here
+   Message& msg = m_mPartialMsgs[msgno];
+   ++ msg.m_iCount;
+   if (2 == boundary)
+      msg.m_iHead = pos;
+   else if (1 == boundary)
+      msg.m_iTail = pos;
+
+   if ((msg.m_iHead >= 0) && (msg.m_iTail >= 0) && ((msg.m_iTail - msg.m_iHead + m_iSize) % m_iSize + 1 == msg.m_iCount))
    {
-      // if the message is larger than the receiver buffer, return part of the message
-      if ((p != -1) && ((q + 1) % m_iSize == p))
-         found = true;
+      m_qReadyMsgs.push_back(make_pair(msg.m_iHead, msgno));
+      m_mPartialMsgs.erase(msgno);
+   }
+}
+
+CRcvBuffer::CUnitTable::CUnitTable(int size):
+m_pPages(NULL),
+m_iPages((size + m_iPageSize - 1) >> m_iPageBits)
+{
+   m_pPages = new CUnit** [m_iPages];
+   for (int i = 0; i < m_iPages; ++ i)
+      m_pPages[i] = NULL;
+}
+
+CRcvBuffer::CUnitTable::~CUnitTable()
+{
+   for (int i = 0; i < m_iPages; ++ i)
+      delete [] m_pPages[i];
+   delete [] m_pPages;
+}
+
+void CRcvBuffer::CUnitTable::set(int pos, CUnit* unit)
+{
+   CUnit**& page = m_pPages[pos >> m_iPageBits];
+   if (NULL == page)
+   {
+      // clearing a position of a missing page is a no-op, there is nothing in it
+      if (NULL == unit)
+         return;
+
+      CUnit** p = new CUnit* [m_iPageSize];
+      for (int i = 0; i < m_iPageSize; ++ i)
+         p[i] = NULL;
+      page = p;
    }
 
-   return found;
+   page[pos & (m_iPageSize - 1)] = unit;
+}
+
+void CRcvBuffer::CUnitTable::trim()
+{
+   for (int i = 0; i < m_iPages; ++ i)
+   {
+      if (NULL == m_pPages[i])
+         continue;
+
+      int j = 0;
+      while ((j < m_iPageSize) && (NULL == m_pPages[i][j]))
+         ++ j;
+
+      if (j == m_iPageSize)
+      {
+         delete [] m_pPages[i];
+         m_pPages[i] = NULL;
+      }
+   }
 }
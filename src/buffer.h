@@ -46,6 +46,9 @@ written by
 #include "list.h"
 #include "queue.h"
 #include <fstream>
+#include <deque>
+#include <map>
+#include <vector>
 
 class CSndBuffer
 {
@@ -60,10 +63,25 @@ public:
       //    1) [in] len: size of the block.
       //    2) [in] ttl: time to live in milliseconds
       //    3) [in] order: if the block should be delivered in order, for DGRAM only
+      //    4) [in] release: if not NULL, the user data is referenced instead of copied, and released by this callback once acknowledged
+      //    5) [in] arg: user argument passed to the release callback
       // Returned value:
       //    None.
 
-   void addBuffer(const char* data, int len, int ttl = -1, bool order = false);
+   void addBuffer(const char* data, int len, int ttl = -1, bool order = false, UDT_RELEASE_CB release = NULL, void* arg = NULL);
+
+      // Functionality:
+      //    Insert the data gathered from a number of user segments into the sending list as one block.
+      // Parameters:
+      //    0) [in] iov: the user segments.
+      //    1) [in] iovcnt: number of segments.
+      //    2) [in] len: size of the block, no more than the total size of the segments.
+      //    3) [in] ttl: time to live in milliseconds
+      //    4) [in] order: if the block should be delivered in order, for DGRAM only
+      // Returned value:
+      //    None.
+
+   void addBuffer(const UDTIOVEC* iov, int iovcnt, int len, int ttl = -1, bool order = false);
 
       // Functionality:
       //    Read a block of data from file and insert it into the sending list.
@@ -75,6 +93,20 @@ public:
 
    int addBufferFromFile(std::fstream& ifs, int len);
 
+#ifndef WIN32
+      // Functionality:
+      //    Insert a block of a file into the sending list, either referencing the mapped file or read directly into the blocks.
+      // Parameters:
+      //    0) [in] fd: file descriptor.
+      //    1) [in] offset: position of the block in the file.
+      //    2) [in] len: size of the block.
+      //    3) [in] map: if the file can be mapped, i.e., it cannot change; the pages are unmapped once acknowledged.
+      // Returned value:
+      //    actual size of data added from the file, -1 on read error.
+
+   int addBufferFromFile(int fd, int64_t offset, int len, bool map);
+#endif
+
       // Functionality:
       //    Find data position to pack a DATA packet from the furthest reading point.
       // Parameters:
@@ -86,16 +118,42 @@ public:
    int readData(char** data, int32_t& msgno);
 
       // Functionality:
-      //    Find data position to pack a DATA packet for a retransmission.
+      //    Find data position to pack a DATA packet for a retransmission; the data of a zero copy send are
+      //    copied into the buffer first, as an ACK may release them while the packet is being sent.
       // Parameters:
       //    0) [out] data: the pointer to the data position.
       //    1) [in] offset: offset from the last ACK point.
       //    2) [out] msgno: message number of the packet.
       //    3) [out] msglen: length of the message
+      //    4) [in] margin: time, in microseconds, the packet still needs to reach the receiver.
       // Returned value:
-      //    Actual length of data read.
+      //    Actual length of data read, or -1 if the message expires within the margin; msglen is then the
+      //    number of its packets from the offset on.
+
+   int readData(char** data, const int offset, int32_t& msgno, int& msglen, uint64_t margin = 0);
+
+      // Functionality:
+      //    Skip the message at an offset if its time to live has expired, including its packets not sent yet.
+      // Parameters:
+      //    0) [in] offset: offset from the last ACK point.
+      //    1) [in] limit: offset the message must end before, e.g., the end of the flow window.
+      //    2) [out] msgno: message number of the expired message.
+      // Returned value:
+      //    number of packets of the expired message from the offset on, 0 if it has not expired or is not
+      //    within the limit.
 
-   int readData(char** data, const int offset, int32_t& msgno, int& msglen);
+   int dropExpired(int offset, int limit, int32_t& msgno);
+
+      // Functionality:
+      //    Remove the messages none of whose packets has been sent and that would expire before their last packet
+      //    reaches the receiver, so that they take no sequence numbers.
+      // Parameters:
+      //    0) [in] margin: time, in microseconds, a packet needs to reach the receiver.
+      //    1) [in] interval: time, in microseconds, between two packets sent.
+      // Returned value:
+      //    number of packets removed.
+
+   int dropUnsent(uint64_t margin, uint64_t interval);
 
       // Functionality:
       //    Update the ACK point and may release/unmap/return the user data according to the flag.
@@ -115,8 +173,27 @@ public:
 
    int getCurrBufSize() const;
 
+      // Functionality:
+      //    Query how many packets can be added before the buffer would have to grow beyond the global memory budget.
+      // Parameters:
+      //    0) [in] limit: number of packets wanted.
+      // Returned value:
+      //    number of packets, no more than "limit".
+
+   int getRoom(int limit) const;
+
+      // Functionality:
+      //    Shrink an empty buffer back to its initial size, releasing the blocks added by increase().
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
+
 private:
    void increase();
+   int skipMsg(int pos, int limit);
 
 private:
 #ifdef WIN32
@@ -125,22 +202,31 @@ private:
    pthread_mutex_t m_BufLock;           // used to synchronize buffer operation
 #endif
 
+   struct Release
+   {
+      UDT_RELEASE_CB m_pCallback;       // user callback
+      void* m_pArg;                     // user argument
+      const char* m_pcData;             // user buffer
+      int m_iLength;                    // size of the user buffer
+      Release* m_pNext;                 // next release in a list of acknowledged buffers
+   };
+
    struct Block
    {
       char* m_pcData;                   // pointer to the data block
+      const char* m_pcUserData;         // user data referenced by a zero copy send, NULL if the data is in m_pcData
+      Release* m_pRelease;              // release of the user buffer, on the last block of a zero copy send
       int m_iLength;                    // length of the block
 
       int32_t m_iMsgNo;                 // message number
       uint64_t m_OriginTime;            // original request time
       int m_iTTL;                       // time to live (milliseconds)
+   } *m_pBlock;                         // ring of blocks, indexed by the offset from the first block
 
-      Block* m_pNext;                   // next block
-   } *m_pBlock, *m_pFirstBlock, *m_pCurrBlock, *m_pLastBlock;
-
-   // m_pBlock:         The head pointer
-   // m_pFirstBlock:    The first block
-   // m_pCurrBlock:	The current block
-   // m_pLastBlock:     The last block (if first == last, buffer is empty)
+   int m_iFirstBlock;                   // position of the first (unacknowledged) block
+   int m_iCurrBlock;                    // position of the next block to send
+   int m_iLastBlock;                    // position after the last block (if first == last, buffer is empty)
+   int m_iMask;                         // m_iSize - 1, the size of the ring is a power of 2
 
    struct Buffer
    {
@@ -155,6 +241,13 @@ private:
    int m_iMSS;                          // maximum seqment/packet size
 
    int m_iCount;			// number of used blocks
+   int m_iReleaseCount;			// number of user buffers waiting for release
+
+private:
+   static void release(Release* list);
+#ifndef WIN32
+   static void unmapFile(const char* data, int len, void* arg);
+#endif
 
 private:
    CSndBuffer(const CSndBuffer&);
@@ -166,7 +259,7 @@ private:
 class CRcvBuffer
 {
 public:
-   CRcvBuffer(CUnitQueue* queue, int bufsize = 65536);
+   CRcvBuffer(CUnitQueue* queue, int bufsize = 65536, bool msgmode = false);
    ~CRcvBuffer();
 
       // Functionality:
@@ -189,6 +282,16 @@ public:
 
    int readBuffer(char* data, int len);
 
+      // Functionality:
+      //    Read data into a number of user segments, filling each before the next.
+      // Parameters:
+      //    0) [in] iov: the user segments.
+      //    1) [in] iovcnt: number of segments.
+      // Returned value:
+      //    size of data read.
+
+   int readBuffer(const UDTIOVEC* iov, int iovcnt);
+
       // Functionality:
       //    Read data directly into file.
       // Parameters:
@@ -199,6 +302,19 @@ public:
 
    int readBufferToFile(std::fstream& ofs, int len);
 
+#ifndef WIN32
+      // Functionality:
+      //    Write data directly into a file, a run of consecutive units per system call.
+      // Parameters:
+      //    0) [in] fd: file descriptor.
+      //    1) [in] offset: position in the file to write the data at.
+      //    2) [in] len: expected length of data to write into the file.
+      // Returned value:
+      //    size of data written, -1 on write error.
+
+   int readBufferToFile(int fd, int64_t offset, int len);
+#endif
+
       // Functionality:
       //    Update the ACK point of the buffer.
       // Parameters:
@@ -245,6 +361,47 @@ public:
 
    int readMsg(char* data, int len);
 
+      // Functionality:
+      //    read a message into a number of user segments.
+      // Parameters:
+      //    0) [in] iov: the user segments.
+      //    1) [in] iovcnt: number of segments.
+      // Returned value:
+      //    actuall size of data read; the part of the message that does not fit is discarded.
+
+   int readMsg(const UDTIOVEC* iov, int iovcnt);
+
+      // Functionality:
+      //    Lend the acknowledged data to the application instead of copying it, one packet per entry.
+      // Parameters:
+      //    0) [out] iov: pointers to the packet payloads.
+      //    1) [in, out] iovcnt: number of entries in iov; number of entries used, unchanged if nothing is lent.
+      //    2) [out] token: identifier of the loan, to be passed to release().
+      // Returned value:
+      //    size of data lent.
+
+   int lendBuffer(UDTIOVEC* iov, int& iovcnt, int& token);
+
+      // Functionality:
+      //    Lend a message to the application instead of copying it, one packet per entry.
+      // Parameters:
+      //    0) [out] iov: pointers to the packet payloads.
+      //    1) [in, out] iovcnt: number of entries in iov; number of entries used, unchanged if nothing is lent.
+      //    2) [out] token: identifier of the loan, to be passed to release().
+      // Returned value:
+      //    size of data lent; the part of the message that does not fit in iov is discarded.
+
+   int lendMsg(UDTIOVEC* iov, int& iovcnt, int& token);
+
+      // Functionality:
+      //    Give the packets of a loan back to the unit queue.
+      // Parameters:
+      //    0) [in] token: identifier of the loan.
+      // Returned value:
+      //    0 if released, -1 if there is no such loan.
+
+   int release(int token);
+
       // Functionality:
       //    Query how many messages are available now.
       // Parameters:
@@ -254,11 +411,44 @@ public:
 
    int getRcvMsgNum();
 
+      // Functionality:
+      //    Release the pages of the buffer that hold no unit; the caller excludes the reading thread.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
+
 private:
    bool scanMsg(int& start, int& end, bool& passack);
+   bool findMsgTail(int start, int32_t msgno, int& end) const;
+   void indexMsg(CUnit* unit, int pos);
+   static void scatter(const UDTIOVEC* iov, int& seg, int& offset, const char* data, int len);
+   void lend(CUnit* unit, int pos, std::vector<std::pair<CUnit*, int> >& loan);
 
 private:
-   CUnit** m_pUnit;                     // pointer to the protocol buffer
+   class CUnitTable
+   {
+   public:
+      CUnitTable(int size);
+      ~CUnitTable();
+
+      CUnit* operator[](int pos) const {CUnit** page = m_pPages[pos >> m_iPageBits]; return (NULL == page) ? NULL : page[pos & (m_iPageSize - 1)];}
+      void set(int pos, CUnit* unit);
+      void trim();
+
+   private:
+      static const int m_iPageBits = 7;
+      static const int m_iPageSize = 1 << m_iPageBits;	// number of units per page
+
+      CUnit*** m_pPages;		// pages of unit pointers, a page is allocated when the first unit is written into it
+      int m_iPages;			// number of pages
+
+   private:
+      CUnitTable(const CUnitTable&);
+      CUnitTable& operator=(const CUnitTable&);
+   } m_Units;                           // the protocol buffer
    int m_iSize;                         // size of the protocol buffer
    CUnitQueue* m_pUnitQueue;		// the shared unit queue
 
@@ -269,6 +459,29 @@ private:
 
    int m_iNotch;			// the starting read point of the first unit
 
+   std::map<int, std::vector<std::pair<CUnit*, int> > > m_mLoans;	// units lent to the application, with their position if still in the buffer, or -1
+   int m_iNextToken;			// identifier of the next loan
+   int m_iLentCount;			// number of lent units that are no longer in the buffer
+
+   struct Message
+   {
+      Message(): m_iHead(-1), m_iTail(-1), m_iCount(0) {}
+
+      int m_iHead;			// position of the first packet, -1 if not received yet
+      int m_iTail;			// position of the last packet, -1 if not received yet
+      int m_iCount;			// number of packets received
+   };
+
+   bool m_bMsgMode;			// if the buffer holds messages (SOCK_DGRAM), so that messages readable out of order are indexed
+   std::map<int32_t, Message> m_mPartialMsgs;		// messages readable out of order that are not complete yet, by message number
+   std::deque<std::pair<int, int32_t> > m_qReadyMsgs;	// complete messages readable out of order: position of the first packet and message number
+
+#ifdef WIN32
+   HANDLE m_ScanLock;			// used to synchronize the reading thread with loans and the message index
+#else
+   pthread_mutex_t m_ScanLock;		// used to synchronize the reading thread with loans and the message index
+#endif
+
 private:
    CRcvBuffer();
    CRcvBuffer(const CRcvBuffer&);
@@ -46,15 +46,19 @@ written by
    #endif
 #endif
 
+#include <cmath>
 #include <cstring>
 #include "cache.h"
 #include "core.h"
 
 using namespace std;
 
+const uint64_t CInfoBlock::m_ullHalfLife = 60000000;
+const uint64_t CInfoBlock::m_ullTimeToLive = 600000000;
+
 CInfoBlock& CInfoBlock::operator=(const CInfoBlock& obj)
 {
-   std::copy(obj.m_piIP, obj.m_piIP + 3, m_piIP);
+   std::copy(obj.m_piIP, obj.m_piIP + 4, m_piIP);
    m_iIPversion = obj.m_iIPversion;
    m_ullTimeStamp = obj.m_ullTimeStamp;
    m_iRTT = obj.m_iRTT;
@@ -88,7 +92,7 @@ CInfoBlock* CInfoBlock::clone()
 {
    CInfoBlock* obj = new CInfoBlock;
 
-   std::copy(m_piIP, m_piIP + 3, obj->m_piIP);
+   std::copy(m_piIP, m_piIP + 4, obj->m_piIP);
    obj->m_iIPversion = m_iIPversion;
    obj->m_ullTimeStamp = m_ullTimeStamp;
    obj->m_iRTT = m_iRTT;
@@ -121,3 +125,12 @@ void CInfoBlock::convert(const sockaddr* addr, int ver, uint32_t ip[])
       memcpy((char*)ip, (char*)((sockaddr_in6*)addr)->sin6_addr.s6_addr, 16);
    }
 }
+
+double CInfoBlock::getWeight(uint64_t currtime) const
+{
+   if ((currtime < m_ullTimeStamp) || (currtime - m_ullTimeStamp > m_ullTimeToLive))
+      return 0;
+
+   // the path may have changed since: trust the old state less and less
+   return pow(0.5, double(currtime - m_ullTimeStamp) / m_ullHalfLife);
+}
@@ -183,12 +183,12 @@ public:
          T* last_data = m_StorageList.back();
          int last_key = last_data->getKey() % m_iHashSize;
 
-         item_list = m_vHashPtr[last_key];
-         for (typename ItemPtrList::iterator i = item_list.begin(); i != item_list.end(); ++ i)
+         ItemPtrList& last_list = m_vHashPtr[last_key];
+         for (typename ItemPtrList::iterator i = last_list.begin(); i != last_list.end(); ++ i)
          {
             if (*last_data == ***i)
             {
-               item_list.erase(i);
+               last_list.erase(i);
                break;
             }
          }
@@ -271,6 +271,9 @@ public:
    double m_dInterval;		// inter-packet time, congestion control
    double m_dCWnd;		// congestion window size, congestion control
 
+   static const uint64_t m_ullHalfLife;		// the congestion state loses half of its weight in this time, microseconds
+   static const uint64_t m_ullTimeToLive;	// information older than this is not used, microseconds
+
 public:
    virtual ~CInfoBlock() {}
    virtual CInfoBlock& operator=(const CInfoBlock& obj);
@@ -291,6 +294,15 @@ public:
       //    None.
 
    static void convert(const sockaddr* addr, int ver, uint32_t ip[]);
+
+      // Functionality:
+      //    compute how much the stored congestion state can be trusted, decaying with its age
+      // Parameters:
+      //    0) [in] currtime: current time
+      // Returned value:
+      //    weight between 0 (expired) and 1 (just updated).
+
+   double getWeight(uint64_t currtime) const;
 };
 
 
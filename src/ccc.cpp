@@ -54,6 +54,8 @@ m_iMSS(),
 m_iSndCurrSeqNo(),
 m_iRcvRate(),
 m_iRTT(),
+m_dHistPktSndPeriod(),
+m_dHistCWndSize(),
 m_pcParam(NULL),
 m_iPSize(0),
 m_UDT(),
@@ -143,6 +145,12 @@ void CCC::setRTT(int rtt)
    m_iRTT = rtt;
 }
 
+void CCC::setHistory(double period, double cwnd)
+{
+   m_dHistPktSndPeriod = period;
+   m_dHistCWndSize = cwnd;
+}
+
 void CCC::setUserParam(const char* param, int size)
 {
    delete [] m_pcParam;
@@ -184,6 +192,16 @@ void CUDTCC::init()
 
    m_dCWndSize = 16;
    m_dPktSndPeriod = 1;
+
+   // a recent connection to the same peer has left slow start: resume from its rate
+   if (m_dHistPktSndPeriod > 1)
+   {
+      m_bSlowStart = false;
+      m_dPktSndPeriod = m_dHistPktSndPeriod;
+      m_dLastDecPeriod = m_dPktSndPeriod;
+      if (m_dHistCWndSize > m_dCWndSize)
+         m_dCWndSize = m_dHistCWndSize;
+   }
 }
 
 void CUDTCC::onACK(int32_t ack)
@@ -312,3 +330,1102 @@ void CUDTCC::onTimeout()
       */
    }
 }
+
+//
+// BBR: model based congestion control.
+// The sender estimates the bottleneck bandwidth (maximum delivery rate in the last rounds)
+// and the minimum RTT of the path. Packets are paced at a gain of the bottleneck bandwidth
+// and the congestion window is a gain of the BDP, so random loss alone does not reduce the
+// sending rate as long as the delivery rate is sustained.
+//
+namespace
+{
+   // 2/ln(2), the smallest gain that doubles the delivery rate every round during startup
+   const double BBR_HIGH_GAIN = 2.885;
+
+   const double BBR_GAIN_CYCLE[] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+   const uint64_t BBR_MIN_RTT_WIN = 10000000;		// min RTT filter window, microseconds
+   const uint64_t BBR_PROBE_RTT_TIME = 200000;		// time to stay in PROBE_RTT, microseconds
+   const double BBR_MIN_CWND = 16;			// minimum congestion window, in packets
+   const double BBR_PROBE_RTT_CWND = 4;			// congestion window in PROBE_RTT, in packets
+}  // namespace
+
+CBBRCC::CBBRCC():
+m_pSamples(NULL),
+m_iSampleSize(0),
+m_Mode(BBR_STARTUP),
+m_dPacingGain(),
+m_dCWndGain(),
+m_dBtlBw(),
+m_dFullBw(),
+m_iFullBwCount(),
+m_iLastAck(),
+m_iDeliveredSeq(),
+m_iDelivered(),
+m_DeliveredTime(),
+m_iRoundEndSeq(),
+m_iRoundCount(),
+m_iMinRTT(),
+m_MinRTTStamp(),
+m_ProbeRTTDoneTime(),
+m_iCycleIndex(),
+m_CycleStartTime()
+{
+   memset(m_pdBwFilter, 0, sizeof(m_pdBwFilter));
+}
+
+CBBRCC::~CBBRCC()
+{
+   delete [] m_pSamples;
+}
+
+void CBBRCC::init()
+{
+   setACKTimer(m_iSYNInterval);
+
+   uint64_t currtime = CTimer::getTime();
+
+   // one sample slot for every 16 packets in the largest possible flight
+   delete [] m_pSamples;
+   m_iSampleSize = (int)(m_dMaxCWndSize / 16) + 1;
+   m_pSamples = new Sample[m_iSampleSize];
+   for (int i = 0; i < m_iSampleSize; ++ i)
+      m_pSamples[i].m_iSeqNo = -1;
+
+   m_Mode = BBR_STARTUP;
+   m_dPacingGain = BBR_HIGH_GAIN;
+   m_dCWndGain = BBR_HIGH_GAIN;
+
+   memset(m_pdBwFilter, 0, sizeof(m_pdBwFilter));
+   m_dBtlBw = 0;
+   m_dFullBw = 0;
+   m_iFullBwCount = 0;
+
+   m_iLastAck = CSeqNo::incseq(m_iSndCurrSeqNo);
+   m_iDeliveredSeq = m_iLastAck;
+   m_iDelivered = 0;
+   m_DeliveredTime = currtime;
+
+   m_iRoundEndSeq = m_iSndCurrSeqNo;
+   m_iRoundCount = 0;
+
+   m_iMinRTT = m_iRTT;
+   m_MinRTTStamp = currtime;
+   m_ProbeRTTDoneTime = 0;
+
+   m_iCycleIndex = 0;
+   m_CycleStartTime = currtime;
+
+   // no bandwidth sample yet: send the initial window over one (possibly cached) RTT
+   m_dCWndSize = BBR_MIN_CWND;
+   m_dPktSndPeriod = (m_iRTT + m_iSYNInterval) / (m_dCWndSize * m_dPacingGain);
+}
+
+void CBBRCC::onACK(int32_t ack)
+{
+   uint64_t currtime = CTimer::getTime();
+
+   if (CSeqNo::seqcmp(ack, m_iLastAck) > 0)
+      m_iLastAck = ack;
+
+   updateMinRTT(currtime);
+   onDelivery(ack, 0, currtime);
+}
+
+void CBBRCC::onLoss(const int32_t* losslist, int size)
+{
+   // The receiver reports a loss as soon as a packet after it arrives, so a loss report
+   // also tells how far the receiver has got while the cumulative ACK is held back by
+   // the holes. Packets reported lost for the first time are not counted as delivered.
+   int lost = 0;
+   int32_t lastloss = m_iDeliveredSeq;
+   for (int i = 0; i < size; ++ i)
+   {
+      int32_t first = losslist[i] & 0x7FFFFFFF;
+      int32_t last = first;
+      if (0 != (losslist[i] & 0x80000000))
+         last = losslist[++ i];
+
+      if (CSeqNo::seqcmp(last, m_iDeliveredSeq) < 0)
+         continue;
+      if (CSeqNo::seqcmp(first, m_iDeliveredSeq) < 0)
+         first = m_iDeliveredSeq;
+
+      lost += CSeqNo::seqlen(first, last);
+      lastloss = last;
+   }
+
+   if (0 == lost)
+      return;
+
+   int32_t seqno = CSeqNo::incseq(CSeqNo::incseq(lastloss));
+   if (CSeqNo::seqcmp(seqno, CSeqNo::incseq(m_iSndCurrSeqNo)) > 0)
+      seqno = CSeqNo::incseq(m_iSndCurrSeqNo);
+
+   onDelivery(seqno, lost, CTimer::getTime());
+}
+
+void CBBRCC::onTimeout()
+{
+   // all unacknowledged packets will be retransmitted, restart from a small window
+   // but keep the path model, which is still valid
+   m_dCWndSize = BBR_MIN_CWND;
+}
+
+void CBBRCC::onPktSent(const CPacket* pkt)
+{
+   // retransmissions would mix up the delivery state of the original transmission
+   if ((pkt->m_iSeqNo != m_iSndCurrSeqNo) || (0 != (pkt->m_iSeqNo & 0xF)))
+      return;
+
+   uint64_t currtime = CTimer::getTime();
+
+   Sample& s = m_pSamples[(pkt->m_iSeqNo >> 4) % m_iSampleSize];
+   s.m_iSeqNo = pkt->m_iSeqNo;
+   s.m_iDelivered = m_iDelivered;
+   s.m_DeliveredTime = m_DeliveredTime;
+   s.m_SentTime = currtime;
+
+   // approximated by the sample taken closest before the first undelivered packet
+   int32_t first = m_iDeliveredSeq & ~0xF;
+   const Sample& f = m_pSamples[(first >> 4) % m_iSampleSize];
+   s.m_FirstSentTime = (f.m_iSeqNo == first) ? f.m_SentTime : currtime;
+}
+
+void CBBRCC::onDelivery(int32_t seqno, int lost, uint64_t currtime)
+{
+   if (CSeqNo::seqcmp(seqno, m_iDeliveredSeq) > 0)
+   {
+      updateBandwidth(seqno, lost, currtime);
+      updateMode(currtime);
+   }
+
+   updateControl();
+}
+
+void CBBRCC::updateBandwidth(int32_t seqno, int lost, uint64_t currtime)
+{
+   m_iDelivered += CSeqNo::seqoff(m_iDeliveredSeq, seqno) - lost;
+   m_iDeliveredSeq = seqno;
+
+   // the rate sample is taken from the latest sampled packet delivered: packets delivered
+   // since it was sent, over the longer of the ACK interval (since the delivery before it
+   // was sent) and the send interval (since the first packet of the delivered range was
+   // sent), so that a burst of ACKs or loss reports is not taken for a higher rate
+   int32_t sampleno = CSeqNo::decseq(seqno) & ~0xF;
+   const Sample& s = m_pSamples[(sampleno >> 4) % m_iSampleSize];
+   if (s.m_iSeqNo == sampleno)
+   {
+      uint64_t interval = currtime - s.m_DeliveredTime;
+      if (s.m_SentTime - s.m_FirstSentTime > interval)
+         interval = s.m_SentTime - s.m_FirstSentTime;
+
+      if (interval > 0)
+      {
+         double rate = (m_iDelivered - s.m_iDelivered) * 1000000.0 / interval;
+         if (rate > m_pdBwFilter[m_iRoundCount % m_iBwFilterLen])
+            m_pdBwFilter[m_iRoundCount % m_iBwFilterLen] = rate;
+      }
+   }
+
+   m_DeliveredTime = currtime;
+
+   // the bottleneck bandwidth is the maximum delivery rate in the last rounds
+   m_dBtlBw = 0;
+   for (int i = 0; i < m_iBwFilterLen; ++ i)
+   {
+      if (m_pdBwFilter[i] > m_dBtlBw)
+         m_dBtlBw = m_pdBwFilter[i];
+   }
+}
+
+void CBBRCC::updateMinRTT(uint64_t currtime)
+{
+   bool expired = (currtime - m_MinRTTStamp > BBR_MIN_RTT_WIN);
+
+   if ((m_iRTT > 0) && ((m_iRTT <= m_iMinRTT) || expired))
+   {
+      m_iMinRTT = m_iRTT;
+      m_MinRTTStamp = currtime;
+   }
+
+   // the minimum RTT has not been refreshed for a while, drain the queue to measure it again
+   if (expired && (BBR_PROBE_RTT != m_Mode))
+   {
+      m_Mode = BBR_PROBE_RTT;
+      m_dPacingGain = 1;
+      m_dCWndGain = 1;
+      m_ProbeRTTDoneTime = 0;
+   }
+}
+
+void CBBRCC::updateMode(uint64_t currtime)
+{
+   bool newround = false;
+   if (CSeqNo::seqcmp(m_iDeliveredSeq, m_iRoundEndSeq) > 0)
+   {
+      newround = true;
+      m_iRoundEndSeq = m_iSndCurrSeqNo;
+      ++ m_iRoundCount;
+      m_pdBwFilter[m_iRoundCount % m_iBwFilterLen] = 0;
+   }
+
+   int inflight = CSeqNo::seqlen(m_iDeliveredSeq, m_iSndCurrSeqNo) - 1;
+
+   switch (m_Mode)
+   {
+   case BBR_STARTUP:
+      // the pipe is full if the bandwidth has not grown by 25% in three rounds
+      if (newround && (m_dBtlBw > 0))
+      {
+         if (m_dBtlBw >= m_dFullBw * 1.25)
+         {
+            m_dFullBw = m_dBtlBw;
+            m_iFullBwCount = 0;
+         }
+         else if (++ m_iFullBwCount >= 3)
+         {
+            m_Mode = BBR_DRAIN;
+            m_dPacingGain = 1.0 / BBR_HIGH_GAIN;
+            m_dCWndGain = BBR_HIGH_GAIN;
+         }
+      }
+      break;
+
+   case BBR_DRAIN:
+      // drain the queue built during startup
+      if (inflight <= getBDP())
+      {
+         m_Mode = BBR_PROBE_BW;
+         m_dCWndGain = 2;
+         // start from a random phase, but never from the draining one
+         srand((unsigned int)currtime);
+         m_iCycleIndex = rand() % m_iGainCycleLen;
+         if (1 == m_iCycleIndex)
+            m_iCycleIndex = 0;
+         m_dPacingGain = BBR_GAIN_CYCLE[m_iCycleIndex];
+         m_CycleStartTime = currtime;
+      }
+      break;
+
+   case BBR_PROBE_BW:
+      // move to the next phase every min RTT
+      if (currtime - m_CycleStartTime > (uint64_t)m_iMinRTT)
+      {
+         m_iCycleIndex = (m_iCycleIndex + 1) % m_iGainCycleLen;
+         m_dPacingGain = BBR_GAIN_CYCLE[m_iCycleIndex];
+         m_CycleStartTime = currtime;
+      }
+      break;
+
+   case BBR_PROBE_RTT:
+      if ((0 == m_ProbeRTTDoneTime) && (inflight <= BBR_PROBE_RTT_CWND))
+      {
+         m_ProbeRTTDoneTime = currtime + BBR_PROBE_RTT_TIME;
+         m_iRoundEndSeq = m_iSndCurrSeqNo;
+      }
+      else if ((0 != m_ProbeRTTDoneTime) && (currtime > m_ProbeRTTDoneTime) && newround)
+      {
+         m_MinRTTStamp = currtime;
+
+         if (m_iFullBwCount >= 3)
+         {
+            m_Mode = BBR_PROBE_BW;
+            m_dCWndGain = 2;
+            m_iCycleIndex = 0;
+            m_dPacingGain = BBR_GAIN_CYCLE[m_iCycleIndex];
+            m_CycleStartTime = currtime;
+         }
+         else
+         {
+            m_Mode = BBR_STARTUP;
+            m_dPacingGain = BBR_HIGH_GAIN;
+            m_dCWndGain = BBR_HIGH_GAIN;
+         }
+      }
+      break;
+   }
+}
+
+void CBBRCC::updateControl()
+{
+   // keep the initial pacing until the first delivery rate sample is available
+   if (m_dBtlBw <= 0)
+      return;
+
+   m_dPktSndPeriod = 1000000.0 / (m_dBtlBw * m_dPacingGain);
+
+   if (BBR_PROBE_RTT == m_Mode)
+   {
+      m_dCWndSize = BBR_PROBE_RTT_CWND;
+      return;
+   }
+
+   m_dCWndSize = getBDP() * m_dCWndGain;
+   if (m_dCWndSize < BBR_MIN_CWND)
+      m_dCWndSize = BBR_MIN_CWND;
+
+   // the window is counted from the cumulative ACK, which stays behind a lost packet until it
+   // is repaired (longer if the retransmission is lost too); let it slide over the holes,
+   // the receiver buffer still bounds the flight through the flow window
+   if (CSeqNo::seqcmp(m_iDeliveredSeq, m_iLastAck) > 0)
+      m_dCWndSize += CSeqNo::seqoff(m_iLastAck, m_iDeliveredSeq);
+
+   if ((m_dMaxCWndSize > 0) && (m_dCWndSize > m_dMaxCWndSize))
+      m_dCWndSize = m_dMaxCWndSize;
+}
+
+double CBBRCC::getBDP() const
+{
+   // ACKs are sent every SYN interval, so the window must also cover the ACK delay
+   return m_dBtlBw * (m_iMinRTT + m_iSYNInterval) / 1000000.0;
+}
+
+//
+// CUBIC: window based congestion control (RFC 8312).
+// After a reduction the window grows along a cubic function of the time since the loss,
+// centered on the window size at which the loss happened, so the growth does not depend
+// on the RTT and recovers quickly on high BDP paths. The window never grows slower than
+// standard TCP would on the same path (TCP-friendly region).
+//
+namespace
+{
+   const double CUBIC_C = 0.4;			// scaling constant of the cubic function
+   const double CUBIC_BETA = 0.7;		// multiplicative decrease factor
+   const double CUBIC_INIT_CWND = 16;		// initial congestion window, in packets
+   const double CUBIC_MIN_CWND = 2;		// minimum congestion window, in packets
+}  // namespace
+
+CCUBICCC::CCUBICCC():
+m_dCWnd(),
+m_dSSThresh(),
+m_dWMax(),
+m_dOrigin(),
+m_dK(),
+m_dWEst(),
+m_EpochStart(),
+m_iMinRTT(),
+m_iLastAck(),
+m_iLastDecSeq(),
+m_iLastLossSeq()
+{
+}
+
+void CCUBICCC::init()
+{
+   setACKTimer(m_iSYNInterval);
+
+   m_dCWnd = CUBIC_INIT_CWND;
+   m_dSSThresh = m_dMaxCWndSize;
+
+   // resume in congestion avoidance from the window of a recent connection to the same peer
+   if (m_dHistCWndSize > CUBIC_INIT_CWND)
+   {
+      m_dCWnd = m_dSSThresh = m_dHistCWndSize;
+      if (m_dCWnd > m_dMaxCWndSize)
+         m_dCWnd = m_dSSThresh = m_dMaxCWndSize;
+   }
+   m_dWMax = 0;
+   m_dOrigin = 0;
+   m_dK = 0;
+   m_dWEst = 0;
+   m_EpochStart = 0;
+
+   m_iMinRTT = m_iRTT;
+   m_iLastAck = CSeqNo::incseq(m_iSndCurrSeqNo);
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+   m_iLastLossSeq = m_iSndCurrSeqNo;
+
+   updateControl();
+}
+
+void CCUBICCC::onACK(int32_t ack)
+{
+   if ((m_iRTT > 0) && (m_iRTT < m_iMinRTT))
+      m_iMinRTT = m_iRTT;
+
+   if (CSeqNo::seqcmp(ack, m_iLastAck) <= 0)
+      return;
+
+   int acked = CSeqNo::seqoff(m_iLastAck, ack);
+   m_iLastAck = ack;
+
+   updateWindow(acked, CTimer::getTime());
+   updateControl();
+}
+
+void CCUBICCC::onLoss(const int32_t* losslist, int size)
+{
+   int32_t lastloss = losslist[size - 1] & 0x7FFFFFFF;
+   if (CSeqNo::seqcmp(lastloss, m_iLastLossSeq) > 0)
+      m_iLastLossSeq = lastloss;
+
+   // one reduction per congestion event: losses of packets sent before the last
+   // reduction belong to the same event
+   if (CSeqNo::seqcmp(losslist[0] & 0x7FFFFFFF, m_iLastDecSeq) > 0)
+   {
+      m_iLastDecSeq = m_iSndCurrSeqNo;
+
+      // fast convergence: release bandwidth to new flows if the window keeps shrinking
+      if (m_dCWnd < m_dWMax)
+         m_dWMax = m_dCWnd * (1 + CUBIC_BETA) / 2;
+      else
+         m_dWMax = m_dCWnd;
+
+      m_dCWnd *= CUBIC_BETA;
+      if (m_dCWnd < CUBIC_MIN_CWND)
+         m_dCWnd = CUBIC_MIN_CWND;
+      m_dSSThresh = m_dCWnd;
+      m_EpochStart = 0;
+   }
+
+   updateControl();
+}
+
+void CCUBICCC::onTimeout()
+{
+   m_dWMax = m_dCWnd;
+   m_dSSThresh = m_dCWnd * CUBIC_BETA;
+   if (m_dSSThresh < CUBIC_MIN_CWND)
+      m_dSSThresh = CUBIC_MIN_CWND;
+
+   m_dCWnd = CUBIC_MIN_CWND;
+   m_EpochStart = 0;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+
+   updateControl();
+}
+
+void CCUBICCC::updateWindow(int acked, uint64_t currtime)
+{
+   if (m_dCWnd < m_dSSThresh)
+   {
+      m_dCWnd += acked;
+      if ((m_dMaxCWndSize > 0) && (m_dCWnd > m_dMaxCWndSize))
+         m_dCWnd = m_dMaxCWndSize;
+      return;
+   }
+
+   if (0 == m_EpochStart)
+   {
+      m_EpochStart = currtime;
+      if (m_dCWnd < m_dWMax)
+      {
+         m_dK = pow((m_dWMax - m_dCWnd) / CUBIC_C, 1.0 / 3);
+         m_dOrigin = m_dWMax;
+      }
+      else
+      {
+         m_dK = 0;
+         m_dOrigin = m_dCWnd;
+      }
+      m_dWEst = m_dCWnd;
+   }
+
+   // target window one RTT ahead
+   double t = double(currtime - m_EpochStart + m_iMinRTT) / 1000000;
+   double target = m_dOrigin + CUBIC_C * (t - m_dK) * (t - m_dK) * (t - m_dK);
+
+   // standard TCP with the same decrease factor increases 3(1-b)/(1+b) packets per RTT
+   m_dWEst += acked * 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) / m_dWEst;
+   if (target < m_dWEst)
+      target = m_dWEst;
+
+   // grow by at most half of the window per RTT
+   double inc = 0.01 / m_dCWnd;
+   if (target > m_dCWnd)
+      inc = (target - m_dCWnd) / m_dCWnd;
+   if (inc > 0.5)
+      inc = 0.5;
+
+   m_dCWnd += inc * acked;
+   if ((m_dMaxCWndSize > 0) && (m_dCWnd > m_dMaxCWndSize))
+      m_dCWnd = m_dMaxCWndSize;
+}
+
+void CCUBICCC::updateControl()
+{
+   m_dCWndSize = m_dCWnd;
+
+   // the window is counted from the cumulative ACK; let it slide over the holes that have
+   // been reported, as TCP does with SACK during the recovery
+   if (CSeqNo::seqcmp(m_iLastLossSeq, m_iLastAck) >= 0)
+      m_dCWndSize += CSeqNo::seqlen(m_iLastAck, m_iLastLossSeq);
+
+   if ((m_dMaxCWndSize > 0) && (m_dCWndSize > m_dMaxCWndSize))
+      m_dCWndSize = m_dMaxCWndSize;
+
+   // pace the window over the RTT to avoid bursts on every ACK, with some headroom so that
+   // the window is still the limit: twice the window in slow start, 1.2 times otherwise
+   double gain = (m_dCWnd < m_dSSThresh) ? 2 : 1.2;
+   m_dPktSndPeriod = m_iRTT / (m_dCWnd * gain);
+}
+
+//
+// LEDBAT: delay based scavenger congestion control (RFC 6817, with the faster decrease of LEDBAT++).
+// The window grows as long as the queuing delay is below a fixed target and shrinks in
+// proportion to the excess delay, so the flow backs off before loss-based flows see any loss
+// and mostly uses the capacity they leave idle. The queuing delay is measured on the
+// one-way delay of the data packets at the receiver side, which reports it back to the sender
+// in a user defined control packet; if the peer does not report (it uses another controller),
+// the sender falls back to the RTT increase.
+//
+namespace
+{
+   const int LEDBAT_TARGET = 25000;		// default target queuing delay, microseconds
+   const double LEDBAT_GAIN = 1;		// window increase per RTT at zero queuing delay, in packets
+   const double LEDBAT_MIN_CWND = 2;		// minimum congestion window, in packets
+   const double LEDBAT_INIT_CWND = 16;		// initial congestion window, in packets
+   const uint64_t LEDBAT_BASE_INT = 60000000;	// length of an interval in the base delay history, microseconds
+   const int32_t LEDBAT_DELAY_REPORT = 1;	// extended type of the queuing delay report
+   const int LEDBAT_REPORT_RTTS = 4;		// a report from the peer is used for this many RTTs, or SYN intervals if longer
+}  // namespace
+
+CLEDBATCC::CLEDBATCC():
+m_iTarget(LEDBAT_TARGET),
+m_dCWnd(),
+m_bSlowStart(),
+m_iLastAck(),
+m_iLastDecSeq(),
+m_iLastLossSeq(),
+m_iMinRTT(),
+m_iPeerDelay(),
+m_PeerDelayTime(),
+m_iBaseIndex(),
+m_BaseRollTime(),
+m_iCurrDelay(),
+m_bCurrDelay(),
+m_LastReportTime()
+{
+   memset(m_piBaseDelay, 0, sizeof(m_piBaseDelay));
+}
+
+void CLEDBATCC::setTarget(int usTarget)
+{
+   if (usTarget > 0)
+      m_iTarget = usTarget;
+}
+
+void CLEDBATCC::init()
+{
+   setACKTimer(m_iSYNInterval);
+
+   m_dCWnd = LEDBAT_INIT_CWND;
+   m_bSlowStart = true;
+
+   m_iLastAck = CSeqNo::incseq(m_iSndCurrSeqNo);
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+   m_iLastLossSeq = m_iSndCurrSeqNo;
+   m_iMinRTT = m_iRTT;
+
+   m_iPeerDelay = 0;
+   m_PeerDelayTime = 0;
+
+   m_iBaseIndex = 0;
+   m_BaseRollTime = 0;
+   m_bCurrDelay = false;
+   m_LastReportTime = 0;
+
+   updateControl();
+}
+
+void CLEDBATCC::onACK(int32_t ack)
+{
+   if ((m_iRTT > 0) && (m_iRTT < m_iMinRTT))
+      m_iMinRTT = m_iRTT;
+
+   if (CSeqNo::seqcmp(ack, m_iLastAck) <= 0)
+      return;
+
+   int acked = CSeqNo::seqoff(m_iLastAck, ack);
+   m_iLastAck = ack;
+
+   int qdelay = getQueuingDelay();
+
+   // slow start until the queue starts to build up
+   if (m_bSlowStart && (qdelay > m_iTarget * 3 / 4))
+      m_bSlowStart = false;
+
+   if (m_bSlowStart)
+      m_dCWnd += LEDBAT_GAIN * acked;
+   else if (qdelay < m_iTarget)
+      m_dCWnd += LEDBAT_GAIN * (m_iTarget - qdelay) / m_iTarget * acked / m_dCWnd;
+   else
+   {
+      // decrease in proportion to the excess delay, by at most half of the window per RTT
+      double dec = m_dCWnd * (qdelay - m_iTarget) / m_iTarget;
+      if (dec > m_dCWnd / 2)
+         dec = m_dCWnd / 2;
+      m_dCWnd -= dec * acked / m_dCWnd;
+   }
+
+   if (m_dCWnd < LEDBAT_MIN_CWND)
+      m_dCWnd = LEDBAT_MIN_CWND;
+   else if ((m_dMaxCWndSize > 0) && (m_dCWnd > m_dMaxCWndSize))
+      m_dCWnd = m_dMaxCWndSize;
+
+   updateControl();
+}
+
+void CLEDBATCC::onLoss(const int32_t* losslist, int size)
+{
+   int32_t lastloss = losslist[size - 1] & 0x7FFFFFFF;
+   if (CSeqNo::seqcmp(lastloss, m_iLastLossSeq) > 0)
+      m_iLastLossSeq = lastloss;
+
+   // halve the window once per congestion event
+   if (CSeqNo::seqcmp(losslist[0] & 0x7FFFFFFF, m_iLastDecSeq) > 0)
+   {
+      m_iLastDecSeq = m_iSndCurrSeqNo;
+      m_bSlowStart = false;
+
+      m_dCWnd /= 2;
+      if (m_dCWnd < LEDBAT_MIN_CWND)
+         m_dCWnd = LEDBAT_MIN_CWND;
+   }
+
+   updateControl();
+}
+
+void CLEDBATCC::onTimeout()
+{
+   m_bSlowStart = false;
+   m_dCWnd = LEDBAT_MIN_CWND;
+   m_iLastDecSeq = m_iSndCurrSeqNo;
+
+   updateControl();
+}
+
+void CLEDBATCC::onPktReceived(const CPacket* pkt)
+{
+   uint64_t currtime = CTimer::getTime();
+
+   // modular arithmetic keeps the difference consistent when the 32-bit timestamp wraps
+   uint32_t delay = (uint32_t)currtime - (uint32_t)pkt->m_iTimeStamp;
+
+   if (0 == m_BaseRollTime)
+   {
+      for (int i = 0; i < m_iBaseHistLen; ++ i)
+         m_piBaseDelay[i] = delay;
+      m_BaseRollTime = currtime + LEDBAT_BASE_INT;
+   }
+   else if (currtime >= m_BaseRollTime)
+   {
+      m_iBaseIndex = (m_iBaseIndex + 1) % m_iBaseHistLen;
+      m_piBaseDelay[m_iBaseIndex] = delay;
+      m_BaseRollTime = currtime + LEDBAT_BASE_INT;
+   }
+   else if ((int32_t)(delay - m_piBaseDelay[m_iBaseIndex]) < 0)
+      m_piBaseDelay[m_iBaseIndex] = delay;
+
+   // the current delay is the minimum since the last report, which filters out processing noise
+   if (!m_bCurrDelay || ((int32_t)(delay - m_iCurrDelay) < 0))
+   {
+      m_iCurrDelay = delay;
+      m_bCurrDelay = true;
+   }
+
+   if (currtime - m_LastReportTime < (uint64_t)m_iSYNInterval)
+      return;
+
+   uint32_t base = m_piBaseDelay[0];
+   for (int i = 1; i < m_iBaseHistLen; ++ i)
+   {
+      if ((int32_t)(m_piBaseDelay[i] - base) < 0)
+         base = m_piBaseDelay[i];
+   }
+
+   int32_t qdelay = (int32_t)(m_iCurrDelay - base);
+
+   CPacket report;
+   int32_t type = LEDBAT_DELAY_REPORT;
+   report.pack(32767, &type, &qdelay, 4);
+   sendCustomMsg(report);
+
+   m_bCurrDelay = false;
+   m_LastReportTime = currtime;
+}
+
+void CLEDBATCC::processCustomMsg(const CPacket* pkt)
+{
+   if ((LEDBAT_DELAY_REPORT != pkt->getExtendedType()) || (pkt->getLength() < 4))
+      return;
+
+   m_iPeerDelay = *(int32_t *)pkt->m_pcData;
+   m_PeerDelayTime = CTimer::getTime();
+}
+
+int CLEDBATCC::getQueuingDelay()
+{
+   // the peer reports every SYN interval while data arrive; an old report no longer reflects the queue,
+   // e.g., when the reports are lost or the peer stops sending them, and the RTT increase is used instead
+   if (0 != m_PeerDelayTime)
+   {
+      int period = (m_iRTT > m_iSYNInterval) ? m_iRTT : m_iSYNInterval;
+      if (CTimer::getTime() - m_PeerDelayTime < (uint64_t)period * LEDBAT_REPORT_RTTS)
+         return m_iPeerDelay;
+   }
+
+   return m_iRTT - m_iMinRTT;
+}
+
+void CLEDBATCC::updateControl()
+{
+   m_dCWndSize = m_dCWnd;
+
+   // let the window slide over the holes that have been reported, see CCUBICCC
+   if (CSeqNo::seqcmp(m_iLastLossSeq, m_iLastAck) >= 0)
+      m_dCWndSize += CSeqNo::seqlen(m_iLastAck, m_iLastLossSeq);
+
+   if ((m_dMaxCWndSize > 0) && (m_dCWndSize > m_dMaxCWndSize))
+      m_dCWndSize = m_dMaxCWndSize;
+
+   double gain = m_bSlowStart ? 2 : 1.2;
+   m_dPktSndPeriod = m_iRTT / (m_dCWnd * gain);
+}
+
+//
+// GCC: delay gradient congestion control for real-time media, after Google Congestion Control
+// (draft-ietf-rmcat-gcc). The receiver groups the data packets sent in the same burst, filters
+// the variation of the one-way delay between groups with a trendline and detects overuse with
+// an adaptive threshold; its rate estimate is decreased to a fraction of the receiving rate on
+// overuse and increased slowly otherwise, and is reported back in a user defined control
+// packet. The sender paces at the minimum of this estimate and a loss based rate, so the queue
+// stays short. The current rate can be read with the UDT_TARGETBW option to drive an encoder.
+//
+namespace
+{
+   const double GCC_INIT_RATE = 100;		// initial sending rate, packets per second
+   const double GCC_MIN_RATE = 10;		// minimum sending rate, packets per second
+   const double GCC_BETA = 0.85;		// rate decrease factor on overuse
+   const double GCC_INC_FACTOR = 1.08;		// rate increase factor per second
+   const int GCC_BURST_TIME = 5000;		// packets sent within this time belong to the same group, microseconds
+   const double GCC_SMOOTHING = 0.9;		// smoothing coefficient of the accumulated delay
+   const double GCC_TREND_GAIN = 4;		// gain applied to the trendline slope
+   const int GCC_MAX_DELTAS = 60;		// cap of the number of samples that scales the slope
+   const uint64_t GCC_OVERUSE_TIME = 10000;	// time over the threshold before overuse is signaled, microseconds
+   const double GCC_K_UP = 0.0087;		// threshold adaptation gain when the trend is above it
+   const double GCC_K_DOWN = 0.039;		// threshold adaptation gain when the trend is below it
+   const uint64_t GCC_RATE_WIN = 500000;	// window to measure the receiving rate, microseconds
+   const uint64_t GCC_LOSS_INT = 100000;	// minimum interval between loss evaluations, microseconds
+   const int32_t GCC_RATE_REPORT = 2;		// extended type of the rate report
+}  // namespace
+
+CGCCCC::CGCCCC():
+m_dLossRate(),
+m_dRemoteRate(),
+m_iSentCount(),
+m_iLostCount(),
+m_LastLossEval(),
+m_bGroup(),
+m_iGroupFirstSend(),
+m_iGroupLastSend(),
+m_GroupArrival(),
+m_bPrevGroup(),
+m_iPrevGroupSend(),
+m_PrevGroupArrival(),
+m_dAccDelay(),
+m_dSmoothedDelay(),
+m_iTrendSamples(),
+m_iNumDeltas(),
+m_FirstArrival(),
+m_Usage(GCC_NORMAL),
+m_dThreshold(),
+m_dPrevTrend(),
+m_OveruseStart(),
+m_LastThresholdUpdate(),
+m_dEstimate(),
+m_LastEstimateUpdate(),
+m_LastDecrease(),
+m_iRcvCount(),
+m_RcvWindowStart(),
+m_dIncomingRate(),
+m_LastReportTime()
+{
+}
+
+void CGCCCC::init()
+{
+   setACKTimer(m_iSYNInterval);
+
+   uint64_t currtime = CTimer::getTime();
+
+   m_dLossRate = GCC_INIT_RATE;
+   m_dRemoteRate = 0;
+   m_iSentCount = 0;
+   m_iLostCount = 0;
+   m_LastLossEval = currtime;
+
+   m_bGroup = false;
+   m_bPrevGroup = false;
+   m_dAccDelay = 0;
+   m_dSmoothedDelay = 0;
+   m_iTrendSamples = 0;
+   m_iNumDeltas = 0;
+
+   m_Usage = GCC_NORMAL;
+   m_dThreshold = 12.5;
+   m_dPrevTrend = 0;
+   m_OveruseStart = 0;
+   m_LastThresholdUpdate = currtime;
+
+   m_dEstimate = GCC_INIT_RATE;
+   m_LastEstimateUpdate = currtime;
+   m_LastDecrease = 0;
+   m_iRcvCount = 0;
+   m_RcvWindowStart = currtime;
+   m_dIncomingRate = 0;
+   m_LastReportTime = currtime;
+
+   updateControl();
+}
+
+void CGCCCC::onACK(int32_t)
+{
+   uint64_t currtime = CTimer::getTime();
+
+   uint64_t interval = (m_iRTT > (int)GCC_LOSS_INT) ? m_iRTT : GCC_LOSS_INT;
+   if ((currtime - m_LastLossEval < interval) || (0 == m_iSentCount))
+      return;
+
+   // loss based control: decrease on heavy loss, increase while the loss is negligible
+   double loss = double(m_iLostCount) / m_iSentCount;
+   if (loss > 0.1)
+      m_dLossRate *= 1 - 0.5 * loss;
+   else if (loss < 0.02)
+      m_dLossRate *= 1.05;
+
+   m_iSentCount = 0;
+   m_iLostCount = 0;
+   m_LastLossEval = currtime;
+
+   updateControl();
+}
+
+void CGCCCC::onLoss(const int32_t* losslist, int size)
+{
+   for (int i = 0; i < size; ++ i)
+   {
+      if (0 != (losslist[i] & 0x80000000))
+      {
+         m_iLostCount += CSeqNo::seqlen(losslist[i] & 0x7FFFFFFF, losslist[i + 1]);
+         ++ i;
+      }
+      else
+         ++ m_iLostCount;
+   }
+}
+
+void CGCCCC::onTimeout()
+{
+   m_dLossRate *= 0.5;
+
+   updateControl();
+}
+
+void CGCCCC::onPktSent(const CPacket*)
+{
+   ++ m_iSentCount;
+}
+
+void CGCCCC::onPktReceived(const CPacket* pkt)
+{
+   uint64_t currtime = CTimer::getTime();
+   uint32_t sendtime = (uint32_t)pkt->m_iTimeStamp;
+
+   if (!m_bGroup)
+   {
+      m_bGroup = true;
+      m_iGroupFirstSend = m_iGroupLastSend = sendtime;
+      m_GroupArrival = currtime;
+      m_FirstArrival = currtime;
+   }
+   else if ((int32_t)(sendtime - m_iGroupFirstSend) < GCC_BURST_TIME)
+   {
+      if ((int32_t)(sendtime - m_iGroupLastSend) > 0)
+         m_iGroupLastSend = sendtime;
+      m_GroupArrival = currtime;
+   }
+   else
+   {
+      // the group is complete: compare its delay with the previous group
+      if (m_bPrevGroup)
+      {
+         int32_t senddelta = (int32_t)(m_iGroupLastSend - m_iPrevGroupSend);
+         if (senddelta > 0)
+            updateTrend(int64_t(m_GroupArrival - m_PrevGroupArrival) - senddelta, m_GroupArrival);
+      }
+
+      m_bPrevGroup = true;
+      m_iPrevGroupSend = m_iGroupLastSend;
+      m_PrevGroupArrival = m_GroupArrival;
+
+      m_iGroupFirstSend = m_iGroupLastSend = sendtime;
+      m_GroupArrival = currtime;
+   }
+
+   ++ m_iRcvCount;
+   if (currtime - m_RcvWindowStart >= GCC_RATE_WIN)
+   {
+      m_dIncomingRate = m_iRcvCount * 1000000.0 / (currtime - m_RcvWindowStart);
+      m_iRcvCount = 0;
+      m_RcvWindowStart = currtime;
+   }
+
+   if (currtime - m_LastReportTime < (uint64_t)m_iSYNInterval)
+      return;
+
+   updateEstimate(currtime);
+
+   CPacket report;
+   int32_t type = GCC_RATE_REPORT;
+   int32_t rate = (int32_t)m_dEstimate;
+   report.pack(32767, &type, &rate, 4);
+   sendCustomMsg(report);
+
+   m_LastReportTime = currtime;
+}
+
+void CGCCCC::processCustomMsg(const CPacket* pkt)
+{
+   if ((GCC_RATE_REPORT != pkt->getExtendedType()) || (pkt->getLength() < 4))
+      return;
+
+   m_dRemoteRate = *(int32_t *)pkt->m_pcData;
+
+   updateControl();
+}
+
+void CGCCCC::updateTrend(int64_t delta, uint64_t currtime)
+{
+   if (m_iNumDeltas < GCC_MAX_DELTAS)
+      ++ m_iNumDeltas;
+
+   m_dAccDelay += delta / 1000.0;
+   m_dSmoothedDelay = GCC_SMOOTHING * m_dSmoothedDelay + (1 - GCC_SMOOTHING) * m_dAccDelay;
+
+   int pos = m_iTrendSamples % m_iTrendWinLen;
+   m_pdTrendTime[pos] = (currtime - m_FirstArrival) / 1000.0;
+   m_pdTrendDelay[pos] = m_dSmoothedDelay;
+   ++ m_iTrendSamples;
+
+   if (m_iTrendSamples < m_iTrendWinLen)
+      return;
+
+   // least squares slope of the smoothed delay over the arrival time
+   double avgtime = 0;
+   double avgdelay = 0;
+   for (int i = 0; i < m_iTrendWinLen; ++ i)
+   {
+      avgtime += m_pdTrendTime[i];
+      avgdelay += m_pdTrendDelay[i];
+   }
+   avgtime /= m_iTrendWinLen;
+   avgdelay /= m_iTrendWinLen;
+
+   double num = 0;
+   double den = 0;
+   for (int i = 0; i < m_iTrendWinLen; ++ i)
+   {
+      num += (m_pdTrendTime[i] - avgtime) * (m_pdTrendDelay[i] - avgdelay);
+      den += (m_pdTrendTime[i] - avgtime) * (m_pdTrendTime[i] - avgtime);
+   }
+
+   if (den > 0)
+      detectOveruse(num / den * m_iNumDeltas * GCC_TREND_GAIN, currtime);
+}
+
+void CGCCCC::detectOveruse(double trend, uint64_t currtime)
+{
+   if (trend > m_dThreshold)
+   {
+      // overuse only if the delay keeps growing for a while
+      if (0 == m_OveruseStart)
+         m_OveruseStart = currtime;
+      if ((currtime - m_OveruseStart > GCC_OVERUSE_TIME) && (trend >= m_dPrevTrend))
+         m_Usage = GCC_OVERUSE;
+   }
+   else if (trend < -m_dThreshold)
+   {
+      m_OveruseStart = 0;
+      m_Usage = GCC_UNDERUSE;
+   }
+   else
+   {
+      m_OveruseStart = 0;
+      m_Usage = GCC_NORMAL;
+   }
+
+   m_dPrevTrend = trend;
+
+   // adapt the threshold to the trend, so that the detector is neither starved by concurrent
+   // loss based flows nor triggered by noise; large spikes are ignored
+   double abstrend = fabs(trend);
+   if (abstrend <= m_dThreshold + 15)
+   {
+      double k = (abstrend < m_dThreshold) ? GCC_K_DOWN : GCC_K_UP;
+      double dt = (currtime - m_LastThresholdUpdate) / 1000.0;
+      if (dt > 100)
+         dt = 100;
+
+      m_dThreshold += k * (abstrend - m_dThreshold) * dt;
+      if (m_dThreshold < 6)
+         m_dThreshold = 6;
+      else if (m_dThreshold > 600)
+         m_dThreshold = 600;
+   }
+   m_LastThresholdUpdate = currtime;
+}
+
+void CGCCCC::updateEstimate(uint64_t currtime)
+{
+   double dt = (currtime - m_LastEstimateUpdate) / 1000000.0;
+   m_LastEstimateUpdate = currtime;
+
+   switch (m_Usage)
+   {
+   case GCC_OVERUSE:
+      // back off below what actually gets through, once per RTT
+      if ((m_dIncomingRate > 0) && (currtime - m_LastDecrease > (uint64_t)m_iRTT + GCC_LOSS_INT))
+      {
+         if (m_dEstimate > GCC_BETA * m_dIncomingRate)
+            m_dEstimate = GCC_BETA * m_dIncomingRate;
+         m_LastDecrease = currtime;
+      }
+      break;
+
+   case GCC_UNDERUSE:
+      // the queues are draining, hold the rate until they are empty
+      break;
+
+   case GCC_NORMAL:
+      if (dt > 1)
+         dt = 1;
+      m_dEstimate *= pow(GCC_INC_FACTOR, dt);
+
+      // do not run far ahead of the rate that is actually received
+      if ((m_dIncomingRate > 0) && (m_dEstimate > 1.5 * m_dIncomingRate + GCC_MIN_RATE))
+         m_dEstimate = 1.5 * m_dIncomingRate + GCC_MIN_RATE;
+      break;
+   }
+
+   if (m_dEstimate < GCC_MIN_RATE)
+      m_dEstimate = GCC_MIN_RATE;
+}
+
+void CGCCCC::updateControl()
+{
+   // the loss based rate never exceeds the delay based estimate of the receiver
+   if ((m_dRemoteRate > 0) && (m_dLossRate > m_dRemoteRate))
+      m_dLossRate = m_dRemoteRate;
+   if (m_dLossRate < GCC_MIN_RATE)
+      m_dLossRate = GCC_MIN_RATE;
+
+   m_dPktSndPeriod = 1000000.0 / m_dLossRate;
+
+   // rate based: the window only guards against a stale rate, as in CUDTCC
+   m_dCWndSize = m_dLossRate * (m_iRTT + m_iSYNInterval) / 1000000.0 * 2 + 16;
+   if ((m_dMaxCWndSize > 0) && (m_dCWndSize > m_dMaxCWndSize))
+      m_dCWndSize = m_dMaxCWndSize;
+}
@@ -201,6 +201,7 @@ private:
    void setSndCurrSeqNo(int32_t seqno);
    void setRcvRate(int rcvrate);
    void setRTT(int rtt);
+   void setHistory(double period, double cwnd);
 
 protected:
    const int32_t& m_iSYNInterval;	// UDT constant parameter, SYN
@@ -215,6 +216,8 @@ protected:
    int32_t m_iSndCurrSeqNo;		// current maximum seq no sent out
    int m_iRcvRate;			// packet arrive rate at receiver side, packets per second
    int m_iRTT;				// current estimated RTT, microsecond
+   double m_dHistPktSndPeriod;		// aged sending period of the last connection to the same peer, 0 if unknown
+   double m_dHistCWndSize;		// aged congestion window size of the last connection to the same peer, 0 if unknown
 
    char* m_pcParam;			// user defined parameter
    int m_iPSize;			// size of m_pcParam
@@ -275,4 +278,214 @@ private:
    int m_iDecCount;			// number of decreases in a congestion epoch
 };
 
+class UDT_API CBBRCC: public CCC
+{
+public:
+   CBBRCC();
+   virtual ~CBBRCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+   virtual void onPktSent(const CPacket*);
+
+private:
+   void onDelivery(int32_t seqno, int lost, uint64_t currtime);
+   void updateBandwidth(int32_t seqno, int lost, uint64_t currtime);
+   void updateMinRTT(uint64_t currtime);
+   void updateMode(uint64_t currtime);
+   void updateControl();
+
+   double getBDP() const;
+
+private:
+   enum BBRMode {BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT};
+
+   static const int m_iBwFilterLen = 10;	// length of the max bandwidth filter, in rounds
+   static const int m_iGainCycleLen = 8;	// number of phases in a bandwidth probing cycle
+
+   struct Sample
+   {
+      int32_t m_iSeqNo;			// sequence number of the sampled packet
+      int m_iDelivered;			// number of packets delivered when the packet was sent
+      uint64_t m_DeliveredTime;		// time of the last delivery when the packet was sent
+      uint64_t m_SentTime;		// time when the packet was sent
+      uint64_t m_FirstSentTime;		// send time of the first unacknowledged packet when the packet was sent
+   } *m_pSamples;			// delivery state recorded for every 16th packet sent
+   int m_iSampleSize;			// size of m_pSamples
+
+   BBRMode m_Mode;			// current state of the BBR state machine
+   double m_dPacingGain;		// gain applied to the bottleneck bandwidth for pacing
+   double m_dCWndGain;			// gain applied to the BDP for the congestion window
+
+   double m_pdBwFilter[m_iBwFilterLen];	// per-round maximum delivery rate, packets per second
+   double m_dBtlBw;			// estimated bottleneck bandwidth, packets per second
+   double m_dFullBw;			// bandwidth at the last significant growth during startup
+   int m_iFullBwCount;			// number of rounds without significant bandwidth growth
+
+   int32_t m_iLastAck;			// last ACKed seq no
+   int32_t m_iDeliveredSeq;		// seq no next to the largest one known to be received, from ACKs and loss reports
+   int m_iDelivered;			// total number of packets delivered
+   uint64_t m_DeliveredTime;		// time when the last packet was delivered
+
+   int32_t m_iRoundEndSeq;		// a round trip is complete when this seq no is acknowledged
+   int m_iRoundCount;			// number of round trips since the connection is started
+
+   int m_iMinRTT;			// minimum RTT in the filter window, microseconds
+   uint64_t m_MinRTTStamp;		// time when the minimum RTT was recorded
+   uint64_t m_ProbeRTTDoneTime;		// time to leave PROBE_RTT mode, 0 if not yet scheduled
+
+   int m_iCycleIndex;			// current phase of the bandwidth probing cycle
+   uint64_t m_CycleStartTime;		// start time of the current probing phase
+};
+
+class UDT_API CCUBICCC: public CCC
+{
+public:
+   CCUBICCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+
+private:
+   void updateWindow(int acked, uint64_t currtime);
+   void updateControl();
+
+private:
+   double m_dCWnd;			// congestion window given by the growth function, in packets
+   double m_dSSThresh;			// slow start threshold, in packets
+   double m_dWMax;			// window size just before the last reduction, in packets
+   double m_dOrigin;			// plateau of the cubic function in the current epoch, in packets
+   double m_dK;				// time for the cubic function to reach the plateau, in seconds
+   double m_dWEst;			// window that standard TCP would reach in the current epoch, in packets
+   uint64_t m_EpochStart;		// start time of the current congestion avoidance epoch, 0 if not started
+
+   int m_iMinRTT;			// minimum RTT observed, microseconds
+   int32_t m_iLastAck;			// last ACKed seq no
+   int32_t m_iLastDecSeq;		// max pkt seq no sent out when last decrease happened
+   int32_t m_iLastLossSeq;		// largest seq no reported lost
+};
+
+class UDT_API CLEDBATCC: public CCC
+{
+public:
+   CLEDBATCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+   virtual void onPktReceived(const CPacket*);
+   virtual void processCustomMsg(const CPacket*);
+
+public:
+
+      // Functionality:
+      //    Set the target queuing delay.
+      // Parameters:
+      //    0) [in] usTarget: target queuing delay, in microseconds.
+      // Returned value:
+      //    None.
+
+   void setTarget(int usTarget);
+
+private:
+   int getQueuingDelay();
+   void updateControl();
+
+private:
+   static const int m_iBaseHistLen = 10;	// number of one-minute intervals in the base delay history
+
+   int m_iTarget;			// target queuing delay, microseconds
+   double m_dCWnd;			// congestion window, excluding the allowance over reported holes, in packets
+   bool m_bSlowStart;			// if in slow start phase
+
+   int32_t m_iLastAck;			// last ACKed seq no
+   int32_t m_iLastDecSeq;		// max pkt seq no sent out when last decrease happened
+   int32_t m_iLastLossSeq;		// largest seq no reported lost
+   int m_iMinRTT;			// minimum RTT observed, microseconds
+
+   int m_iPeerDelay;			// queuing delay reported by the peer, microseconds
+   uint64_t m_PeerDelayTime;		// time when the last report from the peer was received
+
+      // receiver side: one-way delay of the data packets, by the local clock minus the peer timestamp.
+      // The clock offset is unknown but constant, so the base delay is the minimum in the history.
+   uint32_t m_piBaseDelay[m_iBaseHistLen];	// minimum one-way delay in each of the last intervals
+   int m_iBaseIndex;			// current interval in m_piBaseDelay
+   uint64_t m_BaseRollTime;		// time to move to the next interval
+   uint32_t m_iCurrDelay;		// minimum one-way delay since the last report
+   bool m_bCurrDelay;			// if m_iCurrDelay holds a sample
+   uint64_t m_LastReportTime;		// time when the last report was sent
+};
+
+class UDT_API CGCCCC: public CCC
+{
+public:
+   CGCCCC();
+
+public:
+   virtual void init();
+   virtual void onACK(int32_t);
+   virtual void onLoss(const int32_t*, int);
+   virtual void onTimeout();
+   virtual void onPktSent(const CPacket*);
+   virtual void onPktReceived(const CPacket*);
+   virtual void processCustomMsg(const CPacket*);
+
+private:
+   void updateTrend(int64_t delta, uint64_t currtime);
+   void detectOveruse(double trend, uint64_t currtime);
+   void updateEstimate(uint64_t currtime);
+   void updateControl();
+
+private:
+   enum Usage {GCC_NORMAL, GCC_UNDERUSE, GCC_OVERUSE};
+
+   static const int m_iTrendWinLen = 20;	// number of delay samples in the trendline regression
+
+      // sender side: loss based controller, capped by the delay based estimate of the receiver
+   double m_dLossRate;			// rate allowed by the loss based controller, packets per second
+   double m_dRemoteRate;		// rate estimated by the receiver, packets per second, 0 if not reported
+   int m_iSentCount;			// number of packets sent since the last loss evaluation
+   int m_iLostCount;			// number of packets reported lost since the last loss evaluation
+   uint64_t m_LastLossEval;		// time of the last loss evaluation
+
+      // receiver side: delay gradient over groups of packets sent in the same burst
+   bool m_bGroup;			// if a group of packets is open
+   uint32_t m_iGroupFirstSend;		// send timestamp of the first packet in the current group
+   uint32_t m_iGroupLastSend;		// send timestamp of the last packet in the current group
+   uint64_t m_GroupArrival;		// arrival time of the last packet in the current group
+   bool m_bPrevGroup;			// if the previous group is complete
+   uint32_t m_iPrevGroupSend;		// send timestamp of the previous group
+   uint64_t m_PrevGroupArrival;		// arrival time of the previous group
+
+   double m_dAccDelay;			// accumulated delay variation, milliseconds
+   double m_dSmoothedDelay;		// smoothed accumulated delay variation, milliseconds
+   double m_pdTrendTime[m_iTrendWinLen];	// arrival time of each sample in the regression window, milliseconds
+   double m_pdTrendDelay[m_iTrendWinLen];	// smoothed delay of each sample in the regression window, milliseconds
+   int m_iTrendSamples;			// number of samples in the regression window
+   int m_iNumDeltas;			// number of delay variation samples, capped
+   uint64_t m_FirstArrival;		// arrival time of the first group, time origin of the regression
+
+   Usage m_Usage;			// current output of the overuse detector
+   double m_dThreshold;			// adaptive overuse threshold, milliseconds
+   double m_dPrevTrend;			// previous modified trend
+   uint64_t m_OveruseStart;		// start time of the current overuse period, 0 if not overusing
+   uint64_t m_LastThresholdUpdate;	// last time the threshold was adapted
+
+   double m_dEstimate;			// delay based rate estimate, packets per second
+   uint64_t m_LastEstimateUpdate;	// last time the estimate was updated
+   uint64_t m_LastDecrease;		// last time the estimate was decreased
+   int m_iRcvCount;			// number of packets received in the current rate window
+   uint64_t m_RcvWindowStart;		// start time of the current rate window
+   double m_dIncomingRate;		// measured receiving rate, packets per second
+   uint64_t m_LastReportTime;		// time when the last report was sent
+};
+
 #endif
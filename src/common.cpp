@@ -686,6 +686,49 @@ UDT_API void CUDTException::clear()
    m_iErrno = 0;
 }
 
+//
+const int64_t CMemBudget::m_llUnlimited = 0x7FFFFFFFFFFFFFFFLL;
+volatile int64_t CMemBudget::s_llLimit = 0;
+volatile int64_t CMemBudget::s_llUsage = 0;
+#ifndef WIN32
+   pthread_mutex_t CMemBudget::m_BudgetLock = PTHREAD_MUTEX_INITIALIZER;
+#else
+   HANDLE CMemBudget::m_BudgetLock = CreateMutex(NULL, false, NULL);
+#endif
+
+bool CMemBudget::reserve(int64_t size, bool force)
+{
+   CGuard budgetguard(m_BudgetLock);
+
+   if (!force && (s_llLimit > 0) && (s_llUsage + size > s_llLimit))
+      return false;
+
+   s_llUsage += size;
+   return true;
+}
+
+void CMemBudget::release(int64_t size)
+{
+   CGuard budgetguard(m_BudgetLock);
+
+   s_llUsage -= size;
+}
+
+int64_t CMemBudget::getHeadroom(bool sending)
+{
+   // read without the lock, the result is only a hint for sizing windows and buffers
+   int64_t limit = s_llLimit;
+   if (limit <= 0)
+      return m_llUnlimited;
+
+   // data waiting in the sending buffers must not take the memory the connections need to receive, or nothing moves
+   if (sending)
+      limit -= limit >> 2;
+
+   int64_t usage = s_llUsage;
+   return (usage < limit) ? limit - usage : 0;
+}
+
 
 //
 bool CIPAddress::ipcmp(const sockaddr* addr1, const sockaddr* addr2, int ver)
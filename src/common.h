@@ -329,6 +329,59 @@ public:
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Process-wide accounting of the memory taken by the buffers of all UDT sockets
+
+class CMemBudget
+{
+public:
+
+      // Functionality:
+      //    Take memory from the budget.
+      // Parameters:
+      //    0) [in] size: number of bytes.
+      //    1) [in] force: take it even over the limit, for memory that cannot be refused.
+      // Returned value:
+      //    true if taken, false if it would exceed the limit.
+
+   static bool reserve(int64_t size, bool force = false);
+
+      // Functionality:
+      //    Give memory back to the budget.
+      // Parameters:
+      //    0) [in] size: number of bytes.
+      // Returned value:
+      //    None.
+
+   static void release(int64_t size);
+
+      // Functionality:
+      //    Read the memory left under the limit.
+      // Parameters:
+      //    0) [in] sending: if the memory is for sending buffers, which leave a quarter of the limit to the receiving units.
+      // Returned value:
+      //    number of bytes, 0 if the limit is reached, or m_llUnlimited if there is no limit.
+
+   static int64_t getHeadroom(bool sending = false);
+
+   static void setLimit(int64_t limit) {s_llLimit = limit;}
+   static int64_t getUsage() {return s_llUsage;}
+
+public:
+   static const int64_t m_llUnlimited;  // headroom when there is no limit
+
+private:
+   static volatile int64_t s_llLimit;   // maximum number of bytes, 0 if unlimited
+   static volatile int64_t s_llUsage;   // number of bytes taken
+
+#ifndef WIN32
+   static pthread_mutex_t m_BudgetLock;
+#else
+   static HANDLE m_BudgetLock;
+#endif
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 struct CIPAddress
 {
    static bool ipcmp(const sockaddr* addr1, const sockaddr* addr2, int ver = AF_INET);
@@ -45,6 +45,8 @@ written by
    #include <cerrno>
    #include <cstring>
    #include <cstdlib>
+   #include <fcntl.h>
+   #include <sys/stat.h>
 #else
    #include <winsock2.h>
    #include <ws2tcpip.h>
@@ -74,7 +76,8 @@ const int32_t CAckNo::m_iMaxAckSeqNo = 0x7FFFFFFF;
 const int32_t CMsgNo::m_iMsgNoTH = 0xFFFFFFF;
 const int32_t CMsgNo::m_iMaxMsgNo = 0x1FFFFFFF;
 
-const int CUDT::m_iVersion = 4;
+const int CUDT::m_iVersion = 6;
+const int CUDT::m_iMinVersion = 4;
 const int CUDT::m_iSYNInterval = 10000;
 const int CUDT::m_iSelfClockInterval = 64;
 
@@ -88,6 +91,8 @@ CUDT::CUDT()
    m_pACKWindow = NULL;
    m_pSndTimeWindow = NULL;
    m_pRcvTimeWindow = NULL;
+   m_pFECEncoder = NULL;
+   m_pFECDecoder = NULL;
 
    m_pSndQueue = NULL;
    m_pRcvQueue = NULL;
@@ -105,6 +110,8 @@ CUDT::CUDT()
    m_iFlightFlagSize = 25600;
    m_iSndBufSize = 8192;
    m_iRcvBufSize = 8192; //Rcv buffer MUST NOT be bigger than Flight Flag size
+   m_bSndBufAutoTune = true;
+   m_bRcvBufAutoTune = true;
    m_Linger.l_onoff = 1;
    m_Linger.l_linger = 180;
    m_iUDPSndBufSize = 65536;
@@ -116,6 +123,10 @@ CUDT::CUDT()
    m_iRcvTimeOut = -1;
    m_bReuseAddr = true;
    m_llMaxBW = -1;
+   m_iFECGroup = 0;
+   m_iFECParity = 1;
+   m_bFECMsg = false;
+   m_iRcvDeadline = -1;
 
    m_pCCFactory = new CCCFactory<CUDTCC>;
    m_pCC = NULL;
@@ -152,6 +163,8 @@ CUDT::CUDT(const CUDT& ancestor)
    m_pACKWindow = NULL;
    m_pSndTimeWindow = NULL;
    m_pRcvTimeWindow = NULL;
+   m_pFECEncoder = NULL;
+   m_pFECDecoder = NULL;
 
    m_pSndQueue = NULL;
    m_pRcvQueue = NULL;
@@ -169,6 +182,8 @@ CUDT::CUDT(const CUDT& ancestor)
    m_iFlightFlagSize = ancestor.m_iFlightFlagSize;
    m_iSndBufSize = ancestor.m_iSndBufSize;
    m_iRcvBufSize = ancestor.m_iRcvBufSize;
+   m_bSndBufAutoTune = ancestor.m_bSndBufAutoTune;
+   m_bRcvBufAutoTune = ancestor.m_bRcvBufAutoTune;
    m_Linger = ancestor.m_Linger;
    m_iUDPSndBufSize = ancestor.m_iUDPSndBufSize;
    m_iUDPRcvBufSize = ancestor.m_iUDPRcvBufSize;
@@ -179,6 +194,10 @@ CUDT::CUDT(const CUDT& ancestor)
    m_iRcvTimeOut = ancestor.m_iRcvTimeOut;
    m_bReuseAddr = true;	// this must be true, because all accepted sockets shared the same port with the listener
    m_llMaxBW = ancestor.m_llMaxBW;
+   m_iFECGroup = ancestor.m_iFECGroup;
+   m_iFECParity = ancestor.m_iFECParity;
+   m_bFECMsg = ancestor.m_bFECMsg;
+   m_iRcvDeadline = ancestor.m_iRcvDeadline;
 
    m_pCCFactory = ancestor.m_pCCFactory->clone();
    m_pCC = NULL;
@@ -223,6 +242,8 @@ CUDT::~CUDT()
    delete m_pACKWindow;
    delete m_pSndTimeWindow;
    delete m_pRcvTimeWindow;
+   delete m_pFECEncoder;
+   delete m_pFECDecoder;
    delete m_pCCFactory;
    delete m_pCC;
    delete m_pPeerAddr;
@@ -298,6 +319,7 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
          throw CUDTException(5, 3, 0);
 
       m_iSndBufSize = *(int*)optval / (m_iMSS - 28);
+      m_bSndBufAutoTune = false;
 
       break;
 
@@ -318,6 +340,8 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
       if (m_iRcvBufSize > m_iFlightFlagSize)
          m_iRcvBufSize = m_iFlightFlagSize;
 
+      m_bRcvBufAutoTune = false;
+
       break;
 
    case UDT_LINGER:
@@ -369,6 +393,41 @@ void CUDT::setOpt(UDTOpt optName, const void* optval, int)
    case UDT_MAXBW:
       m_llMaxBW = *(int64_t*)optval;
       break;
+
+   case UDT_FECGROUP:
+      if (m_bConnecting || m_bConnected)
+         throw CUDTException(5, 2, 0);
+
+      if ((*(int*)optval < 0) || (*(int*)optval > CFEC::m_iMaxGroup))
+         throw CUDTException(5, 3, 0);
+
+      m_iFECGroup = *(int*)optval;
+      break;
+
+   case UDT_FECPARITY:
+      if (m_bConnecting || m_bConnected)
+         throw CUDTException(5, 2, 0);
+
+      if ((*(int*)optval < 1) || (*(int*)optval > CFEC::m_iMaxParity))
+         throw CUDTException(5, 3, 0);
+
+      m_iFECParity = *(int*)optval;
+      break;
+
+   case UDT_FECMSG:
+      if (m_bConnecting || m_bConnected)
+         throw CUDTException(5, 2, 0);
+
+      m_bFECMsg = *(bool*)optval;
+      break;
+
+   case UDT_RCVDEADLINE:
+      // a byte stream cannot skip data
+      if (UDT_STREAM == m_iSockType)
+         throw CUDTException(5, 9, 0);
+
+      m_iRcvDeadline = (*(int*)optval < 0) ? -1 : *(int*)optval;
+      break;
     
    default:
       throw CUDTException(5, 0, 0);
@@ -410,12 +469,12 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       break;
 
    case UDT_SNDBUF:
-      *(int*)optval = m_iSndBufSize * (m_iMSS - 28);
+      *(int*)optval = (m_bConnected ? m_iSndBufLimit : m_iSndBufSize) * (m_iMSS - 28);
       optlen = sizeof(int);
       break;
 
    case UDT_RCVBUF:
-      *(int*)optval = m_iRcvBufSize * (m_iMSS - 28);
+      *(int*)optval = (m_bConnected ? m_iRcvWindow : m_iRcvBufSize) * (m_iMSS - 28);
       optlen = sizeof(int);
       break;
 
@@ -476,7 +535,7 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       {
          if (m_pRcvBuffer && (m_pRcvBuffer->getRcvDataSize() > 0))
             event |= UDT_EPOLL_IN;
-         if (m_pSndBuffer && (m_iSndBufSize > m_pSndBuffer->getCurrBufSize()))
+         if (m_pSndBuffer && (getSndBufSpace() > 0))
             event |= UDT_EPOLL_OUT;
       }
       *(int32_t*)optval = event;
@@ -500,6 +559,46 @@ void CUDT::getOpt(UDTOpt optName, void* optval, int& optlen)
       optlen = sizeof(int32_t);
       break;
 
+   case UDT_TARGETBW:
+      if (m_bConnected && (m_ullInterval > 0))
+      {
+         // the pacing period already includes the UDT_MAXBW cap; the window bounds it further
+         double rate = double(m_iPayloadSize) * 1000000.0 * m_ullCPUFrequency / m_ullInterval;
+         double wndrate = m_dCongestionWindow * m_iPayloadSize * 1000000.0 / (m_iRTT + m_iSYNInterval);
+         if (wndrate < rate)
+            rate = wndrate;
+
+         // FEC parity packets are paced with the data and take their share of the rate
+         if (NULL != m_pFECEncoder)
+            rate = rate * (m_iPayloadSize - CFEC::m_iHdrSize) / m_iPayloadSize * m_iFECGroup / (m_iFECGroup + m_iFECParity);
+
+         *(int64_t*)optval = int64_t(rate);
+      }
+      else
+         *(int64_t*)optval = 0;
+      optlen = sizeof(int64_t);
+      break;
+
+   case UDT_FECGROUP:
+      *(int*)optval = m_iFECGroup;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_FECPARITY:
+      *(int*)optval = m_iFECParity;
+      optlen = sizeof(int);
+      break;
+
+   case UDT_FECMSG:
+      *(bool*)optval = m_bFECMsg;
+      optlen = sizeof(bool);
+      break;
+
+   case UDT_RCVDEADLINE:
+      *(int*)optval = m_iRcvDeadline;
+      optlen = sizeof(int);
+      break;
+
    default:
       throw CUDTException(5, 0, 0);
    }
@@ -516,6 +615,8 @@ void CUDT::open()
    m_iEXPCount = 1;
    m_iBandwidth = 1;
    m_iDeliveryRate = 16;
+   m_iSndBufLimit = m_iSndBufSize;
+   m_iRcvWindow = m_iRcvBufSize;
    m_iAckSeqNo = 0;
    m_ullLastAckTime = 0;
 
@@ -525,6 +626,10 @@ void CUDT::open()
    m_LastSampleTime = CTimer::getTime();
    m_llTraceSent = m_llTraceRecv = m_iTraceSndLoss = m_iTraceRcvLoss = m_iTraceRetrans = m_iSentACK = m_iRecvACK = m_iSentNAK = m_iRecvNAK = 0;
    m_llSndDuration = m_llSndDurationTotal = 0;
+   m_llSentNAKBytesTotal = m_llRecvNAKBytesTotal = 0;
+   m_ullRecvNAKTimeTotal = 0;
+   m_iSentFECTotal = m_iRecvFECTotal = m_iFECRecoveredTotal = 0;
+   m_iSndDropTotal = m_iRcvDropTotal = 0;
 
    // structures for queue
    if (NULL == m_pSNode)
@@ -542,6 +647,10 @@ void CUDT::open()
 
    m_iRTT = 10 * m_iSYNInterval;
    m_iRTTVar = m_iRTT >> 1;
+   m_iMinRTT = m_iRTT;
+   m_ullMinRTTExpiry = 0;
+   m_ullSndBufTime = 0;
+   m_ullRcvWindowTime = 0;
    m_ullCPUFrequency = CTimer::getCPUFrequency();
 
    // set up the timers
@@ -551,6 +660,9 @@ void CUDT::open()
    m_ullMinNakInt = 300000 * m_ullCPUFrequency;
    m_ullMinExpInt = 300000 * m_ullCPUFrequency;
 
+   // release the memory of the buffers after one second without traffic
+   m_ullTrimInt = 1000000 * m_ullCPUFrequency;
+
    m_ullACKInt = m_ullSYNInt;
    m_ullNAKInt = m_ullMinNakInt;
 
@@ -559,6 +671,8 @@ void CUDT::open()
    m_ullLastRspTime = currtime;
    m_ullNextACKTime = currtime + m_ullSYNInt;
    m_ullNextNAKTime = currtime + m_ullNAKInt;
+   m_ullNextTrimTime = currtime + m_ullTrimInt;
+   m_llTrimPktCount = 0;
 
    m_iPktCount = 0;
    m_iLightACKCount = 1;
@@ -635,7 +749,7 @@ void CUDT::connect(const sockaddr* serv_addr)
    m_ConnReq.m_iVersion = m_iVersion;
    m_ConnReq.m_iType = m_iSockType;
    m_ConnReq.m_iMSS = m_iMSS;
-   m_ConnReq.m_iFlightFlagSize = (m_iRcvBufSize < m_iFlightFlagSize)? m_iRcvBufSize : m_iFlightFlagSize;
+   m_ConnReq.m_iFlightFlagSize = getMaxRcvBufSize();
    m_ConnReq.m_iReqType = (!m_bRendezvous) ? 1 : 0;
    m_ConnReq.m_iID = m_SocketID;
    CIPAddress::ntop(peer_addr, m_ConnReq.m_piPeerIP, m_iIPversion);
@@ -647,6 +761,9 @@ void CUDT::connect(const sockaddr* serv_addr)
    m_iLastDecSeq = m_iISN - 1;
    m_iSndLastAck = m_iISN;
    m_iSndLastDataAck = m_iISN;
+   m_iSndLastDropSeqNo = CSeqNo::decseq(m_iISN);
+   m_iSndDropCheckAck = m_iISN;
+   m_ullSndDropCheckTime = 0;
    m_iSndCurrSeqNo = m_iISN - 1;
    m_iSndLastAck2 = m_iISN;
    m_ullSndLastAck2Time = CTimer::getTime();
@@ -753,6 +870,14 @@ int CUDT::connect(const CPacket& response) throw ()
 
    m_ConnRes.deserialize(response.m_pcData, response.getLength());
 
+   if ((1002 == m_ConnRes.m_iReqType) && (m_ConnReq.m_iVersion > m_iMinVersion))
+   {
+      // the peer may be an older version that rejects any other one, try again with the oldest version
+      m_ConnReq.m_iVersion = m_iMinVersion;
+      m_llLastReqTime = 0;
+      return 1;
+   }
+
    if (m_bRendezvous)
    {
       // regular connect should NOT communicate with rendezvous connect
@@ -793,14 +918,21 @@ POST_CONNECT:
    m_iRcvLastAck = m_ConnRes.m_iISN;
    m_iRcvLastAckAck = m_ConnRes.m_iISN;
    m_iRcvCurrSeqNo = m_ConnRes.m_iISN - 1;
+   m_iNAKDueSeq = m_iNAKCheckSeq = m_iRcvCurrSeqNo;
+   m_ullNAKCheckTime = 0;
    m_PeerID = m_ConnRes.m_iID;
+   m_iPeerVersion = (m_ConnRes.m_iVersion < m_iVersion) ? m_ConnRes.m_iVersion : m_iVersion;
    memcpy(m_piSelfIP, m_ConnRes.m_piPeerIP, 16);
 
    // Prepare all data structures
+   // the buffers, loss lists and ACK window start small or empty and grow with the traffic, see trimBuffers()
    try
    {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
-      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
+      // with FEC, data packets leave room for the header of the virtual packets in the parity packets
+      if ((m_iFECGroup > 0) && (m_iPeerVersion >= 6))
+         m_pFECEncoder = new CFECEncoder(m_iFECGroup, m_iFECParity, m_iPayloadSize - CFEC::m_iHdrSize);
+      m_pSndBuffer = new CSndBuffer(2, (NULL != m_pFECEncoder) ? m_iPayloadSize - CFEC::m_iHdrSize : m_iPayloadSize);
+      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), getMaxRcvBufSize(), UDT_DGRAM == m_iSockType);
       // after introducing lite ACK, the sndlosslist may not be cleared in time, so it requires twice space.
       m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
       m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
@@ -813,13 +945,20 @@ POST_CONNECT:
       throw CUDTException(3, 2, 0);
    }
 
+   // warm start from the last connection to the same peer, if it is recent enough
    CInfoBlock ib;
    ib.m_iIPversion = m_iIPversion;
    CInfoBlock::convert(m_pPeerAddr, m_iIPversion, ib.m_piIP);
+   double weight = 0;
    if (m_pCache->lookup(&ib) >= 0)
+      weight = ib.getWeight(CTimer::getTime());
+   if (weight > 0)
    {
       m_iRTT = ib.m_iRTT;
+      m_iRTTVar = m_iRTT >> 1;
       m_iBandwidth = ib.m_iBandwidth;
+      if (ib.m_dInterval > 1)
+         m_iDeliveryRate = int(1000000.0 / ib.m_dInterval * weight);
    }
 
    m_pCC = m_pCCFactory->create();
@@ -830,6 +969,8 @@ POST_CONNECT:
    m_pCC->setRcvRate(m_iDeliveryRate);
    m_pCC->setRTT(m_iRTT);
    m_pCC->setBandwidth(m_iBandwidth);
+   if ((weight > 0) && (ib.m_dInterval > 0))
+      m_pCC->setHistory(ib.m_dInterval / weight, ib.m_dCWnd * weight);
    m_pCC->init();
 
    m_ullInterval = (uint64_t)(m_pCC->m_dPktSndPeriod * m_ullCPUFrequency);
@@ -864,23 +1005,33 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
 
    // exchange info for maximum flow window size
    m_iFlowWindowSize = hs->m_iFlightFlagSize;
-   hs->m_iFlightFlagSize = (m_iRcvBufSize < m_iFlightFlagSize)? m_iRcvBufSize : m_iFlightFlagSize;
+   hs->m_iFlightFlagSize = getMaxRcvBufSize();
 
    m_iPeerISN = hs->m_iISN;
 
    m_iRcvLastAck = hs->m_iISN;
    m_iRcvLastAckAck = hs->m_iISN;
    m_iRcvCurrSeqNo = hs->m_iISN - 1;
+   m_iNAKDueSeq = m_iNAKCheckSeq = m_iRcvCurrSeqNo;
+   m_ullNAKCheckTime = 0;
 
    m_PeerID = hs->m_iID;
    hs->m_iID = m_SocketID;
 
+   // both sides use the older version
+   if (hs->m_iVersion > m_iVersion)
+      hs->m_iVersion = m_iVersion;
+   m_iPeerVersion = hs->m_iVersion;
+
    // use peer's ISN and send it back for security check
    m_iISN = hs->m_iISN;
 
    m_iLastDecSeq = m_iISN - 1;
    m_iSndLastAck = m_iISN;
    m_iSndLastDataAck = m_iISN;
+   m_iSndLastDropSeqNo = CSeqNo::decseq(m_iISN);
+   m_iSndDropCheckAck = m_iISN;
+   m_ullSndDropCheckTime = 0;
    m_iSndCurrSeqNo = m_iISN - 1;
    m_iSndLastAck2 = m_iISN;
    m_ullSndLastAck2Time = CTimer::getTime();
@@ -898,8 +1049,10 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
    // Prepare all structures
    try
    {
-      m_pSndBuffer = new CSndBuffer(32, m_iPayloadSize);
-      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
+      if ((m_iFECGroup > 0) && (m_iPeerVersion >= 6))
+         m_pFECEncoder = new CFECEncoder(m_iFECGroup, m_iFECParity, m_iPayloadSize - CFEC::m_iHdrSize);
+      m_pSndBuffer = new CSndBuffer(2, (NULL != m_pFECEncoder) ? m_iPayloadSize - CFEC::m_iHdrSize : m_iPayloadSize);
+      m_pRcvBuffer = new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), getMaxRcvBufSize(), UDT_DGRAM == m_iSockType);
       m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
       m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
       m_pACKWindow = new CACKWindow(1024);
@@ -911,13 +1064,20 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
       throw CUDTException(3, 2, 0);
    }
 
+   // warm start from the last connection to the same peer, if it is recent enough
    CInfoBlock ib;
    ib.m_iIPversion = m_iIPversion;
    CInfoBlock::convert(peer, m_iIPversion, ib.m_piIP);
+   double weight = 0;
    if (m_pCache->lookup(&ib) >= 0)
+      weight = ib.getWeight(CTimer::getTime());
+   if (weight > 0)
    {
       m_iRTT = ib.m_iRTT;
+      m_iRTTVar = m_iRTT >> 1;
       m_iBandwidth = ib.m_iBandwidth;
+      if (ib.m_dInterval > 1)
+         m_iDeliveryRate = int(1000000.0 / ib.m_dInterval * weight);
    }
 
    m_pCC = m_pCCFactory->create();
@@ -928,6 +1088,8 @@ void CUDT::connect(const sockaddr* peer, CHandShake* hs)
    m_pCC->setRcvRate(m_iDeliveryRate);
    m_pCC->setRTT(m_iRTT);
    m_pCC->setBandwidth(m_iBandwidth);
+   if ((weight > 0) && (ib.m_dInterval > 0))
+      m_pCC->setHistory(ib.m_dInterval / weight, ib.m_dCWnd * weight);
    m_pCC->init();
 
    m_ullInterval = (uint64_t)(m_pCC->m_dPktSndPeriod * m_ullCPUFrequency);
@@ -1044,8 +1206,20 @@ void CUDT::close()
       CInfoBlock ib;
       ib.m_iIPversion = m_iIPversion;
       CInfoBlock::convert(m_pPeerAddr, m_iIPversion, ib.m_piIP);
+      if (m_pCache->lookup(&ib) < 0)
+      {
+         ib.m_dInterval = 0;
+         ib.m_dCWnd = 0;
+      }
+      ib.m_ullTimeStamp = CTimer::getTime();
       ib.m_iRTT = m_iRTT;
       ib.m_iBandwidth = m_iBandwidth;
+      // keep the previous congestion state if this connection did not send enough to probe the path
+      if (m_llSentTotal >= 16)
+      {
+         ib.m_dInterval = m_pCC->m_dPktSndPeriod;
+         ib.m_dCWnd = m_pCC->m_dCWndSize;
+      }
       m_pCache->update(&ib);
 
       m_bConnected = false;
@@ -1059,7 +1233,7 @@ void CUDT::close()
    m_bOpened = false;
 }
 
-int CUDT::send(const char* data, int len)
+int CUDT::send(const char* data, int len, UDT_RELEASE_CB release, void* arg, const UDTIOVEC* iov, int iovcnt)
 {
    if (UDT_DGRAM == m_iSockType)
       throw CUDTException(5, 10, 0);
@@ -1083,7 +1257,7 @@ int CUDT::send(const char* data, int len)
       m_ullLastRspTime = currtime;
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() <= 0)
    {
       if (!m_bSynSending)
          throw CUDTException(6, 1, 0);
@@ -1094,7 +1268,7 @@ int CUDT::send(const char* data, int len)
             pthread_mutex_lock(&m_SendBlockLock);
             if (m_iSndTimeOut < 0) 
             { 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+               while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth)
                   pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
             }
             else
@@ -1105,21 +1279,21 @@ int CUDT::send(const char* data, int len)
                locktime.tv_sec = exptime / 1000000;
                locktime.tv_nsec = (exptime % 1000000) * 1000;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth && (CTimer::getTime() < exptime))
                   pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
             }
             pthread_mutex_unlock(&m_SendBlockLock);
          #else
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+               while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth)
                   WaitForSingleObject(m_SendBlockCond, INFINITE);
             }
             else 
             {
                uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth && (CTimer::getTime() < exptime))
                   WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000)); 
             }
          #endif
@@ -1137,7 +1311,7 @@ int CUDT::send(const char* data, int len)
       }
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() <= 0)
    {
       if (m_iSndTimeOut >= 0)
          throw CUDTException(6, 3, 0); 
@@ -1145,7 +1319,7 @@ int CUDT::send(const char* data, int len)
       return 0;
    }
 
-   int size = (m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
+   int size = getSndBufSpace() * m_iPayloadSize;
    if (size > len)
       size = len;
 
@@ -1154,12 +1328,15 @@ int CUDT::send(const char* data, int len)
       m_llSndDurationCounter = CTimer::getTime();
 
    // insert the user buffer into the sening list
-   m_pSndBuffer->addBuffer(data, size);
+   if (NULL == iov)
+      m_pSndBuffer->addBuffer(data, size, -1, false, release, arg);
+   else
+      m_pSndBuffer->addBuffer(iov, iovcnt, size);
 
    // insert this socket to snd list if it is not on the list yet
    m_pSndQueue->m_pSndUList->update(this, false);
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() <= 0)
    {
       // write is not available any more
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
@@ -1168,7 +1345,7 @@ int CUDT::send(const char* data, int len)
    return size;
 }
 
-int CUDT::recv(char* data, int len)
+int CUDT::recv(char* data, int len, UDTIOVEC* iov, int* iovcnt, int* token)
 {
    if (UDT_DGRAM == m_iSockType)
       throw CUDTException(5, 10, 0);
@@ -1241,7 +1418,13 @@ int CUDT::recv(char* data, int len)
    else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
       throw CUDTException(2, 1, 0);
 
-   int res = m_pRcvBuffer->readBuffer(data, len);
+   int res;
+   if (NULL == iov)
+      res = m_pRcvBuffer->readBuffer(data, len);
+   else if (NULL == token)
+      res = m_pRcvBuffer->readBuffer(iov, *iovcnt);
+   else
+      res = m_pRcvBuffer->lendBuffer(iov, *iovcnt, *token);
 
    if (m_pRcvBuffer->getRcvDataSize() <= 0)
    {
@@ -1255,7 +1438,7 @@ int CUDT::recv(char* data, int len)
    return res;
 }
 
-int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
+int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder, UDT_RELEASE_CB release, void* arg, const UDTIOVEC* iov, int iovcnt)
 {
    if (UDT_STREAM == m_iSockType)
       throw CUDTException(5, 9, 0);
@@ -1282,7 +1465,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       m_ullLastRspTime = currtime;
    }
 
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
+   if (!msgFitsSndBuf(len))
    {
       if (!m_bSynSending)
          throw CUDTException(6, 1, 0);
@@ -1293,7 +1476,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
             pthread_mutex_lock(&m_SendBlockLock);
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+               while (!m_bBroken && m_bConnected && !m_bClosing && !msgFitsSndBuf(len))
                   pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
             }
             else
@@ -1304,21 +1487,21 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
                locktime.tv_sec = exptime / 1000000;
                locktime.tv_nsec = (exptime % 1000000) * 1000;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && !msgFitsSndBuf(len) && (CTimer::getTime() < exptime))
                   pthread_cond_timedwait(&m_SendBlockCond, &m_SendBlockLock, &locktime);
             }
             pthread_mutex_unlock(&m_SendBlockLock);
          #else
             if (m_iSndTimeOut < 0)
             {
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len))
+               while (!m_bBroken && m_bConnected && !m_bClosing && !msgFitsSndBuf(len))
                   WaitForSingleObject(m_SendBlockCond, INFINITE);
             }
             else
             {
                uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
 
-               while (!m_bBroken && m_bConnected && !m_bClosing && ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len) && (CTimer::getTime() < exptime))
+               while (!m_bBroken && m_bConnected && !m_bClosing && !msgFitsSndBuf(len) && (CTimer::getTime() < exptime))
                   WaitForSingleObject(m_SendBlockCond, DWORD((exptime - CTimer::getTime()) / 1000));
             }
          #endif
@@ -1331,7 +1514,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       }
    }
 
-   if ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize < len)
+   if (!msgFitsSndBuf(len))
    {
       if (m_iSndTimeOut >= 0)
          throw CUDTException(6, 3, 0);
@@ -1344,12 +1527,15 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
       m_llSndDurationCounter = CTimer::getTime();
 
    // insert the user buffer into the sening list
-   m_pSndBuffer->addBuffer(data, len, msttl, inorder);
+   if (NULL == iov)
+      m_pSndBuffer->addBuffer(data, len, msttl, inorder, release, arg);
+   else
+      m_pSndBuffer->addBuffer(iov, iovcnt, len, msttl, inorder);
 
    // insert this socket to the snd list if it is not on the list yet
    m_pSndQueue->m_pSndUList->update(this, false);
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() <= 0)
    {
       // write is not available any more
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
@@ -1358,7 +1544,7 @@ int CUDT::sendmsg(const char* data, int len, int msttl, bool inorder)
    return len;   
 }
 
-int CUDT::recvmsg(char* data, int len)
+int CUDT::recvmsg(char* data, int len, UDTIOVEC* iov, int* iovcnt, int* token)
 {
    if (UDT_STREAM == m_iSockType)
       throw CUDTException(5, 9, 0);
@@ -1374,7 +1560,7 @@ int CUDT::recvmsg(char* data, int len)
 
    if (m_bBroken || m_bClosing)
    {
-      int res = m_pRcvBuffer->readMsg(data, len);
+      int res = readMsg(data, len, iov, iovcnt, token);
 
       if (m_pRcvBuffer->getRcvMsgNum() <= 0)
       {
@@ -1390,7 +1576,14 @@ int CUDT::recvmsg(char* data, int len)
 
    if (!m_bSynRecving)
    {
-      int res = m_pRcvBuffer->readMsg(data, len);
+      int res = readMsg(data, len, iov, iovcnt, token);
+
+      if (m_pRcvBuffer->getRcvMsgNum() <= 0)
+      {
+         // read is not available any more
+         s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+      }
+
       if (0 == res)
          throw CUDTException(6, 2, 0);
       else
@@ -1407,7 +1600,7 @@ int CUDT::recvmsg(char* data, int len)
 
          if (m_iRcvTimeOut < 0)
          {
-            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = m_pRcvBuffer->readMsg(data, len))))
+            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = readMsg(data, len, iov, iovcnt, token))))
                pthread_cond_wait(&m_RecvDataCond, &m_RecvDataLock);
          }
          else
@@ -1421,13 +1614,13 @@ int CUDT::recvmsg(char* data, int len)
             if (pthread_cond_timedwait(&m_RecvDataCond, &m_RecvDataLock, &locktime) == ETIMEDOUT)
                timeout = true;
 
-            res = m_pRcvBuffer->readMsg(data, len);           
+            res = readMsg(data, len, iov, iovcnt, token);           
          }
          pthread_mutex_unlock(&m_RecvDataLock);
       #else
          if (m_iRcvTimeOut < 0)
          {
-            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = m_pRcvBuffer->readMsg(data, len))))
+            while (!m_bBroken && m_bConnected && !m_bClosing && (0 == (res = readMsg(data, len, iov, iovcnt, token))))
                WaitForSingleObject(m_RecvDataCond, INFINITE);
          }
          else
@@ -1435,7 +1628,7 @@ int CUDT::recvmsg(char* data, int len)
             if (WaitForSingleObject(m_RecvDataCond, DWORD(m_iRcvTimeOut)) == WAIT_TIMEOUT)
                timeout = true;
 
-            res = m_pRcvBuffer->readMsg(data, len);
+            res = readMsg(data, len, iov, iovcnt, token);
          }
       #endif
 
@@ -1457,6 +1650,24 @@ int CUDT::recvmsg(char* data, int len)
    return res;
 }
 
+void CUDT::release(int token)
+{
+   // not under m_RecvLock, a loan is often released while another thread is blocked in recvzc
+   if ((NULL == m_pRcvBuffer) || (m_pRcvBuffer->release(token) < 0))
+      throw CUDTException(5, 3, 0);
+}
+
+int CUDT::readMsg(char* data, int len, UDTIOVEC* iov, int* iovcnt, int* token)
+{
+   if (NULL == iov)
+      return m_pRcvBuffer->readMsg(data, len);
+
+   if (NULL == token)
+      return m_pRcvBuffer->readMsg(iov, *iovcnt);
+
+   return m_pRcvBuffer->lendMsg(iov, *iovcnt, *token);
+}
+
 int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
 {
    if (UDT_DGRAM == m_iSockType)
@@ -1506,11 +1717,11 @@ int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
 
       #ifndef WIN32
          pthread_mutex_lock(&m_SendBlockLock);
-         while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+         while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth)
             pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
          pthread_mutex_unlock(&m_SendBlockLock);
       #else
-         while (!m_bBroken && m_bConnected && !m_bClosing && (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) && m_bPeerHealth)
+         while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth)
             WaitForSingleObject(m_SendBlockCond, INFINITE);
       #endif
 
@@ -1541,7 +1752,7 @@ int64_t CUDT::sendfile(fstream& ifs, int64_t& offset, int64_t size, int block)
       m_pSndQueue->m_pSndUList->update(this, false);
    }
 
-   if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() <= 0)
    {
       // write is not available any more
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
@@ -1625,6 +1836,171 @@ int64_t CUDT::recvfile(fstream& ofs, int64_t& offset, int64_t size, int block)
    return size - torecv;
 }
 
+#ifndef WIN32
+int64_t CUDT::sendfile(int fd, int64_t& offset, int64_t size, int block)
+{
+   if (UDT_DGRAM == m_iSockType)
+      throw CUDTException(5, 10, 0);
+
+   if (m_bBroken || m_bClosing)
+      throw CUDTException(2, 1, 0);
+   else if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+
+   if (size <= 0)
+      return 0;
+
+   // the blocks are read at their offsets with preadv, which pipes, FIFOs and sockets do not support
+   struct stat st;
+   if ((fstat(fd, &st) < 0) || (offset < 0) || (lseek(fd, 0, SEEK_CUR) < 0))
+      throw CUDTException(4, 1);
+
+   // regular files are never sent past their end; their pages are mapped and sent without copying only if the file
+   // is sealed against writes and truncation, since reading a mapped page that has been truncated raises SIGBUS
+   bool map = false;
+   if (S_ISREG(st.st_mode))
+   {
+      if (offset >= st.st_size)
+         return 0;
+      if (size > st.st_size - offset)
+         size = st.st_size - offset;
+
+      #ifdef F_GET_SEALS
+         int seals = fcntl(fd, F_GET_SEALS);
+         map = (seals >= 0) && ((F_SEAL_SHRINK | F_SEAL_WRITE) == (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)));
+      #endif
+
+      #ifdef POSIX_FADV_SEQUENTIAL
+         posix_fadvise(fd, offset, size, POSIX_FADV_SEQUENTIAL);
+      #endif
+   }
+
+   CGuard sendguard(m_SendLock);
+
+   if (m_pSndBuffer->getCurrBufSize() == 0)
+   {
+      // delay the EXP timer to avoid mis-fired timeout
+      uint64_t currtime;
+      CTimer::rdtsc(currtime);
+      m_ullLastRspTime = currtime;
+   }
+
+   int64_t tosend = size;
+   int unitsize;
+
+   // sending block by block
+   while (tosend > 0)
+   {
+      unitsize = int((tosend >= block) ? block : tosend);
+
+      pthread_mutex_lock(&m_SendBlockLock);
+      while (!m_bBroken && m_bConnected && !m_bClosing && (getSndBufSpace() <= 0) && m_bPeerHealth)
+         pthread_cond_wait(&m_SendBlockCond, &m_SendBlockLock);
+      pthread_mutex_unlock(&m_SendBlockLock);
+
+      if (m_bBroken || m_bClosing)
+         throw CUDTException(2, 1, 0);
+      else if (!m_bConnected)
+         throw CUDTException(2, 2, 0);
+      else if (!m_bPeerHealth)
+      {
+         // reset peer health status, once this error returns, the app should handle the situation at the peer side
+         m_bPeerHealth = true;
+         throw CUDTException(7);
+      }
+
+      // record total time used for sending
+      if (0 == m_pSndBuffer->getCurrBufSize())
+         m_llSndDurationCounter = CTimer::getTime();
+
+      int64_t sentsize = m_pSndBuffer->addBufferFromFile(fd, offset, unitsize, map);
+
+      if (sentsize < 0)
+         throw CUDTException(4, 2, errno);
+
+      tosend -= sentsize;
+      offset += sentsize;
+
+      // insert this socket to snd list if it is not on the list yet
+      m_pSndQueue->m_pSndUList->update(this, false);
+
+      if (sentsize < unitsize)
+         break;
+   }
+
+   if (getSndBufSpace() <= 0)
+   {
+      // write is not available any more
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, false);
+   }
+
+   return size - tosend;
+}
+
+int64_t CUDT::recvfile(int fd, int64_t& offset, int64_t size, int block)
+{
+   if (UDT_DGRAM == m_iSockType)
+      throw CUDTException(5, 10, 0);
+
+   if (!m_bConnected)
+      throw CUDTException(2, 2, 0);
+   else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+      throw CUDTException(2, 1, 0);
+
+   if (size <= 0)
+      return 0;
+
+   // the packets are written at their offsets with pwritev, which pipes, FIFOs and sockets do not support
+   if ((offset < 0) || (lseek(fd, 0, SEEK_CUR) < 0))
+      throw CUDTException(4, 3);
+
+   CGuard recvguard(m_RecvLock);
+
+   int64_t torecv = size;
+   int unitsize = block;
+   int recvsize;
+
+   // receiving... "recvfile" is always blocking
+   while (torecv > 0)
+   {
+      pthread_mutex_lock(&m_RecvDataLock);
+      while (!m_bBroken && m_bConnected && !m_bClosing && (0 == m_pRcvBuffer->getRcvDataSize()))
+         pthread_cond_wait(&m_RecvDataCond, &m_RecvDataLock);
+      pthread_mutex_unlock(&m_RecvDataLock);
+
+      if (!m_bConnected)
+         throw CUDTException(2, 2, 0);
+      else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+         throw CUDTException(2, 1, 0);
+
+      unitsize = int((torecv >= block) ? block : torecv);
+      recvsize = m_pRcvBuffer->readBufferToFile(fd, offset, unitsize);
+
+      if (recvsize < 0)
+      {
+         int err = errno;
+
+         // send the sender a signal so it will not be blocked forever
+         int32_t err_code = CUDTException::EFILE;
+         sendCtrl(8, &err_code);
+
+         throw CUDTException(4, 4, err);
+      }
+
+      torecv -= recvsize;
+      offset += recvsize;
+   }
+
+   if (m_pRcvBuffer->getRcvDataSize() <= 0)
+   {
+      // read is not available any more
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, false);
+   }
+
+   return size - torecv;
+}
+#endif
+
 void CUDT::sample(CPerfMon* perf, bool clear)
 {
    if (!m_bConnected)
@@ -1655,6 +2031,14 @@ void CUDT::sample(CPerfMon* perf, bool clear)
    perf->pktRecvACKTotal = m_iRecvACKTotal;
    perf->pktSentNAKTotal = m_iSentNAKTotal;
    perf->pktRecvNAKTotal = m_iRecvNAKTotal;
+   perf->byteSentNAKTotal = m_llSentNAKBytesTotal;
+   perf->byteRecvNAKTotal = m_llRecvNAKBytesTotal;
+   perf->usRecvNAKTotal = m_ullRecvNAKTimeTotal / m_ullCPUFrequency;
+   perf->pktSentFECTotal = m_iSentFECTotal;
+   perf->pktRecvFECTotal = m_iRecvFECTotal;
+   perf->pktRcvFECRecoveredTotal = m_iFECRecoveredTotal;
+   perf->pktSndDropTotal = m_iSndDropTotal;
+   perf->pktRcvDropTotal = m_iRcvDropTotal;
    perf->usSndDurationTotal = m_llSndDurationTotal;
 
    double interval = double(currtime - m_LastSampleTime);
@@ -1675,8 +2059,8 @@ void CUDT::sample(CPerfMon* perf, bool clear)
       if (WAIT_OBJECT_0 == WaitForSingleObject(m_ConnectionLock, 0))
    #endif
    {
-      perf->byteAvailSndBuf = (NULL == m_pSndBuffer) ? 0 : (m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iMSS;
-      perf->byteAvailRcvBuf = (NULL == m_pRcvBuffer) ? 0 : m_pRcvBuffer->getAvailBufSize() * m_iMSS;
+      perf->byteAvailSndBuf = (NULL == m_pSndBuffer) ? 0 : getSndBufSpace() * m_iMSS;
+      perf->byteAvailRcvBuf = (NULL == m_pRcvBuffer) ? 0 : getRcvWindowSpace() * m_iMSS;
 
       #ifndef WIN32
          pthread_mutex_unlock(&m_ConnectionLock);
@@ -1852,20 +2236,31 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
       if (CSeqNo::seqcmp(m_iRcvLastAck, m_iRcvLastAckAck) > 0)
       {
          int32_t data[6];
+         bool full = (currtime - m_ullLastAckTime > m_ullSYNInt);
+
+         if (full)
+         {
+            data[4] = m_pRcvTimeWindow->getPktRcvSpeed();
+            data[5] = m_pRcvTimeWindow->getBandwidth();
+
+            if (m_bRcvBufAutoTune)
+               tuneRcvWindow(currtime);
+         }
 
          m_iAckSeqNo = CAckNo::incack(m_iAckSeqNo);
          data[0] = m_iRcvLastAck;
          data[1] = m_iRTT;
          data[2] = m_iRTTVar;
-         data[3] = m_pRcvBuffer->getAvailBufSize();
+         data[3] = getRcvWindowSpace();
+         // under the global memory budget, the window shrinks to what the unit queue can still take
+         if (data[3] > m_pRcvQueue->m_UnitQueue.getRoom())
+            data[3] = m_pRcvQueue->m_UnitQueue.getRoom();
          // a minimum flow window of 2 is used, even if buffer is full, to break potential deadlock
          if (data[3] < 2)
             data[3] = 2;
 
-         if (currtime - m_ullLastAckTime > m_ullSYNInt)
+         if (full)
          {
-            data[4] = m_pRcvTimeWindow->getPktRcvSpeed();
-            data[5] = m_pRcvTimeWindow->getBandwidth();
             ctrlpkt.pack(pkttype, &m_iAckSeqNo, data, 24);
 
             CTimer::rdtsc(m_ullLastAckTime);
@@ -1916,16 +2311,24 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
 
          ++ m_iSentNAK;
          ++ m_iSentNAKTotal;
+         m_llSentNAKBytesTotal += CPacket::m_iPktHdrSize + ctrlpkt.getLength();
          sent_nak = true;
       }
       else if (m_pRcvLossList->getLossLength() > 0)
       {
          // this is periodically NAK report; make sure NAK cannot be sent back too often
+         // losses that were reported on detection less than one RTT ago are left out, their retransmission may be on the way
 
          // read loss list from the local receiver loss list
          int32_t* data = new int32_t[m_iPayloadSize / 4];
          int losslen;
-         m_pRcvLossList->getLossArray(data, losslen, m_iPayloadSize / 4);
+         if (m_iPeerVersion >= 5)
+         {
+            m_pRcvLossList->getLossReport(data, losslen, m_iPayloadSize / 4, m_iNAKDueSeq);
+            pkttype = 9;
+         }
+         else
+            m_pRcvLossList->getLossArray(data, losslen, m_iPayloadSize / 4, m_iNAKDueSeq);
 
          if (0 < losslen)
          {
@@ -1935,6 +2338,7 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
 
             ++ m_iSentNAK;
             ++ m_iSentNAKTotal;
+            m_llSentNAKBytesTotal += CPacket::m_iPktHdrSize + ctrlpkt.getLength();
             sent_nak = true;
          }
 
@@ -2003,6 +2407,25 @@ void CUDT::sendCtrl(int pkttype, void* lparam, void* rparam, int size)
 
       break;
 
+   case 10: //1010 - FEC parity of the current group
+      {
+      int32_t info[2];
+      char* data;
+      for (int i = 0; i < m_pFECEncoder->getParityCount(); ++ i)
+      {
+         int len = m_pFECEncoder->getParity(i, info, data);
+         ctrlpkt.pack(pkttype, info, data, len);
+         ctrlpkt.m_iTimeStamp = int(CTimer::getTime() - m_StartTime);
+         ctrlpkt.m_iID = m_PeerID;
+         m_pSndQueue->sendto(m_pPeerAddr, ctrlpkt);
+      }
+
+      m_iSentFECTotal += m_pFECEncoder->getParityCount();
+      m_pFECEncoder->reset();
+
+      break;
+      }
+
    case 32767: //0x7FFF - Resevered for future use
       break;
 
@@ -2095,6 +2518,9 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
 
       CGuard::leaveCS(m_AckLock);
 
+      if (m_bSndBufAutoTune)
+         tuneSndBuf(currtime);
+
       #ifndef WIN32
          pthread_mutex_lock(&m_SendBlockLock);
          if (m_bSynSending)
@@ -2159,6 +2585,13 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       m_iRTTVar = (m_iRTTVar * 3 + abs(rtt - m_iRTT)) >> 2;
       m_iRTT = (m_iRTT * 7 + rtt) >> 3;
 
+      // the smallest sample over ten seconds approximates the path delay without the queueing delay
+      if ((rtt < m_iMinRTT) || (currtime > m_ullMinRTTExpiry))
+      {
+         m_iMinRTT = rtt;
+         m_ullMinRTTExpiry = currtime + 10000000 * m_ullCPUFrequency;
+      }
+
       m_pCC->setRTT(m_iRTT);
 
       // update last ACK that has been received by the sender
@@ -2169,16 +2602,32 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       }
 
    case 3: //011 - Loss Report
+   case 9: //1001 - Compressed Loss Report
       {
       int32_t* losslist = (int32_t *)(ctrlpkt.m_pcData);
+      int losslen = ctrlpkt.getLength() / 4;
+      int32_t* decoded = NULL;
 
-      m_pCC->onLoss(losslist, ctrlpkt.getLength() / 4);
-      CCUpdate();
+      m_llRecvNAKBytesTotal += CPacket::m_iPktHdrSize + ctrlpkt.getLength();
+
+      if (9 == ctrlpkt.getType())
+      {
+         // every entry of the loss list takes at least one byte in the compressed report
+         decoded = new int32_t[ctrlpkt.getLength()];
+         losslen = CRcvLossList::decodeLossReport(losslist, losslen, decoded, ctrlpkt.getLength());
+         losslist = decoded;
+      }
 
-      bool secure = true;
+      bool secure = (losslen >= 0);
+
+      if (secure)
+      {
+         m_pCC->onLoss(losslist, losslen);
+         CCUpdate();
+      }
 
       // decode loss list message and insert loss into the sender loss list
-      for (int i = 0, n = (int)(ctrlpkt.getLength() / 4); i < n; ++ i)
+      for (int i = 0; secure && (i < losslen); ++ i)
       {
          if (0 != (losslist[i] & 0x80000000))
          {
@@ -2216,6 +2665,12 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
          }
       }
 
+      delete [] decoded;
+
+      uint64_t exittime;
+      CTimer::rdtsc(exittime);
+      m_ullRecvNAKTimeTotal += exittime - currtime;
+
       if (!secure)
       {
          //this should not happen: attack or bug
@@ -2281,6 +2736,9 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       // Signal the sender and recver if they are waiting for data.
       releaseSynch();
 
+      // app can call any UDT API to learn the connection_broken error
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR, true);
+
       CTimer::triggerEvent();
 
       break;
@@ -2289,10 +2747,14 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
       m_pRcvBuffer->dropMsg(ctrlpkt.getMsgSeq());
       m_pRcvLossList->remove(*(int32_t*)ctrlpkt.m_pcData, *(int32_t*)(ctrlpkt.m_pcData + 4));
 
-      // move forward with current recv seq no.
-      if ((CSeqNo::seqcmp(*(int32_t*)ctrlpkt.m_pcData, CSeqNo::incseq(m_iRcvCurrSeqNo)) <= 0)
-         && (CSeqNo::seqcmp(*(int32_t*)(ctrlpkt.m_pcData + 4), m_iRcvCurrSeqNo) > 0))
+      // move forward with current recv seq no., as far as a data packet could
+      if ((CSeqNo::seqcmp(*(int32_t*)(ctrlpkt.m_pcData + 4), m_iRcvCurrSeqNo) > 0) &&
+          (CSeqNo::seqoff(m_iRcvLastAck, *(int32_t*)(ctrlpkt.m_pcData + 4)) < m_pRcvBuffer->getAvailBufSize()))
       {
+         // the sender may skip packets of an expired message it has not sent, but those sent before are due
+         if (CSeqNo::seqcmp(*(int32_t*)ctrlpkt.m_pcData, CSeqNo::incseq(m_iRcvCurrSeqNo)) > 0)
+            insertLoss(CSeqNo::incseq(m_iRcvCurrSeqNo), CSeqNo::decseq(*(int32_t*)ctrlpkt.m_pcData));
+
          m_iRcvCurrSeqNo = *(int32_t*)(ctrlpkt.m_pcData + 4);
       }
 
@@ -2309,6 +2771,25 @@ void CUDT::processCtrl(CPacket& ctrlpkt)
 
       break;
 
+   case 10: //1010 - FEC parity
+      if (NULL == m_pFECDecoder)
+      {
+         try
+         {
+            m_pFECDecoder = new CFECDecoder(m_iPayloadSize);
+         }
+         catch (...)
+         {
+            break;
+         }
+      }
+
+      ++ m_iRecvFECTotal;
+      m_pFECDecoder->addParity(ctrlpkt);
+      recoverData();
+
+      break;
+
    case 32767: //0x7FFF - reserved and user defined messages
       m_pCC->processCustomMsg(&ctrlpkt);
       CCUpdate();
@@ -2324,6 +2805,8 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
 {
    int payload = 0;
    bool probe = false;
+   bool retransmit = false;
+   int parity = 0;
 
    uint64_t entertime;
    CTimer::rdtsc(entertime);
@@ -2331,6 +2814,10 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
    if ((0 != m_ullTargetTime) && (entertime > m_ullTargetTime))
       m_ullTimeDiff += entertime - m_ullTargetTime;
 
+   // expired messages give their place to newer ones before anything is sent
+   if (UDT_DGRAM == m_iSockType)
+      dropExpired();
+
    // Loss retransmission always has higher priority.
    if ((packet.m_iSeqNo = m_pSndLossList->getLostSeq()) >= 0)
    {
@@ -2343,22 +2830,19 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
 
       int msglen;
 
-      payload = m_pSndBuffer->readData(&(packet.m_pcData), offset, packet.m_iMsgNo, msglen);
+      // a retransmission is not worth sending if it arrives after the message has expired
+      payload = m_pSndBuffer->readData(&(packet.m_pcData), offset, packet.m_iMsgNo, msglen, m_iRTT / 2);
 
       if (-1 == payload)
       {
          int32_t seqpair[2];
          seqpair[0] = packet.m_iSeqNo;
-         seqpair[1] = CSeqNo::incseq(seqpair[0], msglen);
-         sendCtrl(7, &packet.m_iMsgNo, seqpair, 8);
+         seqpair[1] = CSeqNo::incseq(seqpair[0], msglen - 1);
+         dropMsg(packet.m_iMsgNo, seqpair);
 
          // only one msg drop request is necessary
          m_pSndLossList->remove(seqpair[1]);
 
-         // skip all dropped packets
-         if (CSeqNo::seqcmp(m_iSndCurrSeqNo, CSeqNo::incseq(seqpair[1])) < 0)
-             m_iSndCurrSeqNo = CSeqNo::incseq(seqpair[1]);
-
          return 0;
       }
       else if (0 == payload)
@@ -2366,6 +2850,7 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
 
       ++ m_iTraceRetrans;
       ++ m_iRetransTotal;
+      retransmit = true;
    }
    else
    {
@@ -2373,29 +2858,24 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
 
       // check congestion/flow window limit
       int cwnd = (m_iFlowWindowSize < (int)m_dCongestionWindow) ? m_iFlowWindowSize : (int)m_dCongestionWindow;
-      if (cwnd >= CSeqNo::seqlen(m_iSndLastAck, CSeqNo::incseq(m_iSndCurrSeqNo)))
+      if ((cwnd >= CSeqNo::seqlen(m_iSndLastAck, CSeqNo::incseq(m_iSndCurrSeqNo))) &&
+          (0 != (payload = m_pSndBuffer->readData(&(packet.m_pcData), packet.m_iMsgNo))))
       {
-         if (0 != (payload = m_pSndBuffer->readData(&(packet.m_pcData), packet.m_iMsgNo)))
-         {
-            m_iSndCurrSeqNo = CSeqNo::incseq(m_iSndCurrSeqNo);
-            m_pCC->setSndCurrSeqNo(m_iSndCurrSeqNo);
+         m_iSndCurrSeqNo = CSeqNo::incseq(m_iSndCurrSeqNo);
+         m_pCC->setSndCurrSeqNo(m_iSndCurrSeqNo);
 
-            packet.m_iSeqNo = m_iSndCurrSeqNo;
+         packet.m_iSeqNo = m_iSndCurrSeqNo;
 
-            // every 16 (0xF) packets, a packet pair is sent
-            if (0 == (packet.m_iSeqNo & 0xF))
-               probe = true;
-         }
-         else
-         {
-            m_ullTargetTime = 0;
-            m_ullTimeDiff = 0;
-            ts = 0;
-            return 0;
-         }
+         // every 16 (0xF) packets, a packet pair is sent
+         if (0 == (packet.m_iSeqNo & 0xF))
+            probe = true;
       }
       else
       {
+         // nothing more can be sent for now: close the FEC group, so that its losses need not wait for more data
+         if ((NULL != m_pFECEncoder) && (m_pFECEncoder->getCount() > 0))
+            sendCtrl(10);
+
          m_ullTargetTime = 0;
          m_ullTimeDiff = 0;
          ts = 0;
@@ -2407,6 +2887,17 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
    packet.m_iID = m_PeerID;
    packet.setLength(payload);
 
+   // the parity packets are queued as control packets, so they go out right after this packet
+   if ((NULL != m_pFECEncoder) && !retransmit)
+   {
+      int count = m_pFECEncoder->add(packet);
+      if ((count == m_pFECEncoder->getGroupSize()) || (m_bFECMsg && (0 != (packet.getMsgBoundary() & 1))))
+      {
+         parity = m_pFECEncoder->getParityCount();
+         sendCtrl(10);
+      }
+   }
+
    m_pCC->onPktSent(&packet);
    //m_pSndTimeWindow->onPktSent(packet.m_iTimeStamp);
 
@@ -2437,12 +2928,16 @@ int CUDT::packData(CPacket& packet, uint64_t& ts)
       #endif
    }
 
+   // the parity packets take their share of the sending rate
+   if (parity > 0)
+      ts += parity * m_ullInterval;
+
    m_ullTargetTime = ts;
 
    return payload;
 }
 
-int CUDT::processData(CUnit* unit)
+int CUDT::processData(CUnit* unit, bool drop)
 {
    CPacket& packet = unit->m_Packet;
 
@@ -2466,6 +2961,24 @@ int CUDT::processData(CUnit* unit)
    ++ m_llTraceRecv;
    ++ m_llRecvTotal;
 
+   // a packet that could not be given a unit is dropped the same way as one beyond the window
+   if (drop || (storeData(unit) < 0))
+      return -1;
+
+   if (NULL != m_pFECDecoder)
+   {
+      // the copy may complete an FEC group; the unit is not used after this point, it may be taken by a rebuilt packet
+      m_pFECDecoder->addData(packet);
+      recoverData();
+   }
+
+   return 0;
+}
+
+int CUDT::storeData(CUnit* unit)
+{
+   CPacket& packet = unit->m_Packet;
+
    int32_t offset = CSeqNo::seqoff(m_iRcvLastAck, packet.m_iSeqNo);
    if ((offset < 0) || (offset >= m_pRcvBuffer->getAvailBufSize()))
       return -1;
@@ -2475,26 +2988,12 @@ int CUDT::processData(CUnit* unit)
 
    // Loss detection.
    if (CSeqNo::seqcmp(packet.m_iSeqNo, CSeqNo::incseq(m_iRcvCurrSeqNo)) > 0)
-   {
-      // If loss found, insert them to the receiver loss list
-      m_pRcvLossList->insert(CSeqNo::incseq(m_iRcvCurrSeqNo), CSeqNo::decseq(packet.m_iSeqNo));
-
-      // pack loss list for NAK
-      int32_t lossdata[2];
-      lossdata[0] = CSeqNo::incseq(m_iRcvCurrSeqNo) | 0x80000000;
-      lossdata[1] = CSeqNo::decseq(packet.m_iSeqNo);
-
-      // Generate loss report immediately.
-      sendCtrl(3, NULL, lossdata, (CSeqNo::incseq(m_iRcvCurrSeqNo) == CSeqNo::decseq(packet.m_iSeqNo)) ? 1 : 2);
-
-      int loss = CSeqNo::seqlen(m_iRcvCurrSeqNo, packet.m_iSeqNo) - 2;
-      m_iTraceRcvLoss += loss;
-      m_iRcvLossTotal += loss;
-   }
+      insertLoss(CSeqNo::incseq(m_iRcvCurrSeqNo), CSeqNo::decseq(packet.m_iSeqNo));
 
    // This is not a regular fixed size packet...   
    //an irregular sized packet usually indicates the end of a message, so send an ACK immediately   
-   if (packet.getLength() != m_iPayloadSize)   
+   //(with FEC, the regular payload of the peer is smaller by the FEC header)
+   if ((packet.getLength() != m_iPayloadSize) && ((NULL == m_pFECDecoder) || (packet.getLength() != m_iPayloadSize - CFEC::m_iHdrSize)))
       CTimer::rdtsc(m_ullNextACKTime); 
 
    // Update the current largest sequence number that has been received.
@@ -2507,6 +3006,50 @@ int CUDT::processData(CUnit* unit)
    return 0;
 }
 
+void CUDT::insertLoss(int32_t seqno1, int32_t seqno2)
+{
+   // If loss found, insert them to the receiver loss list
+   m_pRcvLossList->insert(seqno1, seqno2);
+
+   // pack loss list for NAK
+   int32_t lossdata[2];
+   lossdata[0] = seqno1 | 0x80000000;
+   lossdata[1] = seqno2;
+
+   uint64_t currtime;
+   CTimer::rdtsc(currtime);
+
+   // If the peer sends FEC, the loss may be rebuilt when the parity of its group arrives. The report is held
+   // for about the time of a group and the jitter, but not longer than half an RTT, when a retransmission
+   // is likely to be faster.
+   bool deferred = false;
+   if (NULL != m_pFECDecoder)
+   {
+      int speed = m_pRcvTimeWindow->getPktRcvSpeed();
+      int wait = m_iRTT / 2;
+      if (speed > 0)
+      {
+         int grouptime = int((m_pFECDecoder->getGroupSize() + 1) * 1000000LL / speed) + m_iRTTVar;
+         if (grouptime < wait)
+            wait = grouptime;
+      }
+
+      deferred = m_pFECDecoder->deferLoss(seqno1, seqno2, currtime + wait * m_ullCPUFrequency);
+   }
+
+   // Generate loss report immediately.
+   if (!deferred)
+      sendCtrl(3, NULL, lossdata, (seqno1 == seqno2) ? 1 : 2);
+
+   int loss = CSeqNo::seqlen(seqno1, seqno2);
+   m_iTraceRcvLoss += loss;
+   m_iRcvLossTotal += loss;
+
+   // the messages behind the gap do not wait for it past the play-out deadline
+   if (m_iRcvDeadline >= 0)
+      m_qRcvGaps.push_back(std::make_pair(seqno2, currtime + m_iRcvDeadline * 1000ULL * m_ullCPUFrequency));
+}
+
 int CUDT::listen(sockaddr* addr, CPacket& packet)
 {
    if (m_bClosing)
@@ -2557,7 +3100,7 @@ int CUDT::listen(sockaddr* addr, CPacket& packet)
    // When a peer side connects in...
    if ((1 == packet.getFlag()) && (0 == packet.getType()))
    {
-      if ((hs.m_iVersion != m_iVersion) || (hs.m_iType != m_iSockType))
+      if ((hs.m_iVersion < m_iMinVersion) || (hs.m_iType != m_iSockType))
       {
          // mismatch, reject the request
         hs.m_iReqType = 1002;
@@ -2632,6 +3175,20 @@ void CUDT::checkTimers()
       ++ m_iLightACKCount;
    }
 
+   if (currtime - m_ullNAKCheckTime > m_iRTT * m_ullCPUFrequency)
+   {
+      // losses detected before the last update have been reported for at least one RTT
+      m_iNAKDueSeq = m_iNAKCheckSeq;
+      m_iNAKCheckSeq = m_iRcvCurrSeqNo;
+      m_ullNAKCheckTime = currtime;
+   }
+
+   if (NULL != m_pFECDecoder)
+      reportDeferredLoss(currtime);
+
+   if (!m_qRcvGaps.empty())
+      skipGaps(currtime);
+
    if ((m_pRcvLossList->getLossLength() > 0) && (currtime > m_ullNextNAKTime))
    {
       // NAK timer expired, and there is loss to be reported.
@@ -2641,6 +3198,14 @@ void CUDT::checkTimers()
       m_ullNextNAKTime = currtime + m_ullNAKInt;
    }
 
+   if (m_llSentTotal + m_llRecvTotal != m_llTrimPktCount)
+   {
+      m_llTrimPktCount = m_llSentTotal + m_llRecvTotal;
+      m_ullNextTrimTime = currtime + m_ullTrimInt;
+   }
+   else if ((0 != m_ullNextTrimTime) && (currtime > m_ullNextTrimTime) && trimBuffers())
+      m_ullNextTrimTime = 0;
+
    uint64_t next_exp_time;
    if (m_pCC->m_bUserDefinedRTO)
       next_exp_time = m_ullLastRspTime + m_pCC->m_iRTO * m_ullCPUFrequency;
@@ -2710,6 +3275,318 @@ void CUDT::checkTimers()
    }
 }
 
+bool CUDT::trimBuffers()
+{
+   // this is the receiving worker, the only user of the ACK window and the receiver loss list
+
+   if ((m_pRcvLossList->getLossLength() > 0) || (m_pRcvBuffer->getRcvDataSize() > 0))
+      return false;
+
+   m_pACKWindow->trim();
+   m_pRcvLossList->trim();
+
+   // the next parity packet prepares the decoder again
+   if (NULL != m_pFECDecoder)
+      m_pFECDecoder->trim();
+
+   // the reading thread may be blocked in recv with m_RecvLock; with no data to read it does not touch the units,
+   // and the message scan is excluded by the lock of the buffer
+   m_pRcvBuffer->trim();
+
+   // a sending thread writes into the blocks outside of the buffer lock, so the sender buffer is only trimmed
+   // while no thread is in send, otherwise it is tried again at the next timer check
+   #ifndef WIN32
+      if (0 != pthread_mutex_trylock(&m_SendLock))
+         return false;
+   #else
+      if (WAIT_OBJECT_0 != WaitForSingleObject(m_SendLock, 0))
+         return false;
+   #endif
+
+   m_pSndBuffer->trim();
+   m_pSndLossList->trim();
+
+   #ifndef WIN32
+      pthread_mutex_unlock(&m_SendLock);
+   #else
+      ReleaseMutex(m_SendLock);
+   #endif
+
+   return true;
+}
+
+void CUDT::recoverData()
+{
+   // a rebuilt packet is stored like a received one, but it does not count as an arrival
+   while (m_pFECDecoder->hasRecovered())
+   {
+      CUnit* unit = m_pRcvQueue->m_UnitQueue.getNextAvailUnit();
+      if ((NULL == unit) || !m_pFECDecoder->getRecovered(unit->m_Packet))
+         break;
+
+      unit->m_Packet.m_iID = m_SocketID;
+      if (storeData(unit) == 0)
+         ++ m_iFECRecoveredTotal;
+   }
+}
+
+void CUDT::reportDeferredLoss(uint64_t currtime)
+{
+   int32_t lossdata[2];
+   int32_t seqno1, seqno2;
+   while (m_pFECDecoder->getDueLoss(currtime, seqno1, seqno2))
+   {
+      // packets rebuilt or received in the meantime are not reported
+      if (!m_pRcvLossList->find(seqno1, seqno2))
+         continue;
+
+      while (!m_pRcvLossList->find(seqno1, seqno1))
+         seqno1 = CSeqNo::incseq(seqno1);
+      while (!m_pRcvLossList->find(seqno2, seqno2))
+         seqno2 = CSeqNo::decseq(seqno2);
+
+      lossdata[0] = seqno1 | 0x80000000;
+      lossdata[1] = seqno2;
+      sendCtrl(3, NULL, lossdata, (seqno1 == seqno2) ? 1 : 2);
+   }
+}
+
+void CUDT::skipGaps(uint64_t currtime)
+{
+   int32_t seqno = -1;
+   while (!m_qRcvGaps.empty() && (m_qRcvGaps.front().second <= currtime))
+   {
+      seqno = m_qRcvGaps.front().first;
+      m_qRcvGaps.pop_front();
+   }
+
+   if (seqno < 0)
+      return;
+
+   int32_t first = m_pRcvLossList->getFirstLostSeq();
+   if ((first < 0) || (CSeqNo::seqcmp(first, seqno) > 0))
+      return;
+
+   // give up the packets still missing: the ACK moves past them, so that the sender stops retransmitting them
+   // and the complete messages behind them can be read, while the incomplete ones are dropped from the buffer
+   int loss = m_pRcvLossList->getLossLength();
+   m_pRcvLossList->remove(first, seqno);
+   m_iRcvDropTotal += loss - m_pRcvLossList->getLossLength();
+
+   sendCtrl(2);
+}
+
+void CUDT::dropExpired()
+{
+   CGuard::enterCS(m_AckLock);
+
+   // the messages sent are checked in order, from the first one not dropped yet; the losses of the dropped
+   // packets are left in the loss list, a retransmission of them sends the drop request again
+   int offset = CSeqNo::seqoff(m_iSndLastDataAck, CSeqNo::incseq(m_iSndLastDropSeqNo));
+   if (offset < 0)
+      offset = 0;
+
+   // the rest of a message partly sent is only skipped within the flow window, the receiver moves past it
+   int limit = CSeqNo::seqoff(m_iSndLastDataAck, m_iSndLastAck) + m_iFlowWindowSize;
+
+   int32_t msgno;
+   int msglen;
+   int32_t seqpair[2];
+   while ((msglen = m_pSndBuffer->dropExpired(offset, limit, msgno)) > 0)
+   {
+      seqpair[0] = CSeqNo::incseq(m_iSndLastDataAck, offset);
+      seqpair[1] = CSeqNo::incseq(seqpair[0], msglen - 1);
+      dropMsg(msgno, seqpair);
+
+      m_iSndLastDropSeqNo = seqpair[1];
+      offset += msglen;
+   }
+
+   // a drop request may be lost, the receiver then waits at its ACK point: send it again after an RTT there
+   if (CSeqNo::seqcmp(m_iSndLastAck, m_iSndLastDropSeqNo) <= 0)
+   {
+      uint64_t currtime;
+      CTimer::rdtsc(currtime);
+
+      if (m_iSndDropCheckAck != m_iSndLastAck)
+      {
+         m_iSndDropCheckAck = m_iSndLastAck;
+         m_ullSndDropCheckTime = currtime;
+      }
+      else if (currtime - m_ullSndDropCheckTime > (m_iRTT + 4 * m_iRTTVar) * m_ullCPUFrequency)
+      {
+         offset = CSeqNo::seqoff(m_iSndLastDataAck, m_iSndLastAck);
+         if ((offset >= 0) && ((msglen = m_pSndBuffer->dropExpired(offset, limit, msgno)) > 0))
+         {
+            seqpair[0] = m_iSndLastAck;
+            seqpair[1] = CSeqNo::incseq(seqpair[0], msglen - 1);
+            dropMsg(msgno, seqpair);
+         }
+
+         m_ullSndDropCheckTime = currtime;
+      }
+   }
+
+   CGuard::leaveCS(m_AckLock);
+
+   // a message is not started if it cannot be delivered in time at the current rate; messages not sent at all leave
+   // the buffer without taking sequence numbers, which would count against the window
+   int dropped = m_pSndBuffer->dropUnsent(m_iRTT / 2, m_ullInterval / m_ullCPUFrequency);
+   if (dropped > 0)
+   {
+      m_iSndDropTotal += dropped;
+
+      #ifndef WIN32
+         pthread_mutex_lock(&m_SendBlockLock);
+         if (m_bSynSending)
+            pthread_cond_signal(&m_SendBlockCond);
+         pthread_mutex_unlock(&m_SendBlockLock);
+      #else
+         if (m_bSynSending)
+            SetEvent(m_SendBlockCond);
+      #endif
+
+      s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
+   }
+}
+
+void CUDT::dropMsg(int32_t msgno, int32_t* seqpair)
+{
+   sendCtrl(7, &msgno, seqpair, 8);
+
+   // skip all dropped packets
+   if (CSeqNo::seqcmp(seqpair[1], m_iSndCurrSeqNo) > 0)
+   {
+      // an FEC group covers consecutive sequence numbers, so it ends before the skipped ones
+      if ((NULL != m_pFECEncoder) && (m_pFECEncoder->getCount() > 0))
+         sendCtrl(10);
+
+      m_iSndCurrSeqNo = seqpair[1];
+      m_pCC->setSndCurrSeqNo(m_iSndCurrSeqNo);
+   }
+
+   // a request sent again, because the receiver still reports the packets as lost, is counted once
+   if (CSeqNo::seqcmp(seqpair[1], m_iSndLastDropSeqNo) > 0)
+   {
+      if (CSeqNo::seqcmp(seqpair[0], m_iSndLastDropSeqNo) > 0)
+         m_iSndDropTotal += CSeqNo::seqlen(seqpair[0], seqpair[1]);
+      else
+         m_iSndDropTotal += CSeqNo::seqoff(m_iSndLastDropSeqNo, seqpair[1]);
+   }
+}
+
+int CUDT::getSndBufSpace() const
+{
+   // the current size limit, as far as the global memory budget lets the buffer grow
+   return m_pSndBuffer->getRoom(m_iSndBufLimit - m_pSndBuffer->getCurrBufSize());
+}
+
+bool CUDT::msgFitsSndBuf(int len) const
+{
+   // a message always fits an empty buffer, there would be no acknowledgement to wake the sender up otherwise
+   return (0 == m_pSndBuffer->getCurrBufSize()) || (getSndBufSpace() * m_iPayloadSize >= len);
+}
+
+void CUDT::tuneSndBuf(uint64_t currtime)
+{
+   if (0 == m_ullSndBufTime)
+   {
+      m_iSndBufAck = m_iSndLastDataAck;
+      m_ullSndBufTime = currtime;
+      return;
+   }
+
+   // the acknowledged data is measured like the receiver measures the delivered data, see tuneRcvWindow()
+   int delay = m_iRTT + m_iSYNInterval;
+   int64_t period = (currtime - m_ullSndBufTime) / m_ullCPUFrequency;
+   if (period < delay)
+      return;
+
+   int acked = CSeqNo::seqoff(m_iSndBufAck, m_iSndLastDataAck);
+   m_iSndBufAck = m_iSndLastDataAck;
+   m_ullSndBufTime = currtime;
+
+   if (acked <= 0)
+      return;
+
+   // a sender limited by its buffer gets all of it acknowledged per round trip, so the limit grows by a quarter
+   // each time; the configured size is the lower bound
+   int64_t target = acked * 5LL * delay / (period * 4);
+   if (target < m_iSndBufSize)
+      target = m_iSndBufSize;
+
+   if (target >= m_iSndBufLimit)
+      m_iSndBufLimit = int(target);
+   else
+      m_iSndBufLimit -= (m_iSndBufLimit - int(target) + 15) >> 4;
+}
+
+void CUDT::tuneRcvWindow(uint64_t currtime)
+{
+   if (0 == m_ullRcvWindowTime)
+   {
+      m_iRcvWindowAck = m_iRcvLastAck;
+      m_ullRcvWindowTime = currtime;
+      return;
+   }
+
+   // the sender must be able to keep the pipe busy until the next full ACK arrives, so the delay is the
+   // path delay plus the ACK interval; the queueing delay is left out, otherwise a larger window would
+   // build a longer queue and ask for an even larger window
+   int delay = m_iMinRTT + m_iSYNInterval;
+
+   // measure the delivery rate over at least one such delay, a window-limited sender delivers in bursts
+   int64_t period = (currtime - m_ullRcvWindowTime) / m_ullCPUFrequency;
+   if (period < delay)
+      return;
+
+   int delivered = CSeqNo::seqoff(m_iRcvWindowAck, m_iRcvLastAck);
+   m_iRcvWindowAck = m_iRcvLastAck;
+   m_ullRcvWindowTime = currtime;
+
+   // an idle connection keeps its window
+   if (delivered <= 0)
+      return;
+
+   // a quarter more than the bandwidth-delay product: a window-limited sender delivers the whole window per
+   // round trip and the window grows by a quarter each time, while a window far above the product would only
+   // let the sender overrun the bottleneck queue
+   int64_t target = delivered * 5LL * delay / (period * 4);
+
+   // the configured size is the lower bound, short paths are not worse off than without tuning
+   if (target < m_iRcvBufSize)
+      target = m_iRcvBufSize;
+   if (target > getMaxRcvBufSize())
+      target = getMaxRcvBufSize();
+
+   // grow at once, but shrink gradually so that a short dip in the delivery rate does not stall the sender
+   if (target >= m_iRcvWindow)
+      m_iRcvWindow = int(target);
+   else
+      m_iRcvWindow -= (m_iRcvWindow - int(target) + 15) >> 4;
+}
+
+int CUDT::getRcvWindowSpace() const
+{
+   // the unread data counts against the window; the physical buffer may hold more when the window has shrunk
+   int space = m_iRcvWindow - m_pRcvBuffer->getRcvDataSize() - 1;
+   int avail = m_pRcvBuffer->getAvailBufSize();
+   if (space > avail)
+      space = avail;
+
+   return (space > 0) ? space : 0;
+}
+
+int CUDT::getMaxRcvBufSize() const
+{
+   // an auto-tuned receiver buffer may grow up to the flight flag size, its memory follows the data it holds;
+   // no buffer can be used beyond the flight flag size
+   if (m_bRcvBufAutoTune || (m_iFlightFlagSize < m_iRcvBufSize))
+      return m_iFlightFlagSize;
+
+   return m_iRcvBufSize;
+}
+
 void CUDT::addEPoll(const int eid)
 {
    CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
@@ -2724,7 +3601,7 @@ void CUDT::addEPoll(const int eid)
    {
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN, true);
    }
-   if (m_iSndBufSize > m_pSndBuffer->getCurrBufSize())
+   if (getSndBufSpace() > 0)
    {
       s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT, true);
    }
@@ -53,6 +53,7 @@ written by
 #include "ccc.h"
 #include "cache.h"
 #include "queue.h"
+#include "fec.h"
 
 enum UDTSockType {UDT_STREAM = 1, UDT_DGRAM};
 
@@ -93,8 +94,21 @@ public: //API
    static int recv(UDTSOCKET u, char* buf, int len, int flags);
    static int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
    static int recvmsg(UDTSOCKET u, char* buf, int len);
+   static int sendzc(UDTSOCKET u, const char* buf, int len, UDT_RELEASE_CB release, void* arg = NULL, int ttl = -1, bool inorder = false);
+   static int recvzc(UDTSOCKET u, UDTIOVEC* iov, int* iovcnt, int* token);
+   static int release(UDTSOCKET u, int token);
+   static int sendv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags);
+   static int recvv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags);
+   static int sendmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int ttl = -1, bool inorder = false);
+   static int recvmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt);
    static int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
    static int64_t recvfile(UDTSOCKET u, std::fstream& ofs, int64_t& offset, int64_t size, int block = 7280000);
+#ifndef WIN32
+   static int64_t sendfile_fd(UDTSOCKET u, int fd, int64_t& offset, int64_t size, int block = 364000);
+   static int64_t recvfile_fd(UDTSOCKET u, int fd, int64_t& offset, int64_t size, int block = 7280000);
+   static int64_t sendfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, int block = 364000);
+   static int64_t recvfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal = NULL, int block = 7280000);
+#endif
    static int select(int nfds, ud_set* readfds, ud_set* writefds, ud_set* exceptfds, const timeval* timeout);
    static int selectEx(const std::vector<UDTSOCKET>& fds, std::vector<UDTSOCKET>* readfds, std::vector<UDTSOCKET>* writefds, std::vector<UDTSOCKET>* exceptfds, int64_t msTimeOut);
    static int epoll_create();
@@ -103,10 +117,14 @@ public: //API
    static int epoll_remove_usock(const int eid, const UDTSOCKET u);
    static int epoll_remove_ssock(const int eid, const SYSSOCKET s);
    static int epoll_wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds = NULL, std::set<SYSSOCKET>* wrfds = NULL);
+   static int epoll_uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut);
+   static int epoll_getfd(const int eid);
    static int epoll_release(const int eid);
    static CUDTException& getlasterror();
    static int perfmon(UDTSOCKET u, CPerfMon* perf, bool clear = true);
    static UDTSTATUS getsockstate(UDTSOCKET u);
+   static int setmemlimit(int64_t limit);
+   static int64_t getmemusage();
 #ifdef USE_LIBNICE
    static int getICEInfo(UDTSOCKET u, std::string& ufrag, std::string& pwd,
                          std::vector<std::string>& candidates);
@@ -182,20 +200,28 @@ private:
       // Parameters:
       //    0) [in] data: The address of the application data to be sent.
       //    1) [in] len: The size of the data block.
+      //    2) [in] release: if not NULL, the data is not copied and released by this callback once acknowledged.
+      //    3) [in] arg: user argument passed to the release callback.
+      //    4) [in] iov: if not NULL, the data is gathered from these segments in place of "data", "len" being their total size.
+      //    5) [in] iovcnt: number of segments in iov.
       // Returned value:
       //    Actual size of data sent.
 
-   int send(const char* data, int len);
+   int send(const char* data, int len, UDT_RELEASE_CB release = NULL, void* arg = NULL, const UDTIOVEC* iov = NULL, int iovcnt = 0);
 
       // Functionality:
       //    Request UDT to receive data to a memory block "data" with size of "len".
       // Parameters:
       //    0) [out] data: data received.
       //    1) [in] len: The desired size of data to be received.
+      //    2) [in, out] iov: if not NULL, the segments the data is scattered into in place of "data", "len" being their total size;
+      //       with a token, the data is lent in place of being copied, one entry per packet.
+      //    3) [in, out] iovcnt: number of entries in iov; number of entries used for a loan.
+      //    4) [out] token: identifier of the loan, for release().
       // Returned value:
       //    Actual size of data received.
 
-   int recv(char* data, int len);
+   int recv(char* data, int len, UDTIOVEC* iov = NULL, int* iovcnt = NULL, int* token = NULL);
 
       // Functionality:
       //    send a message of a memory block "data" with size of "len".
@@ -204,20 +230,37 @@ private:
       //    1) [in] len: The desired size of data to be received.
       //    2) [in] ttl: the time-to-live of the message.
       //    3) [in] inorder: if the message should be delivered in order.
+      //    4) [in] release: if not NULL, the data is not copied and released by this callback once acknowledged.
+      //    5) [in] arg: user argument passed to the release callback.
+      //    6) [in] iov: if not NULL, the message is gathered from these segments in place of "data", "len" being their total size.
+      //    7) [in] iovcnt: number of segments in iov.
       // Returned value:
       //    Actual size of data sent.
 
-   int sendmsg(const char* data, int len, int ttl, bool inorder);
+   int sendmsg(const char* data, int len, int ttl, bool inorder, UDT_RELEASE_CB release = NULL, void* arg = NULL, const UDTIOVEC* iov = NULL, int iovcnt = 0);
 
       // Functionality:
       //    Receive a message to buffer "data".
       // Parameters:
       //    0) [out] data: data received.
       //    1) [in] len: size of the buffer.
+      //    2) [in, out] iov: if not NULL, the segments the message is scattered into in place of "data", "len" being their total size;
+      //       with a token, the message is lent in place of being copied, one entry per packet.
+      //    3) [in, out] iovcnt: number of entries in iov; number of entries used for a loan.
+      //    4) [out] token: identifier of the loan, for release().
       // Returned value:
       //    Actual size of data received.
 
-   int recvmsg(char* data, int len);
+   int recvmsg(char* data, int len, UDTIOVEC* iov = NULL, int* iovcnt = NULL, int* token = NULL);
+
+      // Functionality:
+      //    Give the data lent by recv() or recvmsg() back to UDT.
+      // Parameters:
+      //    0) [in] token: identifier of the loan.
+      // Returned value:
+      //    None.
+
+   void release(int token);
 
       // Functionality:
       //    Request UDT to send out a file described as "fd", starting from "offset", with size of "size".
@@ -243,6 +286,32 @@ private:
 
    int64_t recvfile(std::fstream& ofs, int64_t& offset, int64_t size, int block = 7320000);
 
+#ifndef WIN32
+      // Functionality:
+      //    Request UDT to send out a file described as "fd", mapping or reading the file directly into the sending buffer.
+      // Parameters:
+      //    0) [in] fd: The input file descriptor.
+      //    1) [in, out] offset: From where to read and send data; output is the new offset when the call returns.
+      //    2) [in] size: How many data to be sent.
+      //    3) [in] block: size of block per read from disk
+      // Returned value:
+      //    Actual size of data sent.
+
+   int64_t sendfile(int fd, int64_t& offset, int64_t size, int block = 366000);
+
+      // Functionality:
+      //    Request UDT to receive data into a file described as "fd", writing runs of received packets in one call.
+      // Parameters:
+      //    0) [in] fd: The output file descriptor.
+      //    1) [in, out] offset: From where to write data; output is the new offset when the call returns.
+      //    2) [in] size: How many data to be received.
+      //    3) [in] block: size of block per write to disk
+      // Returned value:
+      //    Actual size of data received.
+
+   int64_t recvfile(int fd, int64_t& offset, int64_t size, int block = 7320000);
+#endif
+
       // Functionality:
       //    Configure UDT options.
       // Parameters:
@@ -275,6 +344,25 @@ private:
 
    void sample(CPerfMon* perf, bool clear = true);
 
+      // Functionality:
+      //    read a message from the receiver buffer, by copy, scattered or by loan.
+      // Parameters:
+      //    See recvmsg().
+      // Returned value:
+      //    Actual size of data received.
+
+   int readMsg(char* data, int len, UDTIOVEC* iov, int* iovcnt, int* token);
+
+      // Functionality:
+      //    Total size of a number of user segments.
+      // Parameters:
+      //    0) [in] iov: the user segments.
+      //    1) [in] iovcnt: number of segments.
+      // Returned value:
+      //    Total size; an exception is thrown if the segments are invalid or larger than 2GB in total.
+
+   static int getIOVecSize(const UDTIOVEC* iov, int iovcnt);
+
 private:
    static CUDTUnited s_UDTUnited;               // UDT global management base
 
@@ -287,6 +375,8 @@ private: // Identification
    UDTSockType m_iSockType;                     // Type of the UDT connection (SOCK_STREAM or SOCK_DGRAM)
    UDTSOCKET m_PeerID;				// peer id, for multiplexer
    static const int m_iVersion;                 // UDT version, for compatibility use
+   static const int m_iMinVersion;              // oldest UDT version of the peer that can be connected
+   int m_iPeerVersion;                          // UDT version of the peer, negotiated in handshake
 
 private: // Packet sizes
    int m_iPktSize;                              // Maximum/regular packet size, in bytes
@@ -299,6 +389,8 @@ private: // Options
    int m_iFlightFlagSize;                       // Maximum number of packets in flight from the peer side
    int m_iSndBufSize;                           // Maximum UDT sender buffer size
    int m_iRcvBufSize;                           // Maximum UDT receiver buffer size
+   bool m_bSndBufAutoTune;                      // If the sender buffer size follows the measured bandwidth-delay product
+   bool m_bRcvBufAutoTune;                      // If the receiver buffer size follows the measured bandwidth-delay product
    linger m_Linger;                             // Linger information on close
    int m_iUDPSndBufSize;                        // UDP sending buffer size
    int m_iUDPRcvBufSize;                        // UDP receiving buffer size
@@ -308,6 +400,10 @@ private: // Options
    int m_iRcvTimeOut;                           // receiving timeout in milliseconds
    bool m_bReuseAddr;				// reuse an exiting port or not, for UDP multiplexer
    int64_t m_llMaxBW;				// maximum data transfer rate (threshold)
+   int m_iFECGroup;                             // number of data packets protected by a group of FEC parity packets, 0 if off
+   int m_iFECParity;                            // number of parity packets of an FEC group
+   bool m_bFECMsg;                              // if an FEC group also ends with each message
+   int m_iRcvDeadline;                          // play-out deadline in milliseconds after which a gap is skipped, -1 to wait
 
 private: // congestion control
    CCCVirtualFactory* m_pCCFactory;             // Factory class to create a specific CC instance
@@ -370,7 +466,20 @@ private: // Sending related data
 
    int32_t m_iISN;                              // Initial Sequence Number
 
+   volatile int m_iSndBufLimit;                 // Sender buffer size currently in use, in packets
+   int32_t m_iSndBufAck;                        // Last data ACK when the delivery rate measurement started
+   uint64_t m_ullSndBufTime;                    // Time when the delivery rate measurement started, 0 if not started
+
+   CFECEncoder* m_pFECEncoder;                  // FEC parity of the data packets being sent, NULL if FEC is off
+
+   int32_t m_iSndLastDropSeqNo;                 // Packets up to this seq. no. are covered by a msg drop request
+   int32_t m_iSndDropCheckAck;                  // ACK seen when the peer was last checked for a lost drop request
+   uint64_t m_ullSndDropCheckTime;              // Time the ACK was first seen at m_iSndDropCheckAck
+
    void CCUpdate();
+   void tuneSndBuf(uint64_t currtime);
+   void dropExpired();
+   void dropMsg(int32_t msgno, int32_t* seqpair);
 
 private: // Receiving related data
    CRcvBuffer* m_pRcvBuffer;                    // Receiver buffer
@@ -383,6 +492,28 @@ private: // Receiving related data
    int32_t m_iRcvLastAckAck;                    // Last sent ACK that has been acknowledged
    int32_t m_iAckSeqNo;                         // Last ACK sequence number
    int32_t m_iRcvCurrSeqNo;                     // Largest received sequence number
+   int32_t m_iNAKDueSeq;                        // Losses up to this seq. no. have been reported for at least one RTT
+   int32_t m_iNAKCheckSeq;                      // Largest received sequence number at the last update of m_iNAKDueSeq
+   uint64_t m_ullNAKCheckTime;                  // Time of the last update of m_iNAKDueSeq
+
+   volatile int m_iRcvWindow;                   // Receiver buffer size currently offered to the peer, in packets
+   int m_iMinRTT;                               // Smallest RTT sample in the current filter period, in microseconds
+   uint64_t m_ullMinRTTExpiry;                  // End of the current minimum RTT filter period, in CPU clock cycles
+   int32_t m_iRcvWindowAck;                     // Last sent ACK when the delivery rate measurement started
+   uint64_t m_ullRcvWindowTime;                 // Time when the delivery rate measurement started, 0 if not started
+
+   void tuneRcvWindow(uint64_t currtime);
+   int getRcvWindowSpace() const;
+   int getMaxRcvBufSize() const;
+
+   CFECDecoder* m_pFECDecoder;                  // reconstruction of lost packets, created by the first FEC parity packet
+
+   void recoverData();
+   void reportDeferredLoss(uint64_t currtime);
+
+   std::deque<std::pair<int32_t, uint64_t> > m_qRcvGaps;        // last seq. no. of each gap and the time to skip it
+
+   void skipGaps(uint64_t currtime);
 
    uint64_t m_ullLastWarningTime;               // Last time that a warning message is sent
 
@@ -425,7 +556,9 @@ private: // Generation and processing of packets
    void sendCtrl(int pkttype, void* lparam = NULL, void* rparam = NULL, int size = 0);
    void processCtrl(CPacket& ctrlpkt);
    int packData(CPacket& packet, uint64_t& ts);
-   int processData(CUnit* unit);
+   int processData(CUnit* unit, bool drop = false);
+   int storeData(CUnit* unit);
+   void insertLoss(int32_t seqno1, int32_t seqno2);
    int listen(sockaddr* addr, CPacket& packet);
 
 private: // Trace
@@ -439,6 +572,14 @@ private: // Trace
    int m_iRecvACKTotal;                         // total number of received ACK packets
    int m_iSentNAKTotal;                         // total number of sent NAK packets
    int m_iRecvNAKTotal;                         // total number of received NAK packets
+   int64_t m_llSentNAKBytesTotal;               // total size of sent NAK packets
+   int64_t m_llRecvNAKBytesTotal;               // total size of received NAK packets
+   uint64_t m_ullRecvNAKTimeTotal;              // total time processing received NAK packets, in CPU clock cycles
+   int m_iSentFECTotal;                         // total number of sent FEC parity packets
+   int m_iRecvFECTotal;                         // total number of received FEC parity packets
+   int m_iFECRecoveredTotal;                    // total number of lost packets rebuilt from FEC parity packets
+   int m_iSndDropTotal;                         // total number of data packets dropped because their message expired
+   int m_iRcvDropTotal;                         // total number of lost packets skipped at the play-out deadline
    int64_t m_llSndDurationTotal;		// total real time for sending
 
    uint64_t m_LastSampleTime;                   // last performance sample time
@@ -470,6 +611,9 @@ private: // Timers
 
    uint64_t m_ullMinNakInt;			// NAK timeout lower bound; too small value can cause unnecessary retransmission
    uint64_t m_ullMinExpInt;			// timeout lower bound threshold: too small timeout can cause problem
+   uint64_t m_ullTrimInt;			// idle time after which the buffers are trimmed
+   uint64_t m_ullNextTrimTime;			// time to trim the buffers if there is still no traffic, 0 if they are trimmed
+   int64_t m_llTrimPktCount;			// number of data packets sent and received when the traffic was last checked
 
    int m_iPktCount;				// packet counter for ACK
    int m_iLightACKCount;			// light ACK counter
@@ -477,6 +621,9 @@ private: // Timers
    uint64_t m_ullTargetTime;			// scheduled time of next packet sending
 
    void checkTimers();
+   bool trimBuffers();
+   int getSndBufSpace() const;
+   bool msgFitsSndBuf(int len) const;
 
 private: // for UDP multiplexer
    CSndQueue* m_pSndQueue;			// packet sending queue
@@ -40,6 +40,10 @@ written by
 
 #ifdef __linux__
    #include <sys/epoll.h>
+   #include <sys/eventfd.h>
+#endif
+#ifndef WIN32
+   #include <fcntl.h>
    #include <unistd.h>
 #endif
 #include <algorithm>
@@ -53,6 +57,141 @@ written by
 
 using namespace std;
 
+namespace
+{
+
+const int ALL_EVENTS = UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR;
+
+// events of a UDT socket that have not been reported
+int pending(const CEPollSock& sock)
+{
+   if (sock.m_iWatch & UDT_EPOLL_ET)
+      return sock.m_iWatch & sock.m_iEdge & ALL_EVENTS;
+   return sock.m_iWatch & sock.m_iState & ALL_EVENTS;
+}
+
+void unlink_ready(CEPollDesc& desc, CEPollSock& sock)
+{
+   if (NULL != sock.m_pPrev)
+      sock.m_pPrev->m_pNext = sock.m_pNext;
+   else
+      desc.m_pReadyHead = sock.m_pNext;
+   if (NULL != sock.m_pNext)
+      sock.m_pNext->m_pPrev = sock.m_pPrev;
+   else
+      desc.m_pReadyTail = sock.m_pPrev;
+
+   sock.m_pPrev = sock.m_pNext = NULL;
+   sock.m_bReady = false;
+   -- desc.m_iReadyNum;
+}
+
+void append_ready(CEPollDesc& desc, CEPollSock& sock)
+{
+   sock.m_pPrev = desc.m_pReadyTail;
+   sock.m_pNext = NULL;
+   if (NULL != desc.m_pReadyTail)
+      desc.m_pReadyTail->m_pNext = &sock;
+   else
+      desc.m_pReadyHead = &sock;
+   desc.m_pReadyTail = &sock;
+
+   sock.m_bReady = true;
+   ++ desc.m_iReadyNum;
+}
+
+// keep the socket in the ready list if and only if it has events to report
+void relink(CEPollDesc& desc, CEPollSock& sock)
+{
+   bool ready = (0 != pending(sock));
+   if (ready && !sock.m_bReady)
+      append_ready(desc, sock);
+   else if (!ready && sock.m_bReady)
+      unlink_ready(desc, sock);
+}
+
+// take the events to report from a UDT socket; edge-triggered events are reported only once
+int collect(CEPollSock& sock, int mask)
+{
+   int events = pending(sock) & mask;
+   if (sock.m_iWatch & UDT_EPOLL_ET)
+      sock.m_iEdge &= ~events;
+   return events;
+}
+
+// add a UDT socket to the sets of the old-style wait, returning the number of insertions
+int report(CEPollDesc& desc, CEPollSock& sock, int mask, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefds)
+{
+   int total = 0;
+   int events = collect(sock, mask);
+   if ((NULL != readfds) && (events & (UDT_EPOLL_IN | UDT_EPOLL_ERR)))
+   {
+      readfds->insert(readfds->end(), sock.m_iID);
+      ++ total;
+   }
+   if ((NULL != writefds) && (events & (UDT_EPOLL_OUT | UDT_EPOLL_ERR)))
+   {
+      writefds->insert(writefds->end(), sock.m_iID);
+      ++ total;
+   }
+   relink(desc, sock);
+
+   return total;
+}
+
+bool ready_order(const CEPollSock* a, const CEPollSock* b)
+{
+   return a->m_iID < b->m_iID;
+}
+
+// make the notification descriptor readable if and only if the ready list is not empty
+void update_notify(CEPollDesc& desc)
+{
+   #ifndef WIN32
+      bool ready = (desc.m_iReadyNum > 0);
+      if ((desc.m_iNotifyFD < 0) || (ready == desc.m_bNotified))
+         return;
+
+      if (ready)
+      {
+         // an eventfd needs a 64-bit value, a pipe takes any byte
+         uint64_t one = 1;
+         if (::write(desc.m_iNotifyWriteFD, &one, sizeof(uint64_t)) < 0)
+            return;
+      }
+      else
+      {
+         char buf[64];
+         while (::read(desc.m_iNotifyFD, buf, sizeof(buf)) > 0) {}
+      }
+
+      desc.m_bNotified = ready;
+   #endif
+}
+
+void close_notify(CEPollDesc& desc)
+{
+   #ifndef WIN32
+      if (desc.m_iNotifyFD < 0)
+         return;
+      if (desc.m_iNotifyWriteFD != desc.m_iNotifyFD)
+         ::close(desc.m_iNotifyWriteFD);
+      ::close(desc.m_iNotifyFD);
+      desc.m_iNotifyFD = desc.m_iNotifyWriteFD = -1;
+   #endif
+}
+
+void signal(CEPollDesc& desc)
+{
+   #ifndef WIN32
+      pthread_cond_broadcast(&desc.m_WaitCond);
+   #else
+      SetEvent(desc.m_WaitCond);
+   #endif
+}
+
+}  // namespace
+
 CEPoll::CEPoll():
 m_iIDSeed(0)
 {
@@ -61,6 +200,16 @@ m_iIDSeed(0)
 
 CEPoll::~CEPoll()
 {
+   for (map<int, CEPollDesc>::iterator i = m_mPolls.begin(); i != m_mPolls.end(); ++ i)
+   {
+      close_notify(i->second);
+      #ifndef WIN32
+         pthread_cond_destroy(&i->second.m_WaitCond);
+      #else
+         CloseHandle(i->second.m_WaitCond);
+      #endif
+   }
+
    CGuard::releaseMutex(m_EPollLock);
 }
 
@@ -86,8 +235,19 @@ int CEPoll::create()
    CEPollDesc desc;
    desc.m_iID = m_iIDSeed;
    desc.m_iLocalID = localid;
+   desc.m_pReadyHead = desc.m_pReadyTail = NULL;
+   desc.m_iReadyNum = 0;
+   desc.m_iNotifyFD = desc.m_iNotifyWriteFD = -1;
+   desc.m_bNotified = false;
    m_mPolls[desc.m_iID] = desc;
 
+   // the condition cannot be copied, so it is initialized in place
+   #ifndef WIN32
+      pthread_cond_init(&m_mPolls[desc.m_iID].m_WaitCond, NULL);
+   #else
+      m_mPolls[desc.m_iID].m_WaitCond = CreateEvent(NULL, true, false, NULL);
+   #endif
+
    return desc.m_iID;
 }
 
@@ -99,10 +259,24 @@ int CEPoll::add_usock(const int eid, const UDTSOCKET& u, const int* events)
    if (p == m_mPolls.end())
       throw CUDTException(5, 13);
 
-   if (!events || (*events & UDT_EPOLL_IN))
-      p->second.m_sUDTSocksIn.insert(u);
-   if (!events || (*events & UDT_EPOLL_OUT))
-      p->second.m_sUDTSocksOut.insert(u);
+   map<UDTSOCKET, CEPollSock>::iterator i = p->second.m_mUDTSocks.find(u);
+   if (i == p->second.m_mUDTSocks.end())
+   {
+      CEPollSock sock;
+      memset(&sock, 0, sizeof(CEPollSock));
+      sock.m_iID = u;
+      i = p->second.m_mUDTSocks.insert(make_pair(u, sock)).first;
+   }
+
+   // adding a socket again watches more events, the trigger mode is the latest one
+   int watch = (NULL == events) ? ALL_EVENTS : *events;
+   int before = pending(i->second);
+   i->second.m_iWatch = (i->second.m_iWatch & ALL_EVENTS) | watch;
+   i->second.m_iEdge = i->second.m_iState;
+   relink(p->second, i->second);
+   update_notify(p->second);
+   if (pending(i->second) & ~before)
+      signal(p->second);
 
    return 0;
 }
@@ -130,6 +304,8 @@ int CEPoll::add_ssock(const int eid, const SYSSOCKET& s, const int* events)
          ev.events |= EPOLLOUT;
       if (*events & UDT_EPOLL_ERR)
          ev.events |= EPOLLERR;
+      if (*events & UDT_EPOLL_ET)
+         ev.events |= EPOLLET;
    }
 
    ev.data.fd = s;
@@ -155,9 +331,14 @@ int CEPoll::remove_usock(const int eid, const UDTSOCKET& u)
    if (p == m_mPolls.end())
       throw CUDTException(5, 13);
 
-   p->second.m_sUDTSocksIn.erase(u);
-   p->second.m_sUDTSocksOut.erase(u);
-   p->second.m_sUDTSocksEx.erase(u);
+   map<UDTSOCKET, CEPollSock>::iterator i = p->second.m_mUDTSocks.find(u);
+   if (i != p->second.m_mUDTSocks.end())
+   {
+      if (i->second.m_bReady)
+         unlink_ready(p->second, i->second);
+      p->second.m_mUDTSocks.erase(i);
+      update_notify(p->second);
+   }
 
    return 0;
 }
@@ -210,7 +391,7 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
          throw CUDTException(5, 13);
       }
 
-      if (p->second.m_sUDTSocksIn.empty() && p->second.m_sUDTSocksOut.empty() && p->second.m_sLocals.empty() && (msTimeOut < 0))
+      if (p->second.m_mUDTSocks.empty() && p->second.m_sLocals.empty() && (msTimeOut < 0))
       {
          // no socket is being monitored, this may be a deadlock
          CGuard::leaveCS(m_EPollLock);
@@ -218,19 +399,35 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
       }
 
       // Sockets with exceptions are returned to both read and write sets.
-      if ((NULL != readfds) && (!p->second.m_sUDTReads.empty() || !p->second.m_sUDTExcepts.empty()))
+      if ((NULL != readfds) || (NULL != writefds))
       {
-         *readfds = p->second.m_sUDTReads;
-         for (set<UDTSOCKET>::const_iterator i = p->second.m_sUDTExcepts.begin(); i != p->second.m_sUDTExcepts.end(); ++ i)
-            readfds->insert(*i);
-         total += p->second.m_sUDTReads.size() + p->second.m_sUDTExcepts.size();
-      }
-      if ((NULL != writefds) && (!p->second.m_sUDTWrites.empty() || !p->second.m_sUDTExcepts.empty()))
-      {
-         *writefds = p->second.m_sUDTWrites;
-         for (set<UDTSOCKET>::const_iterator i = p->second.m_sUDTExcepts.begin(); i != p->second.m_sUDTExcepts.end(); ++ i)
-            writefds->insert(*i);
-         total += p->second.m_sUDTWrites.size() + p->second.m_sUDTExcepts.size();
+         int mask = UDT_EPOLL_ERR;
+         if (NULL != readfds)
+            mask |= UDT_EPOLL_IN;
+         if (NULL != writefds)
+            mask |= UDT_EPOLL_OUT;
+
+         // When most sockets are ready, walking all of them in ID order is cheaper than sorting the ready list.
+         // Either way the sockets come in ID order, so each one is appended to the sets in constant time.
+         if (p->second.m_iReadyNum * 4 > int(p->second.m_mUDTSocks.size()))
+         {
+            for (map<UDTSOCKET, CEPollSock>::iterator i = p->second.m_mUDTSocks.begin(); i != p->second.m_mUDTSocks.end(); ++ i)
+               if (i->second.m_bReady)
+                  total += report(p->second, i->second, mask, readfds, writefds);
+         }
+         else
+         {
+            vector<CEPollSock*> ready;
+            ready.reserve(p->second.m_iReadyNum);
+            for (CEPollSock* i = p->second.m_pReadyHead; NULL != i; i = i->m_pNext)
+               ready.push_back(i);
+            sort(ready.begin(), ready.end(), ready_order);
+
+            for (vector<CEPollSock*>::iterator i = ready.begin(); i != ready.end(); ++ i)
+               total += report(p->second, **i, mask, readfds, writefds);
+         }
+
+         update_notify(p->second);
       }
 
       if (lrfds || lwfds)
@@ -294,20 +491,165 @@ int CEPoll::wait(const int eid, set<UDTSOCKET>* readfds, set<UDTSOCKET>* writefd
          #endif
       }
 
+      if (total > 0)
+      {
+         CGuard::leaveCS(m_EPollLock);
+         return total;
+      }
+
+      int64_t timeout = -1;
+      if (msTimeOut >= 0)
+      {
+         timeout = msTimeOut * 1000LL - int64_t(CTimer::getTime() - entertime);
+         if (timeout <= 0)
+         {
+            CGuard::leaveCS(m_EPollLock);
+            throw CUDTException(6, 3, 0);
+         }
+      }
+
+      // only UDT sockets signal this epoll, system sockets are checked again after a short while
+      if (!p->second.m_sLocals.empty() && ((timeout < 0) || (timeout > 10000)))
+         timeout = 10000;
+
+      waitForEvent(p->second, timeout);
+
       CGuard::leaveCS(m_EPollLock);
+   }
+
+   return 0;
+}
+
+int CEPoll::uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut)
+{
+   if ((NULL == events) || (maxevents <= 0))
+      throw CUDTException(5, 3, 0);
+
+   int64_t entertime = CTimer::getTime();
+   while (true)
+   {
+      CGuard::enterCS(m_EPollLock);
+
+      map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
+      if (p == m_mPolls.end())
+      {
+         CGuard::leaveCS(m_EPollLock);
+         throw CUDTException(5, 13);
+      }
+
+      if (p->second.m_mUDTSocks.empty() && (msTimeOut < 0))
+      {
+         // no socket is being monitored, this may be a deadlock
+         CGuard::leaveCS(m_EPollLock);
+         throw CUDTException(5, 3);
+      }
+
+      // Take at most maxevents sockets from the head of the ready list. Level-triggered sockets that
+      // are still ready go back to the tail, so that a short array does not starve the other sockets.
+      int total = 0;
+      for (int n = p->second.m_iReadyNum; (n > 0) && (total < maxevents); -- n)
+      {
+         CEPollSock* s = p->second.m_pReadyHead;
+         events[total].fd = s->m_iID;
+         events[total].events = collect(*s, ALL_EVENTS);
+         ++ total;
+
+         unlink_ready(p->second, *s);
+         relink(p->second, *s);
+      }
+      update_notify(p->second);
 
       if (total > 0)
+      {
+         CGuard::leaveCS(m_EPollLock);
          return total;
+      }
+
+      int64_t timeout = -1;
+      if (msTimeOut >= 0)
+      {
+         timeout = msTimeOut * 1000LL - int64_t(CTimer::getTime() - entertime);
+         if (timeout <= 0)
+         {
+            CGuard::leaveCS(m_EPollLock);
+            throw CUDTException(6, 3, 0);
+         }
+      }
 
-      if ((msTimeOut >= 0) && (int64_t(CTimer::getTime() - entertime) >= msTimeOut * 1000LL))
-         throw CUDTException(6, 3, 0);
+      waitForEvent(p->second, timeout);
 
-      CTimer::waitForEvent();
+      CGuard::leaveCS(m_EPollLock);
    }
 
    return 0;
 }
 
+void CEPoll::waitForEvent(CEPollDesc& desc, int64_t timeout)
+{
+   #ifndef WIN32
+      if (timeout < 0)
+      {
+         pthread_cond_wait(&desc.m_WaitCond, &m_EPollLock);
+         return;
+      }
+
+      timeval now;
+      gettimeofday(&now, 0);
+      uint64_t deadline = now.tv_sec * 1000000ULL + now.tv_usec + timeout;
+      timespec ts;
+      ts.tv_sec = deadline / 1000000;
+      ts.tv_nsec = (deadline % 1000000) * 1000;
+      pthread_cond_timedwait(&desc.m_WaitCond, &m_EPollLock, &ts);
+   #else
+      // the event is set under m_EPollLock, so it cannot be missed between here and the wait
+      HANDLE event = desc.m_WaitCond;
+      ResetEvent(event);
+      CGuard::leaveCS(m_EPollLock);
+      WaitForSingleObject(event, (timeout < 0) ? INFINITE : DWORD(timeout / 1000));
+      CGuard::enterCS(m_EPollLock);
+   #endif
+}
+
+int CEPoll::getfd(const int eid)
+{
+   CGuard pg(m_EPollLock);
+
+   map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
+   if (p == m_mPolls.end())
+      throw CUDTException(5, 13);
+
+   #ifndef WIN32
+      if (p->second.m_iNotifyFD < 0)
+      {
+         #ifdef __linux__
+            int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0)
+               throw CUDTException(-1, 0, errno);
+            p->second.m_iNotifyFD = p->second.m_iNotifyWriteFD = fd;
+         #else
+            int fds[2];
+            if (::pipe(fds) < 0)
+               throw CUDTException(-1, 0, errno);
+            for (int i = 0; i < 2; ++ i)
+            {
+               fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+               fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            }
+            p->second.m_iNotifyFD = fds[0];
+            p->second.m_iNotifyWriteFD = fds[1];
+         #endif
+
+         p->second.m_bNotified = false;
+         update_notify(p->second);
+      }
+
+      return p->second.m_iNotifyFD;
+   #else
+      // Windows sockets cannot be signalled by an application
+      throw CUDTException(5, 0, 0);
+   #endif
+}
+
 int CEPoll::release(const int eid)
 {
    CGuard pg(m_EPollLock);
@@ -321,28 +663,21 @@ int CEPoll::release(const int eid)
    ::close(i->second.m_iLocalID);
    #endif
 
-   m_mPolls.erase(i);
+   close_notify(i->second);
 
-   return 0;
-}
+   // threads still waiting on this epoll will find it released
+   signal(i->second);
+   #ifndef WIN32
+      pthread_cond_destroy(&i->second.m_WaitCond);
+   #else
+      CloseHandle(i->second.m_WaitCond);
+   #endif
 
-namespace
-{
+   m_mPolls.erase(i);
 
-void update_epoll_sets(const UDTSOCKET& uid, const set<UDTSOCKET>& watch, set<UDTSOCKET>& result, bool enable)
-{
-   if (enable && (watch.find(uid) != watch.end()))
-   {
-      result.insert(uid);
-   }
-   else if (!enable)
-   {
-      result.erase(uid);
-   }
+   return 0;
 }
 
-}  // namespace
-
 int CEPoll::update_events(const UDTSOCKET& uid, std::set<int>& eids, int events, bool enable)
 {
    CGuard pg(m_EPollLock);
@@ -356,16 +691,30 @@ int CEPoll::update_events(const UDTSOCKET& uid, std::set<int>& eids, int events,
       if (p == m_mPolls.end())
       {
          lost.push_back(*i);
+         continue;
+      }
+
+      map<UDTSOCKET, CEPollSock>::iterator s = p->second.m_mUDTSocks.find(uid);
+      if (s == p->second.m_mUDTSocks.end())
+         continue;
+
+      int before = pending(s->second);
+      if (enable)
+      {
+         s->second.m_iState |= events;
+         s->second.m_iEdge |= events;
       }
       else
       {
-         if ((events & UDT_EPOLL_IN) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksIn, p->second.m_sUDTReads, enable);
-         if ((events & UDT_EPOLL_OUT) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksOut, p->second.m_sUDTWrites, enable);
-         if ((events & UDT_EPOLL_ERR) != 0)
-            update_epoll_sets(uid, p->second.m_sUDTSocksEx, p->second.m_sUDTExcepts, enable);
+         s->second.m_iState &= ~events;
+         s->second.m_iEdge &= ~events;
       }
+      relink(p->second, s->second);
+      update_notify(p->second);
+
+      // wake up only the threads waiting on this epoll, and only for new events
+      if (pending(s->second) & ~before)
+         signal(p->second);
    }
 
    for (vector<int>::iterator i = lost.begin(); i != lost.end(); ++ i)
@@ -47,21 +47,41 @@ written by
 #include "udt.h"
 
 
+struct CEPollSock
+{
+   int m_iWatch;                             // events to watch, UDT_EPOLL_ET for edge-triggered
+   int m_iState;                             // events currently available
+   int m_iEdge;                              // events occurred since last reported, for edge-triggered sockets
+
+   UDTSOCKET m_iID;                          // UDT socket ID
+   CEPollSock* m_pPrev;                      // previous socket in the ready list
+   CEPollSock* m_pNext;                      // next socket in the ready list
+   bool m_bReady;                            // if the socket is in the ready list
+};
+
 struct CEPollDesc
 {
    int m_iID;                                // epoll ID
-   std::set<UDTSOCKET> m_sUDTSocksOut;       // set of UDT sockets waiting for write events
-   std::set<UDTSOCKET> m_sUDTSocksIn;        // set of UDT sockets waiting for read events
-   std::set<UDTSOCKET> m_sUDTSocksEx;        // set of UDT sockets waiting for exceptions
+   std::map<UDTSOCKET, CEPollSock> m_mUDTSocks; // UDT sockets being watched
 
    int m_iLocalID;                           // local system epoll ID
    std::set<SYSSOCKET> m_sLocals;            // set of local (non-UDT) descriptors
    std::set<SYSSOCKET> m_sLocalsOut;         // local descriptors waiting for write events
    std::set<SYSSOCKET> m_sLocalsIn;          // local descriptors waiting for read events
 
-   std::set<UDTSOCKET> m_sUDTWrites;         // UDT sockets ready for write
-   std::set<UDTSOCKET> m_sUDTReads;          // UDT sockets ready for read
-   std::set<UDTSOCKET> m_sUDTExcepts;        // UDT sockets with exceptions (connection broken, etc.)
+   CEPollSock* m_pReadyHead;                 // UDT sockets with events to report, oldest first
+   CEPollSock* m_pReadyTail;
+   int m_iReadyNum;                          // number of sockets in the ready list
+
+   int m_iNotifyFD;                          // descriptor readable while the ready list is not empty, -1 if not used
+   int m_iNotifyWriteFD;                     // its write end, the same descriptor for an eventfd
+   bool m_bNotified;                         // if m_iNotifyFD is readable
+
+#ifndef WIN32
+   pthread_cond_t m_WaitCond;                // signalled when a UDT socket of this epoll becomes ready
+#else
+   HANDLE m_WaitCond;
+#endif
 };
 
 class CEPoll
@@ -140,6 +160,27 @@ public: // for CUDTUnited API
 
    int wait(const int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET>* writefds, int64_t msTimeOut, std::set<SYSSOCKET>* lrfds, std::set<SYSSOCKET>* lwfds);
 
+      // Functionality:
+      //    wait for events on the UDT sockets of an EPoll, system sockets are not checked.
+      // Parameters:
+      //    0) [in] eid: EPoll ID.
+      //    1) [out] events: ready sockets and their events.
+      //    2) [in] maxevents: size of the events array.
+      //    3) [in] msTimeOut: timeout threshold, in milliseconds.
+      // Returned value:
+      //    number of sockets returned in events.
+
+   int uwait(const int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut);
+
+      // Functionality:
+      //    get a system descriptor that is readable while UDT sockets of an EPoll are ready.
+      // Parameters:
+      //    0) [in] eid: EPoll ID.
+      // Returned value:
+      //    the descriptor, which is owned by the EPoll.
+
+   int getfd(const int eid);
+
       // Functionality:
       //    close and release an EPoll.
       // Parameters:
@@ -163,6 +204,17 @@ public: // for CUDT to acknowledge IO status
 
    int update_events(const UDTSOCKET& uid, std::set<int>& eids, int events, bool enable);
 
+private:
+      // Functionality:
+      //    wait until a UDT socket of an EPoll becomes ready, with m_EPollLock held.
+      // Parameters:
+      //    0) [in] desc: the EPoll.
+      //    1) [in] timeout: maximum waiting time, in microseconds, or -1 for no limit.
+      // Returned value:
+      //    None.
+
+   void waitForEvent(CEPollDesc& desc, int64_t timeout);
+
 private:
    int m_iIDSeed;                            // seed to generate a new ID
 #ifdef WIN32
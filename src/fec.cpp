@@ -0,0 +1,628 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef WIN32
+   #include <arpa/inet.h>
+#else
+   #include <winsock2.h>
+#endif
+#include <cstring>
+#include "common.h"
+#include "fec.h"
+
+// the SSSE3 kernel is compiled for the target alone and only used if the CPU has it, so no build flag is needed
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+   #define UDT_FEC_SSSE3
+   #include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+unsigned char CGF256::s_pcExp[512];
+unsigned char CGF256::s_pcLog[256];
+unsigned char CGF256::s_pcCoef[16][64];
+bool CGF256::s_bSSSE3 = false;
+CGF256 CGF256::s_GF;
+
+CGF256::CGF256()
+{
+   // GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D), generator 2
+   int x = 1;
+   for (int i = 0; i < 255; ++ i)
+   {
+      s_pcExp[i] = s_pcExp[i + 255] = (unsigned char)x;
+      s_pcLog[x] = (unsigned char)i;
+      x <<= 1;
+      if (x & 0x100)
+         x ^= 0x11D;
+   }
+   s_pcExp[510] = s_pcExp[511] = 0;
+   s_pcLog[0] = 0;
+
+   for (int j = 0; j < 16; ++ j)
+   {
+      for (int i = 0; i < 64; ++ i)
+      {
+         unsigned char y = (unsigned char)(16 + i);
+         s_pcCoef[j][i] = mul(y, inv((unsigned char)(j ^ y)));
+      }
+   }
+
+   #ifdef UDT_FEC_SSSE3
+      __builtin_cpu_init();
+      s_bSSSE3 = __builtin_cpu_supports("ssse3");
+   #endif
+}
+
+unsigned char CGF256::mul(unsigned char a, unsigned char b)
+{
+   if ((0 == a) || (0 == b))
+      return 0;
+   return s_pcExp[s_pcLog[a] + s_pcLog[b]];
+}
+
+unsigned char CGF256::inv(unsigned char a)
+{
+   return s_pcExp[255 - s_pcLog[a]];
+}
+
+unsigned char CGF256::coef(int row, int col)
+{
+   return s_pcCoef[row][col];
+}
+
+void CGF256::muladd(char* dst, const char* src, unsigned char c, int len)
+{
+   if (0 == c)
+      return;
+
+   if (1 == c)
+   {
+      // parity 0 and single parity groups only need XOR, which the compiler vectorizes
+      for (int i = 0; i < len; ++ i)
+         dst[i] ^= src[i];
+      return;
+   }
+
+   if (s_bSSSE3)
+      muladd_ssse3(dst, src, c, len);
+   else
+      muladd_ref(dst, src, c, len);
+}
+
+void CGF256::muladd_ref(char* dst, const char* src, unsigned char c, int len)
+{
+   unsigned char table[256];
+   table[0] = 0;
+   for (int x = 1; x < 256; ++ x)
+      table[x] = s_pcExp[s_pcLog[c] + s_pcLog[x]];
+
+   for (int i = 0; i < len; ++ i)
+      dst[i] ^= table[(unsigned char)src[i]];
+}
+
+#ifdef UDT_FEC_SSSE3
+__attribute__((target("ssse3")))
+void CGF256::muladd_ssse3(char* dst, const char* src, unsigned char c, int len)
+{
+   // c * x = c * (x & 0x0F) + c * (x & 0xF0), each half looked up in a 16 byte table with PSHUFB
+   unsigned char lo[16];
+   unsigned char hi[16];
+   for (int x = 0; x < 16; ++ x)
+   {
+      lo[x] = mul(c, (unsigned char)x);
+      hi[x] = mul(c, (unsigned char)(x << 4));
+   }
+
+   __m128i tlo = _mm_loadu_si128((const __m128i*)lo);
+   __m128i thi = _mm_loadu_si128((const __m128i*)hi);
+   __m128i mask = _mm_set1_epi8(0x0F);
+
+   int i = 0;
+   for (; i + 16 <= len; i += 16)
+   {
+      __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+      __m128i l = _mm_shuffle_epi8(tlo, _mm_and_si128(s, mask));
+      __m128i h = _mm_shuffle_epi8(thi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+   }
+
+   for (; i < len; ++ i)
+      dst[i] ^= lo[src[i] & 0x0F] ^ hi[(unsigned char)src[i] >> 4];
+}
+#else
+void CGF256::muladd_ssse3(char* dst, const char* src, unsigned char c, int len)
+{
+   muladd_ref(dst, src, c, len);
+}
+#endif
+
+
+//
+const int CFEC::m_iHdrSize = 8;
+const int CFEC::m_iMaxGroup = 64;
+const int CFEC::m_iMaxParity = 16;
+
+// virtual packet header: message number field and payload size in network order, 2 bytes of padding
+static void packHeader(char* hdr, int32_t msgno, int len)
+{
+   hdr[0] = (char)(msgno >> 24);
+   hdr[1] = (char)(msgno >> 16);
+   hdr[2] = (char)(msgno >> 8);
+   hdr[3] = (char)msgno;
+   hdr[4] = (char)(len >> 8);
+   hdr[5] = (char)len;
+   hdr[6] = hdr[7] = 0;
+}
+
+CFECEncoder::CFECEncoder(int group, int parity, int payload):
+m_iGroup(group),
+m_iParity(parity),
+m_iPayloadSize(payload),
+m_pcParity(NULL),
+m_iRowSize(0),
+m_iBase(0),
+m_iCount(0),
+m_iLength(0)
+{
+   m_iRowSize = (CFEC::m_iHdrSize + m_iPayloadSize + 3) & ~3;
+   m_pcParity = new char[m_iParity * m_iRowSize];
+   memset(m_pcParity, 0, m_iParity * m_iRowSize);
+}
+
+CFECEncoder::~CFECEncoder()
+{
+   delete [] m_pcParity;
+}
+
+int CFECEncoder::add(const CPacket& packet)
+{
+   if (0 == m_iCount)
+      m_iBase = packet.m_iSeqNo;
+
+   int len = packet.getLength();
+   char hdr[8];
+   packHeader(hdr, packet.m_iMsgNo, len);
+
+   for (int j = 0; j < m_iParity; ++ j)
+   {
+      char* row = m_pcParity + j * m_iRowSize;
+      unsigned char c = CGF256::coef(j, m_iCount);
+      CGF256::muladd(row, hdr, c, CFEC::m_iHdrSize);
+      CGF256::muladd(row + CFEC::m_iHdrSize, packet.m_pcData, c, len);
+   }
+
+   if (CFEC::m_iHdrSize + len > m_iLength)
+      m_iLength = CFEC::m_iHdrSize + len;
+
+   return ++ m_iCount;
+}
+
+int CFECEncoder::getParity(int row, int32_t* info, char*& data)
+{
+   info[0] = m_iBase;
+   info[1] = (row << 8) | m_iCount;
+
+   data = m_pcParity + row * m_iRowSize;
+   int len = (m_iLength + 3) & ~3;
+
+   // CChannel converts control information to network order word by word,
+   // reverse it here so that the parity bytes go out unchanged
+   for (int i = 0, n = len / 4; i < n; ++ i)
+      *((uint32_t *)data + i) = ntohl(*((uint32_t *)data + i));
+
+   return len;
+}
+
+void CFECEncoder::reset()
+{
+   for (int j = 0; j < m_iParity; ++ j)
+      memset(m_pcParity + j * m_iRowSize, 0, (m_iLength + 3) & ~3);
+
+   m_iCount = 0;
+   m_iLength = 0;
+}
+
+
+//
+CFECDecoder::CFECDecoder(int payload):
+m_iPayloadSize(payload),
+m_iRowSize(0),
+m_pCopies(NULL),
+m_iCopySize(256),
+m_iLastSeqNo(-1),
+m_pGroups(NULL),
+m_iGroups(8),
+m_iGroupSize(0),
+m_piRecovered(NULL),
+m_iRecoveredSize(64),
+m_iRecoveredHead(0),
+m_iRecoveredTail(0),
+m_pLosses(NULL),
+m_iLossSize(64),
+m_iLossHead(0),
+m_iLossTail(0),
+m_pcWork(NULL)
+{
+   m_iRowSize = (CFEC::m_iHdrSize + m_iPayloadSize + 3) & ~3;
+   m_piRecovered = new int32_t[m_iRecoveredSize];
+   m_pLosses = new CLoss[m_iLossSize];
+}
+
+CFECDecoder::~CFECDecoder()
+{
+   trim();
+
+   delete [] m_piRecovered;
+   delete [] m_pLosses;
+}
+
+void CFECDecoder::prepare()
+{
+   if (NULL != m_pCopies)
+      return;
+
+   // the copies cover several groups of the largest size, so a group is complete long before it is overwritten
+   char* data = new char[m_iCopySize * m_iPayloadSize];
+   m_pCopies = new CCopy[m_iCopySize];
+   for (int i = 0; i < m_iCopySize; ++ i)
+   {
+      m_pCopies[i].m_iSeqNo = -1;
+      m_pCopies[i].m_pcData = data + i * m_iPayloadSize;
+   }
+
+   m_pGroups = new CGroup[m_iGroups];
+   for (int i = 0; i < m_iGroups; ++ i)
+   {
+      m_pGroups[i].m_iRows = 0;
+      for (int j = 0; j < CFEC::m_iMaxParity; ++ j)
+         m_pGroups[i].m_ppcParity[j] = NULL;
+   }
+
+   m_pcWork = new char[m_iRowSize];
+   m_iLastSeqNo = -1;
+}
+
+void CFECDecoder::trim()
+{
+   if (NULL == m_pCopies)
+      return;
+
+   delete [] m_pCopies[0].m_pcData;
+   delete [] m_pCopies;
+   m_pCopies = NULL;
+
+   for (int i = 0; i < m_iGroups; ++ i)
+      for (int j = 0; j < CFEC::m_iMaxParity; ++ j)
+         delete [] m_pGroups[i].m_ppcParity[j];
+   delete [] m_pGroups;
+   m_pGroups = NULL;
+
+   delete [] m_pcWork;
+   m_pcWork = NULL;
+
+   m_iRecoveredHead = m_iRecoveredTail = 0;
+}
+
+void CFECDecoder::addData(const CPacket& packet)
+{
+   int len = packet.getLength();
+   if (len > m_iPayloadSize)
+      return;
+
+   prepare();
+
+   CCopy& c = m_pCopies[packet.m_iSeqNo & (m_iCopySize - 1)];
+   c.m_iSeqNo = packet.m_iSeqNo;
+   c.m_iMsgNo = packet.m_iMsgNo;
+   c.m_iTimeStamp = packet.m_iTimeStamp;
+   c.m_iLength = len;
+   memcpy(c.m_pcData, packet.m_pcData, len);
+
+   if ((m_iLastSeqNo < 0) || (CSeqNo::seqcmp(packet.m_iSeqNo, m_iLastSeqNo) > 0))
+      m_iLastSeqNo = packet.m_iSeqNo;
+
+   for (int i = 0; i < m_iGroups; ++ i)
+   {
+      CGroup& g = m_pGroups[i];
+      if (0 == g.m_iRows)
+         continue;
+
+      int offset = CSeqNo::seqoff(g.m_iBase, packet.m_iSeqNo);
+      if ((offset >= 0) && (offset < g.m_iCount))
+         recover(g);
+   }
+}
+
+void CFECDecoder::addParity(const CPacket& packet)
+{
+   // additional info field: sequence number of the first packet of the group
+   int32_t base = packet.getAckSeqNo();
+   int count = packet.getExtendedType() & 0xFF;
+   int row = packet.getExtendedType() >> 8;
+   int len = packet.getLength();
+
+   if ((count < 1) || (count > CFEC::m_iMaxGroup) || (row >= CFEC::m_iMaxParity))
+      return;
+   if ((len <= CFEC::m_iHdrSize) || (len > m_iRowSize) || (0 != (len & 3)))
+      return;
+
+   prepare();
+
+   // too late, the data packets of the group may have been overwritten already
+   if ((m_iLastSeqNo >= 0) && (CSeqNo::seqoff(base, m_iLastSeqNo) >= m_iCopySize - CFEC::m_iMaxGroup))
+      return;
+
+   // find the group, or take a free slot, or replace the oldest group
+   CGroup* g = NULL;
+   for (int i = 0; (NULL == g) && (i < m_iGroups); ++ i)
+      if ((0 != m_pGroups[i].m_iRows) && (m_pGroups[i].m_iBase == base) && (m_pGroups[i].m_iCount == count))
+         g = m_pGroups + i;
+
+   CGroup* slot = NULL;
+   for (int i = 0; (NULL == g) && (i < m_iGroups); ++ i)
+   {
+      if (0 == m_pGroups[i].m_iRows)
+      {
+         slot = m_pGroups + i;
+         break;
+      }
+      if ((NULL == slot) || (CSeqNo::seqcmp(m_pGroups[i].m_iBase, slot->m_iBase) < 0))
+         slot = m_pGroups + i;
+   }
+
+   if (NULL == g)
+   {
+      g = slot;
+      g->m_iBase = base;
+      g->m_iCount = count;
+      g->m_iRows = 0;
+      g->m_iLength = len;
+   }
+   else if ((0 != (g->m_iRows & (1 << row))) || (g->m_iLength != len))
+      return;
+
+   if (NULL == g->m_ppcParity[row])
+      g->m_ppcParity[row] = new char[m_iRowSize];
+
+   // undo the conversion by CChannel, see CFECEncoder::getParity()
+   char* p = g->m_ppcParity[row];
+   memcpy(p, packet.m_pcData, len);
+   for (int i = 0, n = len / 4; i < n; ++ i)
+      *((uint32_t *)p + i) = htonl(*((uint32_t *)p + i));
+
+   g->m_iRows |= 1 << row;
+   g->m_iTimeStamp = packet.m_iTimeStamp;
+
+   if (count > m_iGroupSize)
+      m_iGroupSize = count;
+
+   recover(*g);
+}
+
+void CFECDecoder::recover(CGroup& group)
+{
+   if ((m_iLastSeqNo >= 0) && (CSeqNo::seqoff(group.m_iBase, m_iLastSeqNo) >= m_iCopySize - CFEC::m_iMaxGroup))
+   {
+      group.m_iRows = 0;
+      return;
+   }
+
+   int rows[16];
+   int n = 0;
+   for (int j = 0; j < CFEC::m_iMaxParity; ++ j)
+      if (0 != (group.m_iRows & (1 << j)))
+         rows[n ++] = j;
+
+   // more losses than parity packets, wait for retransmissions or more parity packets
+   int lost[16];
+   int e = 0;
+   for (int i = 0; i < group.m_iCount; ++ i)
+   {
+      int32_t seqno = CSeqNo::incseq(group.m_iBase, i);
+      if (m_pCopies[seqno & (m_iCopySize - 1)].m_iSeqNo != seqno)
+      {
+         if (e == n)
+            return;
+         lost[e ++] = i;
+      }
+   }
+
+   if (0 == e)
+   {
+      group.m_iRows = 0;
+      return;
+   }
+
+   // remove the received packets from the parity packets that are used
+   int plen = group.m_iLength - CFEC::m_iHdrSize;
+   char hdr[8];
+   for (int i = 0, l = 0; i < group.m_iCount; ++ i)
+   {
+      if ((l < e) && (lost[l] == i))
+      {
+         ++ l;
+         continue;
+      }
+
+      CCopy& c = m_pCopies[CSeqNo::incseq(group.m_iBase, i) & (m_iCopySize - 1)];
+      packHeader(hdr, c.m_iMsgNo, c.m_iLength);
+      int len = (c.m_iLength < plen) ? c.m_iLength : plen;
+      for (int k = 0; k < e; ++ k)
+      {
+         unsigned char f = CGF256::coef(rows[k], i);
+         CGF256::muladd(group.m_ppcParity[rows[k]], hdr, f, CFEC::m_iHdrSize);
+         CGF256::muladd(group.m_ppcParity[rows[k]] + CFEC::m_iHdrSize, c.m_pcData, f, len);
+      }
+   }
+
+   // invert the e x e submatrix of the lost packets and the used parity packets
+   unsigned char a[16][16];
+   unsigned char b[16][16];
+   for (int k = 0; k < e; ++ k)
+   {
+      for (int l = 0; l < e; ++ l)
+      {
+         a[k][l] = CGF256::coef(rows[k], lost[l]);
+         b[k][l] = (k == l) ? 1 : 0;
+      }
+   }
+
+   for (int col = 0; col < e; ++ col)
+   {
+      int pivot = col;
+      while ((pivot < e) && (0 == a[pivot][col]))
+         ++ pivot;
+      if (pivot == e)
+      {
+         group.m_iRows = 0;
+         return;
+      }
+
+      if (pivot != col)
+      {
+         for (int l = 0; l < e; ++ l)
+         {
+            unsigned char t = a[col][l]; a[col][l] = a[pivot][l]; a[pivot][l] = t;
+            t = b[col][l]; b[col][l] = b[pivot][l]; b[pivot][l] = t;
+         }
+      }
+
+      unsigned char f = CGF256::inv(a[col][col]);
+      for (int l = 0; l < e; ++ l)
+      {
+         a[col][l] = CGF256::mul(a[col][l], f);
+         b[col][l] = CGF256::mul(b[col][l], f);
+      }
+
+      for (int k = 0; k < e; ++ k)
+      {
+         if ((k == col) || (0 == a[k][col]))
+            continue;
+         f = a[k][col];
+         for (int l = 0; l < e; ++ l)
+         {
+            a[k][l] ^= CGF256::mul(f, a[col][l]);
+            b[k][l] ^= CGF256::mul(f, b[col][l]);
+         }
+      }
+   }
+
+   for (int l = 0; l < e; ++ l)
+   {
+      memset(m_pcWork, 0, group.m_iLength);
+      for (int k = 0; k < e; ++ k)
+         CGF256::muladd(m_pcWork, group.m_ppcParity[rows[k]], b[l][k], group.m_iLength);
+
+      const unsigned char* h = (const unsigned char*)m_pcWork;
+      int32_t msgno = (int32_t)(((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | ((uint32_t)h[2] << 8) | h[3]);
+      int len = (h[4] << 8) | h[5];
+
+      // a corrupted group, e.g., one whose parity packets were mixed with those of another group
+      if ((len > plen) || (len > m_iPayloadSize) || (0 != h[6]) || (0 != h[7]))
+         break;
+
+      int32_t seqno = CSeqNo::incseq(group.m_iBase, lost[l]);
+      CCopy& c = m_pCopies[seqno & (m_iCopySize - 1)];
+      c.m_iSeqNo = seqno;
+      c.m_iMsgNo = msgno;
+      c.m_iTimeStamp = group.m_iTimeStamp;
+      c.m_iLength = len;
+      memcpy(c.m_pcData, m_pcWork + CFEC::m_iHdrSize, len);
+
+      if (CSeqNo::seqcmp(seqno, m_iLastSeqNo) > 0)
+         m_iLastSeqNo = seqno;
+
+      int next = (m_iRecoveredTail + 1) % m_iRecoveredSize;
+      if (next != m_iRecoveredHead)
+      {
+         m_piRecovered[m_iRecoveredTail] = seqno;
+         m_iRecoveredTail = next;
+      }
+   }
+
+   // the parity packets have been consumed
+   group.m_iRows = 0;
+}
+
+bool CFECDecoder::getRecovered(CPacket& packet)
+{
+   while (m_iRecoveredHead != m_iRecoveredTail)
+   {
+      int32_t seqno = m_piRecovered[m_iRecoveredHead];
+      m_iRecoveredHead = (m_iRecoveredHead + 1) % m_iRecoveredSize;
+
+      CCopy& c = m_pCopies[seqno & (m_iCopySize - 1)];
+      if (c.m_iSeqNo != seqno)
+         continue;
+
+      packet.m_iSeqNo = seqno;
+      packet.m_iMsgNo = c.m_iMsgNo;
+      packet.m_iTimeStamp = c.m_iTimeStamp;
+      memcpy(packet.m_pcData, c.m_pcData, c.m_iLength);
+      packet.setLength(c.m_iLength);
+
+      return true;
+   }
+
+   return false;
+}
+
+bool CFECDecoder::deferLoss(int32_t seqno1, int32_t seqno2, uint64_t due)
+{
+   int next = (m_iLossTail + 1) % m_iLossSize;
+   if (next == m_iLossHead)
+      return false;
+
+   m_pLosses[m_iLossTail].m_iSeqNo1 = seqno1;
+   m_pLosses[m_iLossTail].m_iSeqNo2 = seqno2;
+   m_pLosses[m_iLossTail].m_ullDue = due;
+   m_iLossTail = next;
+
+   return true;
+}
+
+bool CFECDecoder::getDueLoss(uint64_t currtime, int32_t& seqno1, int32_t& seqno2)
+{
+   if ((m_iLossHead == m_iLossTail) || (m_pLosses[m_iLossHead].m_ullDue > currtime))
+      return false;
+
+   seqno1 = m_pLosses[m_iLossHead].m_iSeqNo1;
+   seqno2 = m_pLosses[m_iLossHead].m_iSeqNo2;
+   m_iLossHead = (m_iLossHead + 1) % m_iLossSize;
+
+   return true;
+}
@@ -0,0 +1,307 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_FEC_H__
+#define __UDT_FEC_H__
+
+
+#include "udt.h"
+#include "packet.h"
+
+// Forward error correction over groups of consecutive data packets.
+//
+// Each data packet i of a group is seen as a virtual packet of 8 bytes of header, the message number field
+// and the payload length, followed by its payload padded with zeros. Parity packet j of the group carries
+//
+//    P[j] = sum(G[j][i] * V[i]), G[j][i] = y(i) / (j + y(i)), y(i) = 16 + i
+//
+// in GF(2^8), i.e., a Cauchy matrix with each column scaled so that row 0 is all ones. Parity 0 is the XOR
+// of the group, and any set of lost packets not larger than the number of parity packets received can be
+// rebuilt, because every square submatrix of G is invertible.
+
+class CGF256
+{
+public:
+
+      // Functionality:
+      //    Multiply two elements of GF(2^8).
+      // Parameters:
+      //    0) [in] a: the first element.
+      //    1) [in] b: the second element.
+      // Returned value:
+      //    a * b.
+
+   static unsigned char mul(unsigned char a, unsigned char b);
+
+      // Functionality:
+      //    Compute the multiplicative inverse of an element.
+      // Parameters:
+      //    0) [in] a: a non-zero element.
+      // Returned value:
+      //    1 / a.
+
+   static unsigned char inv(unsigned char a);
+
+      // Functionality:
+      //    Add a multiple of a region to another one, dst += c * src, with SSSE3 where the CPU supports it.
+      // Parameters:
+      //    0) [in, out] dst: the region to update.
+      //    1) [in] src: the region to add.
+      //    2) [in] c: the factor.
+      //    3) [in] len: size of both regions, in bytes.
+      // Returned value:
+      //    None.
+
+   static void muladd(char* dst, const char* src, unsigned char c, int len);
+
+      // Functionality:
+      //    Read the coefficient of a data packet in a parity packet.
+      // Parameters:
+      //    0) [in] row: index of the parity packet, less than CFEC::m_iMaxParity.
+      //    1) [in] col: index of the data packet in its group, less than CFEC::m_iMaxGroup.
+      // Returned value:
+      //    G[row][col].
+
+   static unsigned char coef(int row, int col);
+
+private:
+   static void muladd_ref(char* dst, const char* src, unsigned char c, int len);
+   static void muladd_ssse3(char* dst, const char* src, unsigned char c, int len);
+
+private:
+   CGF256();                                    // fills the tables, run once by s_GF at static initialization
+   static CGF256 s_GF;
+
+   static unsigned char s_pcExp[512];           // exp table, doubled so that log(a) + log(b) needs no modulo
+   static unsigned char s_pcLog[256];           // log table, s_pcLog[0] is not used
+   static unsigned char s_pcCoef[16][64];       // encoding matrix G
+   static bool s_bSSSE3;                        // if the CPU supports the SSSE3 kernel
+};
+
+class CFEC
+{
+public:
+   static const int m_iHdrSize;                 // size of the virtual packet header added to each payload
+   static const int m_iMaxGroup;                // maximum number of data packets in a group
+   static const int m_iMaxParity;               // maximum number of parity packets of a group
+};
+
+class CFECEncoder
+{
+public:
+   CFECEncoder(int group, int parity, int payload);
+   ~CFECEncoder();
+
+public:
+
+      // Functionality:
+      //    Add a new data packet to the current group.
+      // Parameters:
+      //    0) [in] packet: the data packet, with its sequence number, message number and payload set.
+      // Returned value:
+      //    number of data packets in the group, including this one.
+
+   int add(const CPacket& packet);
+
+      // Functionality:
+      //    Pack a parity packet of the current group, in the byte order expected by CChannel.
+      // Parameters:
+      //    0) [in] row: index of the parity packet.
+      //    1) [out] info: group base sequence number and group size/row, for CPacket::pack().
+      //    2) [out] data: the parity payload.
+      // Returned value:
+      //    size of the parity payload.
+
+   int getParity(int row, int32_t* info, char*& data);
+
+      // Functionality:
+      //    Close the current group; the next packet starts a new one.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void reset();
+
+   int getCount() const {return m_iCount;}
+   int getGroupSize() const {return m_iGroup;}
+   int getParityCount() const {return m_iParity;}
+
+private:
+   int m_iGroup;                        // maximum number of data packets in a group
+   int m_iParity;                       // number of parity packets of a group
+   int m_iPayloadSize;                  // maximum payload size of data packets
+
+   char* m_pcParity;                    // parity rows of the current group, m_iRowSize bytes each
+   int m_iRowSize;                      // size of a parity row
+   int32_t m_iBase;                     // sequence number of the first packet of the current group
+   int m_iCount;                        // number of packets in the current group
+   int m_iLength;                       // largest virtual packet size in the current group
+
+private:
+   CFECEncoder(const CFECEncoder&);
+   CFECEncoder& operator=(const CFECEncoder&);
+};
+
+class CFECDecoder
+{
+public:
+   CFECDecoder(int payload);
+   ~CFECDecoder();
+
+public:
+
+      // Functionality:
+      //    Keep a copy of a received data packet, and rebuild what can be rebuilt in its group.
+      // Parameters:
+      //    0) [in] packet: the data packet.
+      // Returned value:
+      //    None.
+
+   void addData(const CPacket& packet);
+
+      // Functionality:
+      //    Add a parity packet, and rebuild what can be rebuilt in its group.
+      // Parameters:
+      //    0) [in] packet: the parity packet, as received from CChannel.
+      // Returned value:
+      //    None.
+
+   void addParity(const CPacket& packet);
+
+      // Functionality:
+      //    Retrieve the next rebuilt data packet.
+      // Parameters:
+      //    0) [out] packet: the packet to write, whose payload buffer must hold a full payload.
+      // Returned value:
+      //    true if a packet is found, false if there is none.
+
+   bool getRecovered(CPacket& packet);
+   bool hasRecovered() const {return m_iRecoveredHead != m_iRecoveredTail;}
+
+      // Functionality:
+      //    Hold the report of a loss until the FEC group may have rebuilt it.
+      // Parameters:
+      //    0) [in] seqno1: first lost sequence number.
+      //    1) [in] seqno2: last lost sequence number.
+      //    2) [in] due: time when the loss must be reported, in CPU clock cycles.
+      // Returned value:
+      //    true if the report is held, false if it must be sent now.
+
+   bool deferLoss(int32_t seqno1, int32_t seqno2, uint64_t due);
+
+      // Functionality:
+      //    Retrieve a held loss report that is due.
+      // Parameters:
+      //    0) [in] currtime: current time, in CPU clock cycles.
+      //    1) [out] seqno1: first lost sequence number.
+      //    2) [out] seqno2: last lost sequence number.
+      // Returned value:
+      //    true if a report is due, false otherwise.
+
+   bool getDueLoss(uint64_t currtime, int32_t& seqno1, int32_t& seqno2);
+
+      // Functionality:
+      //    Release the packet copies and parity packets after the connection has been idle.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
+
+   int getGroupSize() const {return m_iGroupSize;}
+
+private:
+   struct CCopy
+   {
+      int32_t m_iSeqNo;                 // sequence number, or -1 if the slot is empty
+      int32_t m_iMsgNo;                 // message number field
+      int32_t m_iTimeStamp;             // time stamp
+      int m_iLength;                    // payload size
+      char* m_pcData;                   // payload
+   };
+
+   struct CGroup
+   {
+      int32_t m_iBase;                  // sequence number of the first data packet
+      int m_iCount;                     // number of data packets
+      int m_iRows;                      // bit mask of the parity packets received
+      int m_iLength;                    // size of the parity packets
+      int32_t m_iTimeStamp;             // time stamp of the last parity packet
+      char* m_ppcParity[16];            // parity packets, allocated when first used
+   };
+
+   struct CLoss
+   {
+      int32_t m_iSeqNo1;
+      int32_t m_iSeqNo2;
+      uint64_t m_ullDue;
+   };
+
+   void prepare();
+   void recover(CGroup& group);
+
+private:
+   int m_iPayloadSize;                  // size of the payload buffers
+   int m_iRowSize;                      // size of a parity packet buffer
+
+   CCopy* m_pCopies;                    // copies of the recent data packets, indexed by sequence number
+   int m_iCopySize;                     // number of copies, a power of 2
+   int32_t m_iLastSeqNo;                // largest sequence number copied
+
+   CGroup* m_pGroups;                   // groups with parity packets, waiting for their data packets
+   int m_iGroups;                       // number of group slots
+   int m_iGroupSize;                    // largest group seen
+
+   int32_t* m_piRecovered;              // rebuilt packets, kept in the copies, not yet retrieved
+   int m_iRecoveredSize;
+   int m_iRecoveredHead;
+   int m_iRecoveredTail;
+
+   CLoss* m_pLosses;                    // held loss reports, in the order of their due time
+   int m_iLossSize;
+   int m_iLossHead;
+   int m_iLossTail;
+
+   char* m_pcWork;                      // scratch virtual packet
+
+private:
+   CFECDecoder(const CFECDecoder&);
+   CFECDecoder& operator=(const CFECDecoder&);
+};
+
+
+#endif
@@ -38,331 +38,359 @@ written by
    Yunhong Gu, last updated 01/22/2011
 *****************************************************************************/
 
+#include <cstring>
 #include "list.h"
 
-CSndLossList::CSndLossList(int size):
-m_piData1(NULL),
-m_piData2(NULL),
-m_piNext(NULL),
-m_iHead(-1),
-m_iLength(0),
-m_iSize(size),
-m_iLastInsertPos(-1),
-m_ListLock()
+namespace
+{
+// mask of the bits [lo, hi) of a word
+inline uint64_t bitmask(int lo, int hi)
+{
+   return ((64 == hi) ? ~0ULL : ((1ULL << hi) - 1)) & (~0ULL << lo);
+}
+
+inline int popcount(uint64_t w)
+{
+#ifdef __GNUC__
+   return __builtin_popcountll(w);
+#else
+   w = w - ((w >> 1) & 0x5555555555555555ULL);
+   w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+   w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+   return int((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// index of the lowest set bit, the word must not be 0
+inline int lowbit(uint64_t w)
 {
-   m_piData1 = new int32_t [m_iSize];
-   m_piData2 = new int32_t [m_iSize];
-   m_piNext = new int [m_iSize];
+#ifdef __GNUC__
+   return __builtin_ctzll(w);
+#else
+   int i = 0;
+   if (0 == (w & 0xFFFFFFFFULL)) {w >>= 32; i += 32;}
+   if (0 == (w & 0xFFFFULL)) {w >>= 16; i += 16;}
+   if (0 == (w & 0xFFULL)) {w >>= 8; i += 8;}
+   if (0 == (w & 0xFULL)) {w >>= 4; i += 4;}
+   if (0 == (w & 0x3ULL)) {w >>= 2; i += 2;}
+   if (0 == (w & 0x1ULL)) i += 1;
+   return i;
+#endif
+}
+
+// loss reports carry bytes in 32-bit words, most significant byte first, so that the
+// byte order conversion of control packets keeps them intact
+inline void putVarint(int32_t* words, int& pos, uint32_t v)
+{
+   do
+   {
+      uint32_t byte = v & 0x7F;
+      v >>= 7;
+      if (0 != v)
+         byte |= 0x80;
+
+      if (0 == (pos & 3))
+         words[pos >> 2] = 0;
+      words[pos >> 2] |= int32_t(byte << (24 - ((pos & 3) << 3)));
+      ++ pos;
+   } while (0 != v);
+}
 
-   // -1 means there is no data in the node
-   for (int i = 0; i < size; ++ i)
+inline int varintSize(uint32_t v)
+{
+   int size = 1;
+   while (v >= 0x80)
    {
-      m_piData1[i] = -1;
-      m_piData2[i] = -1;
+      v >>= 7;
+      ++ size;
    }
+   return size;
+}
 
-   // sender list needs mutex protection
-   #ifndef WIN32
-      pthread_mutex_init(&m_ListLock, 0);
-   #else
-      m_ListLock = CreateMutex(NULL, false, NULL);
-   #endif
+inline bool getVarint(const int32_t* words, int& pos, int size, uint32_t& v)
+{
+   v = 0;
+   for (int shift = 0; (shift < 32) && (pos < size); shift += 7)
+   {
+      uint32_t byte = (uint32_t(words[pos >> 2]) >> (24 - ((pos & 3) << 3))) & 0xFF;
+      ++ pos;
+      v |= (byte & 0x7F) << shift;
+      if (0 == (byte & 0x80))
+         return v <= uint32_t(CSeqNo::m_iMaxSeqNo);
+   }
+   return false;
+}
 }
 
-CSndLossList::~CSndLossList()
+CLossBitmap::CLossBitmap(int size):
+m_pBits(NULL),
+m_iSize((size + 63) & ~63)
 {
-   delete [] m_piData1;
-   delete [] m_piData2;
-   delete [] m_piNext;
+   if (m_iSize <= 0)
+      m_iSize = 64;
 
-   #ifndef WIN32
-      pthread_mutex_destroy(&m_ListLock);
-   #else
-      CloseHandle(m_ListLock);
-   #endif
+   // the words are not allocated until the first loss, most connections never have one
 }
 
-int CSndLossList::insert(int32_t seqno1, int32_t seqno2)
+CLossBitmap::~CLossBitmap()
 {
-   CGuard listguard(m_ListLock);
+   delete [] m_pBits;
+}
 
-   if (0 == m_iLength)
+int CLossBitmap::set(int pos, int len)
+{
+   if (NULL == m_pBits)
    {
-      // insert data into an empty list
+      m_pBits = new uint64_t [m_iSize >> 6];
+      memset(m_pBits, 0, (m_iSize >> 6) * sizeof(uint64_t));
+   }
 
-      m_iHead = 0;
-      m_piData1[m_iHead] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[m_iHead] = seqno2;
+   if (len > m_iSize)
+      len = m_iSize;
 
-      m_piNext[m_iHead] = -1;
-      m_iLastInsertPos = m_iHead;
+   if (pos + len <= m_iSize)
+      return setLinear(pos, len);
 
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+   return setLinear(pos, m_iSize - pos) + setLinear(0, pos + len - m_iSize);
+}
 
-      return m_iLength;
-   }
+int CLossBitmap::clear(int pos, int len)
+{
+   if (NULL == m_pBits)
+      return 0;
 
-   // otherwise find the position where the data can be inserted
-   int origlen = m_iLength;
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno1);
-   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+   if (len > m_iSize)
+      len = m_iSize;
 
-   if (offset < 0)
-   {
-      // Insert data prior to the head pointer
+   if (pos + len <= m_iSize)
+      return clearLinear(pos, len);
 
-      m_piData1[loc] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[loc] = seqno2;
+   return clearLinear(pos, m_iSize - pos) + clearLinear(0, pos + len - m_iSize);
+}
 
-      // new node becomes head
-      m_piNext[loc] = m_iHead;
-      m_iHead = loc;
-      m_iLastInsertPos = loc;
+int CLossBitmap::find(int pos, int len, bool value) const
+{
+   if (len > m_iSize)
+      len = m_iSize;
 
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
-   }
-   else if (offset > 0)
-   {
-      if (seqno1 == m_piData1[loc])
-      {
-         m_iLastInsertPos = loc;
+   if (NULL == m_pBits)
+      return (value || (len <= 0)) ? -1 : 0;
 
-         // first seqno is equivlent, compare the second
-         if (-1 == m_piData2[loc])
-         {
-            if (seqno2 != seqno1)
-            {
-               m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
-               m_piData2[loc] = seqno2;
-            }
-         }
-         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
-         {
-            // new seq pair is longer than old pair, e.g., insert [3, 7] to [3, 5], becomes [3, 7]
-            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else
-            // Do nothing if it is already there
-            return 0;
-      }
-      else
-      {
-         // searching the prior node
-         int i;
-         if ((-1 != m_iLastInsertPos) && (CSeqNo::seqcmp(m_piData1[m_iLastInsertPos], seqno1) < 0))
-            i = m_iLastInsertPos;
-         else
-            i = m_iHead;
+   if (pos + len <= m_iSize)
+      return findLinear(pos, len, value);
 
-         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno1) < 0))
-            i = m_piNext[i];
+   int d = findLinear(pos, m_iSize - pos, value);
+   if (d >= 0)
+      return d;
 
-         if ((-1 == m_piData2[i]) || (CSeqNo::seqcmp(m_piData2[i], seqno1) < 0))
-         {
-            m_iLastInsertPos = loc;
+   d = findLinear(0, pos + len - m_iSize, value);
+   if (d >= 0)
+      return d + m_iSize - pos;
 
-            // no overlap, create new node
-            m_piData1[loc] = seqno1;
-            if (seqno2 != seqno1)
-               m_piData2[loc] = seqno2;
+   return -1;
+}
 
-            m_piNext[loc] = m_piNext[i];
-            m_piNext[i] = loc;
+int CLossBitmap::setLinear(int pos, int len)
+{
+   int count = 0;
+   int end = pos + len;
 
-            m_iLength += CSeqNo::seqlen(seqno1, seqno2);
-         }
-         else
-         {
-            m_iLastInsertPos = i;
-
-            // overlap, coalesce with prior node, insert(3, 7) to [2, 5], ... becomes [2, 7]
-            if (CSeqNo::seqcmp(m_piData2[i], seqno2) < 0)
-            {
-               m_iLength += CSeqNo::seqlen(m_piData2[i], seqno2) - 1;
-               m_piData2[i] = seqno2;
-
-               loc = i;
-            }
-            else
-               return 0;
-         }
-      }
+   for (int w = pos >> 6, lo = pos & 63; pos < end; ++ w, lo = 0)
+   {
+      int hi = (end - pos + lo > 64) ? 64 : end - pos + lo;
+      uint64_t m = bitmask(lo, hi);
+
+      count += popcount(m & ~m_pBits[w]);
+      m_pBits[w] |= m;
+      pos += hi - lo;
    }
-   else
+
+   return count;
+}
+
+int CLossBitmap::clearLinear(int pos, int len)
+{
+   int count = 0;
+   int end = pos + len;
+
+   for (int w = pos >> 6, lo = pos & 63; pos < end; ++ w, lo = 0)
    {
-      m_iLastInsertPos = m_iHead;
+      int hi = (end - pos + lo > 64) ? 64 : end - pos + lo;
+      uint64_t m = bitmask(lo, hi);
 
-      // insert to head node
-      if (seqno2 != seqno1)
-      {
-         if (-1 == m_piData2[loc])
-         {
-            m_iLength += CSeqNo::seqlen(seqno1, seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else if (CSeqNo::seqcmp(seqno2, m_piData2[loc]) > 0)
-         {
-            m_iLength += CSeqNo::seqlen(m_piData2[loc], seqno2) - 1;
-            m_piData2[loc] = seqno2;
-         }
-         else 
-            return 0;
-      }
-      else
-         return 0;
+      count += popcount(m & m_pBits[w]);
+      m_pBits[w] &= ~m;
+      pos += hi - lo;
    }
 
-   // coalesce with next node. E.g., [3, 7], ..., [6, 9] becomes [3, 9] 
-   while ((-1 != m_piNext[loc]) && (-1 != m_piData2[loc]))
+   return count;
+}
+
+int CLossBitmap::findLinear(int pos, int len, bool value) const
+{
+   int start = pos;
+   int end = pos + len;
+
+   // 64 seq. no. are checked at a time, a clear (or full) word is skipped at once
+   for (int w = pos >> 6, lo = pos & 63; pos < end; ++ w, lo = 0)
    {
-      int i = m_piNext[loc];
+      int hi = (end - pos + lo > 64) ? 64 : end - pos + lo;
+      uint64_t word = (value ? m_pBits[w] : ~m_pBits[w]) & bitmask(lo, hi);
 
-      if (CSeqNo::seqcmp(m_piData1[i], CSeqNo::incseq(m_piData2[loc])) <= 0)
-      {
-         // coalesce if there is overlap
-         if (-1 != m_piData2[i])
-         {
-            if (CSeqNo::seqcmp(m_piData2[i], m_piData2[loc]) > 0)
-            {
-               if (CSeqNo::seqcmp(m_piData2[loc], m_piData1[i]) >= 0)
-                  m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[loc]);
-
-               m_piData2[loc] = m_piData2[i];
-            }
-            else
-               m_iLength -= CSeqNo::seqlen(m_piData1[i], m_piData2[i]);
-         }
-         else
-         {
-            if (m_piData1[i] == CSeqNo::incseq(m_piData2[loc]))
-               m_piData2[loc] = m_piData1[i];
-            else
-               m_iLength --;
-         }
+      if (0 != word)
+         return (w << 6) + lowbit(word) - start;
 
-         m_piData1[i] = -1;
-         m_piData2[i] = -1;
-         m_piNext[loc] = m_piNext[i];
-      }
-      else
-         break;
+      pos += hi - lo;
    }
 
-   return m_iLength - origlen;
+   return -1;
 }
 
-void CSndLossList::remove(int32_t seqno)
+int CLossBitmap::getRuns(int pos, int len, int* runs, int limit) const
 {
-   CGuard listguard(m_ListLock);
-
-   if (0 == m_iLength)
-      return;
+   if (NULL == m_pBits)
+      return 0;
 
-   // Remove all from the head pointer to a node with a larger seq. no. or the list is empty
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno);
-   int loc = (m_iHead + offset + m_iSize) % m_iSize;
+   // record where each run starts and ends, then turn the ends into lengths
+   int edges = 0;
+   int offset = 0;
+   bool full = false;
 
-   if (0 == offset)
+   while ((offset < len) && !full)
    {
-      // It is the head. Remove the head and point to the next node
-      loc = (loc + 1) % m_iSize;
+      int lo = pos & 63;
+      int hi = (len - offset + lo > 64) ? 64 : len - offset + lo;
+      uint64_t mask = bitmask(lo, hi);
+      uint64_t word = m_pBits[pos >> 6] & mask;
 
-      if (-1 == m_piData2[m_iHead])
-         loc = m_piNext[m_iHead];
-      else
+      // a bit of "change" is set where the map differs from the bit before, all of them are read from the word at once
+      uint64_t change = (word ^ ((word << 1) | ((edges & 1) ? (1ULL << lo) : 0))) & mask;
+
+      while (0 != change)
       {
-         m_piData1[loc] = CSeqNo::incseq(seqno);
-         if (CSeqNo::seqcmp(m_piData2[m_iHead], CSeqNo::incseq(seqno)) > 0)
-            m_piData2[loc] = m_piData2[m_iHead];
+         runs[edges] = offset + lowbit(change) - lo;
+         if (++ edges == (limit << 1))
+         {
+            full = true;
+            break;
+         }
+         change &= change - 1;
+      }
 
-         m_piData2[m_iHead] = -1;
+      offset += hi - lo;
+      pos += hi - lo;
+      if (pos >= m_iSize)
+         pos -= m_iSize;
+   }
 
-         m_piNext[loc] = m_piNext[m_iHead];
-      }
+   // the last run is ended by the end of the range
+   if (edges & 1)
+      runs[edges ++] = len;
 
-      m_piData1[m_iHead] = -1;
+   for (int i = 1; i < edges; i += 2)
+      runs[i] -= runs[i - 1];
 
-      if (m_iLastInsertPos == m_iHead)
-         m_iLastInsertPos = -1;
+   return edges >> 1;
+}
 
-      m_iHead = loc;
+void CLossBitmap::release()
+{
+   if ((NULL == m_pBits) || (find(0, m_iSize) >= 0))
+      return;
 
-      m_iLength --;
-   }
-   else if (offset > 0)
+   delete [] m_pBits;
+   m_pBits = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CSndLossList::CSndLossList(int size):
+m_Bitmap(size),
+m_iSize(m_Bitmap.getSize()),
+m_iHead(0),
+m_iHeadSeq(-1),
+m_iTailSeq(-1),
+m_iLength(0),
+m_ListLock()
+{
+   // sender list needs mutex protection
+   #ifndef WIN32
+      pthread_mutex_init(&m_ListLock, 0);
+   #else
+      m_ListLock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CSndLossList::~CSndLossList()
+{
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_ListLock);
+   #else
+      CloseHandle(m_ListLock);
+   #endif
+}
+
+int CSndLossList::insert(int32_t seqno1, int32_t seqno2)
+{
+   CGuard listguard(m_ListLock);
+
+   int len = CSeqNo::seqlen(seqno1, seqno2);
+
+   if (0 == m_iLength)
    {
-      int h = m_iHead;
+      // insert data into an empty list
+      m_iHead = 0;
+      m_iHeadSeq = seqno1;
+      m_iTailSeq = seqno2;
+      m_iLength = m_Bitmap.set(m_iHead, len);
 
-      if (seqno == m_piData1[loc])
-      {
-         // target node is not empty, remove part/all of the seqno in the node.
-         int temp = loc;
-         loc = (loc + 1) % m_iSize;
+      return m_iLength;
+   }
 
-         if (-1 == m_piData2[temp])
-            m_iHead = m_piNext[temp];
-         else
-         {
-            // remove part, e.g., [3, 7] becomes [], [4, 7] after remove(3)
-            m_piData1[loc] = CSeqNo::incseq(seqno);
-            if (CSeqNo::seqcmp(m_piData2[temp], m_piData1[loc]) > 0)
-               m_piData2[loc] = m_piData2[temp];
-            m_iHead = loc;
-            m_piNext[loc] = m_piNext[temp];
-            m_piNext[temp] = loc;
-            m_piData2[temp] = -1;
-         }
-      }
-      else
-      {
-         // target node is empty, check prior node
-         int i = m_iHead;
-         while ((-1 != m_piNext[i]) && (CSeqNo::seqcmp(m_piData1[m_piNext[i]], seqno) < 0))
-            i = m_piNext[i];
+   int loc = pos(seqno1);
 
-         loc = (loc + 1) % m_iSize;
+   // the new range may start before the head or end after the tail
+   if (CSeqNo::seqcmp(seqno1, m_iHeadSeq) < 0)
+   {
+      m_iHead = loc;
+      m_iHeadSeq = seqno1;
+   }
+   if (CSeqNo::seqcmp(seqno2, m_iTailSeq) > 0)
+      m_iTailSeq = seqno2;
 
-         if (-1 == m_piData2[i])
-            m_iHead = m_piNext[i];
-         else if (CSeqNo::seqcmp(m_piData2[i], seqno) > 0)
-         {
-            // remove part/all seqno in the prior node
-            m_piData1[loc] = CSeqNo::incseq(seqno);
-            if (CSeqNo::seqcmp(m_piData2[i], m_piData1[loc]) > 0)
-               m_piData2[loc] = m_piData2[i];
+   // overlapping ranges are counted only once
+   int count = m_Bitmap.set(loc, len);
+   m_iLength += count;
 
-            m_piData2[i] = seqno;
+   return count;
+}
 
-            m_piNext[loc] = m_piNext[i];
-            m_piNext[i] = loc;
+void CSndLossList::remove(int32_t seqno)
+{
+   CGuard listguard(m_ListLock);
 
-            m_iHead = loc;
-         }
-         else
-            m_iHead = m_piNext[i];
-      }
+   if (0 == m_iLength)
+      return;
 
-      // Remove all nodes prior to the new head
-      while (h != m_iHead)
-      {
-         if (m_piData2[h] != -1)
-         {
-            m_iLength -= CSeqNo::seqlen(m_piData1[h], m_piData2[h]);
-            m_piData2[h] = -1;
-         }
-         else
-            m_iLength --;
+   // Remove all from the head to "seqno"
+   int offset = CSeqNo::seqoff(m_iHeadSeq, seqno);
+   if (offset < 0)
+      return;
 
-         m_piData1[h] = -1;
+   if (CSeqNo::seqcmp(seqno, m_iTailSeq) >= 0)
+   {
+      m_Bitmap.clear(m_iHead, CSeqNo::seqlen(m_iHeadSeq, m_iTailSeq));
+      m_iLength = 0;
+      return;
+   }
 
-         if (m_iLastInsertPos == h)
-            m_iLastInsertPos = -1;
+   m_iLength -= m_Bitmap.clear(m_iHead, offset + 1);
 
-         h = m_piNext[h];
-      }
+   if (m_iLength > 0)
+   {
+      m_iHead = (m_iHead + offset + 1) % m_iSize;
+      m_iHeadSeq = CSeqNo::incseq(seqno);
+      seekHead();
    }
 }
 
@@ -383,71 +411,69 @@ int32_t CSndLossList::getLostSeq()
    if (0 == m_iLength)
      return -1;
 
-   if (m_iLastInsertPos == m_iHead)
-      m_iLastInsertPos = -1;
-
    // return the first loss seq. no.
-   int32_t seqno = m_piData1[m_iHead];
+   int32_t seqno = m_iHeadSeq;
+
+   m_Bitmap.clear(m_iHead, 1);
+   m_iLength --;
 
-   // head moves to the next node
-   if (-1 == m_piData2[m_iHead])
+   // head moves to the next loss
+   if (m_iLength > 0)
    {
-      //[3, -1] becomes [], and head moves to next node in the list
-      m_piData1[m_iHead] = -1;
-      m_iHead = m_piNext[m_iHead];
+      m_iHead = (m_iHead + 1) % m_iSize;
+      m_iHeadSeq = CSeqNo::incseq(seqno);
+      seekHead();
    }
-   else
-   {
-      // shift to next node, e.g., [3, 7] becomes [], [4, 7]
-      int loc = (m_iHead + 1) % m_iSize;
 
-      m_piData1[loc] = CSeqNo::incseq(seqno);
-      if (CSeqNo::seqcmp(m_piData2[m_iHead], m_piData1[loc]) > 0)
-         m_piData2[loc] = m_piData2[m_iHead];
+   return seqno;
+}
 
-      m_piData1[m_iHead] = -1;
-      m_piData2[m_iHead] = -1;
+void CSndLossList::trim()
+{
+   CGuard listguard(m_ListLock);
 
-      m_piNext[loc] = m_piNext[m_iHead];
-      m_iHead = loc;
-   }
+   if (0 == m_iLength)
+      m_Bitmap.release();
+}
 
-   m_iLength --;
+int CSndLossList::pos(int32_t seqno) const
+{
+   // seq. no. in the list are less than the size of the map apart
+   int loc = m_iHead + CSeqNo::seqoff(m_iHeadSeq, seqno);
+   if (loc >= m_iSize)
+      return loc - m_iSize;
+   if (loc < 0)
+      return loc + m_iSize;
+   return loc;
+}
 
-   return seqno;
+void CSndLossList::seekHead()
+{
+   int offset = m_Bitmap.find(m_iHead, CSeqNo::seqlen(m_iHeadSeq, m_iTailSeq));
+   if (offset < 0)
+   {
+      m_iLength = 0;
+      return;
+   }
+
+   m_iHead = (m_iHead + offset) % m_iSize;
+   m_iHeadSeq = CSeqNo::incseq(m_iHeadSeq, offset);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CRcvLossList::CRcvLossList(int size):
-m_piData1(NULL),
-m_piData2(NULL),
-m_piNext(NULL),
-m_piPrior(NULL),
-m_iHead(-1),
-m_iTail(-1),
-m_iLength(0),
-m_iSize(size)
+m_Bitmap(size),
+m_iSize(m_Bitmap.getSize()),
+m_iHead(0),
+m_iHeadSeq(-1),
+m_iTailSeq(-1),
+m_iLength(0)
 {
-   m_piData1 = new int32_t [m_iSize];
-   m_piData2 = new int32_t [m_iSize];
-   m_piNext = new int [m_iSize];
-   m_piPrior = new int [m_iSize];
-
-   // -1 means there is no data in the node
-   for (int i = 0; i < size; ++ i)
-   {
-      m_piData1[i] = -1;
-      m_piData2[i] = -1;
-   }
 }
 
 CRcvLossList::~CRcvLossList()
 {
-   delete [] m_piData1;
-   delete [] m_piData2;
-   delete [] m_piNext;
-   delete [] m_piPrior;
 }
 
 void CRcvLossList::insert(int32_t seqno1, int32_t seqno2)
@@ -459,245 +485,241 @@ void CRcvLossList::insert(int32_t seqno1, int32_t seqno2)
    {
       // insert data into an empty list
       m_iHead = 0;
-      m_iTail = 0;
-      m_piData1[m_iHead] = seqno1;
-      if (seqno2 != seqno1)
-         m_piData2[m_iHead] = seqno2;
+      m_iHeadSeq = seqno1;
+   }
 
-      m_piNext[m_iHead] = -1;
-      m_piPrior[m_iHead] = -1;
-      m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+   m_iTailSeq = seqno2;
+   m_iLength += m_Bitmap.set(pos(seqno1), CSeqNo::seqlen(seqno1, seqno2));
+}
 
-      return;
-   }
+bool CRcvLossList::remove(int32_t seqno)
+{
+   if (0 == m_iLength)
+      return false;
 
-   // otherwise searching for the position where the node should be
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno1);
-   int loc = (m_iHead + offset) % m_iSize;
+   if ((CSeqNo::seqcmp(seqno, m_iHeadSeq) < 0) || (CSeqNo::seqcmp(seqno, m_iTailSeq) > 0))
+      return false;
 
-   if ((-1 != m_piData2[m_iTail]) && (CSeqNo::incseq(m_piData2[m_iTail]) == seqno1))
-   {
-      // coalesce with prior node, e.g., [2, 5], [6, 7] becomes [2, 7]
-      loc = m_iTail;
-      m_piData2[loc] = seqno2;
-   }
-   else
-   {
-      // create new node
-      m_piData1[loc] = seqno1;
+   int loc = pos(seqno);
+   if (!m_Bitmap.test(loc))
+      return false;
 
-      if (seqno2 != seqno1)
-         m_piData2[loc] = seqno2;
+   m_Bitmap.clear(loc, 1);
+   m_iLength --;
 
-      m_piNext[m_iTail] = loc;
-      m_piPrior[loc] = m_iTail;
-      m_piNext[loc] = -1;
-      m_iTail = loc;
-   }
+   if ((m_iLength > 0) && (loc == m_iHead))
+      seekHead();
 
-   m_iLength += CSeqNo::seqlen(seqno1, seqno2);
+   return true;
 }
 
-bool CRcvLossList::remove(int32_t seqno)
+bool CRcvLossList::remove(int32_t seqno1, int32_t seqno2)
 {
-   if (0 == m_iLength)
-      return false; 
-
-   // locate the position of "seqno" in the list
-   int offset = CSeqNo::seqoff(m_piData1[m_iHead], seqno);
-   if (offset < 0)
+   if ((0 == m_iLength) || !clip(seqno1, seqno2))
       return false;
 
-   int loc = (m_iHead + offset) % m_iSize;
+   int count = m_Bitmap.clear(pos(seqno1), CSeqNo::seqlen(seqno1, seqno2));
+   m_iLength -= count;
 
-   if (seqno == m_piData1[loc])
-   {
-      // This is a seq. no. that starts the loss sequence
+   if ((m_iLength > 0) && !m_Bitmap.test(m_iHead))
+      seekHead();
 
-      if (-1 == m_piData2[loc])
-      {
-         // there is only 1 loss in the sequence, delete it from the node
-         if (m_iHead == loc)
-         {
-            m_iHead = m_piNext[m_iHead];
-            if (-1 != m_iHead)
-               m_piPrior[m_iHead] = -1;
-         }
-         else
-         {
-            m_piNext[m_piPrior[loc]] = m_piNext[loc];
-            if (-1 != m_piNext[loc])
-               m_piPrior[m_piNext[loc]] = m_piPrior[loc];
-            else
-               m_iTail = m_piPrior[loc];
-         }
+   return count > 0;
+}
 
-         m_piData1[loc] = -1;
-      }
-      else
-      {
-         // there are more than 1 loss in the sequence
-         // move the node to the next and update the starter as the next loss inSeqNo(seqno)
-
-         // find next node
-         int i = (loc + 1) % m_iSize;
-
-         // remove the "seqno" and change the starter as next seq. no.
-         m_piData1[i] = CSeqNo::incseq(m_piData1[loc]);
-
-         // process the sequence end
-         if (CSeqNo::seqcmp(m_piData2[loc], CSeqNo::incseq(m_piData1[loc])) > 0)
-            m_piData2[i] = m_piData2[loc];
-
-         // remove the current node
-         m_piData1[loc] = -1;
-         m_piData2[loc] = -1;
- 
-         // update list pointer
-         m_piNext[i] = m_piNext[loc];
-         m_piPrior[i] = m_piPrior[loc];
-
-         if (m_iHead == loc)
-            m_iHead = i;
-         else
-            m_piNext[m_piPrior[i]] = i;
-
-         if (m_iTail == loc)
-            m_iTail = i;
-         else
-            m_piPrior[m_piNext[i]] = i;
-      }
+bool CRcvLossList::find(int32_t seqno1, int32_t seqno2) const
+{
+   if ((0 == m_iLength) || !clip(seqno1, seqno2))
+      return false;
 
-      m_iLength --;
+   return m_Bitmap.find(pos(seqno1), CSeqNo::seqlen(seqno1, seqno2)) >= 0;
+}
 
-      return true;
-   }
+int CRcvLossList::getLossLength() const
+{
+   return m_iLength;
+}
 
-   // There is no loss sequence in the current position
-   // the "seqno" may be contained in a previous node
+int CRcvLossList::getFirstLostSeq() const
+{
+   if (0 == m_iLength)
+      return -1;
 
-   // searching previous node
-   int i = (loc - 1 + m_iSize) % m_iSize;
-   while (-1 == m_piData1[i])
-      i = (i - 1 + m_iSize) % m_iSize;
+   return m_iHeadSeq;
+}
 
-   // not contained in this node, return
-   if ((-1 == m_piData2[i]) || (CSeqNo::seqcmp(seqno, m_piData2[i]) > 0))
-       return false;
+void CRcvLossList::getLossArray(int32_t* array, int& len, int limit, int32_t seqno)
+{
+   len = 0;
 
-   if (seqno == m_piData2[i])
-   {
-      // it is the sequence end
+   // read the runs of lost packets from the map, a batch at a time
+   const int batch = 128;
+   int runs[batch * 2];
+   int span = this->span(seqno);
+   int offset = 0;
 
-      if (seqno == CSeqNo::incseq(m_piData1[i]))
-         m_piData2[i] = -1;
-      else
-         m_piData2[i] = CSeqNo::decseq(seqno);
-   }
-   else
+   while ((len < limit - 1) && (offset < span))
    {
-      // split the sequence
-
-      // construct the second sequence from CSeqNo::incseq(seqno) to the original sequence end
-      // located at "loc + 1"
-      loc = (loc + 1) % m_iSize;
+      int n = m_Bitmap.getRuns((m_iHead + offset) % m_iSize, span - offset, runs, batch);
+      if (0 == n)
+         break;
 
-      m_piData1[loc] = CSeqNo::incseq(seqno);
-      if (CSeqNo::seqcmp(m_piData2[i], m_piData1[loc]) > 0)      
-         m_piData2[loc] = m_piData2[i];
+      for (int i = 0; (i < n) && (len < limit - 1); ++ i)
+      {
+         int start = offset + runs[i << 1];
+         int run = runs[(i << 1) + 1];
 
-      // the first (original) sequence is between the original sequence start to CSeqNo::decseq(seqno)
-      if (seqno == CSeqNo::incseq(m_piData1[i]))
-         m_piData2[i] = -1;
-      else
-         m_piData2[i] = CSeqNo::decseq(seqno);
+         array[len] = CSeqNo::incseq(m_iHeadSeq, start);
+         if (run > 1)
+         {
+            // there are more than 1 loss in the sequence
+            array[len] |= 0x80000000;
+            ++ len;
+            array[len] = CSeqNo::incseq(m_iHeadSeq, start + run - 1);
+         }
 
-      // update the list pointer
-      m_piNext[loc] = m_piNext[i];
-      m_piNext[i] = loc;
-      m_piPrior[loc] = i;
+         ++ len;
+      }
 
-      if (m_iTail == i)
-         m_iTail = loc;
-      else
-         m_piPrior[m_piNext[loc]] = loc;
+      offset += runs[(n - 1) << 1] + runs[((n - 1) << 1) + 1];
    }
-
-   m_iLength --;
-
-   return true;
 }
 
-bool CRcvLossList::remove(int32_t seqno1, int32_t seqno2)
+void CRcvLossList::getLossReport(int32_t* report, int& len, int limit, int32_t seqno)
 {
-   if (seqno1 <= seqno2)
-   {
-      for (int32_t i = seqno1; i <= seqno2; ++ i)
-         remove(i);
-   }
-   else
+   len = 0;
+
+   int span = this->span(seqno);
+   if ((0 == span) || (limit < 3))
+      return;
+
+   const int batch = 128;
+   int runs[batch * 2];
+   int offset = 0;
+   int last = -1;
+   int count = 0;
+   int pos = 0;
+   int capacity = (limit - 2) << 2;
+   bool full = false;
+
+   // each run is sent as the number of received packets before it and its length minus 1
+   while (!full && (offset < span))
    {
-      for (int32_t j = seqno1; j < CSeqNo::m_iMaxSeqNo; ++ j)
-         remove(j);
-      for (int32_t k = 0; k <= seqno2; ++ k)
-         remove(k);
+      int n = m_Bitmap.getRuns((m_iHead + offset) % m_iSize, span - offset, runs, batch);
+      if (0 == n)
+         break;
+
+      for (int i = 0; i < n; ++ i)
+      {
+         int start = offset + runs[i << 1];
+         int run = runs[(i << 1) + 1];
+
+         if (pos + varintSize(start - last - 1) + varintSize(run - 1) > capacity)
+         {
+            full = true;
+            break;
+         }
+
+         putVarint(report + 2, pos, start - last - 1);
+         putVarint(report + 2, pos, run - 1);
+         last = start + run - 1;
+         ++ count;
+      }
+
+      offset += runs[(n - 1) << 1] + runs[((n - 1) << 1) + 1];
    }
 
-   return true;
+   report[0] = m_iHeadSeq;
+   report[1] = count;
+   len = 2 + ((pos + 3) >> 2);
 }
 
-bool CRcvLossList::find(int32_t seqno1, int32_t seqno2) const
+int CRcvLossList::decodeLossReport(const int32_t* report, int size, int32_t* array, int limit)
 {
-   if (0 == m_iLength)
-      return false;
+   if ((size < 2) || (report[0] < 0) || (report[1] < 0))
+      return -1;
 
-   int p = m_iHead;
+   int len = 0;
+   int pos = 0;
+   int bytes = (size - 2) << 2;
+   int32_t next = report[0];
 
-   while (-1 != p)
+   for (int i = 0; i < report[1]; ++ i)
    {
-      if ((CSeqNo::seqcmp(m_piData1[p], seqno1) == 0) ||
-          ((CSeqNo::seqcmp(m_piData1[p], seqno1) > 0) && (CSeqNo::seqcmp(m_piData1[p], seqno2) <= 0)) ||
-          ((CSeqNo::seqcmp(m_piData1[p], seqno1) < 0) && (m_piData2[p] != -1) && CSeqNo::seqcmp(m_piData2[p], seqno1) >= 0))
-          return true;
+      uint32_t gap, run;
+      if (!getVarint(report + 2, pos, bytes, gap) || !getVarint(report + 2, pos, bytes, run))
+         return -1;
+
+      if (len + ((run > 0) ? 2 : 1) > limit)
+         return -1;
+
+      int32_t start = CSeqNo::incseq(next, gap);
+      int32_t end = CSeqNo::incseq(start, run);
+
+      if (run > 0)
+      {
+         array[len ++] = start | 0x80000000;
+         array[len ++] = end;
+      }
+      else
+         array[len ++] = start;
 
-      p = m_piNext[p];
+      next = CSeqNo::incseq(end);
    }
 
-   return false;
+   return len;
 }
 
-int CRcvLossList::getLossLength() const
+void CRcvLossList::trim()
 {
-   return m_iLength;
+   if (0 == m_iLength)
+      m_Bitmap.release();
 }
 
-int CRcvLossList::getFirstLostSeq() const
+int CRcvLossList::pos(int32_t seqno) const
 {
-   if (0 == m_iLength)
-      return -1;
+   // seq. no. in the list are less than the size of the map apart
+   int loc = m_iHead + CSeqNo::seqoff(m_iHeadSeq, seqno);
+   if (loc >= m_iSize)
+      return loc - m_iSize;
+   if (loc < 0)
+      return loc + m_iSize;
+   return loc;
+}
 
-   return m_piData1[m_iHead];
+bool CRcvLossList::clip(int32_t& seqno1, int32_t& seqno2) const
+{
+   if (CSeqNo::seqcmp(seqno1, m_iHeadSeq) < 0)
+      seqno1 = m_iHeadSeq;
+   if (CSeqNo::seqcmp(seqno2, m_iTailSeq) > 0)
+      seqno2 = m_iTailSeq;
+
+   return CSeqNo::seqcmp(seqno1, seqno2) <= 0;
 }
 
-void CRcvLossList::getLossArray(int32_t* array, int& len, int limit)
+int CRcvLossList::span(int32_t seqno) const
 {
-   len = 0;
+   if (0 == m_iLength)
+      return 0;
 
-   int i = m_iHead;
+   if ((-1 == seqno) || (CSeqNo::seqcmp(seqno, m_iTailSeq) >= 0))
+      return CSeqNo::seqlen(m_iHeadSeq, m_iTailSeq);
 
-   while ((len < limit - 1) && (-1 != i))
-   {
-      array[len] = m_piData1[i];
-      if (-1 != m_piData2[i])
-      {
-         // there are more than 1 loss in the sequence
-         array[len] |= 0x80000000;
-         ++ len;
-         array[len] = m_piData2[i];
-      }
+   if (CSeqNo::seqcmp(seqno, m_iHeadSeq) < 0)
+      return 0;
 
-      ++ len;
+   return CSeqNo::seqlen(m_iHeadSeq, seqno);
+}
 
-      i = m_piNext[i];
+void CRcvLossList::seekHead()
+{
+   int offset = m_Bitmap.find(m_iHead, CSeqNo::seqlen(m_iHeadSeq, m_iTailSeq));
+   if (offset < 0)
+   {
+      m_iLength = 0;
+      return;
    }
+
+   m_iHead = (m_iHead + offset) % m_iSize;
+   m_iHeadSeq = CSeqNo::incseq(m_iHeadSeq, offset);
 }
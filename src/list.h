@@ -46,6 +46,98 @@ written by
 #include "common.h"
 
 
+class CLossBitmap
+{
+public:
+   CLossBitmap(int size = 1024);
+   ~CLossBitmap();
+
+      // Functionality:
+      //    Read the number of bits, which is the size rounded up to whole words.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    number of bits.
+
+   int getSize() const {return m_iSize;}
+
+      // Functionality:
+      //    Set the bits of a range; positions wrap around the end of the map.
+      // Parameters:
+      //    0) [in] pos: first bit.
+      //    1) [in] len: number of bits.
+      // Returned value:
+      //    number of bits that were not set previously.
+
+   int set(int pos, int len);
+
+      // Functionality:
+      //    Clear the bits of a range; positions wrap around the end of the map.
+      // Parameters:
+      //    0) [in] pos: first bit.
+      //    1) [in] len: number of bits.
+      // Returned value:
+      //    number of bits that were set previously.
+
+   int clear(int pos, int len);
+
+      // Functionality:
+      //    Check a bit.
+      // Parameters:
+      //    0) [in] pos: bit position.
+      // Returned value:
+      //    true if the bit is set, otherwise false.
+
+   bool test(int pos) const {return (NULL != m_pBits) && (0 != (m_pBits[pos >> 6] & (1ULL << (pos & 63))));}
+
+      // Functionality:
+      //    Find the first set (or clear) bit of a range, a word at a time.
+      // Parameters:
+      //    0) [in] pos: first bit.
+      //    1) [in] len: number of bits.
+      //    2) [in] value: search for a set bit (true) or a clear bit (false).
+      // Returned value:
+      //    distance of the bit found from "pos", or -1 if there is none in the range.
+
+   int find(int pos, int len, bool value = true) const;
+
+      // Functionality:
+      //    Read the runs of set bits in a range.
+      // Parameters:
+      //    0) [in] pos: first bit.
+      //    1) [in] len: number of bits.
+      //    2) [out] runs: pairs of (distance from "pos", length), one per run.
+      //    3) [in] limit: maximum number of runs to read.
+      // Returned value:
+      //    number of runs read.
+
+   int getRuns(int pos, int len, int* runs, int limit) const;
+
+      // Functionality:
+      //    Release the words of a map with no bit set; they are allocated again by the next set().
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void release();
+
+private:
+   uint64_t* m_pBits;                   // the bits, one per seq. no., NULL (all clear) until a bit is set
+   int m_iSize;                         // number of bits
+
+private:
+   int setLinear(int pos, int len);
+   int clearLinear(int pos, int len);
+   int findLinear(int pos, int len, bool value) const;
+
+private:
+   CLossBitmap(const CLossBitmap&);
+   CLossBitmap& operator=(const CLossBitmap&);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 class CSndLossList
 {
 public:
@@ -89,15 +181,23 @@ public:
 
    int32_t getLostSeq();
 
+      // Functionality:
+      //    Release the memory of an empty list, which is allocated again by the next insert.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
+
 private:
-   int32_t* m_piData1;                  // sequence number starts
-   int32_t* m_piData2;                  // seqnence number ends
-   int* m_piNext;                       // next node in the list
+   CLossBitmap m_Bitmap;                // one bit per seq. no., set if lost
+   int m_iSize;                         // number of bits in the map
 
-   int m_iHead;                         // first node
+   int m_iHead;                         // position of the first loss in the map
+   int32_t m_iHeadSeq;                  // first (smallest) loss seq. no.
+   int32_t m_iTailSeq;                  // no loss seq. no. is greater than this
    int m_iLength;                       // loss length
-   int m_iSize;                         // size of the static array
-   int m_iLastInsertPos;                // position of last insert node
 
 #ifdef WIN32
    HANDLE m_ListLock;          // used to synchronize list operation
@@ -105,6 +205,10 @@ private:
    pthread_mutex_t m_ListLock;          // used to synchronize list operation
 #endif
 
+private:
+   int pos(int32_t seqno) const;
+   void seekHead();
+
 private:
    CSndLossList(const CSndLossList&);
    CSndLossList& operator=(const CSndLossList&);
@@ -181,21 +285,59 @@ public:
       //    0) [out] array: the result list of seq. no. to be included in NAK.
       //    1) [out] physical length of the result array.
       //    2) [in] limit: maximum length of the array.
+      //    3) [in] seqno: the last seq. no. to be reported, or -1 for the whole list.
       // Returned value:
       //    None.
 
-   void getLossArray(int32_t* array, int& len, int limit);
+   void getLossArray(int32_t* array, int& len, int limit, int32_t seqno = -1);
+
+      // Functionality:
+      //    Get a compressed loss report for NAK: the first loss followed by (gap, length) runs in variable length bytes.
+      // Parameters:
+      //    0) [out] report: the result report, in 32-bit words.
+      //    1) [out] len: number of words in the report.
+      //    2) [in] limit: maximum number of words.
+      //    3) [in] seqno: the last seq. no. to be reported, or -1 for the whole list.
+      // Returned value:
+      //    None.
+
+   void getLossReport(int32_t* report, int& len, int limit, int32_t seqno = -1);
+
+      // Functionality:
+      //    Decode a compressed loss report into the loss array format of a regular NAK.
+      // Parameters:
+      //    0) [in] report: the compressed report.
+      //    1) [in] size: number of words in the report.
+      //    2) [out] array: the loss array.
+      //    3) [in] limit: maximum length of the array.
+      // Returned value:
+      //    length of the array, or -1 if the report is malformed.
+
+   static int decodeLossReport(const int32_t* report, int size, int32_t* array, int limit);
+
+      // Functionality:
+      //    Release the memory of an empty list, which is allocated again by the next insert.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
 
 private:
-   int32_t* m_piData1;                  // sequence number starts
-   int32_t* m_piData2;                  // sequence number ends
-   int* m_piNext;                       // next node in the list
-   int* m_piPrior;                      // prior node in the list;
+   CLossBitmap m_Bitmap;                // one bit per seq. no., set if lost
+   int m_iSize;                         // number of bits in the map
 
-   int m_iHead;                         // first node in the list
-   int m_iTail;                         // last node in the list;
+   int m_iHead;                         // position of the first loss in the map
+   int32_t m_iHeadSeq;                  // first (smallest) loss seq. no.
+   int32_t m_iTailSeq;                  // last (largest) loss seq. no. inserted
    int m_iLength;                       // loss length
-   int m_iSize;                         // size of the static array
+
+private:
+   int pos(int32_t seqno) const;
+   bool clip(int32_t& seqno1, int32_t& seqno2) const;
+   int span(int32_t seqno) const;
+   void seekHead();
 
 private:
    CRcvLossList(const CRcvLossList&);
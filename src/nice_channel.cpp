@@ -416,6 +416,12 @@ void CNiceChannel::close()
    }
    if (m_pRecvQueue)
    {
+      // packets not read yet are given back to the memory budget
+      while (GByteArray* arr = static_cast<GByteArray*>(g_async_queue_try_pop(m_pRecvQueue)))
+      {
+         CMemBudget::release(arr->len);
+         g_byte_array_unref(arr);
+      }
       g_async_queue_unref(m_pRecvQueue);
       m_pRecvQueue = NULL;
    }
@@ -687,6 +693,7 @@ int CNiceChannel::recvfrom(sockaddr* addr, CPacket& packet) const
    }
 
    int size = arr->len;
+   CMemBudget::release(size);
    if (size < CPacket::m_iPktHdrSize)
    {
       g_byte_array_unref(arr);
@@ -1109,6 +1116,11 @@ void CNiceChannel::cb_recv(NiceAgent* agent, guint stream_id, guint component_id
    CNiceChannel* self = (CNiceChannel*)data;
    if (!self->m_pRecvQueue)
       return;
+
+   // the packet is dropped like on a full UDP socket buffer when the global memory budget is used up
+   if (!CMemBudget::reserve(len))
+      return;
+
    GByteArray* arr = g_byte_array_sized_new(len);
    g_byte_array_append(arr, (guint8*)buf, len);
    g_async_queue_push(self->m_pRecvQueue, arr);
@@ -119,6 +119,14 @@ written by
 //      8: Error Signal from the Peer Side
 //              Add. Info:    Error code
 //              Control Info: None
+//      9: Compressed Negative Acknowledgement (NAK), UDT version 5 or later
+//              Add. Info:    Undefined
+//              Control Info: Compressed loss list (see compressed loss list coding below)
+//      10: FEC Parity, UDT version 6 or later
+//              Add. Info:    Sequence number of the first data packet of the group
+//              Control Info: Parity of the data packets of the group (see CFECEncoder)
+//              bit 16 - 23:  Index of the parity packet in the group
+//              bit 24 - 31:  Number of data packets in the group
 //      0x7FFF: Explained by bits 16 - 31
 //              
 //   bit 16 - 31:
@@ -141,6 +149,24 @@ written by
 //      the first bit of a to 1.
 //      For any single loss or consectutive loss less than 2 packets, use
 //      the original sequence numbers in the field.
+//
+//    0                   1                   2                   3
+//    0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |0|                 First Lost Sequence Number                  |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   |                        Number of Runs                         |
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//   ~         Gap, Length - 1, Gap, Length - 1, ... (bytes)         ~
+//   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//
+//   Compressed Loss List Field Coding:
+//      Each run of consecutive lost sequence numbers is recorded as the
+//      number of received packets between it and the previous run (or the
+//      first lost sequence number), and its length minus 1. Both numbers are
+//      coded in 7 bits per byte, with the highest bit set if more bytes follow.
+//      Bytes are packed into 32-bit words from the most significant one, and
+//      unused bytes of the last word are 0.
 
 
 #include <cstring>
@@ -214,12 +240,26 @@ void CPacket::pack(int pkttype, void* lparam, void* rparam, int size)
       break;
 
    case 3: //0011 - Loss Report (NAK)
+   case 9: //1001 - Compressed Loss Report (NAK)
       // loss list
       m_PacketVector[1].iov_base = (char *)rparam;
       m_PacketVector[1].iov_len = size;
 
       break;
 
+   case 10: //1010 - FEC Parity
+      // first sequence number of the group
+      m_nHeader[1] = *(int32_t *)lparam;
+
+      // parity index and group size
+      m_nHeader[0] |= *((int32_t *)lparam + 1) & 0xFFFF;
+
+      // parity of the data packets
+      m_PacketVector[1].iov_base = (char *)rparam;
+      m_PacketVector[1].iov_len = size;
+
+      break;
+
    case 4: //0100 - Congestion Warning
       // control info field should be none
       // but "writev" does not allow this
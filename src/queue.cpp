@@ -70,6 +70,7 @@ CUnitQueue::~CUnitQueue()
 
    while (p != NULL)
    {
+      CMemBudget::release(int64_t(p->m_iSize) * (m_iMSS + sizeof(CUnit)));
       delete [] p->m_pUnit;
       delete [] p->m_pBuffer;
 
@@ -111,6 +112,7 @@ int CUnitQueue::init(int size, int mss, int version)
    tempq->m_pUnit = tempu;
    tempq->m_pBuffer = tempb;
    tempq->m_iSize = size;
+   CMemBudget::reserve(int64_t(size) * (mss + sizeof(CUnit)), true);
 
    m_pQEntry = m_pCurrQueue = m_pLastQueue = tempq;
    m_pQEntry->m_pNext = m_pQEntry;
@@ -152,6 +154,10 @@ int CUnitQueue::increase()
    // all queues have the same size
    int size = m_pQEntry->m_iSize;
 
+   // over the global memory budget the queue stops growing, new packets are dropped until units are freed
+   if (!CMemBudget::reserve(int64_t(size) * (m_iMSS + sizeof(CUnit))))
+      return -1;
+
    try
    {
       tempq = new CQEntry;
@@ -163,6 +169,7 @@ int CUnitQueue::increase()
       delete tempq;
       delete [] tempu;
       delete [] tempb;
+      CMemBudget::release(int64_t(size) * (m_iMSS + sizeof(CUnit)));
 
       return -1;
    }
@@ -222,11 +229,23 @@ CUnit* CUnitQueue::getNextAvailUnit()
    return NULL;
 }
 
+int CUnitQueue::getRoom() const
+{
+   int64_t room = (m_iSize > m_iCount) ? m_iSize - m_iCount : 0;
+
+   // the queue grows by entries of the same size as the first one
+   int64_t entry = int64_t(m_pQEntry->m_iSize) * (m_iMSS + sizeof(CUnit));
+   room += CMemBudget::getHeadroom() / entry * m_pQEntry->m_iSize;
+
+   return (room < 0x7FFFFFFF) ? int(room) : 0x7FFFFFFF;
+}
+
 
 CSndUList::CSndUList():
 m_pHeap(NULL),
 m_iArrayLength(4096),
 m_iLastEntry(-1),
+m_pSending(NULL),
 m_ListLock(),
 m_pWindowLock(NULL),
 m_pWindowCond(NULL),
@@ -327,6 +346,7 @@ int CSndUList::pop(sockaddr*& addr, CPacket& pkt)
       return -1;
 
    addr = u->m_pPeerAddr;
+   m_pSending = u;
 
    // insert a new entry, ts is the next processing time
    if (ts > 0)
@@ -346,12 +366,22 @@ uint64_t CSndUList::getNextProcTime()
 {
    CGuard listguard(m_ListLock);
 
+   // the worker asks for the next time only after it has sent the packet last popped
+   m_pSending = NULL;
+
    if (-1 == m_iLastEntry)
       return 0;
 
    return m_pHeap[0]->m_llTimeStamp;
 }
 
+bool CSndUList::busy(const CUDT* u)
+{
+   CGuard listguard(m_ListLock);
+
+   return (u->m_pSNode->m_iHeapLoc >= 0) || (m_pSending == u);
+}
+
 void CSndUList::insert_(int64_t ts, const CUDT* u)
 {
    CSNode* n = u->m_pSNode;
@@ -441,10 +471,100 @@ void CSndUList::remove_(const CUDT* u)
       m_pTimer->interrupt();
 }
 
+//
+CCtrlQueue::CCtrlQueue(int size):
+m_pSlots(NULL),
+m_iSize(size),
+m_iHead(0),
+m_iTail(0)
+{
+   m_pSlots = new CSlot[m_iSize];
+   for (int i = 0; i < m_iSize; ++ i)
+   {
+      m_pSlots[i].m_pcBuffer = NULL;
+      m_pSlots[i].m_iBufSize = 0;
+      m_pSlots[i].m_bHasAddr = false;
+   }
+
+   #ifndef WIN32
+      pthread_mutex_init(&m_Lock, NULL);
+   #else
+      m_Lock = CreateMutex(NULL, false, NULL);
+   #endif
+}
+
+CCtrlQueue::~CCtrlQueue()
+{
+   for (int i = 0; i < m_iSize; ++ i)
+      delete [] m_pSlots[i].m_pcBuffer;
+   delete [] m_pSlots;
+
+   #ifndef WIN32
+      pthread_mutex_destroy(&m_Lock);
+   #else
+      CloseHandle(m_Lock);
+   #endif
+}
+
+bool CCtrlQueue::push(const sockaddr* addr, const CPacket& packet)
+{
+   CGuard queueguard(m_Lock);
+
+   int next = (m_iTail + 1 == m_iSize) ? 0 : m_iTail + 1;
+   if (next == m_iHead)
+      return false;
+
+   CSlot& slot = m_pSlots[m_iTail];
+
+   int len = packet.getLength();
+   if (len > slot.m_iBufSize)
+   {
+      delete [] slot.m_pcBuffer;
+      slot.m_pcBuffer = new char[len];
+      slot.m_iBufSize = len;
+   }
+   memcpy(slot.m_Packet.header(), packet.header(), CPacket::m_iPktHdrSize);
+   memcpy(slot.m_pcBuffer, packet.m_pcData, len);
+   slot.m_Packet.m_pcData = slot.m_pcBuffer;
+   slot.m_Packet.setLength(len);
+
+   slot.m_bHasAddr = (NULL != addr);
+   if (slot.m_bHasAddr)
+      memcpy(&slot.m_Addr, addr, (AF_INET == addr->sa_family) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
+
+   m_iTail = next;
+
+   return true;
+}
+
+bool CCtrlQueue::front(sockaddr*& addr, CPacket*& packet)
+{
+   CGuard queueguard(m_Lock);
+
+   if (m_iHead == m_iTail)
+      return false;
+
+   // the slot is not reused until pop(), so it can be read without the lock
+   CSlot& slot = m_pSlots[m_iHead];
+   addr = slot.m_bHasAddr ? (sockaddr*)&slot.m_Addr : NULL;
+   packet = &slot.m_Packet;
+
+   return true;
+}
+
+void CCtrlQueue::pop()
+{
+   CGuard queueguard(m_Lock);
+
+   if (m_iHead != m_iTail)
+      m_iHead = (m_iHead + 1 == m_iSize) ? 0 : m_iHead + 1;
+}
+
 //
 CSndQueue::CSndQueue():
 m_WorkerThread(),
 m_pSndUList(NULL),
+m_pCtrlQueue(NULL),
 m_pChannel(NULL),
 m_pTimer(NULL),
 m_WindowLock(),
@@ -485,6 +605,7 @@ CSndQueue::~CSndQueue()
    #endif
 
    delete m_pSndUList;
+   delete m_pCtrlQueue;
 }
 
 #ifdef USE_LIBNICE
@@ -499,6 +620,7 @@ void CSndQueue::init(CChannel* c, CTimer* t)
    m_pSndUList->m_pWindowLock = &m_WindowLock;
    m_pSndUList->m_pWindowCond = &m_WindowCond;
    m_pSndUList->m_pTimer = m_pTimer;
+   m_pCtrlQueue = new CCtrlQueue;
 
    #ifndef WIN32
       if (0 != pthread_create(&m_WorkerThread, NULL, CSndQueue::worker, this))
@@ -529,14 +651,17 @@ void CSndQueue::init(CChannel* c, CTimer* t)
       if (self->m_bClosing)
          draining = true;
 
+      // control packets go out ahead of any data packet
+      self->sendCtrl();
+
       uint64_t ts = self->m_pSndUList->getNextProcTime();
 
       if (ts > 0)
       {
-         // wait until next processing time of the first socket on the list
+         // wait until next processing time of the first socket on the list, or until a control packet is queued
          uint64_t currtime;
          CTimer::rdtsc(currtime);
-         if (currtime < ts)
+         if ((currtime < ts) && self->m_pCtrlQueue->empty())
             self->m_pTimer->sleepto(ts);
 
          // it is time to send the next pkt
@@ -549,6 +674,9 @@ void CSndQueue::init(CChannel* c, CTimer* t)
             continue;
          }
 
+         // a control packet queued while the data packet was packed, e.g., a msg drop request, comes first
+         self->sendCtrl();
+
          self->m_pChannel->sendto(addr, pkt);
       }
       else
@@ -559,15 +687,19 @@ void CSndQueue::init(CChannel* c, CTimer* t)
          // wait here if there is no sockets with data to be sent
          #ifndef WIN32
             pthread_mutex_lock(&self->m_WindowLock);
-            if (!self->m_bClosing && (self->m_pSndUList->m_iLastEntry < 0))
+            if (!self->m_bClosing && (self->m_pSndUList->m_iLastEntry < 0) && self->m_pCtrlQueue->empty())
                pthread_cond_wait(&self->m_WindowCond, &self->m_WindowLock);
             pthread_mutex_unlock(&self->m_WindowLock);
          #else
-            WaitForSingleObject(self->m_WindowCond, INFINITE);
+            if (self->m_pCtrlQueue->empty())
+               WaitForSingleObject(self->m_WindowCond, INFINITE);
          #endif
       }
    }
 
+   // a control packet queued while closing, e.g., a shutdown, is still sent
+   self->sendCtrl();
+
    #ifndef WIN32
       return NULL;
    #else
@@ -578,11 +710,36 @@ void CSndQueue::init(CChannel* c, CTimer* t)
 
 int CSndQueue::sendto(const sockaddr* addr, CPacket& packet)
 {
-   // send out the packet immediately (high priority), this is a control packet
+   // Control packets are handed to the worker instead of being sent here, so that the caller, usually the
+   // receiving thread, never waits for the channel. Like any UDP packet, a control packet may be dropped.
    if (NULL == m_pChannel)
       return -1;
 
-   return m_pChannel->sendto(addr, packet);
+   if (!m_pCtrlQueue->push(addr, packet))
+      return -1;
+
+   // wake up the worker, either waiting for a socket with data or sleeping until the next data packet
+   #ifndef WIN32
+      pthread_mutex_lock(&m_WindowLock);
+      pthread_cond_signal(&m_WindowCond);
+      pthread_mutex_unlock(&m_WindowLock);
+   #else
+      SetEvent(m_WindowCond);
+   #endif
+   m_pTimer->interrupt();
+
+   return CPacket::m_iPktHdrSize + packet.getLength();
+}
+
+void CSndQueue::sendCtrl()
+{
+   sockaddr* addr;
+   CPacket* packet;
+   while (m_pCtrlQueue->front(addr, packet))
+   {
+      m_pChannel->sendto(addr, *packet);
+      m_pCtrlQueue->pop();
+   }
 }
 
 
@@ -1021,6 +1178,11 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
    CUDT* u = NULL;
    int32_t id;
 
+   // packets are read into this unit when the unit queue is used up, so that control packets are still processed
+   CUnit spare;
+   spare.m_iFlag = 0;
+   spare.m_Packet.m_pcData = new char[self->m_iPayloadSize];
+
    while (!self->m_bClosing)
    {
       #ifdef NO_BUSY_WAITING
@@ -1042,13 +1204,8 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
       CUnit* unit = self->m_UnitQueue.getNextAvailUnit();
       if (NULL == unit)
       {
-         // no space, skip this packet
-         CPacket temp;
-         temp.m_pcData = new char[self->m_iPayloadSize];
-         temp.setLength(self->m_iPayloadSize);
-         self->m_pChannel->recvfrom(addr, temp);
-         delete [] temp.m_pcData;
-         goto TIMER_CHECK;
+         // no space, a data packet is dropped after it is read
+         unit = &spare;
       }
 
       unit->m_Packet.setLength(self->m_iPayloadSize);
@@ -1089,7 +1246,7 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize, CChannel* c
                if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing)
                {
                   if (0 == unit->m_Packet.getFlag())
-                     u->processData(unit);
+                     u->processData(unit, unit == &spare);
                   else
                      u->processCtrl(unit->m_Packet);
 
@@ -1143,6 +1300,7 @@ TIMER_CHECK:
       delete (sockaddr_in*)addr;
    else
       delete (sockaddr_in6*)addr;
+   delete [] spare.m_Packet.m_pcData;
 
    #ifndef WIN32
       return NULL;
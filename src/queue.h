@@ -59,7 +59,7 @@ class CUDT;
 struct CUnit
 {
    CPacket m_Packet;		// packet
-   int m_iFlag;			// 0: free, 1: occupied, 2: msg read but not freed (out-of-order), 3: msg dropped
+   int m_iFlag;			// 0: free, 1: occupied, 2: msg read but not freed (out-of-order), 3: msg dropped, 4: lent to the application
 };
 
 class CUnitQueue
@@ -111,6 +111,15 @@ public:
 
    CUnit* getNextAvailUnit();
 
+      // Functionality:
+      //    Query how many more packets the queue can hold, counting the growth the global memory budget allows.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    number of packets.
+
+   int getRoom() const;
+
 private:
    struct CQEntry
    {
@@ -203,6 +212,15 @@ public:
 
    uint64_t getNextProcTime();
 
+      // Functionality:
+      //    Check if the sending worker may still use a UDT instance.
+      // Parameters:
+      //    1) [in] u: pointer to the UDT instance
+      // Returned value:
+      //    true if the instance is on the list or the packet last popped from it may still be in transmission.
+
+   bool busy(const CUDT* u);
+
 private:
    void insert_(int64_t ts, const CUDT* u);
    void remove_(const CUDT* u);
@@ -211,6 +229,7 @@ private:
    CSNode** m_pHeap;			// The heap array
    int m_iArrayLength;			// physical length of the array
    int m_iLastEntry;			// position of last entry on the heap array
+   const CUDT* m_pSending;		// instance of the packet last popped, until the worker asks for the next processing time
 
 #ifdef WIN32
    HANDLE m_ListLock;
@@ -380,6 +399,71 @@ private:
 #endif
 };
 
+class CCtrlQueue
+{
+public:
+   CCtrlQueue(int size = 256);
+   ~CCtrlQueue();
+
+public:
+
+      // Functionality:
+      //    Copy a control packet to the end of the queue.
+      // Parameters:
+      //    0) [in] addr: destination address, or NULL for the peer of the channel
+      //    1) [in] packet: the control packet
+      // Returned value:
+      //    true if the packet is queued, false if the queue is full.
+
+   bool push(const sockaddr* addr, const CPacket& packet);
+
+      // Functionality:
+      //    Retrieve the first packet in the queue, which stays valid until pop() is called.
+      // Parameters:
+      //    0) [out] addr: destination address, or NULL for the peer of the channel
+      //    1) [out] packet: the control packet
+      // Returned value:
+      //    true if a packet is found, false if the queue is empty.
+
+   bool front(sockaddr*& addr, CPacket*& packet);
+
+      // Functionality:
+      //    Remove the first packet from the queue.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void pop();
+
+   bool empty() const {return m_iHead == m_iTail;}
+
+private:
+   struct CSlot
+   {
+      CPacket m_Packet;                 // header and length of the packet
+      char* m_pcBuffer;                 // packet payload
+      int m_iBufSize;                   // size of m_pcBuffer, grown as needed
+      sockaddr_in6 m_Addr;              // destination address
+      bool m_bHasAddr;                  // if m_Addr is used
+   };
+
+   CSlot* m_pSlots;                     // ring of queued packets
+   int m_iSize;                         // number of slots
+   volatile int m_iHead;                // first queued packet, only moved by the consumer
+   volatile int m_iTail;                // next free slot, only moved by the producers
+
+#ifndef WIN32
+   pthread_mutex_t m_Lock;              // serializes the producers
+#else
+   HANDLE m_Lock;
+#endif
+
+private:
+   CCtrlQueue(const CCtrlQueue&);
+   CCtrlQueue& operator=(const CCtrlQueue&);
+};
+
 class CSndQueue
 {
 friend class CUDT;
@@ -406,15 +490,18 @@ public:
 #endif
 
       // Functionality:
-      //    Send out a packet to a given address.
+      //    Queue a control packet to a given address; the worker sends it ahead of any data packet.
       // Parameters:
       //    1) [in] addr: destination address
       //    2) [in] packet: packet to be sent out
       // Returned value:
-      //    Size of data sent out.
+      //    Size of data queued, -1 if the packet is dropped.
 
    int sendto(const sockaddr* addr, CPacket& packet);
 
+private:
+   void sendCtrl();
+
 private:
 #ifndef WIN32
    static void* worker(void* param);
@@ -430,6 +517,7 @@ private:
 
 private:
     CSndUList* m_pSndUList;              // List of UDT instances for data sending
+    CCtrlQueue* m_pCtrlQueue;            // Control packets waiting to be sent
 #ifdef USE_LIBNICE
     CNiceChannel* m_pChannel;                // The UDP channel for data sending
 #else
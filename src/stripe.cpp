@@ -0,0 +1,428 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef WIN32
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include "core.h"
+#include "stripe.h"
+
+using namespace std;
+
+CRangeList::CRangeList():
+m_mRanges(),
+m_llSize(0),
+m_iJournal(-1),
+m_strJournal()
+{
+   pthread_mutex_init(&m_Lock, NULL);
+}
+
+CRangeList::~CRangeList()
+{
+   if (m_iJournal >= 0)
+      ::close(m_iJournal);
+
+   pthread_mutex_destroy(&m_Lock);
+}
+
+int CRangeList::open(const char* path, int64_t size)
+{
+   m_llSize = size;
+   m_mRanges.clear();
+
+   if (NULL == path)
+      return 0;
+
+   m_strJournal = path;
+   m_iJournal = ::open(path, O_RDWR | O_CREAT, 0644);
+   if (m_iJournal < 0)
+      return -1;
+
+   // the journal starts with the file size, followed by the completed ranges as (offset, size)
+   int64_t rec[2];
+   if ((read(m_iJournal, rec, sizeof(int64_t)) == sizeof(int64_t)) && (rec[0] == size))
+   {
+      while (read(m_iJournal, rec, sizeof(rec)) == sizeof(rec))
+      {
+         if ((rec[0] >= 0) && (rec[1] > 0) && (rec[0] + rec[1] <= size))
+            merge(rec[0], rec[0] + rec[1]);
+      }
+
+      // drop a record that is only partly written
+      off_t end = lseek(m_iJournal, 0, SEEK_CUR);
+      if (end > off_t(sizeof(int64_t)))
+         end -= (end - sizeof(int64_t)) % sizeof(rec);
+      if ((ftruncate(m_iJournal, end) < 0) || (lseek(m_iJournal, end, SEEK_SET) < 0))
+         return -1;
+
+      return 0;
+   }
+
+   m_mRanges.clear();
+   if ((ftruncate(m_iJournal, 0) < 0) || (pwrite(m_iJournal, &size, sizeof(int64_t), 0) != sizeof(int64_t)) || (lseek(m_iJournal, sizeof(int64_t), SEEK_SET) < 0))
+      return -1;
+
+   return 0;
+}
+
+int CRangeList::insert(int64_t offset, int64_t len)
+{
+   CGuard rangeguard(m_Lock);
+
+   merge(offset, offset + len);
+
+   if (m_iJournal < 0)
+      return 0;
+
+   int64_t rec[2] = {offset, len};
+   if ((write(m_iJournal, rec, sizeof(rec)) != sizeof(rec)) || (fdatasync(m_iJournal) < 0))
+      return -1;
+
+   return 0;
+}
+
+void CRangeList::getMissing(vector<pair<int64_t, int64_t> >& ranges)
+{
+   CGuard rangeguard(m_Lock);
+
+   ranges.clear();
+
+   int64_t pos = 0;
+   for (map<int64_t, int64_t>::iterator i = m_mRanges.begin(); i != m_mRanges.end(); ++ i)
+   {
+      if (i->first > pos)
+         ranges.push_back(make_pair(pos, i->first - pos));
+      pos = i->second;
+   }
+
+   if (pos < m_llSize)
+      ranges.push_back(make_pair(pos, m_llSize - pos));
+}
+
+bool CRangeList::complete()
+{
+   CGuard rangeguard(m_Lock);
+
+   if (0 == m_llSize)
+      return true;
+
+   return (1 == m_mRanges.size()) && (0 == m_mRanges.begin()->first) && (m_llSize == m_mRanges.begin()->second);
+}
+
+void CRangeList::close()
+{
+   if (m_iJournal < 0)
+      return;
+
+   ::close(m_iJournal);
+   m_iJournal = -1;
+
+   if (complete())
+      unlink(m_strJournal.c_str());
+}
+
+void CRangeList::merge(int64_t start, int64_t end)
+{
+   // join the ranges that overlap or touch [start, end)
+   map<int64_t, int64_t>::iterator i = m_mRanges.upper_bound(start);
+   if ((i != m_mRanges.begin()) && ((-- i)->second >= start))
+   {
+      start = i->first;
+      if (i->second > end)
+         end = i->second;
+      m_mRanges.erase(i ++);
+   }
+   else
+      i = m_mRanges.lower_bound(start);
+
+   while ((i != m_mRanges.end()) && (i->first <= end))
+   {
+      if (i->second > end)
+         end = i->second;
+      m_mRanges.erase(i ++);
+   }
+
+   m_mRanges[start] = end;
+}
+
+int64_t CStripe::sendfile(const UDTSOCKET* socks, int n, int fd, int64_t size, int block)
+{
+   if ((NULL == socks) || (n <= 0) || (size < 0) || (block <= 0))
+      throw CUDTException(5, 3, 0);
+
+   // the receiver asks for the ranges it is missing
+   // missing ranges are separated by at least one completed byte
+   int32_t count;
+   recvAll(socks[0], (char*)&count, sizeof(int32_t));
+   if ((count < 0) || (count > size / 2 + 1))
+      throw CUDTException(5, 3, 0);
+
+   Job job;
+   job.m_iFD = fd;
+   job.m_iBlock = block;
+   job.m_llSize = size;
+
+   // the ranges must be sorted and disjoint, so the chunks never cover more than the file
+   int64_t next = 0;
+   for (int i = 0; i < count; ++ i)
+   {
+      int64_t range[2];
+      recvAll(socks[0], (char*)range, sizeof(range));
+      if ((range[0] < next) || (range[1] <= 0) || (range[1] > size - range[0]))
+         throw CUDTException(5, 3, 0);
+      next = range[0] + range[1];
+
+      // cut into chunks so that a faster connection takes more of them
+      for (int64_t off = 0; off < range[1]; off += m_iChunkSize)
+         job.m_vChunks.push_back(make_pair(range[0] + off, (range[1] - off > m_iChunkSize) ? m_iChunkSize : range[1] - off));
+   }
+
+   #ifdef POSIX_FADV_SEQUENTIAL
+      posix_fadvise(fd, 0, size, POSIX_FADV_SEQUENTIAL);
+   #endif
+
+   int64_t sent = run(socks, n, job, sendWorker);
+
+   // wait until the receiver confirms all ranges are written
+   int32_t done;
+   recvAll(socks[0], (char*)&done, sizeof(int32_t));
+
+   return sent;
+}
+
+int64_t CStripe::recvfile(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal, int block)
+{
+   if ((NULL == socks) || (n <= 0) || (size < 0) || (block <= 0))
+      throw CUDTException(5, 3, 0);
+
+   CRangeList ranges;
+   if (ranges.open(journal, size) < 0)
+      throw CUDTException(4, 4, errno);
+
+   vector<pair<int64_t, int64_t> > missing;
+   ranges.getMissing(missing);
+
+   int32_t count = missing.size();
+   sendAll(socks[0], (char*)&count, sizeof(int32_t));
+   for (vector<pair<int64_t, int64_t> >::iterator i = missing.begin(); i != missing.end(); ++ i)
+   {
+      int64_t range[2] = {i->first, i->second};
+      sendAll(socks[0], (char*)range, sizeof(range));
+   }
+
+   Job job;
+   job.m_iFD = fd;
+   job.m_iBlock = block;
+   job.m_llSize = size;
+   job.m_pRanges = &ranges;
+
+   int64_t recvd = run(socks, n, job, recvWorker);
+
+   if (!ranges.complete())
+      return recvd;
+
+   ranges.close();
+
+   int32_t done = 0;
+   sendAll(socks[0], (char*)&done, sizeof(int32_t));
+
+   return recvd;
+}
+
+int64_t CStripe::run(const UDTSOCKET* socks, int n, Job& job, void* (*worker)(void*))
+{
+   job.m_iNext = 0;
+   job.m_llBytes = 0;
+   job.m_pError = NULL;
+   pthread_mutex_init(&job.m_Lock, NULL);
+
+   // one thread per connection, a connection that cannot get its own thread is served by this one
+   vector<Worker> workers(n);
+   vector<bool> started(n, false);
+   for (int i = 0; i < n; ++ i)
+   {
+      workers[i].m_pJob = &job;
+      workers[i].m_Socket = socks[i];
+      started[i] = (0 == pthread_create(&workers[i].m_Thread, NULL, worker, &workers[i]));
+   }
+
+   for (int i = 0; i < n; ++ i)
+   {
+      if (!started[i])
+         worker(&workers[i]);
+   }
+
+   for (int i = 0; i < n; ++ i)
+   {
+      if (started[i])
+         pthread_join(workers[i].m_Thread, NULL);
+   }
+
+   pthread_mutex_destroy(&job.m_Lock);
+
+   if (NULL != job.m_pError)
+   {
+      CUDTException e(*job.m_pError);
+      delete job.m_pError;
+      throw e;
+   }
+
+   return job.m_llBytes;
+}
+
+void* CStripe::sendWorker(void* param)
+{
+   Worker* self = (Worker*)param;
+   Job* job = self->m_pJob;
+
+   try
+   {
+      while (true)
+      {
+         int64_t header[2] = {-1, 0};
+
+         CGuard::enterCS(job->m_Lock);
+         if ((NULL == job->m_pError) && (job->m_iNext < job->m_vChunks.size()))
+         {
+            header[0] = job->m_vChunks[job->m_iNext].first;
+            header[1] = job->m_vChunks[job->m_iNext].second;
+            ++ job->m_iNext;
+         }
+         CGuard::leaveCS(job->m_Lock);
+
+         // every chunk is preceded by its position, a negative position ends the stream
+         sendAll(self->m_Socket, (char*)header, sizeof(header));
+         if (header[0] < 0)
+            break;
+
+         int64_t offset = header[0];
+         int64_t sent = CUDT::sendfile_fd(self->m_Socket, job->m_iFD, offset, header[1], job->m_iBlock);
+         if (CUDT::ERROR == sent)
+            throw CUDTException(CUDT::getlasterror());
+         if (sent < header[1])
+            throw CUDTException(4, 2, 0);
+
+         CGuard::enterCS(job->m_Lock);
+         job->m_llBytes += sent;
+         CGuard::leaveCS(job->m_Lock);
+      }
+   }
+   catch (CUDTException& e)
+   {
+      fail(job, e);
+   }
+
+   return NULL;
+}
+
+void* CStripe::recvWorker(void* param)
+{
+   Worker* self = (Worker*)param;
+   Job* job = self->m_pJob;
+
+   try
+   {
+      while (true)
+      {
+         int64_t header[2];
+         recvAll(self->m_Socket, (char*)header, sizeof(header));
+         if (header[0] < 0)
+            break;
+
+         if ((header[1] <= 0) || (header[1] > job->m_llSize - header[0]))
+            throw CUDTException(5, 3, 0);
+
+         int64_t offset = header[0];
+         int64_t recvd = CUDT::recvfile_fd(self->m_Socket, job->m_iFD, offset, header[1], job->m_iBlock);
+         if (CUDT::ERROR == recvd)
+            throw CUDTException(CUDT::getlasterror());
+
+         // the range is only recorded once it is on the disk
+         if ((fdatasync(job->m_iFD) < 0) && (EINVAL != errno))
+            throw CUDTException(4, 4, errno);
+         if (job->m_pRanges->insert(header[0], header[1]) < 0)
+            throw CUDTException(4, 4, errno);
+
+         CGuard::enterCS(job->m_Lock);
+         job->m_llBytes += recvd;
+         CGuard::leaveCS(job->m_Lock);
+      }
+   }
+   catch (CUDTException& e)
+   {
+      fail(job, e);
+   }
+
+   return NULL;
+}
+
+void CStripe::fail(Job* job, const CUDTException& e)
+{
+   CGuard failguard(job->m_Lock);
+
+   if (NULL == job->m_pError)
+      job->m_pError = new CUDTException(e);
+}
+
+void CStripe::sendAll(UDTSOCKET u, const char* buf, int len)
+{
+   while (len > 0)
+   {
+      int ss = CUDT::send(u, buf, len, 0);
+      if (CUDT::ERROR == ss)
+         throw CUDTException(CUDT::getlasterror());
+
+      buf += ss;
+      len -= ss;
+   }
+}
+
+void CStripe::recvAll(UDTSOCKET u, char* buf, int len)
+{
+   while (len > 0)
+   {
+      int rs = CUDT::recv(u, buf, len, 0);
+      if (CUDT::ERROR == rs)
+         throw CUDTException(CUDT::getlasterror());
+
+      buf += rs;
+      len -= rs;
+   }
+}
+
+#endif
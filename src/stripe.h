@@ -0,0 +1,177 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_STRIPE_H__
+#define __UDT_STRIPE_H__
+
+#ifndef WIN32
+
+#include <pthread.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "udt.h"
+
+
+class CRangeList
+{
+public:
+   CRangeList();
+   ~CRangeList();
+
+      // Functionality:
+      //    Start the bookkeeping of a file, loading the ranges completed by an earlier transfer from the journal.
+      // Parameters:
+      //    0) [in] path: journal file, NULL if the ranges are not kept.
+      //    1) [in] size: size of the file; a journal recorded for another size is discarded.
+      // Returned value:
+      //    0 on success, -1 if the journal cannot be opened.
+
+   int open(const char* path, int64_t size);
+
+      // Functionality:
+      //    Record a range as completed and append it to the journal.
+      // Parameters:
+      //    0) [in] offset: start of the range.
+      //    1) [in] len: size of the range.
+      // Returned value:
+      //    0 on success, -1 if the journal cannot be written.
+
+   int insert(int64_t offset, int64_t len);
+
+      // Functionality:
+      //    Read the ranges that are not completed yet.
+      // Parameters:
+      //    0) [out] ranges: list of (offset, size).
+      // Returned value:
+      //    None.
+
+   void getMissing(std::vector<std::pair<int64_t, int64_t> >& ranges);
+
+      // Functionality:
+      //    Check if the whole file is completed.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    true if completed, otherwise false.
+
+   bool complete();
+
+      // Functionality:
+      //    Close the journal, and remove it if the whole file is completed.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void close();
+
+private:
+   std::map<int64_t, int64_t> m_mRanges;        // completed ranges, start -> end, neither overlapping nor adjacent
+   int64_t m_llSize;                            // size of the file
+   int m_iJournal;                              // journal file descriptor, -1 if none
+   std::string m_strJournal;                    // journal path
+
+   pthread_mutex_t m_Lock;                      // synchronizing the workers
+
+private:
+   void merge(int64_t start, int64_t end);
+};
+
+class CStripe
+{
+public:
+
+      // Functionality:
+      //    Send the ranges of a file that the receiver asks for, spread over a number of connections.
+      // Parameters:
+      //    0) [in] socks: connected sockets, the first one also carries the range requests.
+      //    1) [in] n: number of sockets.
+      //    2) [in] fd: file descriptor.
+      //    3) [in] size: size of the file.
+      //    4) [in] block: size of block per read from disk.
+      // Returned value:
+      //    Actual size of data sent.
+
+   static int64_t sendfile(const UDTSOCKET* socks, int n, int fd, int64_t size, int block);
+
+      // Functionality:
+      //    Receive the missing ranges of a file over a number of connections.
+      // Parameters:
+      //    0) [in] socks: connected sockets, in the same order as the sender's.
+      //    1) [in] n: number of sockets.
+      //    2) [in] fd: file descriptor.
+      //    3) [in] size: size of the file.
+      //    4) [in] journal: file to keep the completed ranges in, NULL if the transfer is not to be resumed.
+      //    5) [in] block: size of block per write to disk.
+      // Returned value:
+      //    Actual size of data received.
+
+   static int64_t recvfile(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal, int block);
+
+private:
+   struct Job
+   {
+      int m_iFD;                                      // file descriptor
+      int m_iBlock;                                   // block size per disk IO
+      int64_t m_llSize;                               // size of the file
+      std::vector<std::pair<int64_t, int64_t> > m_vChunks;   // chunks to be sent
+      unsigned int m_iNext;                           // next chunk to be taken by a sender
+      CRangeList* m_pRanges;                          // completed ranges at the receiver
+      int64_t m_llBytes;                              // bytes transferred
+      CUDTException* m_pError;                        // first error hit by a worker
+      pthread_mutex_t m_Lock;                         // synchronizing the workers
+   };
+
+   struct Worker
+   {
+      Job* m_pJob;
+      UDTSOCKET m_Socket;
+      pthread_t m_Thread;
+   };
+
+   static const int m_iChunkSize = 8 * 1024 * 1024;  // size of a range handed to one connection at a time
+
+   static int64_t run(const UDTSOCKET* socks, int n, Job& job, void* (*worker)(void*));
+   static void* sendWorker(void* param);
+   static void* recvWorker(void* param);
+   static void fail(Job* job, const CUDTException& e);
+   static void sendAll(UDTSOCKET u, const char* buf, int len);
+   static void recvAll(UDTSOCKET u, char* buf, int len);
+};
+
+#endif
+
+#endif
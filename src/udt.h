@@ -45,6 +45,7 @@ written by
 #ifndef WIN32
    #include <sys/types.h>
    #include <sys/socket.h>
+   #include <sys/uio.h>
    #include <netinet/in.h>
 #else
    #ifdef __MINGW__
@@ -108,6 +109,16 @@ written by
 typedef SYSSOCKET UDPSOCKET;
 typedef int UDTSOCKET;
 
+#ifndef WIN32
+   typedef struct iovec UDTIOVEC;
+#else
+   struct UDTIOVEC
+   {
+      void* iov_base;
+      size_t iov_len;
+   };
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef std::set<UDTSOCKET> ud_set;
@@ -122,11 +133,22 @@ enum EPOLLOpt
    // so that if system values are used by mistake, they should have the same effect
    UDT_EPOLL_IN = 0x1,
    UDT_EPOLL_OUT = 0x4,
-   UDT_EPOLL_ERR = 0x8
+   UDT_EPOLL_ERR = 0x8,
+   UDT_EPOLL_ET = 0x80000000     // edge-triggered: report an event once each time it occurs
+};
+
+// one ready socket returned by epoll_uwait()
+struct UDTEPOLLEVENT
+{
+   UDTSOCKET fd;                 // UDT socket
+   int events;                   // combination of UDT_EPOLL_IN, UDT_EPOLL_OUT and UDT_EPOLL_ERR
 };
 
 enum UDTSTATUS {INIT = 1, OPENED, LISTENING, CONNECTING, CONNECTED, BROKEN, CLOSING, CLOSED, NONEXIST};
 
+// release of a user buffer passed to sendzc(), called once the data is acknowledged or the socket is released
+typedef void (*UDT_RELEASE_CB)(const char* buf, int len, void* arg);
+
 ////////////////////////////////////////////////////////////////////////////////
 
 enum UDTOpt
@@ -151,7 +173,12 @@ enum UDTOpt
    UDT_STATE,		// current socket state, see UDTSTATUS, read only
    UDT_EVENT,		// current avalable events associated with the socket
    UDT_SNDDATA,		// size of data in the sending buffer
-   UDT_RCVDATA		// size of data available for recv
+   UDT_RCVDATA,		// size of data available for recv
+   UDT_TARGETBW,	// current sending rate (bytes per second) allowed by congestion control, read only
+   UDT_FECGROUP,	// number of data packets protected by a group of FEC parity packets, 0 to disable FEC
+   UDT_FECPARITY,	// number of FEC parity packets per group
+   UDT_FECMSG,		// if FEC groups end with each message
+   UDT_RCVDEADLINE	// play-out deadline (ms) after which a gap in received messages is skipped, -1 to wait
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -194,6 +221,16 @@ struct CPerfMon
    double mbpsBandwidth;                // estimated bandwidth, in Mb/s
    int byteAvailSndBuf;                 // available UDT sender buffer size
    int byteAvailRcvBuf;                 // available UDT receiver buffer size
+
+   // global measurements added since, appended so that the fields above keep their offsets
+   int64_t byteSentNAKTotal;            // total size of sent NAK packets, including headers
+   int64_t byteRecvNAKTotal;            // total size of received NAK packets, including headers
+   int64_t usRecvNAKTotal;              // total time spent processing received NAK packets, in microseconds
+   int pktSentFECTotal;                 // total number of sent FEC parity packets
+   int pktRecvFECTotal;                 // total number of received FEC parity packets
+   int pktRcvFECRecoveredTotal;         // total number of lost packets rebuilt from FEC parity packets
+   int pktSndDropTotal;                 // total number of data packets dropped by the sender because their message expired
+   int pktRcvDropTotal;                 // total number of lost packets skipped by the receiver at the play-out deadline
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -330,10 +367,23 @@ UDT_API int send(UDTSOCKET u, const char* buf, int len, int flags);
 UDT_API int recv(UDTSOCKET u, char* buf, int len, int flags);
 UDT_API int sendmsg(UDTSOCKET u, const char* buf, int len, int ttl = -1, bool inorder = false);
 UDT_API int recvmsg(UDTSOCKET u, char* buf, int len);
+UDT_API int sendzc(UDTSOCKET u, const char* buf, int len, UDT_RELEASE_CB release, void* arg = NULL, int ttl = -1, bool inorder = false);
+UDT_API int recvzc(UDTSOCKET u, UDTIOVEC* iov, int* iovcnt, int* token);
+UDT_API int release(UDTSOCKET u, int token);
+UDT_API int sendv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags);
+UDT_API int recvv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int flags);
+UDT_API int sendmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt, int ttl = -1, bool inorder = false);
+UDT_API int recvmsgv(UDTSOCKET u, const UDTIOVEC* iov, int iovcnt);
 UDT_API int64_t sendfile(UDTSOCKET u, std::fstream& ifs, int64_t& offset, int64_t size, int block = 364000);
 UDT_API int64_t recvfile(UDTSOCKET u, std::fstream& ofs, int64_t& offset, int64_t size, int block = 7280000);
 UDT_API int64_t sendfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 364000);
 UDT_API int64_t recvfile2(UDTSOCKET u, const char* path, int64_t* offset, int64_t size, int block = 7280000);
+#ifndef WIN32
+UDT_API int64_t sendfile_fd(UDTSOCKET u, int fd, int64_t* offset, int64_t size, int block = 364000);
+UDT_API int64_t recvfile_fd(UDTSOCKET u, int fd, int64_t* offset, int64_t size, int block = 7280000);
+UDT_API int64_t sendfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, int block = 364000);
+UDT_API int64_t recvfile_striped(const UDTSOCKET* socks, int n, int fd, int64_t size, const char* journal = NULL, int block = 7280000);
+#endif
 
 // select and selectEX are DEPRECATED; please use epoll. 
 UDT_API int select(int nfds, UDSET* readfds, UDSET* writefds, UDSET* exceptfds, const struct timeval* timeout);
@@ -349,6 +399,8 @@ UDT_API int epoll_wait(int eid, std::set<UDTSOCKET>* readfds, std::set<UDTSOCKET
                        std::set<SYSSOCKET>* lrfds = NULL, std::set<SYSSOCKET>* wrfds = NULL);
 UDT_API int epoll_wait2(int eid, UDTSOCKET* readfds, int* rnum, UDTSOCKET* writefds, int* wnum, int64_t msTimeOut,
                         SYSSOCKET* lrfds = NULL, int* lrnum = NULL, SYSSOCKET* lwfds = NULL, int* lwnum = NULL);
+UDT_API int epoll_uwait(int eid, UDTEPOLLEVENT* events, int maxevents, int64_t msTimeOut);
+UDT_API int epoll_getfd(int eid);
 UDT_API int epoll_release(int eid);
 UDT_API ERRORINFO& getlasterror();
 UDT_API int getlasterror_code();
@@ -365,6 +417,8 @@ UDT_API int setICETURNServer(UDTSOCKET u, const std::string& server, int port,
 UDT_API int setICEPortRange(UDTSOCKET u, int min_port, int max_port);
 #endif
 UDT_API UDTSTATUS getsockstate(UDTSOCKET u);
+UDT_API int setmemlimit(int64_t limit);
+UDT_API int64_t getmemusage();
 
 }  // namespace UDT
 
@@ -53,11 +53,7 @@ m_iSize(size),
 m_iHead(0),
 m_iTail(0)
 {
-   m_piACKSeqNo = new int32_t[m_iSize];
-   m_piACK = new int32_t[m_iSize];
-   m_pTimeStamp = new uint64_t[m_iSize];
-
-   m_piACKSeqNo[0] = -1;
+   // the records are allocated by the first store(), an idle connection never needs them
 }
 
 CACKWindow::~CACKWindow()
@@ -69,6 +65,14 @@ CACKWindow::~CACKWindow()
 
 void CACKWindow::store(int32_t seq, int32_t ack)
 {
+   if (NULL == m_piACKSeqNo)
+   {
+      m_piACKSeqNo = new int32_t[m_iSize];
+      m_piACK = new int32_t[m_iSize];
+      m_pTimeStamp = new uint64_t[m_iSize];
+      m_iHead = m_iTail = 0;
+   }
+
    m_piACKSeqNo[m_iHead] = seq;
    m_piACK[m_iHead] = ack;
    m_pTimeStamp[m_iHead] = CTimer::getTime();
@@ -82,6 +86,9 @@ void CACKWindow::store(int32_t seq, int32_t ack)
 
 int CACKWindow::acknowledge(int32_t seq, int32_t& ack)
 {
+   if (NULL == m_piACKSeqNo)
+      return -1;
+
    if (m_iHead >= m_iTail)
    {
       // Head has not exceeded the physical boundary of the window
@@ -142,6 +149,18 @@ int CACKWindow::acknowledge(int32_t seq, int32_t& ack)
    return -1;
 }
 
+void CACKWindow::trim()
+{
+   delete [] m_piACKSeqNo;
+   delete [] m_piACK;
+   delete [] m_pTimeStamp;
+
+   m_piACKSeqNo = NULL;
+   m_piACK = NULL;
+   m_pTimeStamp = NULL;
+   m_iHead = m_iTail = 0;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 CPktTimeWindow::CPktTimeWindow(int asize, int psize):
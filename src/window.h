@@ -75,8 +75,17 @@ public:
 
    int acknowledge(int32_t seq, int32_t& ack);
 
+      // Functionality:
+      //    Release the records; an ACK-2 for an ACK sent before is not matched afterwards.
+      // Parameters:
+      //    None.
+      // Returned value:
+      //    None.
+
+   void trim();
+
 private:
-   int32_t* m_piACKSeqNo;       // Seq. No. for the ACK packet
+   int32_t* m_piACKSeqNo;       // Seq. No. for the ACK packet, NULL until the first ACK is stored
    int32_t* m_piACK;            // Data Seq. No. carried by the ACK packet
    uint64_t* m_pTimeStamp;      // The timestamp when the ACK was sent
 